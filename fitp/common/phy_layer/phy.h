@@ -108,6 +108,13 @@ void PHY_send (const char *data, uint8_t len);
  */
 void PHY_send_with_cca (uint8_t * data, uint8_t len);
 
+/**
+ * Sets sync word recognized by packet handler, frames with other sync
+ * word are not received.
+ * @param sync 	Sync word (SYNC_WORD_LENGTH bytes, SYNCV31REG first).
+ */
+void PHY_set_sync_word (const uint8_t * sync);
+
 extern void PHY_process_packet (uint8_t * data, uint8_t len);
 
 extern void PHY_timer_interrupt (void);
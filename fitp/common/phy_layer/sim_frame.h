@@ -0,0 +1,59 @@
+#ifndef MRF_SIM_FRAME_H
+#define MRF_SIM_FRAME_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Frames exchanged between simulated devices and the network simulator.
+ * Every frame is one datagram on UNIX socket: fixed header followed
+ * by the frame exactly as it would leave the radio.
+ *
+ *   0        1        2        3        4
+ *   +--------+--------+--------+--------+---------------
+ *   |version |channel |bitrate |  len   | len bytes of frame
+ *   +--------+--------+--------+--------+---------------
+ */
+
+// version of frame encoding
+#define SIM_FRAME_VERSION 1
+// size of header preceding frame
+#define SIM_FRAME_HEADER_SIZE 4
+// socket of network simulator used when no other is set
+#define SIM_DEFAULT_BUS_PATH "/tmp/fitp-simulator.sock"
+
+/**
+ * Encodes frame for network simulator.
+ * @param buffer 		Buffer of at least SIM_FRAME_HEADER_SIZE + len bytes.
+ * @param channel 	Channel.
+ * @param bitrate 	Bitrate.
+ * @param data 			Frame.
+ * @param len 			Frame length.
+ * @return Returns size of encoded frame.
+ */
+static inline uint16_t sim_frame_encode (uint8_t * buffer, uint8_t channel,
+																				 uint8_t bitrate, const uint8_t * data,
+																				 uint8_t len)
+{
+	buffer[0] = SIM_FRAME_VERSION;
+	buffer[1] = channel;
+	buffer[2] = bitrate;
+	buffer[3] = len;
+	for (uint8_t i = 0; i < len; i++)
+		buffer[SIM_FRAME_HEADER_SIZE + i] = data[i];
+	return SIM_FRAME_HEADER_SIZE + len;
+}
+
+/**
+ * Checks datagram received from network simulator.
+ * @param buffer 		Datagram.
+ * @param size 			Datagram size.
+ * @return Returns true if datagram carries a whole frame, false otherwise.
+ */
+static inline bool sim_frame_valid (const uint8_t * buffer, long size)
+{
+	return size >= SIM_FRAME_HEADER_SIZE && buffer[0] == SIM_FRAME_VERSION
+		&& size == SIM_FRAME_HEADER_SIZE + buffer[3];
+}
+
+#endif
@@ -0,0 +1,47 @@
+#ifndef MRF_SYNC_WORD_H
+#define MRF_SYNC_WORD_H
+
+#include <stdint.h>
+#include "constants.h"
+
+/*
+ * Sync word of MRF89XA derived from network ID, so that frames of other
+ * networks are dropped by packet handler before they reach FIFO.
+ * All devices of network have to derive it the same way, joining devices
+ * do not know NID yet and use the default sync word.
+ */
+
+// length of sync word (SYNCREG_SET selects 32 bits)
+#define SYNC_WORD_LENGTH 4
+
+/**
+ * Default sync word (SYNCV31REG_SET to SYNCV07REG_SET).
+ * @param sync 	Buffer for sync word.
+ */
+static inline void sync_word_default (uint8_t * sync)
+{
+	sync[0] = SYNCV31REG_SET;
+	sync[1] = SYNCV23REG_SET;
+	sync[2] = SYNCV15REG_SET;
+	sync[3] = SYNCV07REG_SET;
+}
+
+/**
+ * Derives sync word from network ID.
+ * Every byte of default sync word is XORed with byte of NID, byte without
+ * bit transitions (0x00, 0xff) would weaken synchronization and is replaced
+ * by default one. NID 0 gives the default sync word.
+ * @param nid 	Network ID (4 bytes, nid[3] is the most significant).
+ * @param sync 	Buffer for sync word (SYNCV31REG first).
+ */
+static inline void sync_word_from_nid (const uint8_t * nid, uint8_t * sync)
+{
+	sync_word_default (sync);
+	for (uint8_t i = 0; i < SYNC_WORD_LENGTH; i++) {
+		uint8_t value = sync[i] ^ nid[SYNC_WORD_LENGTH - 1 - i];
+		if (value != 0x00 && value != 0xff)
+			sync[i] = value;
+	}
+}
+
+#endif
@@ -66,6 +66,26 @@ void NET_received (const uint8_t from_cid, const uint8_t from_edid[4],
 	fitp_received (from_cid, from_edid, data, len);
 }
 
+/**
+ * Enables filtering of foreign networks by sync word derived from NID,
+ * PAN coordinator has to enable it too. Has to be called after fitp_init.
+ * @param enable	True to derive sync word from NID, false for default sync word.
+ */
+void fitp_set_sync_filter (bool enable)
+{
+	NET_set_sync_filter (enable);
+}
+
+/**
+ * Sends reliable packets by two-way handshake (DATA and ACK), PAN
+ * coordinator and other devices have to support it. Disabled by default.
+ * @param enable	True to send reliable packets by two-way handshake.
+ */
+void fitp_set_two_way_transfer (bool enable)
+{
+	LINK_set_two_way (enable);
+}
+
 /**
  * Sends MOVE REQUEST message.
  */
@@ -87,6 +107,7 @@ void fitp_joining_enable (uint8_t timeout)
 	// 1s = 1000 ms -> 1000/50 = 20
 	// 20 is number of pair_mode_timeout decrements per second
 	GLOBAL_STORAGE.pair_mode_timeout = 20 * timeout;
+	NET_update_sync_word ();
 	D_G printf("fitp_joining_enable()\n");
 }
 
@@ -96,6 +117,7 @@ void fitp_joining_enable (uint8_t timeout)
 void fitp_joining_disable ()
 {
 	GLOBAL_STORAGE.pair_mode = false;
+	NET_update_sync_word ();
 	D_G printf("fitp_joining_disable()\n");
 }
 
@@ -19,6 +19,16 @@
 #define MAX_CHANNEL 							31
 /*! broadcast address */
 #define LINK_COORD_ALL 						0xfc
+/*! switched bitrate is kept while parent sends within this time (ticks) */
+#define LINK_RATE_WINDOW					2
+/*! number of neighbours whose sequence numbers are remembered */
+#define LINK_SEQ_TABLE_SIZE				8
+/*! DATA of two-way handshake with remembered sequence numbers are duplicates
+ * within this time (ticks), it exceeds retransmissions of sender */
+#define LINK_DUPLICATE_TIMEOUT		16
+/*! number of the last sequence numbers of two-way handshake remembered
+ * per sender, it exceeds DATA which sender has in flight at once */
+#define LINK_DUPLICATE_WINDOW			8
 
 /** @enum LINK_packet_type
  * Packet types.
@@ -96,6 +106,23 @@ typedef struct {
 	uint8_t transfer_type;							/**< Transfer type. */
 } LINK_tx_buffer_record_ed_t;
 
+/**
+ * Sequence numbers of two-way handshakes with neighbour.
+ */
+typedef struct {
+	uint8_t used:1;											/**< Flag if record is used. */
+	uint8_t address_type:1;							/**< Address type: 0 - coordinator, 1 - end device. */
+	uint8_t rx_valid:1;									/**< Flag if DATA in rx_mask are duplicates. */
+	uint8_t tx_seq;											/**< Sequence number of the next DATA for neighbour. */
+	uint8_t rx_seq;											/**< The newest sequence number of DATA accepted from neighbour. */
+	uint8_t rx_mask;										/**< Accepted sequence numbers, bit n is rx_seq - n. */
+	uint8_t rx_expiration;							/**< Expiration time of rx_seq. */
+	union {
+		uint8_t coord;										/**< Coordinator address. */
+		uint8_t ed[EDID_LENGTH];					/**< End device address. */
+	} address;
+} LINK_seq_record_t;
+
 /**
  * Structure for link layer.
  */
@@ -108,6 +135,18 @@ struct LINK_storage_t {
 	LINK_tx_buffer_record_ed_t ed_tx_buffer;									/**< Array of TX buffer records for end device. */
 	bool link_ack_join_received;															/**< Flag if ACK JOIN packet was received. */
 	uint8_t ack_join_address[MAX_COORD];											/**< Array of coordinators that sent ACK JOIN packet. */
+	uint8_t base_bitrate;																			/**< Bitrate of LINK_init. */
+	bool rate_switched;																				/**< Flag if bitrate was switched by parent. */
+	uint8_t rate_expiration;																	/**< Expiration time of switched bitrate. */
+	uint8_t window_data[LINK_WINDOW_SIZE][MAX_LINK_PAYLOAD_SIZE];/**< DATA of window from parent. */
+	uint8_t window_len[LINK_WINDOW_SIZE];											/**< Length of DATA of window. */
+	uint8_t window_seq[LINK_WINDOW_SIZE];											/**< Sequence number of DATA of window. */
+	uint8_t window_stored;																		/**< Bit mask of stored DATA of window. */
+	uint8_t window_expected;																	/**< Sequence number expected next. */
+	bool window_active;																				/**< Flag if window of parent is known. */
+	bool two_way;																							/**< Flag if four-way handshakes are sent as two-way ones. */
+	LINK_seq_record_t seq_table[LINK_SEQ_TABLE_SIZE];					/**< Sequence numbers of two-way handshakes with neighbours. */
+	uint8_t seq_next;																					/**< Record replaced when table is full. */
 } LINK_STORAGE;
 
 extern void delay_ms (uint16_t maximum);
@@ -334,6 +373,95 @@ void send_busy_ack (bool as_ed, bool to_ed, uint8_t* address)
 	PHY_send_with_cca (ack_packet, LINK_HEADER_SIZE);
 }
 
+/**
+ * Sends ACK of two-way handshake.
+ * @param as_ed 										True if device sends packet as end device ID, false otherwise.
+ * @param to_ed 										True if device sends packet to end device ID, false otherwise.
+ * @param address 									Destination coordinator ID or end device ID.
+ * @param seq 											Sequence number of acknowledged DATA.
+ */
+void send_two_way_ack (bool as_ed, bool to_ed, uint8_t* address, uint8_t seq)
+{
+	uint8_t ack_packet[LINK_HEADER_SIZE + LINK_HS2_HEADER_SIZE];
+	gen_header (ack_packet, as_ed, to_ed, address, LINK_ACK_TYPE, LINK_DATA_HS2);
+	ack_packet[LINK_HEADER_SIZE] = seq;
+	D_LINK printf ("send_two_way_ack()\n");
+	PHY_send_with_cca (ack_packet, LINK_HEADER_SIZE + LINK_HS2_HEADER_SIZE);
+}
+
+/**
+ * Finds sequence numbers of neighbour. Unknown neighbour gets an empty
+ * record, records are replaced in round robin when table is full.
+ * @param ed 				True if neighbour is end device, false otherwise.
+ * @param address 	Coordinator ID or end device ID.
+ * @return Returns record of neighbour.
+ */
+LINK_seq_record_t* seq_record (bool ed, uint8_t* address)
+{
+	uint8_t index = LINK_STORAGE.seq_next;
+	for (uint8_t i = 0; i < LINK_SEQ_TABLE_SIZE; i++) {
+		LINK_seq_record_t* record = &LINK_STORAGE.seq_table[i];
+		if (!record->used) {
+			index = i;
+			continue;
+		}
+		if (record->address_type == (ed ? 1 : 0)
+				&& (ed ? array_cmp (record->address.ed, address)
+						: record->address.coord == LINK_cid_mask (*address)))
+			return record;
+	}
+	if (index == LINK_STORAGE.seq_next)
+		LINK_STORAGE.seq_next = (LINK_STORAGE.seq_next + 1) % LINK_SEQ_TABLE_SIZE;
+	LINK_seq_record_t* record = &LINK_STORAGE.seq_table[index];
+	record->used = 1;
+	record->address_type = ed ? 1 : 0;
+	if (ed)
+		array_copy (address, record->address.ed, EDID_LENGTH);
+	else
+		record->address.coord = LINK_cid_mask (*address);
+	record->rx_valid = 0;
+	// neighbour which remembers replaced record or previous run hardly gets
+	// the same number, timer is nearly the same after reset, so noise of
+	// channel is mixed in
+	record->tx_seq = LINK_STORAGE.timer_counter + PHY_get_noise ();
+	return record;
+}
+
+/**
+ * Checks if DATA of two-way handshake are new, they are remembered then.
+ * Sender can have several DATA in flight, ACK of older one can be lost
+ * after newer one was accepted, so the last LINK_DUPLICATE_WINDOW sequence
+ * numbers are remembered.
+ * @param ed 				True if sender is end device, false otherwise.
+ * @param address 	Coordinator ID or end device ID of sender.
+ * @param seq 			Sequence number of DATA.
+ * @return Returns false if DATA were already accepted, true otherwise.
+ */
+bool two_way_accept (bool ed, uint8_t* address, uint8_t seq)
+{
+	LINK_seq_record_t* record = seq_record (ed, address);
+	uint8_t behind = record->rx_seq - seq;
+	uint8_t ahead = seq - record->rx_seq;
+
+	if (!record->rx_valid) {
+		record->rx_mask = 1;
+		record->rx_seq = seq;
+	}
+	else if (behind < LINK_DUPLICATE_WINDOW) {
+		if (record->rx_mask & (1 << behind))
+			return false;
+		record->rx_mask |= 1 << behind;
+	}
+	else {
+		// DATA far behind come from restarted sender, they start again
+		record->rx_mask = ahead < LINK_DUPLICATE_WINDOW ? record->rx_mask << ahead | 1 : 1;
+		record->rx_seq = seq;
+	}
+	record->rx_valid = 1;
+	record->rx_expiration = LINK_STORAGE.timer_counter + LINK_DUPLICATE_TIMEOUT;
+	return true;
+}
+
 /**
  * Processes packet for end device.
  * @param data 	Data.
@@ -379,6 +507,14 @@ bool ed_process_packet (uint8_t* data, uint8_t len)
 			if (transfer_type == LINK_DATA_WITHOUT_ACK || transfer_type == LINK_DATA_BROADCAST) {
 				return LINK_process_packet (data + LINK_HEADER_SIZE, len - LINK_HEADER_SIZE);
 			}
+			else if (transfer_type == LINK_DATA_HS2 && len > LINK_HEADER_SIZE) {
+				// ACK is sent for repeated DATA too, its previous ACK was lost
+				send_two_way_ack (true, false, &data[9], data[LINK_HEADER_SIZE]);
+				if (!two_way_accept (false, &data[9], data[LINK_HEADER_SIZE]))
+					return true;
+				return LINK_process_packet (data + LINK_HEADER_SIZE + LINK_HS2_HEADER_SIZE,
+																		len - LINK_HEADER_SIZE - LINK_HS2_HEADER_SIZE);
+			}
 			else if (transfer_type == LINK_DATA_HS4) {
 				if(LINK_STORAGE.ed_rx_buffer.empty) {
 					uint8_t index = 0;
@@ -415,6 +551,165 @@ bool ed_process_packet (uint8_t* data, uint8_t len)
 		return true;
 }
 
+/**
+ * Returns to bitrate of LINK_init after exchange with parent
+ * at switched bitrate.
+ */
+void rate_revert ()
+{
+	if (!LINK_STORAGE.rate_switched)
+		return;
+	D_LINK printf ("bitrate %d again\n", LINK_STORAGE.base_bitrate);
+	LINK_STORAGE.rate_switched = false;
+	PHY_set_bitrate (LINK_STORAGE.base_bitrate);
+}
+
+/**
+ * Processes RATE SWITCH packet from parent, the following exchange runs
+ * at requested bitrate.
+ * @param data 	Data.
+ * @param len 	Data length.
+ */
+void rate_switch (uint8_t* data, uint8_t len)
+{
+	if ((data[0] & LINK_ED_TO_COORD) || LINK_cid_mask (data[6]) != GLOBAL_STORAGE.parent_cid
+			|| len <= LINK_HEADER_SIZE)
+		return;
+	uint8_t bitrate = data[LINK_HEADER_SIZE];
+	if (bitrate == LINK_STORAGE.base_bitrate) {
+		rate_revert ();
+		return;
+	}
+	D_LINK printf ("R: RATE SWITCH to %d\n", bitrate);
+	// unknown bitrate or channel which does not exist at bitrate is refused,
+	// parent falls back to bitrate of LINK_init
+	if (!PHY_set_bitrate (bitrate))
+		return;
+	LINK_STORAGE.rate_switched = true;
+	LINK_STORAGE.rate_expiration = LINK_STORAGE.timer_counter + LINK_RATE_WINDOW;
+}
+
+/**
+ * Synchronizes window with the oldest sequence number unacknowledged by
+ * parent. Parent is behind at most by one window (COMMIT ACK was lost),
+ * other base means that parent started again.
+ * @param base 	The oldest unacknowledged sequence number.
+ */
+void window_sync (uint8_t base)
+{
+	if (LINK_STORAGE.window_active
+			&& (uint8_t) (LINK_STORAGE.window_expected - base) <= LINK_WINDOW_SIZE)
+		return;
+	LINK_STORAGE.window_active = true;
+	LINK_STORAGE.window_expected = base;
+	LINK_STORAGE.window_stored = 0;
+}
+
+/**
+ * Processes DATA and COMMIT of window from parent. DATA are kept until
+ * COMMIT, then those received in order are routed and acknowledged by
+ * sequence number which is expected next.
+ * @param data 	Data.
+ * @param len 	Data length.
+ */
+void window_process_packet (uint8_t* data, uint8_t len)
+{
+	uint8_t packet_type = data[0] >> 6;
+
+	if ((data[0] & LINK_ED_TO_COORD) || LINK_cid_mask (data[6]) != GLOBAL_STORAGE.parent_cid)
+		return;
+	if (packet_type == LINK_DATA_TYPE && len >= LINK_HEADER_SIZE + LINK_WINDOW_HEADER_SIZE) {
+		uint8_t seq = data[LINK_HEADER_SIZE];
+		window_sync (data[LINK_HEADER_SIZE + 1]);
+		// DATA already routed or beyond window
+		if ((uint8_t) (seq - LINK_STORAGE.window_expected) >= LINK_WINDOW_SIZE)
+			return;
+		uint8_t slot = seq % LINK_WINDOW_SIZE;
+		uint8_t index = 0;
+		for (uint8_t i = LINK_HEADER_SIZE + LINK_WINDOW_HEADER_SIZE; i < len; i++)
+			LINK_STORAGE.window_data[slot][index++] = data[i];
+		LINK_STORAGE.window_len[slot] = index;
+		LINK_STORAGE.window_seq[slot] = seq;
+		LINK_STORAGE.window_stored |= 1 << slot;
+		D_LINK printf ("R: DATA %d of window\n", seq);
+	}
+	else if (packet_type == LINK_COMMIT_TYPE && len > LINK_HEADER_SIZE) {
+		window_sync (data[LINK_HEADER_SIZE]);
+		while (true) {
+			uint8_t slot = LINK_STORAGE.window_expected % LINK_WINDOW_SIZE;
+			if (!(LINK_STORAGE.window_stored & (1 << slot))
+					|| LINK_STORAGE.window_seq[slot] != LINK_STORAGE.window_expected)
+				break;
+			LINK_STORAGE.window_stored &= ~(1 << slot);
+			LINK_STORAGE.window_expected++;
+			// layers above know windowed DATA as four-way handshake
+			LINK_route (LINK_STORAGE.window_data[slot], LINK_STORAGE.window_len[slot], LINK_DATA_HS4);
+		}
+		uint8_t packet[LINK_HEADER_SIZE + 1];
+		gen_header (packet, false, false, data + 6, LINK_COMMIT_ACK_TYPE, LINK_DATA_WINDOW);
+		packet[LINK_HEADER_SIZE] = LINK_STORAGE.window_expected;
+		D_LINK printf ("S: COMMIT ACK of window, %d expected\n", LINK_STORAGE.window_expected);
+		PHY_send_with_cca (packet, LINK_HEADER_SIZE + 1);
+	}
+}
+
+/**
+ * Processes ACK of two-way handshake, DATA with acknowledged sequence
+ * number are removed from TX buffer.
+ * @param data 	Data.
+ * @param len 	Data length.
+ */
+void two_way_acked (uint8_t* data, uint8_t len)
+{
+	uint8_t address_type = (data[0] & LINK_ED_TO_COORD) ? 1 : 0;
+
+	if (len <= LINK_HEADER_SIZE)
+		return;
+	for (uint8_t i = 0; i < LINK_TX_BUFFER_SIZE; i++) {
+		LINK_tx_buffer_record_t* record = &LINK_STORAGE.tx_buffer[i];
+		// sequence number precedes payload of stored DATA
+		if (record->empty || record->transfer_type != LINK_DATA_HS2
+				|| record->address_type != address_type || record->data[0] != data[LINK_HEADER_SIZE])
+			continue;
+		if (address_type ? !array_cmp (record->address.ed, data + 6)
+				: LINK_cid_mask (record->address.coord) != LINK_cid_mask (data[6]))
+			continue;
+		D_LINK printf ("R: ACK of DATA %d\n", data[LINK_HEADER_SIZE]);
+		record->empty = 1;
+		if (!address_type)
+			LINK_notify_send_done ();
+		return;
+	}
+}
+
+/**
+ * Processes DATA of two-way handshake. DATA are acknowledged and routed,
+ * repeated DATA whose ACK was lost are acknowledged only.
+ * @param data 	Data.
+ * @param len 	Data length.
+ * @return Returns false if DATA are repeated or if they are not
+ *				 successfully sent, true otherwise.
+ */
+bool two_way_process_data (uint8_t* data, uint8_t len)
+{
+	uint8_t sender_address_type = (data[0] & LINK_ED_TO_COORD) ? 1 : 0;
+	// ACK to DATA for ED goes as from ED
+	bool as_ed = !sender_address_type && (data[0] & LINK_COORD_TO_ED);
+
+	if (len <= LINK_HEADER_SIZE)
+		return false;
+	send_two_way_ack (as_ed, sender_address_type, data + 6, data[LINK_HEADER_SIZE]);
+	// exchange is finished, bitrate of LINK_init is used for routing
+	if (!sender_address_type)
+		rate_revert ();
+	if (!two_way_accept (sender_address_type, data + 6, data[LINK_HEADER_SIZE])) {
+		D_LINK printf ("DATA %d has been already routed!\n", data[LINK_HEADER_SIZE]);
+		return false;
+	}
+	return LINK_route (data + LINK_HEADER_SIZE + LINK_HS2_HEADER_SIZE,
+										 len - LINK_HEADER_SIZE - LINK_HS2_HEADER_SIZE, LINK_DATA_HS2);
+}
+
 /**
  * Processes packet for coordinator and routes it towards destination.
  * @param data 	Data.
@@ -428,6 +723,11 @@ bool router_process_packet (uint8_t* data, uint8_t len)
 	uint8_t packet_type = data[0] >> 6;
 	uint8_t transfer_type = data[0] & 0x0f;
 	D_LINK printf("router_process_packet()\n");
+	// two-way handshake is finished by ACK
+	if (packet_type == LINK_ACK_TYPE && transfer_type == LINK_DATA_HS2) {
+		two_way_acked (data, len);
+		return true;
+	}
 	// processing of ACK packet
 	if (packet_type == LINK_ACK_TYPE) {
 		D_LINK printf ("ACK\n");
@@ -438,7 +738,8 @@ bool router_process_packet (uint8_t* data, uint8_t len)
 				// COMMIT message can be sent
 				if (!LINK_STORAGE.tx_buffer[i].empty) {
 					if (LINK_STORAGE.tx_buffer[i].address_type == 1
-							&& array_cmp (LINK_STORAGE.tx_buffer[i].address.ed, data + 6)) {
+							&& array_cmp (LINK_STORAGE.tx_buffer[i].address.ed, data + 6)
+							&& (transfer_type == LINK_BUSY || LINK_STORAGE.tx_buffer[i].transfer_type == LINK_DATA_HS4)) {
 							// it is not BUSY ACK packet, switch state and send COMMIT packet
 							if (transfer_type != LINK_BUSY) {
 								LINK_STORAGE.tx_buffer[i].state = COMMIT_SENT;;
@@ -465,7 +766,8 @@ bool router_process_packet (uint8_t* data, uint8_t len)
 				// COMMIT packet can be sent
 				if (!LINK_STORAGE.tx_buffer[i].empty) {
 					if (LINK_STORAGE.tx_buffer[i].address_type == 0
-							&& LINK_STORAGE.tx_buffer[i].address.coord == data[6]) {
+							&& LINK_STORAGE.tx_buffer[i].address.coord == data[6]
+							&& (transfer_type == LINK_BUSY || LINK_STORAGE.tx_buffer[i].transfer_type == LINK_DATA_HS4)) {
 							// it is not BUSY ACK packet, switch state and send COMMIT packet
 							if (transfer_type != LINK_BUSY) {
 								LINK_STORAGE.tx_buffer[i].state = COMMIT_SENT;;
@@ -506,7 +808,8 @@ bool router_process_packet (uint8_t* data, uint8_t len)
 			for (uint8_t i = 0; i < LINK_TX_BUFFER_SIZE; i++) {
 				if (!LINK_STORAGE.tx_buffer[i].empty) {
 					if (LINK_STORAGE.tx_buffer[i].address_type == 1
-							&& array_cmp (LINK_STORAGE.tx_buffer[i].address.ed, data + 6)) {
+							&& array_cmp (LINK_STORAGE.tx_buffer[i].address.ed, data + 6)
+							&& LINK_STORAGE.tx_buffer[i].transfer_type == LINK_DATA_HS4) {
 							// packet can be accepted
 							LINK_STORAGE.tx_buffer[i].empty = 1;
 							break;
@@ -518,7 +821,8 @@ bool router_process_packet (uint8_t* data, uint8_t len)
 			for (uint8_t i = 0; i < LINK_TX_BUFFER_SIZE; i++) {
 				if (!LINK_STORAGE.tx_buffer[i].empty) {
 					if (LINK_STORAGE.tx_buffer[i].address_type == 0
-							&& LINK_STORAGE.tx_buffer[i].address.coord == data[6]) {
+							&& LINK_STORAGE.tx_buffer[i].address.coord == data[6]
+							&& LINK_STORAGE.tx_buffer[i].transfer_type == LINK_DATA_HS4) {
 							// packet can be accepted
 							LINK_STORAGE.tx_buffer[i].empty = 1;
 							D_LINK printf ("R: COMMIT ACK to ED or COORD\n");
@@ -535,6 +839,9 @@ bool router_process_packet (uint8_t* data, uint8_t len)
 		if (transfer_type == LINK_DATA_WITHOUT_ACK) {
 			return LINK_route (data + LINK_HEADER_SIZE, len - LINK_HEADER_SIZE, transfer_type);
 		}
+		else if (transfer_type == LINK_DATA_HS2) {
+			return two_way_process_data (data, len);
+		}
 		else if (transfer_type == LINK_DATA_HS4) {
 			for(uint8_t i = 0; i < LINK_RX_BUFFER_SIZE; i++) {
 				// some DATA are in RX buffer, verify if received packet has not been
@@ -669,6 +976,8 @@ bool router_process_packet (uint8_t* data, uint8_t len)
 							D_LINK printf ("S: COMMIT ACK to COORD\n");
 							send_commit_ack (false, data[0] & LINK_ED_TO_COORD, data + 6);
 						}
+						// exchange is finished, bitrate of LINK_init is used for routing
+						rate_revert ();
 						bool result = LINK_route (LINK_STORAGE.rx_buffer[i].data + LINK_HEADER_SIZE,
 																				 LINK_STORAGE.rx_buffer[i].len - LINK_HEADER_SIZE, LINK_STORAGE.rx_buffer[i].transfer_type);
 						LINK_STORAGE.rx_buffer[i].empty = 1;
@@ -684,6 +993,8 @@ bool router_process_packet (uint8_t* data, uint8_t len)
 			else {
 				send_commit_ack (false, data[0] & LINK_ED_TO_COORD, data + 6);
 			}
+			// exchange is finished
+			rate_revert ();
 		}
 	}
 	return true;
@@ -725,10 +1036,13 @@ void check_buffers_state ()
 		if ((!LINK_STORAGE.tx_buffer[i].empty)
 				&& LINK_STORAGE.tx_buffer[i].expiration_time == LINK_STORAGE.timer_counter) {
 			if ((LINK_STORAGE.tx_buffer[i].transmits_to_error--) == 0) {
+				// network layer gets its packet without sequence number
+				uint8_t header = LINK_STORAGE.tx_buffer[i].transfer_type == LINK_DATA_HS2
+					? LINK_HS2_HEADER_SIZE : 0;
 				if (LINK_STORAGE.tx_buffer[i].address_type) {
 					// multiple unsuccessful packet sending to ED, network reinitialization starts
-					LINK_error_handler_coord (LINK_STORAGE.tx_buffer[i].data,
-																		LINK_STORAGE.tx_buffer[i].len);
+					LINK_error_handler_coord (LINK_STORAGE.tx_buffer[i].data + header,
+																		LINK_STORAGE.tx_buffer[i].len - header);
 					// delete all messages for unavailable ED
 					for (uint8_t j = 0; j < LINK_TX_BUFFER_SIZE; j++) {
 						if(!LINK_STORAGE.tx_buffer[j].empty && array_cmp(LINK_STORAGE.tx_buffer[i].address.ed, LINK_STORAGE.tx_buffer[j].address.ed)){
@@ -738,8 +1052,8 @@ void check_buffers_state ()
 				}
 				else {
 					// multiple unsuccessful packet sending to COORD, network reinitialization starts
-					LINK_error_handler_coord (LINK_STORAGE.tx_buffer[i].data,
-																		LINK_STORAGE.tx_buffer[i].len);
+					LINK_error_handler_coord (LINK_STORAGE.tx_buffer[i].data + header,
+																		LINK_STORAGE.tx_buffer[i].len - header);
 					// delete all messages for unavailable COORD
 					for (uint8_t j = 0; j < LINK_TX_BUFFER_SIZE; j++) {
 						if(!LINK_STORAGE.tx_buffer[j].empty && LINK_STORAGE.tx_buffer[i].address.coord == LINK_STORAGE.tx_buffer[j].address.coord){
@@ -779,6 +1093,12 @@ void check_buffers_state ()
 			}
 		}
 	}
+	// repeated DATA cannot come after retransmissions of sender
+	for (uint8_t i = 0; i < LINK_SEQ_TABLE_SIZE; i++) {
+		if (LINK_STORAGE.seq_table[i].rx_valid
+				&& LINK_STORAGE.seq_table[i].rx_expiration == LINK_STORAGE.timer_counter)
+			LINK_STORAGE.seq_table[i].rx_valid = 0;
+	}
 }
 
 /**
@@ -856,6 +1176,9 @@ void PHY_process_packet (uint8_t* data, uint8_t len)
 	// packet is not in my network
 	if (!array_cmp (data + 1, GLOBAL_STORAGE.nid))
 		return;
+	// exchange at switched bitrate continues
+	if (LINK_STORAGE.rate_switched)
+		LINK_STORAGE.rate_expiration = LINK_STORAGE.timer_counter + LINK_RATE_WINDOW;
 
 	if (transfer_type == LINK_DATA_BROADCAST) {
 		D_LINK printf("BROADCAST received\n");
@@ -892,13 +1215,25 @@ void PHY_process_packet (uint8_t* data, uint8_t len)
 			return;
 		}
 
+		if (transfer_type == LINK_RATE_SWITCH && packet_type == LINK_DATA_TYPE) {
+			rate_switch (data, len);
+			return;
+		}
+
 		// if routing is disabled and four-way handshake is not finished
 		// do not process next packets
-		if (!GLOBAL_STORAGE.routing_enabled && ((transfer_type == LINK_DATA_HS4) && packet_type != LINK_COMMIT_ACK_TYPE)) {
+		if (!GLOBAL_STORAGE.routing_enabled && (((transfer_type == LINK_DATA_HS4 || transfer_type == LINK_DATA_WINDOW)
+				&& packet_type != LINK_COMMIT_ACK_TYPE)
+				|| (transfer_type == LINK_DATA_HS2 && packet_type == LINK_DATA_TYPE))) {
 			D_LINK printf ("Routing disabled!\n");
 			return;
 		}
 
+		if (transfer_type == LINK_DATA_WINDOW) {
+			window_process_packet (data, len);
+			return;
+		}
+
 		// packet is from COORD
 		if (!(data[0] & LINK_ED_TO_COORD)) {
 			uint8_t sender_cid = LINK_cid_mask (data[6]);
@@ -932,6 +1267,9 @@ void PHY_timer_interrupt ()
 	LINK_STORAGE.timer_counter++;
 	LINK_timer_counter();
 	check_buffers_state ();
+	// parent does not continue exchange at switched bitrate
+	if (LINK_STORAGE.rate_switched && LINK_STORAGE.rate_expiration == LINK_STORAGE.timer_counter)
+		rate_revert ();
 }
 
 uint8_t LINK_cid_mask (uint8_t address)
@@ -954,11 +1292,22 @@ void LINK_init (struct PHY_init_t* phy_params, struct LINK_init_t* link_params)
 	LINK_STORAGE.ed_tx_buffer.empty = 1;
 
 	LINK_STORAGE.timer_counter = 0;
+	LINK_STORAGE.base_bitrate = phy_params->bitrate;
+	LINK_STORAGE.rate_switched = false;
+	LINK_STORAGE.window_active = false;
+	for (uint8_t i = 0; i < LINK_SEQ_TABLE_SIZE; i++)
+		LINK_STORAGE.seq_table[i].used = 0;
+	LINK_STORAGE.seq_next = 0;
 
 	for(uint8_t i = 0; i < MAX_COORD; i++)
 		LINK_STORAGE.ack_join_address[i] = INVALID_CID;
 }
 
+void LINK_set_two_way (bool enable)
+{
+	LINK_STORAGE.two_way = enable;
+}
+
 /**
  * Sends JOIN REQUEST message.
  * @param payload 			Payload.
@@ -1081,14 +1430,23 @@ bool LINK_send_coord (bool to_ed, uint8_t * address,
 											uint8_t * payload, uint8_t len, uint8_t transfer_type)
 {
 	D_LINK printf("LINK_send_coord()\n");
-	if (transfer_type == LINK_DATA_HS4) {
-		// send data using four-way handshake
+	if (transfer_type == LINK_DATA_HS4 && LINK_STORAGE.two_way)
+		transfer_type = LINK_DATA_HS2;
+	// sequence number takes part of payload, longer DATA go by four-way handshake
+	if (transfer_type == LINK_DATA_HS2 && len > MAX_LINK_PAYLOAD_SIZE - LINK_HS2_HEADER_SIZE)
+		transfer_type = LINK_DATA_HS4;
+	if (transfer_type == LINK_DATA_HS4 || transfer_type == LINK_DATA_HS2) {
+		// send data using four-way or two-way handshake
 		uint8_t free_index = get_free_index_tx ();
 		if (free_index >= LINK_TX_BUFFER_SIZE)
 			return false;
+		uint8_t index = 0;
+		// sequence number is kept with DATA for retransmissions
+		if (transfer_type == LINK_DATA_HS2)
+			LINK_STORAGE.tx_buffer[free_index].data[index++] = seq_record (to_ed, address)->tx_seq++;
 		for (uint8_t i = 0; i < len; i++)
-			LINK_STORAGE.tx_buffer[free_index].data[i] = payload[i];
-		LINK_STORAGE.tx_buffer[free_index].len = len;
+			LINK_STORAGE.tx_buffer[free_index].data[index++] = payload[i];
+		LINK_STORAGE.tx_buffer[free_index].len = index;
 		if (to_ed) {
 			for (uint8_t i = 0; i < EDID_LENGTH; i++)
 				LINK_STORAGE.tx_buffer[free_index].address.ed[i] = address[i];
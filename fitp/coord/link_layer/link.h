@@ -28,6 +28,19 @@
 #define LINK_DATA_JOIN_RESPONSE		0x04
 /*! ACK JOIN message */
 #define LINK_ACK_JOIN_REQUEST			0x05
+/*! bitrate switch for the following exchange with parent */
+#define LINK_RATE_SWITCH					0x06
+/*! data transfer using four-way handshake with window of DATA */
+#define LINK_DATA_WINDOW					0x07
+/*! data transfer using two-way handshake (DATA and ACK with sequence number) */
+#define LINK_DATA_HS2							0x09
+
+/*! maximum number of DATA in window */
+#define LINK_WINDOW_SIZE					4
+/*! size of sequence numbers preceding payload of windowed DATA */
+#define LINK_WINDOW_HEADER_SIZE		2
+/*! size of sequence number preceding payload of two-way handshake DATA */
+#define LINK_HS2_HEADER_SIZE			1
 
 /**
  * Structure for link layer (accessible for user).
@@ -43,6 +56,13 @@ struct LINK_init_t {
  */
 void LINK_init (struct PHY_init_t* phy_params, struct LINK_init_t* link_params);
 
+/**
+ * Sends packets of four-way handshake by two-way handshake (LINK_DATA_HS2),
+ * neighbours have to support it. Disabled by default.
+ * @param enable 	True to send packets by two-way handshake.
+ */
+void LINK_set_two_way (bool enable);
+
 /**
  * Gets address of coordinator (CID).
  * @param byte Byte containing coordinator ID.
@@ -5,6 +5,7 @@
 #include "net.h"
 #include "net_common.h"
 #include "log.h"
+#include "sync_word.h"
 
 /*! maximum payload length of ROUTING DATA message */
 /*! if the length is greater than 40 B, packet is segmented */
@@ -36,6 +37,7 @@ struct NET_storage_t {
 	NET_current_processing_packet_t processing_packet;	/**< Structure for currently processed packet. */
 	bool waiting_move_response;													/**< Flag if network is being reinitialized. */
 	uint8_t move_timeout;																/**< Timeout for MOVE RESPONSE message (containing new parent ID). */
+	bool sync_filter;																		/**< Flag if sync word is derived from NID. */
 } NET_STORAGE;
 
 /*
@@ -592,6 +594,25 @@ void NET_init (struct PHY_init_t *phy_params, struct LINK_init_t *link_params)
 	NET_STORAGE.waiting_move_response = false;
 	for(uint8_t i = 0; i < MAX_COORD; i++)
 		GLOBAL_STORAGE.routing_tree[i] = INVALID_CID;
+	NET_update_sync_word ();
+}
+
+void NET_set_sync_filter (bool enable)
+{
+	NET_STORAGE.sync_filter = enable;
+	NET_update_sync_word ();
+}
+
+void NET_update_sync_word ()
+{
+	uint8_t sync[SYNC_WORD_LENGTH];
+
+	// joining device does not know NID yet
+	if (NET_STORAGE.sync_filter && NET_joined () && !GLOBAL_STORAGE.pair_mode)
+		sync_word_from_nid (GLOBAL_STORAGE.nid, sync);
+	else
+		sync_word_default (sync);
+	PHY_set_sync_word (sync);
 }
 
 bool NET_joined ()
@@ -634,6 +655,7 @@ bool NET_join ()
 	tmp[index++] = GLOBAL_STORAGE.edid[2];
 	tmp[index++] = GLOBAL_STORAGE.edid[3];
 	GLOBAL_STORAGE.waiting_join_response = true;
+	NET_update_sync_word ();
 	if (LINK_send_join_request (tmp, index)) {
 		D_NET printf ("NET_join(): ACK JOIN REQUEST received\n");
 		for (uint8_t i = 0; i < MAX_JOIN_DELAY; i++) {
@@ -647,9 +669,11 @@ bool NET_join ()
 		// JOIN RESPONSE packet was not received
 		D_NET printf ("NET_join(): timeout\n");
 		GLOBAL_STORAGE.waiting_join_response = false;
+		NET_update_sync_word ();
 		return false;
 	}
 	D_NET printf ("NET_join(): success\n");
+	NET_update_sync_word ();
 	return true;
 }
 
@@ -1,4 +1,8 @@
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 #include "include.h"
+#include "sim_frame.h"
 
 struct PHY_storage_t {
 	uint8_t mode;
@@ -10,6 +14,9 @@ struct PHY_storage_t {
 	uint8_t received_packet[MAX_PHY_PAYLOAD_SIZE];
 	uint8_t cca_noise_threshold;
 	std::thread timer_interrupt_generator;
+	std::thread rx_deamon;
+	int fd;
+	struct sockaddr_un bus_addr;
 } PHY_STORAGE;
 
 /**
@@ -45,6 +52,62 @@ void timer_interrupt_generator_f ()
 	}
 }
 
+/**
+ * Receives frames from network simulator until socket fails,
+ * started only when socket is open.
+ */
+void rx_deamon_f ()
+{
+	uint8_t buffer[SIM_FRAME_HEADER_SIZE + MAX_PHY_PAYLOAD_SIZE + 1];
+
+	while (1) {
+		ssize_t size = recv (PHY_STORAGE.fd, buffer, sizeof (buffer), 0);
+		if (size < 0 && errno == EINTR)
+			continue;
+		// socket is not usable, receiving ends instead of retrying in vain
+		if (size < 0) {
+			printf ("rx_deamon_f: %s\n", strerror (errno));
+			return;
+		}
+		if (!sim_frame_valid (buffer, size) || buffer[3] > MAX_PHY_PAYLOAD_SIZE
+				|| buffer[1] != PHY_STORAGE.channel)
+			continue;
+		for (uint8_t i = 0; i < buffer[3]; i++)
+			PHY_STORAGE.received_packet[i] = buffer[SIM_FRAME_HEADER_SIZE + i];
+		PHY_process_packet (PHY_STORAGE.received_packet, buffer[3]);
+	}
+}
+
+/**
+ * Opens socket for network simulator, frames are sent to SIM_DEFAULT_BUS_PATH,
+ * the simulator replies to SIM_DEFAULT_BUS_PATH.<pid>.
+ * @return Returns true if socket is ready, false otherwise.
+ */
+bool open_bus ()
+{
+	struct sockaddr_un node_addr;
+
+	memset (&PHY_STORAGE.bus_addr, 0, sizeof (PHY_STORAGE.bus_addr));
+	PHY_STORAGE.bus_addr.sun_family = AF_UNIX;
+	strncpy (PHY_STORAGE.bus_addr.sun_path, SIM_DEFAULT_BUS_PATH,
+					 sizeof (PHY_STORAGE.bus_addr.sun_path) - 1);
+	memset (&node_addr, 0, sizeof (node_addr));
+	node_addr.sun_family = AF_UNIX;
+	snprintf (node_addr.sun_path, sizeof (node_addr.sun_path), "%s.%d",
+						SIM_DEFAULT_BUS_PATH, (int) getpid ());
+
+	PHY_STORAGE.fd = socket (AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+	if (PHY_STORAGE.fd < 0)
+		return false;
+	unlink (node_addr.sun_path);
+	if (bind (PHY_STORAGE.fd, (struct sockaddr *) &node_addr, sizeof (node_addr)) < 0) {
+		close (PHY_STORAGE.fd);
+		PHY_STORAGE.fd = -1;
+		return false;
+	}
+	return true;
+}
+
 /**
  * set the operating channel, band and bitrate for the RF transceiver.
  * @param channel		The channel number (0-31, not all channels
@@ -108,6 +171,20 @@ bool PHY_set_channel (uint8_t channel)
 	return holder;
 }
 
+/**
+ * Sets the bitrate, frames are sent to network simulator at this bitrate.
+ * @param bitrate The bitrate.
+ * @return Returns true if the bitrate setting is successful, false otherwise.
+ */
+bool PHY_set_bitrate (uint8_t bitrate)
+{
+	if (bitrate == PHY_STORAGE.bitrate)
+		return true;
+	if (set_bitrate (bitrate) == false)
+		return false;
+	return set_channel_freq_rate (PHY_STORAGE.channel, PHY_STORAGE.band, bitrate);
+}
+
 /**
  * Finds out the set channel number.
  * @return the channel number.
@@ -129,6 +206,10 @@ void PHY_init (PHY_init_t params)
 	set_channel_freq_rate (params.channel, params.band, params.bitrate);
 	set_power (params.power);
 	set_bitrate (params.bitrate);
+	if (open_bus ())
+		PHY_STORAGE.rx_deamon = std::thread (rx_deamon_f);
+	else
+		printf ("PHY_init: can't open simulator socket\n");
 	PHY_STORAGE.timer_interrupt_generator = std::thread (timer_interrupt_generator_f);
 }
 
@@ -142,29 +223,20 @@ uint8_t PHY_get_noise ()
 }
 
 /**
- * Sends the data.
+ * Sends the data to network simulator as one datagram.
  * @param data 	The data.
  * @param len 	The data length.
  */
 void PHY_send (const uint8_t* data, uint8_t len)
 {
-	string msg, msg_tmp;
-	msg.clear ();
-
-	msg = create_head ();
-
-	for (uint8_t i = 0; i < len; i++) {
-		msg += to_string (data[i]) + ',';
-
-	}
-	cout << endl << "PHY_send: " << msg << endl;
-
-	//  mq->send_message(DATA_FROM_TOPIC, msg.c_str(), msg.length());
-	msg_tmp = "/usr/bin/mosquitto_pub -t BeeeOn/data_from -m " + msg;
-
-	usleep (1000);
+	uint8_t buffer[SIM_FRAME_HEADER_SIZE + MAX_PHY_PAYLOAD_SIZE];
 
-	std::system (msg_tmp.c_str ());
+	if (PHY_STORAGE.fd < 0 || len > MAX_PHY_PAYLOAD_SIZE)
+		return;
+	uint16_t size = sim_frame_encode (buffer, PHY_STORAGE.channel, PHY_STORAGE.bitrate,
+																		data, len);
+	sendto (PHY_STORAGE.fd, buffer, size, 0, (struct sockaddr *) &PHY_STORAGE.bus_addr,
+					sizeof (PHY_STORAGE.bus_addr));
 }
 
 /**
@@ -66,6 +66,26 @@ void NET_received (const uint8_t from_cid, const uint8_t from_edid[4],
 	 fitp_received (from_cid, from_edid, data, len);
 }
 
+/**
+ * Enables filtering of foreign networks by sync word derived from NID,
+ * PAN coordinator has to enable it too. Has to be called after fitp_init.
+ * @param enable	True to derive sync word from NID, false for default sync word.
+ */
+void fitp_set_sync_filter (bool enable)
+{
+	NET_set_sync_filter (enable);
+}
+
+/**
+ * Sends reliable packets by two-way handshake (DATA and ACK), PAN
+ * coordinator and other devices have to support it. Disabled by default.
+ * @param enable	True to send reliable packets by two-way handshake.
+ */
+void fitp_set_two_way_transfer (bool enable)
+{
+	LINK_set_two_way (enable);
+}
+
 /**
  * Sends MOVE REQUEST message.
  */
@@ -14,6 +14,12 @@
 #define LINK_COORD_ALL 						0xfc
 /*! invalid coordinator ID */
 #define INVALID_CID 0xff
+/*! DATA of two-way handshake with remembered sequence numbers are duplicates
+ * within this time (ticks), it exceeds retransmissions of parent */
+#define LINK_DUPLICATE_TIMEOUT		16
+/*! number of the last sequence numbers of two-way handshake remembered,
+ * it exceeds DATA which parent has in flight at once */
+#define LINK_DUPLICATE_WINDOW			8
 
 /**
  * Packet types.
@@ -65,6 +71,12 @@ struct LINK_storage_t {
 	LINK_tx_buffer_record_ed_t ed_tx_buffer;									/**< Array of TX buffer records for end device. */
 	bool link_ack_join_received;															/**< Flag if ACK JOIN packet was received. */
 	uint8_t ack_join_address[MAX_COORD];											/**< Array of coordinators that sent ACK JOIN packet. */
+	bool two_way;																							/**< Flag if four-way handshakes are sent as two-way ones. */
+	uint8_t tx_seq;																						/**< Sequence number of the next two-way handshake DATA. */
+	uint8_t rx_seq;																						/**< The newest sequence number of DATA accepted from parent. */
+	uint8_t rx_mask;																					/**< Accepted sequence numbers, bit n is rx_seq - n. */
+	bool rx_valid;																						/**< Flag if DATA in rx_mask are duplicates. */
+	uint8_t rx_expiration;																		/**< Expiration time of rx_seq. */
 } LINK_STORAGE;
 
 extern void delay_ms (uint16_t t);
@@ -204,6 +216,50 @@ void send_commit_ack ()
 	PHY_send_with_cca (commit_ack_packet, LINK_HEADER_SIZE);
 }
 
+/**
+ * Sends ACK of two-way handshake.
+ * @param seq 	Sequence number of acknowledged DATA.
+ */
+void send_two_way_ack (uint8_t seq)
+{
+	uint8_t ack_packet[LINK_HEADER_SIZE + LINK_HS2_HEADER_SIZE];
+	gen_header (ack_packet, LINK_ACK_TYPE, LINK_DATA_HS2);
+	ack_packet[LINK_HEADER_SIZE] = seq;
+	PHY_send_with_cca (ack_packet, LINK_HEADER_SIZE + LINK_HS2_HEADER_SIZE);
+}
+
+/**
+ * Checks if DATA of two-way handshake are new, they are remembered then.
+ * Parent can have several DATA in flight, ACK of older one can be lost
+ * after newer one was accepted, so the last LINK_DUPLICATE_WINDOW sequence
+ * numbers are remembered.
+ * @param seq 	Sequence number of DATA.
+ * @return Returns false if DATA were already accepted, true otherwise.
+ */
+bool two_way_accept (uint8_t seq)
+{
+	uint8_t behind = LINK_STORAGE.rx_seq - seq;
+	uint8_t ahead = seq - LINK_STORAGE.rx_seq;
+
+	if (!LINK_STORAGE.rx_valid) {
+		LINK_STORAGE.rx_mask = 1;
+		LINK_STORAGE.rx_seq = seq;
+	}
+	else if (behind < LINK_DUPLICATE_WINDOW) {
+		if (LINK_STORAGE.rx_mask & (1 << behind))
+			return false;
+		LINK_STORAGE.rx_mask |= 1 << behind;
+	}
+	else {
+		// DATA far behind come from restarted parent, they start again
+		LINK_STORAGE.rx_mask = ahead < LINK_DUPLICATE_WINDOW ? LINK_STORAGE.rx_mask << ahead | 1 : 1;
+		LINK_STORAGE.rx_seq = seq;
+	}
+	LINK_STORAGE.rx_valid = true;
+	LINK_STORAGE.rx_expiration = LINK_STORAGE.timer_counter + LINK_DUPLICATE_TIMEOUT;
+	return true;
+}
+
 /**
  * Processes packet for end device.
  * @param data 	Data.
@@ -217,6 +273,23 @@ bool ed_process_packet (uint8_t* data, uint8_t len)
 	uint8_t transfer_type = data[0] & 0x0f;
 	D_LINK printf ("packet type: %02x, transfer type: %02x\n", packet_type, transfer_type);
 
+	// two-way handshake is finished by ACK with sequence number of DATA,
+	// sequence number precedes payload of stored DATA
+	if (packet_type == LINK_ACK_TYPE && transfer_type == LINK_DATA_HS2) {
+		if (!LINK_STORAGE.ed_tx_buffer.empty && len > LINK_HEADER_SIZE
+				&& LINK_STORAGE.ed_tx_buffer.transfer_type == LINK_DATA_HS2
+				&& LINK_STORAGE.ed_tx_buffer.data[0] == data[LINK_HEADER_SIZE]) {
+			LINK_STORAGE.ed_tx_buffer.empty = 1;
+			LINK_notify_send_done ();
+		}
+		return true;
+	}
+	// COMMIT does not belong to two-way handshake
+	if (!LINK_STORAGE.ed_tx_buffer.empty && LINK_STORAGE.ed_tx_buffer.transfer_type == LINK_DATA_HS2
+			&& transfer_type != LINK_BUSY
+			&& (packet_type == LINK_ACK_TYPE || packet_type == LINK_COMMIT_ACK_TYPE))
+		return true;
+
 	// processing of ACK packet
 	if (packet_type == LINK_ACK_TYPE) {
 		if (!LINK_STORAGE.ed_tx_buffer.empty) {
@@ -249,6 +322,15 @@ bool ed_process_packet (uint8_t* data, uint8_t len)
 		if (transfer_type == LINK_DATA_WITHOUT_ACK || transfer_type == LINK_DATA_BROADCAST) {
 			return LINK_process_packet (data + LINK_HEADER_SIZE, len - LINK_HEADER_SIZE);
 		}
+		else if (transfer_type == LINK_DATA_HS2 && len > LINK_HEADER_SIZE) {
+			uint8_t seq = data[LINK_HEADER_SIZE];
+			// ACK is sent for repeated DATA too, its previous ACK was lost
+			send_two_way_ack (seq);
+			if (!two_way_accept (seq))
+				return true;
+			return LINK_process_packet (data + LINK_HEADER_SIZE + LINK_HS2_HEADER_SIZE,
+																	len - LINK_HEADER_SIZE - LINK_HS2_HEADER_SIZE);
+		}
 		else if (transfer_type == LINK_DATA_HS4) {
 			if(LINK_STORAGE.ed_rx_buffer.empty) {
 				uint8_t i;
@@ -315,6 +397,9 @@ void check_buffers_state ()
 			LINK_STORAGE.ed_tx_buffer.expiration_time = LINK_STORAGE.timer_counter + 2;
 		}
 	}
+	// repeated DATA cannot come after retransmissions of parent
+	if (LINK_STORAGE.rx_valid && LINK_STORAGE.rx_expiration == LINK_STORAGE.timer_counter)
+		LINK_STORAGE.rx_valid = false;
 }
 
 /**
@@ -426,12 +511,21 @@ void LINK_init (struct PHY_init_t* phy_params, struct LINK_init_t* link_params)
 	LINK_STORAGE.tx_max_retries = link_params->tx_max_retries;
 	LINK_STORAGE.ed_rx_buffer.empty = 1;
 	LINK_STORAGE.ed_tx_buffer.empty = 1;
+	// parent which remembers DATA of previous run hardly gets the same number,
+	// timer is zero after reset, so noise of channel is mixed in
+	LINK_STORAGE.tx_seq = LINK_STORAGE.timer_counter + PHY_get_noise ();
 	LINK_STORAGE.timer_counter = 0;
 	LINK_STORAGE.link_ack_join_received = false;
+	LINK_STORAGE.rx_valid = false;
 	for(uint8_t i = 0; i < MAX_COORD; i++)
 		LINK_STORAGE.ack_join_address[i] = INVALID_CID;
 }
 
+void LINK_set_two_way (bool enable)
+{
+	LINK_STORAGE.two_way = enable;
+}
+
 /**
  * Sends packet.
  * @param payload 			Payload.
@@ -441,13 +535,22 @@ void LINK_init (struct PHY_init_t* phy_params, struct LINK_init_t* link_params)
  */
 bool LINK_send_ed (uint8_t* payload, uint8_t len, uint8_t transfer_type)
 {
-	if (transfer_type == LINK_DATA_HS4) {
+	if (transfer_type == LINK_DATA_HS4 && LINK_STORAGE.two_way)
+		transfer_type = LINK_DATA_HS2;
+	// sequence number takes part of payload, longer DATA go by four-way handshake
+	if (transfer_type == LINK_DATA_HS2 && len > MAX_LINK_PAYLOAD_SIZE - LINK_HS2_HEADER_SIZE)
+		transfer_type = LINK_DATA_HS4;
+	if (transfer_type == LINK_DATA_HS4 || transfer_type == LINK_DATA_HS2) {
 		if (!LINK_STORAGE.ed_tx_buffer.empty)
 			return false;
+		uint8_t index = 0;
+		// sequence number is kept with DATA for retransmissions
+		if (transfer_type == LINK_DATA_HS2)
+			LINK_STORAGE.ed_tx_buffer.data[index++] = LINK_STORAGE.tx_seq++;
 		for (uint8_t i = 0; i < len; i++) {
-			LINK_STORAGE.ed_tx_buffer.data[i] = payload[i];
+			LINK_STORAGE.ed_tx_buffer.data[index++] = payload[i];
 		}
-		LINK_STORAGE.ed_tx_buffer.len = len;
+		LINK_STORAGE.ed_tx_buffer.len = index;
 		LINK_STORAGE.ed_tx_buffer.state = DATA_SENT;
 		LINK_STORAGE.ed_tx_buffer.transmits_to_error = LINK_STORAGE.tx_max_retries;
 		LINK_STORAGE.ed_tx_buffer.expiration_time = LINK_STORAGE.timer_counter + 3;
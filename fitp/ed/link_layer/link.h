@@ -33,6 +33,11 @@ bool send_done = false;
 #define LINK_DATA_JOIN_RESPONSE 0x04
 /*! JOIN ACK JOIN message */
 #define LINK_ACK_JOIN_REQUEST   0x05
+/*! data transfer using two-way handshake (DATA and ACK with sequence number) */
+#define LINK_DATA_HS2           0x09
+
+/*! size of sequence number preceding payload of two-way handshake DATA */
+#define LINK_HS2_HEADER_SIZE    1
 
 /**
  * Structure for link layer (accessible for user).
@@ -49,6 +54,13 @@ struct LINK_init_t {
  */
 void LINK_init (struct PHY_init_t* phy_params, struct LINK_init_t *link_params);
 
+/**
+ * Sends packets of four-way handshake by two-way handshake (LINK_DATA_HS2),
+ * parent has to support it. Disabled by default.
+ * @param enable 	True to send packets by two-way handshake.
+ */
+void LINK_set_two_way (bool enable);
+
 /**
  * Gets address of coordinator (CID).
  * @param byte Byte containing coordinator ID.
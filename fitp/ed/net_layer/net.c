@@ -6,6 +6,7 @@
 #include "net_common.h"
 #include "link.h"
 #include "log.h"
+#include "sync_word.h"
 
 /*! maximum delay for MOVE REPONSE message */
 /*! if 2 second delay if required, then MAX_MOVE_DELAY is: */
@@ -43,6 +44,7 @@ struct NET_storage_t {
 	NET_current_processing_packet_t processing_packet;	/**< Structure for currently processed packet. */
 	bool waiting_move_response;													/**< Flag if network is being reinitialized. */
 	uint8_t move_timeout;																/**< Timeout for MOVE RESPONSE message (containing new parent ID). */
+	bool sync_filter;																		/**< Flag if sync word is derived from NID. */
 } NET_STORAGE;
 
 /**
@@ -314,6 +316,25 @@ void NET_init (struct PHY_init_t *phy_params, struct LINK_init_t *link_params)
 	NET_STORAGE.move_timeout = 0;
 	D_NET printf("%02x %02x %02x %02x %02x\n", GLOBAL_STORAGE.nid[0], GLOBAL_STORAGE.nid[1],
 				GLOBAL_STORAGE.nid[2], GLOBAL_STORAGE.nid[3], GLOBAL_STORAGE.parent_cid);
+	NET_update_sync_word ();
+}
+
+void NET_set_sync_filter (bool enable)
+{
+	NET_STORAGE.sync_filter = enable;
+	NET_update_sync_word ();
+}
+
+void NET_update_sync_word ()
+{
+	uint8_t sync[SYNC_WORD_LENGTH];
+
+	// joining device does not know NID yet
+	if (NET_STORAGE.sync_filter && NET_joined ())
+		sync_word_from_nid (GLOBAL_STORAGE.nid, sync);
+	else
+		sync_word_default (sync);
+	PHY_set_sync_word (sync);
 }
 
 bool NET_joined ()
@@ -405,6 +426,7 @@ bool NET_join ()
 	tmp[index++] = GLOBAL_STORAGE.edid[2];
 	tmp[index++] = GLOBAL_STORAGE.edid[3];
 	GLOBAL_STORAGE.waiting_join_response = true;
+	NET_update_sync_word ();
 	if (LINK_send_join_request (tmp, index)) {
 		D_NET printf ("NET_join(): ACK JOIN REQUEST received\n");
 		for (uint8_t i = 0; i < MAX_JOIN_DELAY; i++) {
@@ -419,9 +441,11 @@ bool NET_join ()
 		// JOIN RESPONSE packet was not received
 		D_NET printf ("NET_join(): timeout\n");
 		GLOBAL_STORAGE.waiting_join_response = false;
+		NET_update_sync_word ();
 		return false;
 	}
 	D_NET printf ("NET_join(): success\n");
+	NET_update_sync_word ();
 	return true;
 }
 
@@ -46,6 +46,20 @@ bool NET_send_broadcast (uint8_t message_type, uint8_t * payload, uint8_t len);
  */
 bool NET_join ();
 
+/**
+ * Enables filtering of foreign networks by packet handler. Joined device
+ * uses sync word derived from NID (sync_word_from_nid) like PAN coordinator
+ * with fitp_set_sync_filter, joining device uses default sync word.
+ * Has to be called after NET_init.
+ * @param enable 	True to derive sync word from NID, false for default sync word.
+ */
+void NET_set_sync_filter (bool enable);
+
+/**
+ * Sets sync word of radio, it is called whenever NID or pair mode changes.
+ */
+void NET_update_sync_word ();
+
 /**
  * Checks if end device is joined the network.
  * @return Returns true if end device is joined the network, false otherwise.
@@ -537,6 +537,18 @@ void PHY_send_with_cca (uint8_t* data, uint8_t len)
 	PHY_send (data, len);
 }
 
+/**
+ * Sets sync word recognized by packet handler.
+ * @param sync Sync word (SYNCV31REG first).
+ */
+void PHY_set_sync_word (const uint8_t * sync)
+{
+	set_register (SYNCV31REG, sync[0]);
+	set_register (SYNCV23REG, sync[1]);
+	set_register (SYNCV15REG, sync[2]);
+	set_register (SYNCV07REG, sync[3]);
+}
+
 /**
  * Interrupt request 0 (IRQ0) occured.
  */
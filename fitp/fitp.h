@@ -11,7 +11,7 @@
 #include <string>
 #include <map>
 #include <vector>
-#include "fitp/common/phy_layer/phy.h"
+#include "fitp/pan/phy_layer/phy.h"
 #include "pan/link_layer/link.h"
 //#include "pan/net_layer/net.h"
 //#include "net_common.h"
@@ -46,6 +46,7 @@ struct fitp_received_messages_t {
 	uint8_t len;
 	uint8_t sedid[4];
 	uint8_t device_type;
+	struct PHY_rx_info_t rx_info;
 };
 
 enum DeviceType {
@@ -149,6 +150,14 @@ bool NET_unpair(uint8_t* edid);
  */
 void fitp_received_data(std::vector<uint8_t> &data);
 
+/**
+ * Processes received data together with arrival time (monotonic, ns),
+ * RSSI, channel, bitrate and radio of the frame which carried it.
+ * @param data 	Data sent from end device, unchanged if nothing came in 5 seconds.
+ * @param info 	Metadata of frame, valid only if data were filled.
+ */
+void fitp_received_data(std::vector<uint8_t> &data, struct PHY_rx_info_t &info);
+
 /**
  * Reacts to accept command sent from server.
  * @param edid	Destination end device ID.
@@ -178,6 +187,190 @@ void fitp_set_config_path(const std::string &configPath);
 
 double fitp_get_measured_noise();
 
+/**
+ * Gets noise floor and RSSI percentiles of used channel.
+ * @param stats	Structure for noise estimate.
+ * @return Returns true if estimate is available, false otherwise.
+ */
+bool fitp_get_measured_noise(struct PHY_noise_stats_t *stats);
+
+/**
+ * Sets distance of CCA threshold above noise floor.
+ * @param margin	Margin, 0 disables adaptive CCA.
+ */
+void fitp_set_cca_margin(uint8_t margin);
+
 void fitp_set_nid(uint32_t nid);
 
+/**
+ * Selects implementation of physical layer, has to be called before fitp_init.
+ * @param name	Backend name: "mrf89xa" (default), "loopback" or "simulator".
+ * @return Returns false if backend is unknown or stack is running, true otherwise.
+ */
+bool fitp_set_phy_backend(const std::string &name);
+
+/**
+ * Sets sockets of "simulator" backend, has to be called before fitp_init.
+ * @param bus_path	Socket of network simulator.
+ * @param node_path	Socket of this device, empty for bus_path.<pid>.
+ */
+void fitp_set_simulator_bus(const std::string &bus_path, const std::string &node_path = "");
+
+/**
+ * Sets channel access (CSMA/CA) parameters.
+ * @param slot_time_us	Duration of backoff slot (us).
+ * @param min_be				Initial backoff exponent.
+ * @param max_be				Maximum backoff exponent.
+ * @param max_attempts	Number of CCA attempts before frame is dropped.
+ * @return Returns true if parameters are valid, false otherwise.
+ */
+bool fitp_set_csma(uint16_t slot_time_us, uint8_t min_be, uint8_t max_be, uint8_t max_attempts);
+
+/**
+ * Sets switching of RX between interrupts and polling during bursts,
+ * has to be called before fitp_init. Counters are read by PHY_get_rx_poll_stats.
+ * @param enter_gap_ms	Frames closer than this start polling, 0 disables polling.
+ * @param interval_ms		Period of polling.
+ * @param idle_ms				Time without frame after which interrupts are used again.
+ * @return Returns false if parameters are invalid or stack is running, true otherwise.
+ */
+bool fitp_set_rx_poll(uint16_t enter_gap_ms, uint16_t interval_ms, uint16_t idle_ms);
+
+/**
+ * Sets health checks of radios, has to be called before fitp_init.
+ * Wedged radio is reset and reconfigured without restart of the stack,
+ * counters are read by PHY_get_health_stats. RX silence is measured from
+ * the first frame sent after the last received one, so quiet network does
+ * not reset radio, but radio whose frames are not answered because its
+ * neighbours are gone is reset once, it is reset again only after it
+ * receives a frame.
+ * @param period_ms			Period of register readback check, 0 disables watchdog.
+ * @param tx_timeouts		Consecutive TXDONE timeouts causing recovery, 0 disables the check.
+ * @param rx_silence_ms	Time without received frame after sent one causing recovery, 0 disables the check.
+ * @return Returns false if stack is running, true otherwise.
+ */
+bool fitp_set_watchdog(uint16_t period_ms, uint8_t tx_timeouts, uint32_t rx_silence_ms);
+
+/**
+ * Enables warm start of radios, has to be called before fitp_init.
+ * Radio still configured by previous run of the stack is not reset and
+ * only registers which differ are written. Duration of start of every
+ * radio is read by PHY_get_init_stats.
+ * @param enable	True to enable warm start.
+ */
+void fitp_set_warm_start(bool enable);
+
+/**
+ * Sets transceivers driven by PAN, has to be called before fitp_init.
+ * The first radio uses channel from PHY_init_t and carries joining.
+ * @param radios	Wiring and channels of radios (1 to PHY_MAX_RADIOS).
+ * @return Returns false if radios cannot be set, true otherwise.
+ */
+bool fitp_set_radios(const std::vector<struct PHY_radio_config_t> &radios);
+
+/**
+ * Sets real-time scheduling of stack threads, has to be called before fitp_init.
+ * SCHED_FIFO needs CAP_SYS_NICE, threads keep normal scheduling otherwise.
+ * @param thread		Thread class: PHY_THREAD_IRQ, PHY_THREAD_RX, PHY_THREAD_TX or PHY_THREAD_TIMER.
+ * @param priority	SCHED_FIFO priority (1-99), 0 for normal scheduling.
+ * @param cpu				CPU the threads are pinned to, -1 for any CPU.
+ * @return Returns false if parameters are invalid, true otherwise.
+ */
+bool fitp_set_thread_sched(uint8_t thread, int priority, int cpu);
+
+/**
+ * Locks process memory and prefaults stacks of stack threads in fitp_init,
+ * has to be called before fitp_init.
+ * @param enable	True to lock memory.
+ */
+void fitp_set_memory_lock(bool enable);
+
+/**
+ * Gets wakeup latency of stack threads to check real-time settings.
+ * @param thread	Thread class (PHY_THREAD_*).
+ * @param stats		Structure for latency counters.
+ * @return Returns false if thread class does not exist, true otherwise.
+ */
+bool fitp_get_latency_stats(uint8_t thread, struct PHY_latency_stats_t *stats);
+
+/**
+ * Enables filtering of foreign networks by MRF89XA packet handler.
+ * Radios use sync word derived from NID (sync_word_from_nid), so frames
+ * of other networks never reach SPI. All devices of network have to use
+ * the same sync word, coordinators and end devices enable it by their
+ * fitp_set_sync_filter. During pair mode radio 0 uses default sync word
+ * to hear joining devices, so the filter needs at least two radios
+ * (fitp_set_radios) and the others keep hearing the network.
+ * @param enable	True to derive sync word from NID, false for default sync word.
+ * @return Returns false if filter is enabled on PAN with single radio, true otherwise.
+ */
+bool fitp_set_sync_filter(bool enable);
+
+/**
+ * Enables selection of the least occupied channel by fitp_init,
+ * has to be called before fitp_init. Every radio is surveyed and gets
+ * its own channel, channel from PHY_init_t is used only if survey fails.
+ * Devices find new channel by scanning, so it is suitable for new networks.
+ * @param enable	True to survey channels during fitp_init.
+ */
+void fitp_set_auto_channel(bool enable);
+
+/**
+ * Measures occupancy of all channels by sampling RSSI, radio
+ * must not transmit during survey (a few seconds).
+ * @param radio						Radio index.
+ * @param busy_threshold	RSSI above which sample counts as busy.
+ * @param table						Channels ordered from the least occupied one.
+ * @return Returns false if radio cannot be surveyed, true otherwise.
+ */
+bool fitp_survey_channels(uint8_t radio, uint8_t busy_threshold,
+													std::vector<struct PHY_survey_t> &table);
+
+/**
+ * Serves coordinator and its subtree by given radio, has to be called after fitp_init.
+ * @param cid		Coordinator ID (child of PAN for whole subtree).
+ * @param radio	Radio index.
+ * @return Returns false if radio does not exist, true otherwise.
+ */
+bool fitp_assign_radio(uint8_t cid, uint8_t radio);
+
+/**
+ * Adapts bitrate of four-way handshakes to every coordinator, fast bitrates
+ * are used for good links, disabled by default.
+ * @param enable	True to enable bitrate adaptation.
+ */
+void fitp_set_rate_control(bool enable);
+
+/**
+ * Gets statistics of bitrates used for coordinator.
+ * @param cid		Coordinator ID.
+ * @param stats	Structure for statistics.
+ */
+void fitp_get_rate_stats(uint8_t cid, struct LINK_rate_stats_t *stats);
+
+/**
+ * Sends reliable packets to coordinators in windows of several DATA
+ * acknowledged together, all coordinators have to support it.
+ * @param enable	True to send packets to coordinators in windows.
+ */
+void fitp_set_windowed_transfer(bool enable);
+
+/**
+ * Sends reliable packets by two-way handshake (DATA and ACK), repeated
+ * DATA are suppressed by sequence numbers. Suitable for idempotent data,
+ * all devices have to support it.
+ * @param enable	True to send reliable packets by two-way handshake.
+ */
+void fitp_set_two_way_transfer(bool enable);
+
+/**
+ * Gets round-trip time statistics of neighbour, retransmission timeouts
+ * of reliable packets adapt to them.
+ * @param cid		Coordinator ID.
+ * @param edid	End device ID, NULL for coordinator.
+ * @param stats	Structure for statistics.
+ * @return Returns false if no reliable packet was sent to neighbour, true otherwise.
+ */
+bool fitp_get_rtt_stats(uint8_t cid, uint8_t *edid, struct LINK_rtt_stats_t *stats);
+
 //#endif
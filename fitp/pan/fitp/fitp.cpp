@@ -6,12 +6,69 @@
 #include <pan/global_storage/global.h>
 #include "pan/net_layer/net.h"
 #include "pan/global_storage/global.h"
+#include "pan/phy_layer/x86_phy.h"
+#include "common/phy_layer/sync_word.h"
 #include "fitp.h"
 
 std::deque<struct fitp_received_messages_t> received_messages;
 std::mutex received_messages_mutex;
 std::condition_variable condition_variable_received_messages;
 
+/*! RSSI samples taken on every channel by automatic channel selection */
+#define FITP_SURVEY_SAMPLES 200
+/*! time between RSSI samples of automatic channel selection (us) */
+#define FITP_SURVEY_INTERVAL_US 500
+
+static bool auto_channel = false;
+static bool sync_filter = false;
+
+/**
+ * Sets sync words of radios according to NID and pair mode.
+ * Radio 0 carries joining, it uses default sync word during pair mode.
+ */
+static void update_sync_words()
+{
+	uint8_t network_sync[SYNC_WORD_LENGTH];
+	uint8_t default_sync[SYNC_WORD_LENGTH];
+
+	sync_word_default(default_sync);
+	if (sync_filter)
+		sync_word_from_nid(GLOBAL_STORAGE.nid, network_sync);
+	else
+		sync_word_default(network_sync);
+	for (uint8_t radio = 0; radio < PHY_get_radio_count(); radio++) {
+		if (radio == 0 && GLOBAL_STORAGE.pair_mode)
+			PHY_set_sync_word(radio, default_sync);
+		else
+			PHY_set_sync_word(radio, network_sync);
+	}
+}
+
+/**
+ * Moves every radio to the least occupied channel not used by other radio.
+ * @param busy_threshold	RSSI above which channel is considered busy.
+ */
+static void select_channels(uint8_t busy_threshold)
+{
+	struct PHY_survey_t table[PHY_MAX_CHANNELS];
+	bool taken[PHY_MAX_CHANNELS] = {false};
+
+	for (uint8_t radio = 0; radio < PHY_get_radio_count(); radio++) {
+		uint8_t channels = PHY_survey(radio, FITP_SURVEY_SAMPLES, FITP_SURVEY_INTERVAL_US,
+																	busy_threshold, table);
+		for (uint8_t i = 0; i < channels; i++) {
+			if (taken[table[i].channel])
+				continue;
+			if (PHY_set_radio_channel(radio, table[i].channel)) {
+				taken[table[i].channel] = true;
+				std::cout << "fitp_init(): radio " << int(radio) << " uses channel "
+									<< int(table[i].channel) << " (busy " << int(table[i].busy) << "%)" << std::endl;
+			}
+			break;
+		}
+	}
+}
+
 /**
  * Ensures initialization of network, link and physical layer.
  * @param phy_params		Parameters of physical layer.
@@ -20,6 +77,11 @@ std::condition_variable condition_variable_received_messages;
 void fitp_init (struct PHY_init_t* phy_params, struct LINK_init_t* link_params)
 {
 	NET_init(phy_params, link_params);
+	// NID is known after device table is loaded
+	update_sync_words();
+	// nothing is transmitted yet, radios can be surveyed
+	if (auto_channel)
+		select_channels(phy_params->cca_noise_threshold_max);
 }
 
 void fitp_deinit ()
@@ -147,8 +209,11 @@ void NET_received (const uint8_t, const uint8_t [EDID_LENGTH],
 	 //fitp_received (from_cid, from_edid, data, len);
 }
 
-void NET_save_msg_info(uint8_t msg_type, uint8_t device_type, uint8_t* sedid, uint8_t* data, uint8_t len)
+void NET_save_msg_info(uint8_t msg_type, uint8_t device_type, uint8_t* sedid, uint8_t* data, uint8_t len,
+											 const struct PHY_rx_info_t *info)
 {
+	if (len > MAX_DATA_LENGTH)
+		return;
 	std::unique_lock<std::mutex> lk(received_messages_mutex);
 	struct fitp_received_messages_t tmp_received_message;
 	if (msg_type == FITP_JOIN_REQUEST)
@@ -167,6 +232,7 @@ void NET_save_msg_info(uint8_t msg_type, uint8_t device_type, uint8_t* sedid, ui
 		tmp_received_message.data[l] = data[l];
 
 	tmp_received_message.len = len;
+	tmp_received_message.rx_info = *info;
 	received_messages.push_back(tmp_received_message);
 	condition_variable_received_messages.notify_all();
 }
@@ -177,6 +243,17 @@ void NET_save_msg_info(uint8_t msg_type, uint8_t device_type, uint8_t* sedid, ui
  * @param data 	Data sent from end device.
  */
 void fitp_received_data(std::vector<uint8_t> &data)
+{
+	struct PHY_rx_info_t info;
+	fitp_received_data(data, info);
+}
+
+/**
+ * Processes received data together with its physical layer metadata.
+ * @param data 	Data sent from end device.
+ * @param info 	Metadata of frame which carried data.
+ */
+void fitp_received_data(std::vector<uint8_t> &data, struct PHY_rx_info_t &info)
 {
 	struct fitp_received_messages_t tmp_received_message;
 	std::unique_lock<std::mutex> lk(received_messages_mutex);
@@ -196,6 +273,7 @@ void fitp_received_data(std::vector<uint8_t> &data)
 
 		for (uint8_t k = 0; k < tmp_received_message.len; k++)
 			data.push_back(tmp_received_message.data[k]);
+		info = tmp_received_message.rx_info;
 	}
 }
 
@@ -207,6 +285,7 @@ void fitp_joining_enable (uint8_t timeout)
 {
 	//printf("fitp_joining_enable()\n");
 	GLOBAL_STORAGE.pair_mode = true;
+	update_sync_words();
 	// TODO: To be deleted, include a .h file!
 	//NET_send_broadcast(PT_NETWORK_EXTENDED, PT_DATA_PAIR_MODE_ENABLED, NULL, 0);
 	//NET_send_broadcast(15, 16, NULL, 0);
@@ -221,6 +300,7 @@ void fitp_joining_disable ()
 {
 //	printf("fitp_joining_disable()\n");
 	GLOBAL_STORAGE.pair_mode = false;
+	update_sync_words();
 //	D_G printf("fitp_joining_disable()\n");
 }
 
@@ -303,6 +383,16 @@ double fitp_get_measured_noise()
 	return double(res);
 }
 
+bool fitp_get_measured_noise(struct PHY_noise_stats_t *stats)
+{
+	return PHY_get_noise_stats(0, PHY_get_channel(), stats);
+}
+
+void fitp_set_cca_margin(uint8_t margin)
+{
+	PHY_set_cca_margin(margin);
+}
+
 void fitp_set_config_path(const std::string &configPath)
 {
 	GLOBAL_STORAGE.device_table_path = configPath;
@@ -324,4 +414,128 @@ void fitp_set_nid(uint32_t nid)
 	GLOBAL_STORAGE.nid[2] = (nid >> 16) & 0xFF;
 	GLOBAL_STORAGE.nid[1] = (nid >> 8) & 0xFF;
 	GLOBAL_STORAGE.nid[0] = nid & 0xFF;
+	update_sync_words();
+}
+
+bool fitp_set_phy_backend(const std::string &name)
+{
+	return PHY_set_backend(name.c_str());
+}
+
+void fitp_set_simulator_bus(const std::string &bus_path, const std::string &node_path)
+{
+	PHY_simulator_set_bus(bus_path.c_str(), node_path.empty() ? NULL : node_path.c_str());
+}
+
+bool fitp_set_csma(uint16_t slot_time_us, uint8_t min_be, uint8_t max_be, uint8_t max_attempts)
+{
+	struct PHY_csma_t csma;
+	csma.slot_time_us = slot_time_us;
+	csma.min_be = min_be;
+	csma.max_be = max_be;
+	csma.max_attempts = max_attempts;
+	return PHY_set_csma(&csma);
+}
+
+bool fitp_set_rx_poll(uint16_t enter_gap_ms, uint16_t interval_ms, uint16_t idle_ms)
+{
+	struct PHY_rx_poll_t poll;
+	poll.enter_gap_ms = enter_gap_ms;
+	poll.interval_ms = interval_ms;
+	poll.idle_ms = idle_ms;
+	return PHY_set_rx_poll(&poll);
+}
+
+bool fitp_set_watchdog(uint16_t period_ms, uint8_t tx_timeouts, uint32_t rx_silence_ms)
+{
+	struct PHY_watchdog_t watchdog;
+	watchdog.period_ms = period_ms;
+	watchdog.tx_timeouts = tx_timeouts;
+	watchdog.rx_silence_ms = rx_silence_ms;
+	return PHY_set_watchdog(&watchdog);
+}
+
+void fitp_set_warm_start(bool enable)
+{
+	PHY_set_warm_start(enable);
+}
+
+bool fitp_set_radios(const std::vector<struct PHY_radio_config_t> &radios)
+{
+	if (radios.empty() || radios.size() > PHY_MAX_RADIOS)
+		return false;
+	return PHY_set_radios(radios.data(), radios.size());
+}
+
+bool fitp_set_thread_sched(uint8_t thread, int priority, int cpu)
+{
+	return PHY_set_thread_sched(thread, priority, cpu);
+}
+
+void fitp_set_memory_lock(bool enable)
+{
+	PHY_set_memory_lock(enable);
+}
+
+bool fitp_get_latency_stats(uint8_t thread, struct PHY_latency_stats_t *stats)
+{
+	return PHY_get_latency_stats(thread, stats);
+}
+
+bool fitp_set_sync_filter(bool enable)
+{
+	// single radio would not hear network during pair mode
+	if (enable && PHY_get_radio_count() < 2)
+		return false;
+	sync_filter = enable;
+	update_sync_words();
+	return true;
+}
+
+void fitp_set_auto_channel(bool enable)
+{
+	auto_channel = enable;
+}
+
+bool fitp_survey_channels(uint8_t radio, uint8_t busy_threshold,
+													std::vector<struct PHY_survey_t> &table)
+{
+	struct PHY_survey_t survey[PHY_MAX_CHANNELS];
+
+	uint8_t channels = PHY_survey(radio, FITP_SURVEY_SAMPLES, FITP_SURVEY_INTERVAL_US,
+																busy_threshold, survey);
+	table.assign(survey, survey + channels);
+	return channels > 0;
+}
+
+bool fitp_assign_radio(uint8_t cid, uint8_t radio)
+{
+	return LINK_set_coord_radio(cid, radio);
+}
+
+void fitp_set_rate_control(bool enable)
+{
+	LINK_set_rate_control(enable);
+}
+
+void fitp_get_rate_stats(uint8_t cid, struct LINK_rate_stats_t *stats)
+{
+	LINK_get_rate_stats(cid, stats);
+}
+
+void fitp_set_windowed_transfer(bool enable)
+{
+	LINK_set_window(enable);
+}
+
+void fitp_set_two_way_transfer(bool enable)
+{
+	LINK_set_two_way(enable);
+}
+
+bool fitp_get_rtt_stats(uint8_t cid, uint8_t *edid, struct LINK_rtt_stats_t *stats)
+{
+	if (edid)
+		return LINK_get_rtt_stats(true, edid, stats);
+	return LINK_get_rtt_stats(false, &cid, stats);
 }
@@ -2,9 +2,13 @@
 * @file link.cc
 */
 
-#include "common/phy_layer/phy.h"
+#include "pan/phy_layer/phy.h"
 #include "pan/link_layer/link.h"
 #include <stdio.h>
+#include <vector>
+#include <set>
+#include <mutex>
+#include <unordered_map>
 #include "common/log/log.h"
 
 /*! bit mask of data transfer from coordinator to end device */
@@ -13,14 +17,55 @@
 #define LINK_ED_TO_COORD					0x10
 /*! bit mask of device busyness */
 #define LINK_BUSY									0x08
-/*! RX buffer size */
-#define LINK_RX_BUFFER_SIZE 4
-/*! TX buffer size */
-#define LINK_TX_BUFFER_SIZE 4
+/*! default RX buffer size, hundreds of transfers run at once */
+#define LINK_RX_BUFFER_SIZE 256
+/*! default TX buffer size, hundreds of transfers run at once */
+#define LINK_TX_BUFFER_SIZE 256
+/*! index of no buffer record */
+#define LINK_NO_RECORD						0xffff
 /*! maximum number of channels */
 #define MAX_CHANNEL 							31
 /*! broadcast address */
 #define LINK_COORD_ALL 						0xfc
+/*! radio of neighbour is not known */
+#define LINK_NO_RADIO							0xff
+/*! number of end devices whose radio is remembered */
+#define LINK_ED_RADIOS						32
+/*! every n-th exchange with coordinator samples another bitrate */
+#define LINK_RATE_SAMPLE_INTERVAL	10
+/*! period of bitrate statistics update (ms) */
+#define LINK_RATE_UPDATE_MS				1000
+/*! radio is not switched for any coordinator */
+#define LINK_NO_COORD							0xff
+/*! the shortest time (ms) within which DATA of two-way handshake with
+ * remembered sequence numbers are duplicates, it is extended to exceed
+ * retransmissions of sender with the same tx_max_retries */
+#define LINK_DUPLICATE_TIMEOUT_MS	8000
+/*! number of the last sequence numbers of two-way handshake remembered
+ * per sender, it exceeds DATA which sender has in flight at once */
+#define LINK_DUPLICATE_WINDOW			8
+/*! retransmission timeout of neighbour without round-trip time sample (ms) */
+#define LINK_RTO_INITIAL_MS				100
+/*! bounds of retransmission timeout estimated from round-trip time (ms) */
+#define LINK_RTO_MIN_MS						50
+#define LINK_RTO_MAX_MS						1000
+/*! maximum exponent of retransmission timeout backoff */
+#define LINK_RTO_MAX_BACKOFF			6
+/*! upper bound of retransmission timeout including backoff (ms), backoff
+ * extends timeout past LINK_RTO_MAX_MS for multi-hop and sleepy neighbours */
+#define LINK_RTO_BACKOFF_MAX_MS		60000
+/*! delay of COMMIT of window which is not full (ms) */
+#define LINK_WINDOW_DELAY_MS			50
+/*! period of network layer counter (ms) */
+#define LINK_NET_TICK_MS					50
+/*! timer target of bitrate statistics update */
+#define LINK_TIMER_RATE						(1ULL << 62)
+/*! timer targets of windows carry key of neighbour, the other targets
+ * are indexes of TX buffer records */
+#define LINK_TIMER_WINDOW					(1ULL << 63)
+
+/*! bitrates in kbps, indexed by DATA_RATE_* */
+static const uint8_t LINK_RATE_KBPS[LINK_RATE_COUNT] = { 5, 10, 20, 40, 50, 66, 100, 200 };
 
 /** @enum LINK_packet_type
  * Packet types.
@@ -65,23 +110,122 @@ typedef struct {
 	uint8_t empty:1;										/**< Flag if record is empty. */
 	uint8_t len:6;											/**< Data length. */
 	uint8_t state:1;										/**< Packet states: 0 - DATA were sent, 1 - COMMIT was sent. */
-	uint8_t expiration_time;						/**< Packet expiration time. */
+	uint8_t rate_control:1;							/**< Flag if record adapts bitrate of its radio. */
+	uint8_t waiting:1;									/**< Flag if record waits for handshake of previous record. */
+	uint8_t windowed:1;									/**< Flag if DATA is sent in window. */
+	uint8_t seq;												/**< Sequence number of windowed or two-way handshake DATA. */
+	uint8_t bitrate;										/**< Bitrate of the last sent DATA or COMMIT. */
+	uint8_t attempt;										/**< Number of unsuccessful transmissions of DATA or COMMIT. */
+	uint8_t timed:1;										/**< Flag if the last DATA or COMMIT gives round-trip time sample. */
+	uint8_t failed:1;										/**< Flag if the last DATA or COMMIT did not leave radio. */
+	uint64_t sent_at;										/**< Time when the last DATA or COMMIT left radio, or was queued (ns). */
+	uint64_t deadline;									/**< Retransmission time of DATA or COMMIT (ms). */
 	uint8_t transmits_to_error;					/**< Maximum number of packet retransmissions. */
 	uint8_t transfer_type;							/**< Transfer type. */
+	uint32_t phy_frame;									/**< Identifier of the last sent DATA or COMMIT in TX queue. */
+	uint16_t next;											/**< Next record for the same neighbour. */
 	union {
 		uint8_t coord;										/**< Coordinator address. */
 		uint8_t ed[EDID_LENGTH];					/**< End device address. */
 	} address;
 } LINK_tx_buffer_record_t;
 
+/**
+ * TX buffer records of neighbour, the first one is in four-way handshake.
+ */
+typedef struct {
+	uint16_t first;							/**< Record in four-way handshake. */
+	uint16_t last;							/**< The last queued record. */
+	uint8_t window;							/**< Number of windowed DATA in flight. */
+	uint8_t commit_sent:1;			/**< Flag if COMMIT of window was sent. */
+	uint8_t timed:1;						/**< Flag if the last COMMIT gives round-trip time sample. */
+	uint8_t commit_seq;					/**< The oldest unacknowledged sequence number when the last COMMIT was sent. */
+	uint64_t sent_at;						/**< Time when the last COMMIT left radio, or was queued (ns). */
+	uint32_t commit_frame;			/**< Identifier of the last COMMIT in TX queue. */
+	uint64_t deadline;					/**< Retransmission or COMMIT time of window (ms). */
+	uint8_t transmits_to_error;	/**< Maximum number of window retransmissions. */
+} LINK_tx_queue_t;
+
+/**
+ * Sequence numbers of two-way handshakes with neighbour.
+ */
+typedef struct {
+	uint8_t tx_seq;						/**< Sequence number of the next DATA for neighbour. */
+	uint8_t rx_seq;						/**< The newest sequence number of DATA accepted from neighbour. */
+	uint8_t rx_mask;					/**< Accepted sequence numbers, bit n is rx_seq - n. */
+	uint8_t rx_valid:1;				/**< Flag if DATA in rx_mask are duplicates. */
+	uint64_t rx_expiration;		/**< Expiration time of rx_seq (ms). */
+} LINK_seq_t;
+
+/**
+ * Round-trip time estimation of neighbour.
+ */
+typedef struct {
+	uint32_t srtt_us;					/**< Smoothed round-trip time (us). */
+	uint32_t rttvar_us;				/**< Round-trip time variation (us). */
+	uint32_t rto_ms;					/**< Retransmission timeout without backoff (ms). */
+	uint32_t min_us;					/**< The shortest round-trip time (us). */
+	uint32_t max_us;					/**< The longest round-trip time (us). */
+	uint32_t samples;					/**< Number of round-trip time samples. */
+	uint32_t timeouts;				/**< Number of retransmissions after timeout. */
+	uint8_t backoff;					/**< Exponent of retransmission timeout backoff. */
+} LINK_rtt_t;
+
+/**
+ * Radio on which end device was heard.
+ */
+typedef struct {
+	uint8_t ed[EDID_LENGTH];	/**< End device address. */
+	uint8_t radio;						/**< Radio index, LINK_NO_RADIO if record is empty. */
+} LINK_ed_radio_t;
+
+/**
+ * Bitrate statistics of coordinator.
+ */
+typedef struct {
+	uint16_t attempts[LINK_RATE_COUNT];				/**< Frames sent at bitrate since the last update. */
+	uint16_t successes[LINK_RATE_COUNT];			/**< Frames acknowledged at bitrate since the last update. */
+	uint16_t probability[LINK_RATE_COUNT];		/**< Success probability of bitrate (per mille). */
+	uint32_t total_attempts[LINK_RATE_COUNT];	/**< Frames sent at bitrate. */
+	uint32_t total_successes[LINK_RATE_COUNT];/**< Frames acknowledged at bitrate. */
+	uint8_t best_throughput;									/**< Bitrate with the best throughput. */
+	uint8_t best_probability;									/**< Bitrate with the best success probability. */
+	uint8_t listening;												/**< Bitrate on which coordinator listens. */
+	uint8_t exchanges;												/**< Number of exchanges, every n-th one samples. */
+	uint8_t sample;														/**< The last sampled bitrate. */
+} LINK_rate_t;
+
 /**
  * Structure for link layer.
  */
 struct LINK_storage_t {
 	uint8_t tx_max_retries;																		/**< Maximum number of packet retransmissions. */
-	uint8_t timer_counter;																		/**< Timer for packet expiration time setting. */
-	LINK_rx_buffer_record_t rx_buffer[LINK_RX_BUFFER_SIZE];		/**< Array of RX buffer records for coordinator. */
-	LINK_tx_buffer_record_t tx_buffer[LINK_TX_BUFFER_SIZE];		/**< Array of TX buffer records for coordinator. */
+	uint32_t duplicate_timeout;																/**< Time within which remembered DATA are duplicates (ms). */
+	std::set < std::pair < uint64_t, uint64_t > > timers;				/**< Armed deadlines (ms) and their targets, the earliest first. */
+	uint64_t timer_scheduled;																	/**< Deadline requested from physical layer (ms). */
+	std::vector < LINK_rx_buffer_record_t > rx_buffer;				/**< RX buffer records for coordinator. */
+	std::vector < LINK_tx_buffer_record_t > tx_buffer;				/**< TX buffer records for coordinator. */
+	std::vector < uint16_t > rx_free;													/**< Indexes of empty RX buffer records. */
+	std::vector < uint16_t > tx_free;													/**< Indexes of empty TX buffer records. */
+	std::unordered_map < uint64_t, uint16_t > rx_index;				/**< RX buffer record of neighbour. */
+	std::unordered_map < uint64_t, LINK_tx_queue_t > tx_index;/**< TX buffer records of neighbour. */
+	std::unordered_map < uint32_t, uint16_t > frame_index;		/**< TX buffer record of frame in TX queue. */
+	bool window_enabled;																			/**< Flag if coordinators get DATA in windows. */
+	uint8_t window_seq[MAX_COORD];														/**< Next sequence number of windowed DATA. */
+	bool two_way_enabled;																			/**< Flag if four-way handshakes are sent as two-way ones. */
+	std::unordered_map < uint64_t, LINK_seq_t > seq_index;		/**< Sequence numbers of two-way handshakes with neighbour. */
+	std::unordered_map < uint64_t, LINK_rtt_t > rtt_index;		/**< Round-trip time estimation of neighbour. */
+	std::recursive_mutex mutex;																/**< Lock of buffers, layers above are called with it. */
+	uint8_t coord_radio_assigned[MAX_COORD];									/**< Radio assigned to coordinator and its subtree. */
+	uint8_t coord_radio[MAX_COORD];														/**< Radio on which coordinator was heard. */
+	LINK_ed_radio_t ed_radio[LINK_ED_RADIOS];									/**< Radios on which end devices were heard. */
+	uint8_t ed_radio_next;																		/**< Record replaced when table is full. */
+	bool rate_control;																				/**< Flag if bitrate adaptation is enabled. */
+	uint64_t rate_deadline;																		/**< Time of the next update of bitrate statistics (ms). */
+	uint8_t band;																							/**< Band of PHY_init. */
+	uint8_t base_bitrate;																			/**< Bitrate of PHY_init. */
+	LINK_rate_t rates[MAX_COORD];															/**< Bitrate statistics of coordinators. */
+	uint8_t rate_window[PHY_MAX_RADIOS];											/**< Coordinator for which radio is switched. */
 } LINK_STORAGE;
 
 extern void delay_ms (uint16_t t);
@@ -130,39 +274,202 @@ void array_copy (uint8_t* src, uint8_t* dst, uint8_t size)
 }
 
 /**
- * Searches a free index in TX buffer.
- * @return Returns a free index in TX buffer or invalid index in case of
- * full TX buffer.
+ * Gets key of neighbour in buffer indexes.
+ * @param ed 				True if neighbour is end device, false otherwise.
+ * @param address 	Coordinator ID or end device ID.
+ * @return Returns key of neighbour.
  */
-uint8_t get_free_index_tx ()
+uint64_t neighbour_key (bool ed, const uint8_t* address)
 {
-	uint8_t free_index = LINK_TX_BUFFER_SIZE;
+	if (!ed)
+		return LINK_cid_mask (*address);
+	uint64_t key = 1;
+	for (uint8_t i = 0; i < EDID_LENGTH; i++)
+		key = key << 8 | address[i];
+	return key;
+}
 
-	for (uint8_t i = 0; i < LINK_TX_BUFFER_SIZE; i++) {
-		if (LINK_STORAGE.tx_buffer[i].empty) {
-			free_index = i;
-			break;
+/**
+ * Gets time for deadlines.
+ * @return Returns monotonic time (ms).
+ */
+uint64_t now_ms ()
+{
+	return PHY_monotonic_ns () / 1000000;
+}
+
+/**
+ * Requests wakeup of physical layer at the earliest deadline.
+ */
+void schedule_timer ()
+{
+	uint64_t next = LINK_STORAGE.timers.empty () ? 0 : LINK_STORAGE.timers.begin ()->first;
+
+	if (next == LINK_STORAGE.timer_scheduled)
+		return;
+	LINK_STORAGE.timer_scheduled = next;
+	PHY_set_timer (next * 1000000);
+}
+
+/**
+ * Arms timer of target, its previous deadline is cancelled.
+ * @param target 		Timer target.
+ * @param deadline 	Deadline of target, 0 if timer is not armed.
+ * @param at 				New deadline (ms).
+ */
+void arm_timer (uint64_t target, uint64_t *deadline, uint64_t at)
+{
+	if (*deadline)
+		LINK_STORAGE.timers.erase (std::make_pair (*deadline, target));
+	*deadline = at;
+	LINK_STORAGE.timers.insert (std::make_pair (at, target));
+	schedule_timer ();
+}
+
+/**
+ * Cancels timer of target.
+ * @param target 		Timer target.
+ * @param deadline 	Deadline of target, 0 if timer is not armed.
+ */
+void cancel_timer (uint64_t target, uint64_t *deadline)
+{
+	if (*deadline == 0)
+		return;
+	LINK_STORAGE.timers.erase (std::make_pair (*deadline, target));
+	*deadline = 0;
+	schedule_timer ();
+}
+
+/**
+ * Takes an empty record of TX buffer.
+ * @return Returns index of record or LINK_NO_RECORD in case of full TX buffer.
+ */
+uint16_t alloc_tx ()
+{
+	if (LINK_STORAGE.tx_free.empty ())
+		return LINK_NO_RECORD;
+	uint16_t index = LINK_STORAGE.tx_free.back ();
+	LINK_STORAGE.tx_free.pop_back ();
+	LINK_STORAGE.tx_buffer[index].empty = 0;
+	LINK_STORAGE.tx_buffer[index].next = LINK_NO_RECORD;
+	return index;
+}
+
+/**
+ * Returns record to TX buffer.
+ * @param index 	Index of record.
+ */
+void free_tx (uint16_t index)
+{
+	cancel_timer (index, &LINK_STORAGE.tx_buffer[index].deadline);
+	LINK_STORAGE.tx_buffer[index].empty = 1;
+	LINK_STORAGE.tx_free.push_back (index);
+}
+
+/**
+ * Takes an empty record of RX buffer.
+ * @return Returns index of record or LINK_NO_RECORD in case of full RX buffer.
+ */
+uint16_t alloc_rx ()
+{
+	if (LINK_STORAGE.rx_free.empty ())
+		return LINK_NO_RECORD;
+	uint16_t index = LINK_STORAGE.rx_free.back ();
+	LINK_STORAGE.rx_free.pop_back ();
+	return index;
+}
+
+/**
+ * Returns record to RX buffer.
+ * @param index 	Index of record.
+ */
+void free_rx (uint16_t index)
+{
+	LINK_STORAGE.rx_buffer[index].empty = 1;
+	LINK_STORAGE.rx_free.push_back (index);
+}
+
+/**
+ * Remembers the last frame of TX buffer record, result of its
+ * transmission is matched to the record.
+ * @param index 	Index of TX buffer record.
+ * @param id 			Identifier of frame in TX queue, 0 if frame was refused.
+ */
+void set_phy_frame (uint16_t index, uint32_t id)
+{
+	LINK_STORAGE.tx_buffer[index].phy_frame = id;
+	if (id != 0)
+		LINK_STORAGE.frame_index[id] = index;
+}
+
+/**
+ * Finds radio which reaches neighbour.
+ * Assigned radio takes precedence over radio on which neighbour was heard,
+ * unknown neighbours are reached by radio 0.
+ * @param to_ed 		True if neighbour is end device, false otherwise.
+ * @param address 	Coordinator ID or end device ID.
+ * @return Returns radio index.
+ */
+uint8_t radio_of (bool to_ed, uint8_t* address)
+{
+	if (to_ed) {
+		for (uint8_t i = 0; i < LINK_ED_RADIOS; i++) {
+			if (LINK_STORAGE.ed_radio[i].radio != LINK_NO_RADIO
+					&& array_cmp (LINK_STORAGE.ed_radio[i].ed, address))
+				return LINK_STORAGE.ed_radio[i].radio;
 		}
+		return 0;
 	}
-	return free_index;
+	uint8_t cid = LINK_cid_mask (*address);
+	if (LINK_STORAGE.coord_radio_assigned[cid] != LINK_NO_RADIO)
+		return LINK_STORAGE.coord_radio_assigned[cid];
+	if (LINK_STORAGE.coord_radio[cid] != LINK_NO_RADIO)
+		return LINK_STORAGE.coord_radio[cid];
+	return 0;
 }
 
 /**
- * Searches a free index in RX buffer.
- * @return Returns a free index in RX buffer or invalid index in case of
- * full RX buffer.
+ * Remembers radio on which sender of packet was heard.
+ * @param data 	Packet.
+ * @param radio Radio index.
  */
-uint8_t get_free_index_rx ()
+void learn_radio (uint8_t* data, uint8_t radio)
 {
-	uint8_t free_index = LINK_RX_BUFFER_SIZE;
-
-	for (uint8_t i = 0; i < LINK_RX_BUFFER_SIZE; i++) {
-		if (LINK_STORAGE.rx_buffer[i].empty) {
-			free_index = i;
-			break;
+	if (!(data[0] & LINK_ED_TO_COORD)) {
+		LINK_STORAGE.coord_radio[LINK_cid_mask (data[6])] = radio;
+		return;
+	}
+	uint8_t index = LINK_STORAGE.ed_radio_next;
+	for (uint8_t i = 0; i < LINK_ED_RADIOS; i++) {
+		if (LINK_STORAGE.ed_radio[i].radio != LINK_NO_RADIO
+				&& array_cmp (LINK_STORAGE.ed_radio[i].ed, data + 6)) {
+			LINK_STORAGE.ed_radio[i].radio = radio;
+			return;
 		}
+		if (LINK_STORAGE.ed_radio[i].radio == LINK_NO_RADIO)
+			index = i;
 	}
-	return free_index;
+	// table is full, records are replaced in round robin
+	if (index == LINK_STORAGE.ed_radio_next)
+		LINK_STORAGE.ed_radio_next = (LINK_STORAGE.ed_radio_next + 1) % LINK_ED_RADIOS;
+	array_copy (data + 6, LINK_STORAGE.ed_radio[index].ed, EDID_LENGTH);
+	LINK_STORAGE.ed_radio[index].radio = radio;
+}
+
+/**
+ * Sends packet by radio which reaches neighbour, coordinator is reached
+ * at bitrate on which it listens.
+ * @param to_ed 		True if neighbour is end device, false otherwise.
+ * @param address 	Coordinator ID or end device ID.
+ * @param packet 		Packet.
+ * @param len 			Packet length.
+ * @return Returns identifier of frame in TX queue.
+ */
+uint32_t send_packet (bool to_ed, uint8_t* address, uint8_t* packet, uint8_t len)
+{
+	uint8_t bitrate = to_ed ? PHY_BITRATE_BASE
+		: LINK_STORAGE.rates[LINK_cid_mask (*address)].listening;
+	return PHY_send_at_bitrate (radio_of (to_ed, address), packet, len, true, bitrate);
 }
 
 /**
@@ -227,9 +534,10 @@ void gen_header (uint8_t* header, bool as_ed, bool to_ed,
  * @param payload										Payload.
  * @param len												Payload length.
  * @param transfer_type 						Transfer type on link layer.
+ * @return Returns identifier of frame in TX queue.
  */
-void send_data (bool as_ed, bool to_ed, uint8_t* address, uint8_t* payload,
-								uint8_t len, uint8_t transfer_type)
+uint32_t send_data (bool as_ed, bool to_ed, uint8_t* address, uint8_t* payload,
+										uint8_t len, uint8_t transfer_type)
 {
 	uint8_t packet[MAX_PHY_PAYLOAD_SIZE];
 	gen_header (packet, as_ed, to_ed, address, LINK_DATA_TYPE,
@@ -239,7 +547,7 @@ void send_data (bool as_ed, bool to_ed, uint8_t* address, uint8_t* payload,
 	for (uint8_t i = 0; i < len; i++)
 		packet[packet_index++] = payload[i];
 	D_LINK printf ("send_data()\n");
-	PHY_send_with_cca (packet, packet_index);
+	return send_packet (to_ed, address, packet, packet_index);
 }
 
 /**
@@ -255,7 +563,7 @@ void send_ack (bool as_ed, bool to_ed, uint8_t* address, uint8_t transfer_type)
 	gen_header (ack_packet, as_ed, to_ed, address, LINK_ACK_TYPE,
 							transfer_type);
 	D_LINK printf ("send_ack()\n");
-	PHY_send_with_cca (ack_packet, LINK_HEADER_SIZE);
+	send_packet (to_ed, address, ack_packet, LINK_HEADER_SIZE);
 }
 
 /**
@@ -263,14 +571,15 @@ void send_ack (bool as_ed, bool to_ed, uint8_t* address, uint8_t transfer_type)
  * @param as_ed 										True if device sends packet as end device ID, false otherwise.
  * @param to_ed 										True if device sends packet to end device ID, false otherwise.
  * @param address 									Destination coordinator ID or end device ID.
+ * @return Returns identifier of frame in TX queue.
  */
-void send_commit (bool as_ed, bool to_ed, uint8_t* address)
+uint32_t send_commit (bool as_ed, bool to_ed, uint8_t* address)
 {
 	uint8_t commit_packet[LINK_HEADER_SIZE];
 	gen_header (commit_packet, as_ed, to_ed, address, LINK_COMMIT_TYPE,
 							LINK_DATA_HS4);
 	D_LINK printf ("send_commit()\n");
-	PHY_send_with_cca (commit_packet, LINK_HEADER_SIZE);
+	return send_packet (to_ed, address, commit_packet, LINK_HEADER_SIZE);
 }
 
 /**
@@ -285,7 +594,7 @@ void send_commit_ack (bool as_ed, bool to_ed, uint8_t* address)
 	gen_header (commit_ack_packet, as_ed, to_ed, address, LINK_COMMIT_ACK_TYPE,
 							LINK_DATA_HS4);
 	D_LINK printf ("send_commit_ack()\n");
-	PHY_send_with_cca (commit_ack_packet, LINK_HEADER_SIZE);
+	send_packet (to_ed, address, commit_ack_packet, LINK_HEADER_SIZE);
 }
 
 /**
@@ -299,121 +608,881 @@ void send_busy_ack (bool as_ed, bool to_ed, uint8_t* address)
 	uint8_t ack_packet[LINK_HEADER_SIZE];
 	gen_header (ack_packet, as_ed, to_ed, address, LINK_ACK_TYPE, LINK_BUSY);
 	D_LINK printf ("send_busy_ack()\n");
-	PHY_send_with_cca (ack_packet, LINK_HEADER_SIZE);
+	send_packet (to_ed, address, ack_packet, LINK_HEADER_SIZE);
+}
+
+/**
+ * Gets DATA_RATE_* value of bitrate.
+ * @param bitrate 	Bitrate or PHY_BITRATE_BASE.
+ * @return Returns DATA_RATE_* value.
+ */
+uint8_t rate_value (uint8_t bitrate)
+{
+	return bitrate == PHY_BITRATE_BASE ? LINK_STORAGE.base_bitrate : bitrate;
+}
+
+/**
+ * Checks if channel of radio exists at bitrate.
+ * @param radio 		Radio index.
+ * @param bitrate 	Bitrate.
+ * @return Returns true if bitrate can be used by radio, false otherwise.
+ */
+bool rate_allowed (uint8_t radio, uint8_t bitrate)
+{
+	return PHY_get_radio_channel (radio) < PHY_channel_amount (LINK_STORAGE.band, bitrate);
+}
+
+/**
+ * Selects bitrate for transmission to coordinator. The first attempt uses
+ * bitrate with the best throughput or samples another bitrate, the second
+ * one bitrate with the best probability, the next ones bitrate of PHY_init.
+ * @param cid 			Coordinator ID.
+ * @param radio 		Radio which reaches coordinator.
+ * @param attempt 	Number of unsuccessful transmissions.
+ * @return Returns bitrate or PHY_BITRATE_BASE.
+ */
+uint8_t rate_select (uint8_t cid, uint8_t radio, uint8_t attempt)
+{
+	LINK_rate_t *rate = &LINK_STORAGE.rates[cid];
+	uint8_t bitrate = LINK_STORAGE.base_bitrate;
+
+	if (attempt == 0) {
+		bitrate = rate->best_throughput;
+		if (++rate->exchanges % LINK_RATE_SAMPLE_INTERVAL == 0) {
+			uint32_t best = (uint32_t) rate->probability[bitrate] * LINK_RATE_KBPS[bitrate];
+			for (uint8_t i = 0; i < LINK_RATE_COUNT; i++) {
+				rate->sample = (rate->sample + 1) % LINK_RATE_COUNT;
+				// bitrate which is worse even without losses is not sampled
+				if (rate->sample != bitrate && rate_allowed (radio, rate->sample)
+						&& (uint32_t) 1000 * LINK_RATE_KBPS[rate->sample] > best) {
+					bitrate = rate->sample;
+					break;
+				}
+			}
+		}
+	}
+	else if (attempt == 1) {
+		bitrate = rate->best_probability;
+	}
+	if (!rate_allowed (radio, bitrate))
+		bitrate = LINK_STORAGE.base_bitrate;
+	return bitrate == LINK_STORAGE.base_bitrate ? PHY_BITRATE_BASE : bitrate;
+}
+
+/**
+ * Records result of transmission to coordinator.
+ * @param cid 			Coordinator ID.
+ * @param bitrate 	Bitrate of transmission.
+ * @param success 	True if frame was acknowledged, false otherwise.
+ */
+void rate_result (uint8_t cid, uint8_t bitrate, bool success)
+{
+	LINK_rate_t *rate = &LINK_STORAGE.rates[cid];
+
+	bitrate = rate_value (bitrate);
+	rate->attempts[bitrate]++;
+	rate->total_attempts[bitrate]++;
+	if (success) {
+		rate->successes[bitrate]++;
+		rate->total_successes[bitrate]++;
+	}
+}
+
+/**
+ * Updates success probabilities of bitrates (EWMA) and selects the best ones.
+ */
+void rate_update ()
+{
+	for (uint8_t cid = 0; cid < MAX_COORD; cid++) {
+		LINK_rate_t *rate = &LINK_STORAGE.rates[cid];
+		uint32_t best_throughput = 0;
+		uint16_t best_probability = 0;
+
+		rate->best_throughput = LINK_STORAGE.base_bitrate;
+		rate->best_probability = LINK_STORAGE.base_bitrate;
+		for (uint8_t i = 0; i < LINK_RATE_COUNT; i++) {
+			if (rate->attempts[i] > 0) {
+				uint16_t probability = (uint32_t) rate->successes[i] * 1000 / rate->attempts[i];
+				// the first period is taken as it is
+				if (rate->total_attempts[i] == rate->attempts[i])
+					rate->probability[i] = probability;
+				else
+					rate->probability[i] = ((uint32_t) rate->probability[i] * 75 + probability * 25) / 100;
+				rate->attempts[i] = 0;
+				rate->successes[i] = 0;
+			}
+			uint32_t throughput = (uint32_t) rate->probability[i] * LINK_RATE_KBPS[i];
+			if (throughput > best_throughput) {
+				best_throughput = throughput;
+				rate->best_throughput = i;
+			}
+			// equal probability prefers faster bitrate
+			if (rate->probability[i] > 0 && rate->probability[i] >= best_probability) {
+				best_probability = rate->probability[i];
+				rate->best_probability = i;
+			}
+		}
+	}
+}
+
+/**
+ * Switches coordinator of TX buffer record to bitrate. RATE SWITCH is sent
+ * at bitrate on which coordinator listens, the next packets at the new one.
+ * @param index 		Index of TX buffer record.
+ * @param bitrate 	Bitrate or PHY_BITRATE_BASE.
+ */
+void rate_switch (uint16_t index, uint8_t bitrate)
+{
+	LINK_tx_buffer_record_t *record = &LINK_STORAGE.tx_buffer[index];
+	LINK_rate_t *rate = &LINK_STORAGE.rates[LINK_cid_mask (record->address.coord)];
+
+	record->bitrate = bitrate;
+	if (bitrate == rate->listening)
+		return;
+	uint8_t packet[LINK_HEADER_SIZE + 1];
+	gen_header (packet, false, false, &record->address.coord, LINK_DATA_TYPE,
+							LINK_RATE_SWITCH);
+	packet[LINK_HEADER_SIZE] = rate_value (bitrate);
+	D_LINK printf ("S: RATE SWITCH to COORD (%d)\n", packet[LINK_HEADER_SIZE]);
+	send_packet (false, &record->address.coord, packet, sizeof (packet));
+	rate->listening = bitrate;
+}
+
+/**
+ * Starts bitrate adaptation of four-way handshake with coordinator. Radio is
+ * adapted for one coordinator at a time, other exchanges run at bitrate
+ * on which their coordinators listen.
+ * @param index 	Index of TX buffer record.
+ */
+void rate_start (uint16_t index)
+{
+	LINK_tx_buffer_record_t *record = &LINK_STORAGE.tx_buffer[index];
+
+	record->rate_control = 0;
+	record->attempt = 0;
+	if (record->address_type) {
+		record->bitrate = PHY_BITRATE_BASE;
+		return;
+	}
+	uint8_t cid = LINK_cid_mask (record->address.coord);
+	uint8_t radio = radio_of (false, &record->address.coord);
+	record->bitrate = LINK_STORAGE.rates[cid].listening;
+	if (!LINK_STORAGE.rate_control || LINK_STORAGE.rate_window[radio] != LINK_NO_COORD)
+		return;
+	LINK_STORAGE.rate_window[radio] = cid;
+	record->rate_control = 1;
+	rate_switch (index, rate_select (cid, radio, 0));
+}
+
+/**
+ * Handles unsuccessful transmission of DATA or COMMIT, next attempt falls
+ * back to more reliable bitrate.
+ * @param index 	Index of TX buffer record.
+ */
+void rate_retry (uint16_t index)
+{
+	LINK_tx_buffer_record_t *record = &LINK_STORAGE.tx_buffer[index];
+
+	if (!record->rate_control)
+		return;
+	uint8_t cid = LINK_cid_mask (record->address.coord);
+	rate_result (cid, record->bitrate, false);
+	record->attempt++;
+	rate_switch (index, rate_select (cid, radio_of (false, &record->address.coord),
+																	 record->attempt));
+}
+
+/**
+ * Handles acknowledged DATA or COMMIT.
+ * @param index 	Index of TX buffer record.
+ */
+void rate_acked (uint16_t index)
+{
+	LINK_tx_buffer_record_t *record = &LINK_STORAGE.tx_buffer[index];
+
+	if (!record->rate_control)
+		return;
+	rate_result (LINK_cid_mask (record->address.coord), record->bitrate, true);
+	record->attempt = 0;
+}
+
+/**
+ * Finishes bitrate adaptation of four-way handshake. Coordinator returns
+ * to bitrate of PHY_init after COMMIT ACK (ACK of two-way handshake) by
+ * itself, otherwise it is switched back explicitly.
+ * @param index 	Index of TX buffer record.
+ * @param success True if four-way handshake was finished, false otherwise.
+ */
+void rate_finish (uint16_t index, bool success)
+{
+	LINK_tx_buffer_record_t *record = &LINK_STORAGE.tx_buffer[index];
+
+	if (!record->rate_control)
+		return;
+	record->rate_control = 0;
+	uint8_t cid = LINK_cid_mask (record->address.coord);
+	if (!success)
+		rate_switch (index, PHY_BITRATE_BASE);
+	LINK_STORAGE.rates[cid].listening = PHY_BITRATE_BASE;
+	for (uint8_t radio = 0; radio < PHY_MAX_RADIOS; radio++) {
+		if (LINK_STORAGE.rate_window[radio] != cid)
+			continue;
+		LINK_STORAGE.rate_window[radio] = LINK_NO_COORD;
+		// radio listens at bitrate of PHY_init again
+		PHY_send_at_bitrate (radio, NULL, 0, false, PHY_BITRATE_BASE);
+	}
+}
+
+/**
+ * Sends DATA of TX buffer record.
+ * @param index 	Index of TX buffer record.
+ */
+void send_tx_data (uint16_t index)
+{
+	LINK_tx_buffer_record_t *record = &LINK_STORAGE.tx_buffer[index];
+	uint8_t *payload = record->data;
+	uint8_t len = record->len;
+	uint8_t two_way[MAX_LINK_PAYLOAD_SIZE];
+
+	// sequence number precedes payload of two-way handshake
+	if (record->transfer_type == LINK_DATA_HS2) {
+		two_way[0] = record->seq;
+		for (uint8_t i = 0; i < record->len; i++)
+			two_way[LINK_HS2_HEADER_SIZE + i] = record->data[i];
+		payload = two_way;
+		len += LINK_HS2_HEADER_SIZE;
+	}
+	if (record->address_type)
+		set_phy_frame (index, send_data (false, true, record->address.ed, payload,
+																		 len, record->transfer_type));
+	else
+		set_phy_frame (index, send_data (false, false, &record->address.coord, payload,
+																		 len, record->transfer_type));
+}
+
+/**
+ * Gets sequence numbers of two-way handshakes with neighbour.
+ * @param key 	Key of neighbour.
+ * @return Returns sequence numbers of neighbour.
+ */
+LINK_seq_t *seq_of (uint64_t key)
+{
+	auto found = LINK_STORAGE.seq_index.find (key);
+	if (found != LINK_STORAGE.seq_index.end ())
+		return &found->second;
+	LINK_seq_t *seq = &LINK_STORAGE.seq_index[key];
+	*seq = LINK_seq_t ();
+	// neighbour does not take DATA of new run for duplicates
+	seq->tx_seq = PHY_monotonic_ns () >> 10;
+	return seq;
+}
+
+/**
+ * Sends ACK of two-way handshake.
+ * @param as_ed 		True if device sends packet as end device ID, false otherwise.
+ * @param to_ed 		True if device sends packet to end device ID, false otherwise.
+ * @param address 	Destination coordinator ID or end device ID.
+ * @param seq 			Sequence number of acknowledged DATA.
+ */
+void send_two_way_ack (bool as_ed, bool to_ed, uint8_t* address, uint8_t seq)
+{
+	uint8_t ack_packet[LINK_HEADER_SIZE + LINK_HS2_HEADER_SIZE];
+	gen_header (ack_packet, as_ed, to_ed, address, LINK_ACK_TYPE, LINK_DATA_HS2);
+	ack_packet[LINK_HEADER_SIZE] = seq;
+	D_LINK printf ("S: ACK of DATA %d\n", seq);
+	send_packet (to_ed, address, ack_packet, sizeof (ack_packet));
+}
+
+/**
+ * Checks if DATA of two-way handshake are new, they are remembered then.
+ * Sender can have several DATA in flight, ACK of older one can be lost
+ * after newer one was accepted, so the last LINK_DUPLICATE_WINDOW sequence
+ * numbers are remembered.
+ * @param key 	Key of sender.
+ * @param seq 	Sequence number of DATA.
+ * @return Returns false if DATA were already accepted, true otherwise.
+ */
+bool two_way_accept (uint64_t key, uint8_t seq)
+{
+	LINK_seq_t *record = seq_of (key);
+	uint64_t now = now_ms ();
+	uint8_t behind = record->rx_seq - seq;
+	uint8_t ahead = seq - record->rx_seq;
+
+	// repeated DATA cannot come after retransmissions of sender
+	if (!record->rx_valid || now >= record->rx_expiration) {
+		record->rx_mask = 1;
+		record->rx_seq = seq;
+	}
+	else if (behind < LINK_DUPLICATE_WINDOW) {
+		if (record->rx_mask & (1 << behind))
+			return false;
+		record->rx_mask |= 1 << behind;
+	}
+	else {
+		// DATA far behind come from restarted sender, they start again
+		record->rx_mask = ahead < LINK_DUPLICATE_WINDOW ? record->rx_mask << ahead | 1 : 1;
+		record->rx_seq = seq;
+	}
+	record->rx_valid = 1;
+	record->rx_expiration = now + LINK_STORAGE.duplicate_timeout;
+	return true;
+}
+
+/**
+ * Gets round-trip time estimation of neighbour.
+ * @param key 	Key of neighbour.
+ * @return Returns round-trip time estimation of neighbour.
+ */
+LINK_rtt_t *rtt_of (uint64_t key)
+{
+	auto found = LINK_STORAGE.rtt_index.find (key);
+	if (found != LINK_STORAGE.rtt_index.end ())
+		return &found->second;
+	LINK_rtt_t *rtt = &LINK_STORAGE.rtt_index[key];
+	*rtt = LINK_rtt_t ();
+	rtt->rto_ms = LINK_RTO_INITIAL_MS;
+	return rtt;
+}
+
+/**
+ * Gets retransmission timeout of neighbour including backoff.
+ * @param key 	Key of neighbour.
+ * @return Returns retransmission timeout (ms).
+ */
+uint32_t rtt_timeout (uint64_t key)
+{
+	LINK_rtt_t *rtt = rtt_of (key);
+	uint32_t timeout = rtt->rto_ms << rtt->backoff;
+	return timeout > LINK_RTO_BACKOFF_MAX_MS ? LINK_RTO_BACKOFF_MAX_MS : timeout;
+}
+
+/**
+ * Gets the longest time in which retransmissions of DATA end, neighbour
+ * with the same number of retransmissions and the upper bound of RTO
+ * whose every retransmission times out is assumed.
+ * @param retries 	Maximum number of packet retransmissions.
+ * @return Returns time (ms).
+ */
+uint32_t rtt_retransmission_span (uint8_t retries)
+{
+	uint32_t span = 0;
+
+	for (uint8_t i = 0; i < retries; i++) {
+		uint32_t timeout = (uint32_t) LINK_RTO_MAX_MS << (i < LINK_RTO_MAX_BACKOFF ? i : LINK_RTO_MAX_BACKOFF);
+		span += timeout > LINK_RTO_BACKOFF_MAX_MS ? LINK_RTO_BACKOFF_MAX_MS : timeout;
+	}
+	return span;
+}
+
+/**
+ * Updates round-trip time estimation of neighbour (Jacobson/Karels),
+ * backoff ends with the first valid sample.
+ * @param key 			Key of neighbour.
+ * @param sent_at 	Time of acknowledged DATA or COMMIT (ns).
+ */
+void rtt_sample (uint64_t key, uint64_t sent_at)
+{
+	LINK_rtt_t *rtt = rtt_of (key);
+	uint64_t now = PHY_monotonic_ns ();
+	uint32_t sample = now > sent_at ? (now - sent_at) / 1000 : 0;
+
+	if (rtt->samples == 0) {
+		rtt->srtt_us = sample;
+		rtt->rttvar_us = sample / 2;
+		rtt->min_us = sample;
+		rtt->max_us = sample;
+	}
+	else {
+		uint32_t error = rtt->srtt_us > sample ? rtt->srtt_us - sample : sample - rtt->srtt_us;
+		rtt->rttvar_us = rtt->rttvar_us - rtt->rttvar_us / 4 + error / 4;
+		rtt->srtt_us = rtt->srtt_us - rtt->srtt_us / 8 + sample / 8;
+		if (sample < rtt->min_us)
+			rtt->min_us = sample;
+		if (sample > rtt->max_us)
+			rtt->max_us = sample;
+	}
+	rtt->samples++;
+	rtt->backoff = 0;
+	uint32_t rto = (rtt->srtt_us + 4 * rtt->rttvar_us + 999) / 1000;
+	if (rto < LINK_RTO_MIN_MS)
+		rto = LINK_RTO_MIN_MS;
+	else if (rto > LINK_RTO_MAX_MS)
+		rto = LINK_RTO_MAX_MS;
+	rtt->rto_ms = rto;
+	D_LINK printf ("RTT %u us, SRTT %u us, RTTVAR %u us, RTO %u ms\n", sample, rtt->srtt_us,
+								 rtt->rttvar_us, rto);
+}
+
+/**
+ * Doubles retransmission timeout of neighbour after timeout.
+ * @param key 	Key of neighbour.
+ */
+void rtt_backoff (uint64_t key)
+{
+	LINK_rtt_t *rtt = rtt_of (key);
+
+	rtt->timeouts++;
+	if (rtt->backoff < LINK_RTO_MAX_BACKOFF)
+		rtt->backoff++;
+}
+
+/**
+ * Sets retransmission deadline of TX buffer record whose DATA or COMMIT
+ * was queued, it is restarted when frame leaves radio. Retransmissions give
+ * no round-trip time sample (Karn's rule), their ACK can belong to the
+ * previous transmission.
+ * @param index 		Index of TX buffer record.
+ * @param timed 		True if packet was sent for the first time, false otherwise.
+ */
+void tx_sent (uint16_t index, bool timed)
+{
+	LINK_tx_buffer_record_t *record = &LINK_STORAGE.tx_buffer[index];
+
+	record->timed = timed;
+	record->sent_at = PHY_monotonic_ns ();
+	arm_timer (index, &record->deadline, record->sent_at / 1000000
+		+ rtt_timeout (neighbour_key (record->address_type, record->address.ed)));
+}
+
+/**
+ * Restarts round-trip time measurement and retransmission deadline of
+ * TX buffer record or window when its DATA or COMMIT left radio, time
+ * spent in TX queue is not a part of round-trip time.
+ * @param index 	Index of TX buffer record.
+ * @param id 			Identifier of sent frame.
+ */
+void tx_departed (uint16_t index, uint32_t id)
+{
+	LINK_tx_buffer_record_t *record = &LINK_STORAGE.tx_buffer[index];
+	uint64_t key = neighbour_key (record->address_type, record->address.ed);
+
+	if (record->empty)
+		return;
+	if (record->windowed) {
+		auto found = LINK_STORAGE.tx_index.find (key);
+		if (found == LINK_STORAGE.tx_index.end ())
+			return;
+		LINK_tx_queue_t *queue = &found->second;
+		if (!queue->commit_sent || queue->commit_frame != id || queue->deadline == 0)
+			return;
+		queue->sent_at = PHY_monotonic_ns ();
+		arm_timer (LINK_TIMER_WINDOW | key, &queue->deadline,
+							 queue->sent_at / 1000000 + rtt_timeout (key));
+		return;
+	}
+	// ACK came already or frame was replaced by retransmission
+	if (record->phy_frame != id || record->deadline == 0)
+		return;
+	record->sent_at = PHY_monotonic_ns ();
+	arm_timer (index, &record->deadline, record->sent_at / 1000000 + rtt_timeout (key));
+}
+
+/**
+ * Updates round-trip time of neighbour by acknowledged TX buffer record.
+ * @param index 	Index of TX buffer record.
+ */
+void tx_acked (uint16_t index)
+{
+	LINK_tx_buffer_record_t *record = &LINK_STORAGE.tx_buffer[index];
+
+	if (!record->timed)
+		return;
+	record->timed = 0;
+	rtt_sample (neighbour_key (record->address_type, record->address.ed), record->sent_at);
+}
+
+/**
+ * Starts four-way handshake of TX buffer record.
+ * @param index 	Index of TX buffer record.
+ */
+void start_tx (uint16_t index)
+{
+	LINK_tx_buffer_record_t *record = &LINK_STORAGE.tx_buffer[index];
+
+	record->waiting = 0;
+	record->state = DATA_SENT;
+	record->transmits_to_error = LINK_STORAGE.tx_max_retries;
+	// retransmissions keep sequence number, neighbour acknowledges them only
+	if (record->transfer_type == LINK_DATA_HS2)
+		record->seq = seq_of (neighbour_key (record->address_type, record->address.ed))->tx_seq++;
+	rate_start (index);
+	send_tx_data (index);
+	tx_sent (index, true);
+}
+
+/**
+ * Checks if sequence number of window precedes another one.
+ * @param seq 		Sequence number.
+ * @param other 	Another sequence number.
+ * @return Returns true if seq precedes other, false otherwise.
+ */
+bool seq_before (uint8_t seq, uint8_t other)
+{
+	return (uint8_t) (other - seq - 1) < 128;
+}
+
+/**
+ * Sends windowed DATA of TX buffer record. Sequence number of DATA and
+ * the oldest unacknowledged sequence number of window precede payload.
+ * @param index 	Index of TX buffer record.
+ * @param base 		The oldest unacknowledged sequence number.
+ */
+void send_window_data (uint16_t index, uint8_t base)
+{
+	LINK_tx_buffer_record_t *record = &LINK_STORAGE.tx_buffer[index];
+	uint8_t payload[MAX_LINK_PAYLOAD_SIZE];
+
+	payload[0] = record->seq;
+	payload[1] = base;
+	for (uint8_t i = 0; i < record->len; i++)
+		payload[LINK_WINDOW_HEADER_SIZE + i] = record->data[i];
+	D_LINK printf ("S: DATA %d of window to COORD\n", record->seq);
+	set_phy_frame (index, send_data (false, false, &record->address.coord, payload,
+																	 record->len + LINK_WINDOW_HEADER_SIZE, LINK_DATA_WINDOW));
+}
+
+/**
+ * Sends queued windowed DATA of neighbour until window is full.
+ * @param queue 	TX buffer records of neighbour.
+ */
+void window_fill (LINK_tx_queue_t *queue)
+{
+	LINK_tx_buffer_record_t *head = &LINK_STORAGE.tx_buffer[queue->first];
+	uint8_t *seq = &LINK_STORAGE.window_seq[LINK_cid_mask (head->address.coord)];
+	uint8_t base = head->waiting ? *seq : head->seq;
+
+	queue->window = 0;
+	for (uint16_t i = queue->first; i != LINK_NO_RECORD && queue->window < LINK_WINDOW_SIZE;
+			 i = LINK_STORAGE.tx_buffer[i].next) {
+		LINK_tx_buffer_record_t *record = &LINK_STORAGE.tx_buffer[i];
+		// four-way handshake waits until window is acknowledged
+		if (!record->windowed)
+			break;
+		if (record->waiting) {
+			record->waiting = 0;
+			record->seq = (*seq)++;
+			send_window_data (i, base);
+		}
+		queue->window++;
+	}
+}
+
+/**
+ * Sends COMMIT of window, neighbour acknowledges DATA received in order.
+ * @param key 		Key of neighbour.
+ * @param queue 	TX buffer records of neighbour.
+ * @param timed 	True if COMMIT ACK gives round-trip time sample, false otherwise.
+ */
+void window_commit (uint64_t key, LINK_tx_queue_t *queue, bool timed)
+{
+	LINK_tx_buffer_record_t *head = &LINK_STORAGE.tx_buffer[queue->first];
+	uint8_t packet[LINK_HEADER_SIZE + 1];
+
+	gen_header (packet, false, false, &head->address.coord, LINK_COMMIT_TYPE,
+							LINK_DATA_WINDOW);
+	packet[LINK_HEADER_SIZE] = head->seq;
+	D_LINK printf ("S: COMMIT of window %d to COORD\n", head->seq);
+	queue->commit_frame = send_packet (false, &head->address.coord, packet, sizeof (packet));
+	// result of COMMIT is matched to the first record of window
+	if (queue->commit_frame != 0)
+		LINK_STORAGE.frame_index[queue->commit_frame] = queue->first;
+	queue->commit_sent = 1;
+	queue->commit_seq = head->seq;
+	queue->timed = timed;
+	queue->sent_at = PHY_monotonic_ns ();
+	arm_timer (LINK_TIMER_WINDOW | key, &queue->deadline,
+						 queue->sent_at / 1000000 + rtt_timeout (key));
+}
+
+/**
+ * Starts window of neighbour. COMMIT is sent when window is full,
+ * otherwise after LINK_WINDOW_DELAY_MS, so DATA sent meanwhile share it.
+ * @param key 		Key of neighbour.
+ * @param queue 	TX buffer records of neighbour.
+ */
+void window_start (uint64_t key, LINK_tx_queue_t *queue)
+{
+	queue->transmits_to_error = LINK_STORAGE.tx_max_retries;
+	queue->commit_sent = 0;
+	window_fill (queue);
+	if (queue->window == LINK_WINDOW_SIZE)
+		window_commit (key, queue, true);
+	else
+		arm_timer (LINK_TIMER_WINDOW | key, &queue->deadline, now_ms () + LINK_WINDOW_DELAY_MS);
+}
+
+/**
+ * Starts the first TX buffer record of neighbour.
+ * @param key 		Key of neighbour.
+ * @param queue 	TX buffer records of neighbour.
+ */
+void start_queue (uint64_t key, LINK_tx_queue_t *queue)
+{
+	if (LINK_STORAGE.tx_buffer[queue->first].windowed)
+		window_start (key, queue);
+	else
+		start_tx (queue->first);
+}
+
+/**
+ * Drops all TX buffer records of unavailable neighbour.
+ * @param key 	Key of neighbour.
+ */
+void drop_queue (uint64_t key)
+{
+	auto queue = LINK_STORAGE.tx_index.find (key);
+	if (queue == LINK_STORAGE.tx_index.end ())
+		return;
+	for (uint16_t j = queue->second.first; j != LINK_NO_RECORD; ) {
+		uint16_t next = LINK_STORAGE.tx_buffer[j].next;
+		rate_finish (j, false);
+		free_tx (j);
+		j = next;
+	}
+	cancel_timer (LINK_TIMER_WINDOW | key, &queue->second.deadline);
+	LINK_STORAGE.tx_index.erase (queue);
+}
+
+/**
+ * Processes COMMIT ACK of window. DATA preceding the next expected
+ * sequence number are delivered, the rest of window is resent on timeout.
+ * Only COMMIT ACK acknowledging DATA beyond the cumulative point of the
+ * last COMMIT gives round-trip time sample, older one can answer previous
+ * COMMIT.
+ * @param key 	Key of neighbour.
+ * @param next 	Sequence number expected by neighbour.
+ */
+void window_acked (uint64_t key, uint8_t next)
+{
+	auto found = LINK_STORAGE.tx_index.find (key);
+	if (found == LINK_STORAGE.tx_index.end ())
+		return;
+	LINK_tx_queue_t *queue = &found->second;
+	uint8_t acked = 0;
+
+	if (queue->commit_sent && queue->timed && seq_before (queue->commit_seq, next)) {
+		queue->timed = 0;
+		rtt_sample (key, queue->sent_at);
+	}
+	while (queue->window > 0) {
+		uint16_t i = queue->first;
+		LINK_tx_buffer_record_t *record = &LINK_STORAGE.tx_buffer[i];
+		if (!seq_before (record->seq, next))
+			break;
+		queue->first = record->next;
+		queue->window--;
+		free_tx (i);
+		acked++;
+	}
+	if (queue->window == 0)
+		cancel_timer (LINK_TIMER_WINDOW | key, &queue->deadline);
+	if (queue->first == LINK_NO_RECORD) {
+		LINK_STORAGE.tx_index.erase (found);
+	}
+	else if (acked > 0) {
+		if (LINK_STORAGE.tx_buffer[queue->first].windowed) {
+			// window moves, DATA in flight and the new ones share COMMIT
+			queue->transmits_to_error = LINK_STORAGE.tx_max_retries;
+			window_fill (queue);
+			window_commit (key, queue, true);
+		}
+		else if (queue->window == 0) {
+			start_tx (queue->first);
+		}
+	}
+	D_LINK printf ("R: COMMIT ACK of window, %d DATA delivered\n", acked);
+	// layers above can send again, buffers are consistent
+	for (uint8_t i = 0; i < acked; i++)
+		LINK_notify_send_done ();
+}
+
+/**
+ * Retransmits window whose COMMIT ACK did not come, window waiting
+ * for more DATA gets its COMMIT.
+ * @param key 	Key of neighbour.
+ */
+void window_expired (uint64_t key)
+{
+	auto found = LINK_STORAGE.tx_index.find (key);
+	if (found == LINK_STORAGE.tx_index.end ())
+		return;
+	LINK_tx_queue_t *queue = &found->second;
+
+	queue->deadline = 0;
+	if (queue->window == 0)
+		return;
+	if (!queue->commit_sent) {
+		window_commit (key, queue, true);
+		return;
+	}
+	if ((queue->transmits_to_error--) == 0) {
+		LINK_error_handler_coord ();
+		drop_queue (key);
+		return;
+	}
+	D_LINK printf("Window again!\n");
+	rtt_backoff (key);
+	// go back to the oldest unacknowledged DATA
+	uint16_t i = queue->first;
+	uint8_t base = LINK_STORAGE.tx_buffer[i].seq;
+	for (uint8_t n = 0; n < queue->window; n++, i = LINK_STORAGE.tx_buffer[i].next)
+		send_window_data (i, base);
+	window_commit (key, queue, false);
+}
+
+/**
+ * Finishes four-way handshake of TX buffer record, the next packet
+ * for the same neighbour is sent.
+ * @param index 	Index of TX buffer record.
+ */
+void finish_tx (uint16_t index)
+{
+	LINK_tx_buffer_record_t *record = &LINK_STORAGE.tx_buffer[index];
+	uint64_t key = neighbour_key (record->address_type, record->address.ed);
+	uint16_t next = record->next;
+
+	free_tx (index);
+	if (next == LINK_NO_RECORD) {
+		LINK_STORAGE.tx_index.erase (key);
+		return;
+	}
+	LINK_tx_queue_t *queue = &LINK_STORAGE.tx_index[key];
+	queue->first = next;
+	start_queue (key, queue);
+}
+
+/**
+ * Processes ACK of two-way handshake, the next packet for the same
+ * neighbour is sent.
+ * @param key 	Key of neighbour.
+ * @param seq 	Sequence number of acknowledged DATA.
+ */
+void two_way_acked (uint64_t key, uint8_t seq)
+{
+	auto queue = LINK_STORAGE.tx_index.find (key);
+	if (queue == LINK_STORAGE.tx_index.end ())
+		return;
+	uint16_t i = queue->second.first;
+	LINK_tx_buffer_record_t *record = &LINK_STORAGE.tx_buffer[i];
+	// ACK of previous DATA came late
+	if (record->transfer_type != LINK_DATA_HS2 || record->waiting || record->seq != seq)
+		return;
+	bool to_coord = !record->address_type;
+	D_LINK printf ("R: ACK of DATA %d\n", seq);
+	rate_acked (i);
+	tx_acked (i);
+	rate_finish (i, true);
+	finish_tx (i);
+	if (to_coord)
+		LINK_notify_send_done ();
 }
 
 /**
  * Processes packet for coordinator and routes it towards destination.
+ * Handshake state of sender is found by its address.
  * @param data 	Data.
  * @param len 	Data length.
+ * @param info 	Metadata of received frame.
  * @return Returns false if packet is BUSY ACK,
  *				 if the packet has been already stored in RX buffer
  *				 or if the packet is not successfully sent, true otherwise.
  */
-bool router_process_packet (uint8_t* data, uint8_t len)
+bool router_process_packet (uint8_t* data, uint8_t len, const struct PHY_rx_info_t *info)
 {
 	uint8_t packet_type = data[0] >> 6;
 	uint8_t transfer_type = data[0] & 0x0f;
+	uint8_t sender_address_type = (data[0] & LINK_ED_TO_COORD) ? 1 : 0;
+	uint64_t key = neighbour_key (sender_address_type, data + 6);
 	D_LINK printf("router_process_packet()\n");
+	// windows are sent by PAN, only their COMMIT ACK comes back
+	if (transfer_type == LINK_DATA_WINDOW) {
+		if (packet_type == LINK_COMMIT_ACK_TYPE && !sender_address_type && len > LINK_HEADER_SIZE)
+			window_acked (key, data[LINK_HEADER_SIZE]);
+		return true;
+	}
+	// two-way handshake is finished by ACK
+	if (transfer_type == LINK_DATA_HS2 && packet_type == LINK_ACK_TYPE) {
+		if (len > LINK_HEADER_SIZE)
+			two_way_acked (key, data[LINK_HEADER_SIZE]);
+		return true;
+	}
 	// processing of ACK packet
 	if (packet_type == LINK_ACK_TYPE) {
 		D_LINK printf ("ACK\n");
-		if (data[0] & LINK_ED_TO_COORD) {
+		auto queue = LINK_STORAGE.tx_index.find (key);
+		// DATA for sender is not in TX buffer
+		if (queue == LINK_STORAGE.tx_index.end ())
+			return true;
+		uint16_t i = queue->second.first;
+		LINK_tx_buffer_record_t *record = &LINK_STORAGE.tx_buffer[i];
+		// only BUSY ACK belongs to two-way handshake or window
+		if ((record->windowed || record->transfer_type == LINK_DATA_HS2)
+				&& transfer_type != LINK_BUSY)
+			return true;
+		if (sender_address_type)
 			D_LINK printf ("R: ACK to COORD\n");
-			for (uint8_t i = 0; i < LINK_TX_BUFFER_SIZE; i++) {
-				// if some DATA message for ED is in TX buffer and address is the same,
-				// COMMIT message can be sent
-				if (!LINK_STORAGE.tx_buffer[i].empty) {
-					if (LINK_STORAGE.tx_buffer[i].address_type == 1
-							&& array_cmp (LINK_STORAGE.tx_buffer[i].address.ed, data + 6)) {
-							// it is not BUSY ACK packet, switch state and send COMMIT packet
-							if (transfer_type != LINK_BUSY) {
-								LINK_STORAGE.tx_buffer[i].state = COMMIT_SENT;
-								LINK_STORAGE.tx_buffer[i].transmits_to_error = LINK_STORAGE.tx_max_retries;
-								LINK_STORAGE.tx_buffer[i].expiration_time = LINK_STORAGE.timer_counter + 2;
-								D_LINK printf ("S: COMMIT to ED\n");
-								send_commit (false, true, LINK_STORAGE.tx_buffer[i].address.ed);
-								break;
-							}
-							else {
-								// it is BUSY ACK packet, set retransmission count again and set
-								// longer timeout (receiving device is busy)
-								LINK_STORAGE.tx_buffer[i].transmits_to_error = LINK_STORAGE.tx_max_retries;
-								LINK_STORAGE.tx_buffer[i].expiration_time = LINK_STORAGE.timer_counter + 3;
-								return false;
-							}
-					}
-				}
+		// window is measured by its COMMIT ACK only
+		if (!record->windowed) {
+			rate_acked (i);
+			// repeated ACK cannot measure COMMIT
+			if (record->state == DATA_SENT)
+				tx_acked (i);
+		}
+		if (transfer_type == LINK_BUSY) {
+			// it is BUSY ACK packet, set retransmission count again and set
+			// longer timeout (receiving device is busy), window is resent whole
+			if (record->windowed) {
+				queue->second.transmits_to_error = LINK_STORAGE.tx_max_retries;
+				arm_timer (LINK_TIMER_WINDOW | key, &queue->second.deadline,
+									 now_ms () + rtt_timeout (key) * 3 / 2);
+				return false;
 			}
+			record->transmits_to_error = LINK_STORAGE.tx_max_retries;
+			arm_timer (i, &record->deadline, now_ms () + rtt_timeout (key) * 3 / 2);
+			return false;
+		}
+		// it is not BUSY ACK packet, switch state and send COMMIT packet
+		record->state = COMMIT_SENT;
+		record->transmits_to_error = LINK_STORAGE.tx_max_retries;
+		if (sender_address_type) {
+			D_LINK printf ("S: COMMIT to ED\n");
+			set_phy_frame (i, send_commit (false, true, record->address.ed));
+		}
+		else if (data[0] & LINK_COORD_TO_ED) {
+			D_LINK printf ("R: ACK to ED\n");
+			D_LINK printf ("S: COMMIT to COORD\n");
+			set_phy_frame (i, send_commit (true, false, &record->address.coord));
 		}
 		else {
-			for (uint8_t i = 0; i < LINK_TX_BUFFER_SIZE; i++) {
-				// if some DATA message for COORD is in buffer and address is the same,
-				// COMMIT packet can be sent
-				if (!LINK_STORAGE.tx_buffer[i].empty) {
-					if (LINK_STORAGE.tx_buffer[i].address_type == 0
-							&& LINK_STORAGE.tx_buffer[i].address.coord == data[6]) {
-							// it is not BUSY ACK packet, switch state and send COMMIT packet
-							if(transfer_type != LINK_BUSY) {
-								LINK_STORAGE.tx_buffer[i].state = COMMIT_SENT;;
-								LINK_STORAGE.tx_buffer[i].transmits_to_error = LINK_STORAGE.tx_max_retries;
-								LINK_STORAGE.tx_buffer[i].expiration_time = LINK_STORAGE.timer_counter + 2;
-								if(data[0] & LINK_COORD_TO_ED) {
-									D_LINK printf ("R: ACK to ED\n");
-									D_LINK printf ("S: COMMIT to COORD\n");
-									send_commit (true, false,
-															&LINK_STORAGE.tx_buffer[i].address.coord);
-									break;
-								}
-								else {
-									D_LINK printf ("R: ACK to COORD\n");
-									D_LINK printf ("S: COMMIT to COORD\n");
-									send_commit (false, false,
-															&LINK_STORAGE.tx_buffer[i].address.coord);
-									break;
-								}
-							}
-							else {
-								// it is BUSY ACK packet, set retransmission count again and set
-								// longer timeout (receiving device is busy)
-								LINK_STORAGE.tx_buffer[i].transmits_to_error = LINK_STORAGE.tx_max_retries;
-								LINK_STORAGE.tx_buffer[i].expiration_time = LINK_STORAGE.timer_counter + 3;
-								return false;
-							}
-					}
-				}
-			}
+			D_LINK printf ("R: ACK to COORD\n");
+			D_LINK printf ("S: COMMIT to COORD\n");
+			set_phy_frame (i, send_commit (false, false, &record->address.coord));
 		}
+		tx_sent (i, true);
 	}
 	// processing of COMMIT ACK packet
 	else if (packet_type == LINK_COMMIT_ACK_TYPE) {
 		D_LINK printf ("COMMIT ACK\n");
-		if (data[0] & LINK_ED_TO_COORD) {
+		auto queue = LINK_STORAGE.tx_index.find (key);
+		if (queue == LINK_STORAGE.tx_index.end ())
+			return true;
+		uint16_t i = queue->second.first;
+		if (LINK_STORAGE.tx_buffer[i].windowed
+				|| LINK_STORAGE.tx_buffer[i].transfer_type == LINK_DATA_HS2)
+			return true;
+		// packet can be accepted
+		rate_acked (i);
+		if (LINK_STORAGE.tx_buffer[i].state == COMMIT_SENT)
+			tx_acked (i);
+		rate_finish (i, true);
+		finish_tx (i);
+		if (sender_address_type) {
 			D_LINK printf ("R: COMMIT ACK to COORD\n");
-			for (uint8_t i = 0; i < LINK_TX_BUFFER_SIZE; i++) {
-				if (!LINK_STORAGE.tx_buffer[i].empty) {
-					if (LINK_STORAGE.tx_buffer[i].address_type == 1
-							&& array_cmp (LINK_STORAGE.tx_buffer[i].address.ed, data + 6)) {
-							// packet can be accepted
-							LINK_STORAGE.tx_buffer[i].empty = 1;
-							break;
-					}
-				}
-			}
 		}
 		else {
-			for (uint8_t i = 0; i < LINK_TX_BUFFER_SIZE; i++) {
-				if (!LINK_STORAGE.tx_buffer[i].empty) {
-					if (LINK_STORAGE.tx_buffer[i].address_type == 0
-							&& LINK_STORAGE.tx_buffer[i].address.coord == data[6]) {
-							// packet can be accepted
-							LINK_STORAGE.tx_buffer[i].empty = 1;
-							D_LINK printf ("R: COMMIT ACK to ED or COORD\n");
-							LINK_notify_send_done();
-							break;
-					}
-				}
-			}
+			D_LINK printf ("R: COMMIT ACK to ED or COORD\n");
+			LINK_notify_send_done();
 		}
 	}
 	// processing of DATA packet
@@ -422,218 +1491,200 @@ bool router_process_packet (uint8_t* data, uint8_t len)
 		if (transfer_type == LINK_DATA_WITHOUT_ACK) {
 			return LINK_route (data + LINK_HEADER_SIZE, len - LINK_HEADER_SIZE, transfer_type);
 		}
+		else if (transfer_type == LINK_DATA_HS2 && len > LINK_HEADER_SIZE) {
+			bool as_ed = !sender_address_type && (data[0] & LINK_COORD_TO_ED);
+			uint8_t seq = data[LINK_HEADER_SIZE];
+			// ACK is sent for repeated DATA too, its previous ACK was lost
+			send_two_way_ack (as_ed, sender_address_type, data + 6, seq);
+			if (!two_way_accept (key, seq)) {
+				D_LINK printf ("DATA %d has been already routed!\n", seq);
+				return false;
+			}
+			LINK_save_msg_info (data + LINK_HEADER_SIZE + LINK_HS2_HEADER_SIZE,
+													len - LINK_HEADER_SIZE - LINK_HS2_HEADER_SIZE, info);
+			return LINK_route (data + LINK_HEADER_SIZE + LINK_HS2_HEADER_SIZE,
+												 len - LINK_HEADER_SIZE - LINK_HS2_HEADER_SIZE, transfer_type);
+		}
 		else if (transfer_type == LINK_DATA_HS4) {
-			for(uint8_t i = 0; i < LINK_RX_BUFFER_SIZE; i++) {
-				// some DATA are in RX buffer, verify if received packet has not been
-				// already stored in RX buffer
-				if(!LINK_STORAGE.rx_buffer[i].empty) {
-					if (LINK_STORAGE.rx_buffer[i].address_type == 1) {
-						if (array_cmp (LINK_STORAGE.tx_buffer[i].address.ed, data + 6)) {
-							D_LINK printf("ED -> COORD: DATA has been already stored!\n");
-							send_ack (false, LINK_STORAGE.rx_buffer[i].address_type, data + 6, LINK_STORAGE.rx_buffer[i].transfer_type);
-							return false;
-						}
-					}
-					else {
-						if ((LINK_STORAGE.rx_buffer[i].address.coord == data[6])) {
-							if (data[0] & LINK_COORD_TO_ED) {
-								D_LINK printf("COORD -> ED: DATA has been already stored!\n");
-								send_ack (true, LINK_STORAGE.rx_buffer[i].address_type, data + 6, LINK_STORAGE.rx_buffer[i].transfer_type);
-								return false;
-							}
-							else {
-								D_LINK printf("COORD -> COORD: DATA has been already stored!\n");
-								send_ack (false, LINK_STORAGE.rx_buffer[i].address_type, data + 6, LINK_STORAGE.rx_buffer[i].transfer_type);
-								return false;
-							}
-						}
-					}
-				}
+			// ACK to DATA for ED goes as from ED
+			bool as_ed = !sender_address_type && (data[0] & LINK_COORD_TO_ED);
+			auto stored = LINK_STORAGE.rx_index.find (key);
+			// verify if received packet has not been already stored in RX buffer
+			if (stored != LINK_STORAGE.rx_index.end ()) {
+				D_LINK printf("DATA has been already stored!\n");
+				send_ack (as_ed, sender_address_type, data + 6,
+									LINK_STORAGE.rx_buffer[stored->second].transfer_type);
+				return false;
 			}
 
-			uint8_t sender_address_type = (data[0] & LINK_ED_TO_COORD) ? 1 : 0;
-			uint8_t empty_index = get_free_index_rx ();
-
-			if (empty_index < LINK_RX_BUFFER_SIZE) {
-				// RX buffer is not full, save information about DATA packet
-				uint8_t data_index = 0;
-				for (; data_index < len && data_index < MAX_PHY_PAYLOAD_SIZE; data_index++) {
-					LINK_STORAGE.rx_buffer[empty_index].data[data_index] = data[data_index];
-				}
-				LINK_STORAGE.rx_buffer[empty_index].len = data_index;
-				LINK_STORAGE.rx_buffer[empty_index].transfer_type = transfer_type;
-				LINK_STORAGE.rx_buffer[empty_index].empty = 0;
-				LINK_STORAGE.rx_buffer[empty_index].address_type = sender_address_type;
-				if (sender_address_type) {
-					for (uint8_t i = 0; i < EDID_LENGTH; i++)
-						LINK_STORAGE.rx_buffer[empty_index].address.ed[i] = data[6 + i];
-				} else {
-					LINK_STORAGE.rx_buffer[empty_index].address.coord = LINK_cid_mask (data[6]);
-				}
-			}
-			else {
+			uint16_t empty_index = alloc_rx ();
+			if (empty_index == LINK_NO_RECORD) {
 				// RX buffer is full, send BUSY ACK packet
 				send_busy_ack (false, sender_address_type, data + 6);
 				return true;
 			}
+			// save information about DATA packet
+			LINK_rx_buffer_record_t *record = &LINK_STORAGE.rx_buffer[empty_index];
+			uint8_t data_index = 0;
+			for (; data_index < len && data_index < MAX_PHY_PAYLOAD_SIZE; data_index++) {
+				record->data[data_index] = data[data_index];
+			}
+			record->len = data_index;
+			record->transfer_type = transfer_type;
+			record->empty = 0;
+			record->address_type = sender_address_type;
+			if (sender_address_type) {
+				for (uint8_t i = 0; i < EDID_LENGTH; i++)
+					record->address.ed[i] = data[6 + i];
+			} else {
+				record->address.coord = LINK_cid_mask (data[6]);
+			}
+			LINK_STORAGE.rx_index[key] = empty_index;
 			if (sender_address_type) {
 				D_LINK printf("R: DATA to COORD\n");
-				for (uint8_t i = 0; i < LINK_RX_BUFFER_SIZE; i++) {
-					// if some DATA message for COORD from ED is in RX buffer
-					// and address is the same, ACK packet can be sent
-					if (!LINK_STORAGE.rx_buffer[i].empty) {
-						if (LINK_STORAGE.rx_buffer[i].address_type == 1
-								&& array_cmp (LINK_STORAGE.rx_buffer[i].address.ed, data + 6)) {
-							D_LINK printf("S: ACK to ED\n");
-							send_ack (false, sender_address_type, data + 6, LINK_STORAGE.rx_buffer[i].transfer_type);
-						}
-					}
-				}
+				D_LINK printf("S: ACK to ED\n");
+			}
+			else if (as_ed) {
+				D_LINK printf("R: DATA to ED\n");
+				D_LINK printf("S: ACK to COORD\n");
 			}
 			else {
-				for (uint8_t i = 0; i < LINK_RX_BUFFER_SIZE; i++) {
-					// if some DATA message for ED or COORD from COORD is in RX buffer
-					// and address is the same, ACK packet can be sent
-					if (!LINK_STORAGE.rx_buffer[i].empty) {
-						if (LINK_STORAGE.rx_buffer[i].address_type == 0
-								&& LINK_STORAGE.rx_buffer[i].address.coord == data[6]) {
-							if (data[0] & LINK_COORD_TO_ED) {
-								D_LINK printf("R: DATA to ED\n");
-								D_LINK printf("S: ACK to COORD\n");
-								send_ack (true, sender_address_type, data + 6, LINK_STORAGE.rx_buffer[i].transfer_type);
-							}
-							else {
-								D_LINK printf("R: DATA to COORD\n");
-								D_LINK printf("S: ACK to COORD\n");
-								send_ack (false, sender_address_type, data + 6, LINK_STORAGE.rx_buffer[i].transfer_type);
-							}
-						}
-					}
-				}
+				D_LINK printf("R: DATA to COORD\n");
+				D_LINK printf("S: ACK to COORD\n");
 			}
+			send_ack (as_ed, sender_address_type, data + 6, transfer_type);
 		}
 	}
 	// processing of COMMIT packet
 	else if (packet_type == LINK_COMMIT_TYPE) {
 		D_LINK printf ("COMMIT\n");
-		if (data[0] & LINK_ED_TO_COORD) {
-			D_LINK printf ("R: COMMIT to COORD\n");
-			uint8_t i = 0;
-			for (; i < LINK_RX_BUFFER_SIZE; i++) {
-				// if some DATA message for COORD from ED is in RX buffer
-				// and address is the same, COMMIT ACK packet can be sent
-				if (!LINK_STORAGE.rx_buffer[i].empty) {
-					if (LINK_STORAGE.rx_buffer[i].address_type == 1
-							&& array_cmp (LINK_STORAGE.rx_buffer[i].address.ed, data + 6)) {
-						D_LINK printf("S: COMMIT ACK to ED\n");
-						send_commit_ack (false, data[0] & LINK_ED_TO_COORD, data + 6);
-						bool result = LINK_route (LINK_STORAGE.rx_buffer[i].data + LINK_HEADER_SIZE,
-																				 LINK_STORAGE.rx_buffer[i].len - LINK_HEADER_SIZE, LINK_STORAGE.rx_buffer[i].transfer_type);
-						LINK_STORAGE.rx_buffer[i].empty = 1;
-						return result;
-					}
-				}
-			}
+		bool as_ed = !sender_address_type && (data[0] & LINK_COORD_TO_ED);
+		auto stored = LINK_STORAGE.rx_index.find (key);
+		if (stored == LINK_STORAGE.rx_index.end ()) {
 			// in case of multiple receiving of COMMIT packet send COMMIT ACK
 			// packet (COMMIT packet was not received by sender)
-			send_commit_ack (false, data[0] & LINK_ED_TO_COORD, data + 6);
+			send_commit_ack (as_ed, sender_address_type, data + 6);
+			return true;
+		}
+		// DATA from sender is in RX buffer, COMMIT ACK packet can be sent
+		LINK_rx_buffer_record_t *record = &LINK_STORAGE.rx_buffer[stored->second];
+		if (sender_address_type) {
+			D_LINK printf ("R: COMMIT to COORD\n");
+			D_LINK printf ("S: COMMIT ACK to ED\n");
+		}
+		else if (as_ed) {
+			D_LINK printf ("R: COMMIT to ED\n");
+			D_LINK printf ("S: COMMIT ACK to COORD\n");
 		}
 		else {
-			uint8_t i = 0;
-			for (; i < LINK_RX_BUFFER_SIZE; i++) {
-				if (!LINK_STORAGE.rx_buffer[i].empty) {
-					// if some DATA message for ED or COORD from COORD is in RX buffer
-					// and address is the same, COMMIT ACK packet can be sent
-					if (LINK_STORAGE.rx_buffer[i].address_type == 0
-							&& LINK_STORAGE.rx_buffer[i].address.coord == LINK_cid_mask (data[6])) {
-						if(data[0] & LINK_COORD_TO_ED) {
-							D_LINK printf ("R: COMMIT to ED\n");
-							D_LINK printf ("S: COMMIT ACK to COORD\n");
-							send_commit_ack (true, data[0] & LINK_ED_TO_COORD, data + 6);
-						}
-						else {
-							D_LINK printf ("R: COMMIT to COORD\n");
-							D_LINK printf ("S: COMMIT ACK to COORD\n");
-							send_commit_ack (false, data[0] & LINK_ED_TO_COORD, data + 6);
-						}
-						bool result = LINK_route (LINK_STORAGE.rx_buffer[i].data + LINK_HEADER_SIZE,
-																				 LINK_STORAGE.rx_buffer[i].len - LINK_HEADER_SIZE, LINK_STORAGE.rx_buffer[i].transfer_type);
-						LINK_STORAGE.rx_buffer[i].empty = 1;
-						return result;
-					}
-				}
-			}
-			// in case of multiple receiving of COMMIT packet send COMMIT ACK
-			// packet (COMMIT packet was not received by sender)
-			if(data[0] & LINK_COORD_TO_ED) {
-				send_commit_ack (true, data[0] & LINK_ED_TO_COORD, data + 6);
-			}
-			else {
-				send_commit_ack (false, data[0] & LINK_ED_TO_COORD, data + 6);
-			}
+			D_LINK printf ("R: COMMIT to COORD\n");
+			D_LINK printf ("S: COMMIT ACK to COORD\n");
 		}
+		send_commit_ack (as_ed, sender_address_type, data + 6);
+		bool result = LINK_route (record->data + LINK_HEADER_SIZE,
+															record->len - LINK_HEADER_SIZE, record->transfer_type);
+		free_rx (stored->second);
+		LINK_STORAGE.rx_index.erase (key);
+		return result;
 	}
 	return true;
 }
 
-/*
- * Checks TX and RX buffers periodically.
- * Ensures packet retransmission during four-way handshake and detects
- * unsuccessful four-way handshake.
+/**
+ * Retransmits DATA or COMMIT of TX buffer record whose ACK did not come,
+ * detects unsuccessful four-way handshake. Packet which did not leave radio
+ * was not lost, it is resent without backoff and keeps its measurement.
+ * @param index 	Index of TX buffer record.
+ */
+void tx_expired (uint16_t index)
+{
+	LINK_tx_buffer_record_t *record = &LINK_STORAGE.tx_buffer[index];
+	bool failed = record->failed;
+
+	record->deadline = 0;
+	record->failed = 0;
+	if (record->empty || record->waiting || record->windowed)
+		return;
+	if ((record->transmits_to_error--) == 0) {
+		// multiple unsuccessful packet sending, network reinitialization starts
+		LINK_error_handler_coord ();
+		// delete all messages for unavailable ED or COORD
+		drop_queue (neighbour_key (record->address_type, record->address.ed));
+		return;
+	}
+	// try to resend packet
+	if (!failed) {
+		rate_retry (index);
+		rtt_backoff (neighbour_key (record->address_type, record->address.ed));
+	}
+	if (record->state) {
+		D_LINK printf("COMMIT again!\n");
+		if (record->address_type)
+			set_phy_frame (index, send_commit (false, true, record->address.ed));
+		else
+			set_phy_frame (index, send_commit (false, false, &record->address.coord));
+	}
+	else {
+		D_LINK printf("DATA again!\n");
+		send_tx_data (index);
+	}
+	tx_sent (index, failed && record->timed);
+}
+
+/**
+ * Processes expired timers, only records and windows whose deadline
+ * passed are visited.
  */
 void check_buffers_state ()
 {
-	// check the COORD buffers
-	for (uint8_t i = 0; i < LINK_TX_BUFFER_SIZE; i++) {
-		if ((!LINK_STORAGE.tx_buffer[i].empty)
-				&& LINK_STORAGE.tx_buffer[i].expiration_time == LINK_STORAGE.timer_counter) {
-			if ((LINK_STORAGE.tx_buffer[i].transmits_to_error--) == 0) {
-				// multiple unsuccessful packet sending, network reinitialization starts
-				if (LINK_STORAGE.tx_buffer[i].address_type) {
-					LINK_error_handler_coord ();
-					// delete all messages for unavailable ED
-					for (uint8_t j = 0; j < LINK_TX_BUFFER_SIZE; j++) {
-						if(!LINK_STORAGE.tx_buffer[j].empty && array_cmp(LINK_STORAGE.tx_buffer[i].address.ed, LINK_STORAGE.tx_buffer[j].address.ed)){
-							LINK_STORAGE.tx_buffer[j].empty = 1;
-						}
-					}
-				}
-				else {
-					LINK_error_handler_coord ();
-					// delete all messages for unavailable COORD
-					for (uint8_t j = 0; j < LINK_TX_BUFFER_SIZE; j++) {
-						if(!LINK_STORAGE.tx_buffer[j].empty && LINK_STORAGE.tx_buffer[i].address.coord == LINK_STORAGE.tx_buffer[j].address.coord){
-							LINK_STORAGE.tx_buffer[j].empty = 1;
-						}
-					}
-				}
-			}
-			else {
-				// try to resend packet
-				if (LINK_STORAGE.tx_buffer[i].state) {
-					D_LINK printf("COMMIT again!\n");
-					if (LINK_STORAGE.tx_buffer[i].address_type) {
-						send_commit (false, true, LINK_STORAGE.tx_buffer[i].address.ed);
-					}
-					else {
-						send_commit (false, false,
-												 &LINK_STORAGE.tx_buffer[i].address.coord);
-					}
-				}
-				else {
-					D_LINK printf("DATA again!\n");
-					if (LINK_STORAGE.tx_buffer[i].address_type) {
-						send_data (false, true, LINK_STORAGE.tx_buffer[i].address.ed,
-											 LINK_STORAGE.tx_buffer[i].data, LINK_STORAGE.tx_buffer[i].len, LINK_STORAGE.tx_buffer[i].transfer_type);
-					}
-					else {
-						send_data (false, false, &LINK_STORAGE.tx_buffer[i].address.coord,
-											 LINK_STORAGE.tx_buffer[i].data, LINK_STORAGE.tx_buffer[i].len, LINK_STORAGE.tx_buffer[i].transfer_type);
-					}
-				}
-				LINK_STORAGE.tx_buffer[i].expiration_time = LINK_STORAGE.timer_counter + 2;
-			}
+	uint64_t now = now_ms ();
+
+	while (!LINK_STORAGE.timers.empty () && LINK_STORAGE.timers.begin ()->first <= now) {
+		uint64_t target = LINK_STORAGE.timers.begin ()->second;
+		// handlers arm timers again
+		LINK_STORAGE.timers.erase (LINK_STORAGE.timers.begin ());
+		if (target == LINK_TIMER_RATE) {
+			LINK_STORAGE.rate_deadline = 0;
+			rate_update ();
+			if (LINK_STORAGE.rate_control)
+				arm_timer (LINK_TIMER_RATE, &LINK_STORAGE.rate_deadline, now + LINK_RATE_UPDATE_MS);
 		}
+		else if (target & LINK_TIMER_WINDOW) {
+			window_expired (target & ~LINK_TIMER_WINDOW);
+		}
+		else {
+			tx_expired (target);
+		}
+	}
+	schedule_timer ();
+}
+
+/**
+ * Handles result of frame transmission. Round-trip time of sent DATA or
+ * COMMIT is measured since now, failed one is resent at once instead of
+ * waiting for ACK timeout.
+ * @param id 			Frame identifier.
+ * @param status 	Result of transmission.
+ */
+void PHY_send_done (uint32_t id, uint8_t status)
+{
+	std::lock_guard < std::recursive_mutex > lock (LINK_STORAGE.mutex);
+	auto frame = LINK_STORAGE.frame_index.find (id);
+	if (frame == LINK_STORAGE.frame_index.end ())
+		return;
+	uint16_t index = frame->second;
+	LINK_STORAGE.frame_index.erase (frame);
+	if (status == PHY_TX_OK) {
+		tx_departed (index, id);
+		return;
+	}
+	D_LINK printf ("PHY_send_done(): frame %u not sent (%d)\n", id, status);
+	// record can be reused by another packet since the frame was queued
+	LINK_tx_buffer_record_t *record = &LINK_STORAGE.tx_buffer[index];
+	// lost windowed DATA is resent with window
+	if (!record->empty && !record->windowed && record->phy_frame == id) {
+		record->failed = 1;
+		arm_timer (index, &record->deadline, now_ms ());
 	}
 }
 
@@ -641,8 +1692,9 @@ void check_buffers_state ()
  * Processes received packet.
  * @param data 	Data.
  * @param len 	Data length.
+ * @param info 	Metadata of received frame.
  */
-void PHY_process_packet (uint8_t* data, uint8_t len)
+void PHY_process_packet (uint8_t* data, uint8_t len, const struct PHY_rx_info_t *info)
 {
 	/*printf("RAW: ");
 	for(uint8_t i = 0; i < len; i++)
@@ -653,6 +1705,7 @@ void PHY_process_packet (uint8_t* data, uint8_t len)
 	if (len < LINK_HEADER_SIZE)
 		return;
 
+	std::lock_guard < std::recursive_mutex > lock (LINK_STORAGE.mutex);
 	uint8_t packet_type = data[0] >> 6;
 	uint8_t transfer_type = data[0] & 0x0f;
 	// JOIN packet processing before NID check
@@ -664,15 +1717,17 @@ void PHY_process_packet (uint8_t* data, uint8_t len)
 			return;
 		}
 
-		LINK_save_msg_info(data + 10, len - 10);
+		LINK_save_msg_info(data + 10, len - 10, info);
+		// JOIN RESPONSE goes back by the same radio
+		learn_radio (data, info->radio);
 
 		uint8_t ack_packet[LINK_HEADER_SIZE];
 		gen_header (ack_packet, false, true, data + 6, LINK_ACK_TYPE,
 								LINK_ACK_JOIN_REQUEST);
 		D_LINK printf("ACK JOIN REQUEST\n");
-		PHY_send_with_cca (ack_packet, LINK_HEADER_SIZE);
+		send_packet (true, data + 6, ack_packet, LINK_HEADER_SIZE);
 		// send JOIN REQUEST ROUTE message with RSSI
-		uint8_t RSSI = PHY_get_measured_noise();
+		uint8_t RSSI = info->rssi;
 		LINK_join_request_received (RSSI, data + LINK_HEADER_SIZE, len - LINK_HEADER_SIZE);
 		return;
 	}
@@ -680,8 +1735,13 @@ void PHY_process_packet (uint8_t* data, uint8_t len)
 	// packet is not in my network
 	if (!array_cmp (data + 1, GLOBAL_STORAGE.nid))
 		return;
+	// packets from PAN children tell which radio reaches them
+	if (!(data[0] & LINK_COORD_TO_ED))
+		learn_radio (data, info->radio);
 
-	LINK_save_msg_info(data + 10, len - 10);
+	// DATA of two-way handshake are saved when they are not repeated
+	if (transfer_type != LINK_DATA_HS2)
+		LINK_save_msg_info(data + 10, len - 10, info);
 
 	if (transfer_type == LINK_DATA_BROADCAST) {
 		D_LINK printf("BROADCAST received\n");
@@ -698,8 +1758,12 @@ void PHY_process_packet (uint8_t* data, uint8_t len)
 
 	// if routing is disabled and four-way handshake is not finished
 	// do not process next packets
-	if (!GLOBAL_STORAGE.routing_enabled && ((transfer_type == LINK_DATA_HS4) && packet_type != LINK_COMMIT_ACK_TYPE)) {
+	if (!GLOBAL_STORAGE.routing_enabled && (((transfer_type == LINK_DATA_HS4) && packet_type != LINK_COMMIT_ACK_TYPE)
+			|| (transfer_type == LINK_DATA_HS2 && packet_type == LINK_DATA_TYPE))) {
 		D_LINK printf ("Routing disabled\n");
+		// two-way handshake has no COMMIT, sender waits longer and keeps DATA
+		if (transfer_type == LINK_DATA_HS2)
+			send_busy_ack (false, (data[0] & LINK_ED_TO_COORD) ? 1 : 0, data + 6);
 		return;
 	}
 
@@ -713,23 +1777,34 @@ void PHY_process_packet (uint8_t* data, uint8_t len)
 		}
 	}
 	// packet processing and routing
-	router_process_packet (data, len);
+	router_process_packet (data, len, info);
 }
 
 /**
- * Checks buffers, increments counter periodically and
+ * Processes expired timers at the earliest deadline, idle link layer has
+ * none, and
  * alternatively sends JOIN RESPONSE (ROUTE) and MOVE RESPONSE (ROUTE) messages.
  */
 void PHY_timer_interrupt ()
 {
-	LINK_STORAGE.timer_counter++;
-	LINK_timer_counter();
 	/*if(GLOBAL_STORAGE.pair_mode)
 		NET_joining();
 	NET_moving();*/
+	std::lock_guard < std::recursive_mutex > lock (LINK_STORAGE.mutex);
+	// physical layer has no deadline now
+	LINK_STORAGE.timer_scheduled = 0;
 	check_buffers_state ();
 }
 
+/**
+ * Gets counter of network layer ticks, idle stack is not woken up for them.
+ * @return Returns number of LINK_NET_TICK_MS ticks modulo 256.
+ */
+uint8_t LINK_tick_counter ()
+{
+	return now_ms () / LINK_NET_TICK_MS;
+}
+
 /**
  * Gets address of coordinator (CID).
  * @param byte Byte containing coordinator ID.
@@ -748,17 +1823,129 @@ uint8_t LINK_cid_mask (uint8_t address)
 void LINK_init (struct PHY_init_t* phy_params, struct LINK_init_t* link_params)
 {
 	D_LINK printf("LINK_init\n");
-	PHY_init(phy_params);
+	std::lock_guard < std::recursive_mutex > lock (LINK_STORAGE.mutex);
+	// receiving starts in PHY_init, radios of neighbours are learned since then
+	for (uint8_t i = 0; i < MAX_COORD; i++) {
+		LINK_STORAGE.coord_radio[i] = LINK_NO_RADIO;
+		LINK_STORAGE.coord_radio_assigned[i] = LINK_NO_RADIO;
+	}
+	for (uint8_t i = 0; i < LINK_ED_RADIOS; i++)
+		LINK_STORAGE.ed_radio[i].radio = LINK_NO_RADIO;
+	LINK_STORAGE.ed_radio_next = 0;
+	LINK_STORAGE.band = phy_params->band;
+	LINK_STORAGE.base_bitrate = phy_params->bitrate;
+	for (uint8_t i = 0; i < MAX_COORD; i++) {
+		LINK_STORAGE.rates[i] = LINK_rate_t ();
+		LINK_STORAGE.rates[i].best_throughput = phy_params->bitrate;
+		LINK_STORAGE.rates[i].best_probability = phy_params->bitrate;
+		LINK_STORAGE.rates[i].listening = PHY_BITRATE_BASE;
+	}
+	for (uint8_t i = 0; i < PHY_MAX_RADIOS; i++)
+		LINK_STORAGE.rate_window[i] = LINK_NO_COORD;
+	// sequence numbers differ from those of previous run, coordinators
+	// do not take new DATA for duplicates
+	for (uint8_t i = 0; i < MAX_COORD; i++)
+		LINK_STORAGE.window_seq[i] = PHY_monotonic_ns () >> 10;
+	LINK_STORAGE.seq_index.clear ();
+	LINK_STORAGE.rtt_index.clear ();
+	LINK_STORAGE.timers.clear ();
+	LINK_STORAGE.timer_scheduled = 0;
+	LINK_STORAGE.rate_deadline = 0;
+	// buffers are ready before receiving starts
+	uint16_t rx_size = link_params->rx_buffer_size ? link_params->rx_buffer_size
+		: LINK_RX_BUFFER_SIZE;
+	uint16_t tx_size = link_params->tx_buffer_size ? link_params->tx_buffer_size
+		: LINK_TX_BUFFER_SIZE;
+	LINK_STORAGE.rx_buffer.assign (rx_size, LINK_rx_buffer_record_t ());
+	LINK_STORAGE.tx_buffer.assign (tx_size, LINK_tx_buffer_record_t ());
+	LINK_STORAGE.rx_free.clear ();
+	LINK_STORAGE.tx_free.clear ();
+	// records with the lowest indexes are taken first
+	for (uint16_t i = rx_size; i > 0; i--)
+		free_rx (i - 1);
+	for (uint16_t i = tx_size; i > 0; i--)
+		free_tx (i - 1);
+	LINK_STORAGE.rx_index.clear ();
+	LINK_STORAGE.tx_index.clear ();
+	LINK_STORAGE.frame_index.clear ();
+	LINK_STORAGE.rx_index.reserve (rx_size);
+	LINK_STORAGE.tx_index.reserve (tx_size);
 	LINK_STORAGE.tx_max_retries = link_params->tx_max_retries;
+	LINK_STORAGE.duplicate_timeout = rtt_retransmission_span (link_params->tx_max_retries);
+	if (LINK_STORAGE.duplicate_timeout < LINK_DUPLICATE_TIMEOUT_MS)
+		LINK_STORAGE.duplicate_timeout = LINK_DUPLICATE_TIMEOUT_MS;
 
-	for (uint8_t i = 0; i < LINK_RX_BUFFER_SIZE; i++) {
-		LINK_STORAGE.rx_buffer[i].empty = 1;
-	}
-	for (uint8_t i = 0; i < LINK_TX_BUFFER_SIZE; i++) {
-		LINK_STORAGE.tx_buffer[i].empty = 1;
+	if (LINK_STORAGE.rate_control)
+		arm_timer (LINK_TIMER_RATE, &LINK_STORAGE.rate_deadline, now_ms () + LINK_RATE_UPDATE_MS);
+	// threads of physical layer wait for the lock until link layer is ready
+	PHY_init(phy_params);
+}
+
+bool LINK_set_coord_radio (uint8_t cid, uint8_t radio)
+{
+	cid = LINK_cid_mask (cid);
+	if (radio != LINK_NO_RADIO && radio >= PHY_get_radio_count ())
+		return false;
+	std::lock_guard < std::recursive_mutex > lock (LINK_STORAGE.mutex);
+	LINK_STORAGE.coord_radio_assigned[cid] = radio;
+	return true;
+}
+
+void LINK_set_rate_control (bool enable)
+{
+	std::lock_guard < std::recursive_mutex > lock (LINK_STORAGE.mutex);
+	LINK_STORAGE.rate_control = enable;
+	// statistics are updated periodically only while they are used
+	if (enable && LINK_STORAGE.rate_deadline == 0)
+		arm_timer (LINK_TIMER_RATE, &LINK_STORAGE.rate_deadline, now_ms () + LINK_RATE_UPDATE_MS);
+	else if (!enable)
+		cancel_timer (LINK_TIMER_RATE, &LINK_STORAGE.rate_deadline);
+}
+
+void LINK_set_window (bool enable)
+{
+	std::lock_guard < std::recursive_mutex > lock (LINK_STORAGE.mutex);
+	LINK_STORAGE.window_enabled = enable;
+}
+
+void LINK_set_two_way (bool enable)
+{
+	std::lock_guard < std::recursive_mutex > lock (LINK_STORAGE.mutex);
+	LINK_STORAGE.two_way_enabled = enable;
+}
+
+void LINK_get_rate_stats (uint8_t cid, struct LINK_rate_stats_t *stats)
+{
+	std::lock_guard < std::recursive_mutex > lock (LINK_STORAGE.mutex);
+	LINK_rate_t *rate = &LINK_STORAGE.rates[LINK_cid_mask (cid)];
+
+	stats->best_throughput = rate->best_throughput;
+	stats->best_probability = rate->best_probability;
+	for (uint8_t i = 0; i < LINK_RATE_COUNT; i++) {
+		stats->probability[i] = rate->probability[i];
+		stats->attempts[i] = rate->total_attempts[i];
+		stats->successes[i] = rate->total_successes[i];
 	}
+}
 
-	LINK_STORAGE.timer_counter = 0;
+bool LINK_get_rtt_stats (bool ed, uint8_t* address, struct LINK_rtt_stats_t *stats)
+{
+	std::lock_guard < std::recursive_mutex > lock (LINK_STORAGE.mutex);
+	uint64_t key = neighbour_key (ed, address);
+	auto found = LINK_STORAGE.rtt_index.find (key);
+
+	if (found == LINK_STORAGE.rtt_index.end ())
+		return false;
+	LINK_rtt_t *rtt = &found->second;
+	stats->srtt_us = rtt->srtt_us;
+	stats->rttvar_us = rtt->rttvar_us;
+	stats->min_us = rtt->min_us;
+	stats->max_us = rtt->max_us;
+	stats->rto_ms = rtt_timeout (key);
+	stats->samples = rtt->samples;
+	stats->timeouts = rtt->timeouts;
+	stats->backoff = rtt->backoff;
+	return true;
 }
 
 void LINK_send_join_response (uint8_t* edid, uint8_t* payload, uint8_t len)
@@ -770,7 +1957,9 @@ void LINK_send_join_response (uint8_t* edid, uint8_t* payload, uint8_t len)
 	for (uint8_t i = 0; i < len && packet_index < MAX_PHY_PAYLOAD_SIZE; i++) {
 		packet[packet_index++] = payload[i];
 	}
-	PHY_send_with_cca (packet, packet_index);
+	// radio of ED is learned by RX thread
+	std::lock_guard < std::recursive_mutex > lock (LINK_STORAGE.mutex);
+	send_packet (true, edid, packet, packet_index);
 }
 
 /**
@@ -789,7 +1978,9 @@ bool LINK_send_broadcast (uint8_t * payload, uint8_t len)
 	for (uint8_t index = 0; index < len; index++) {
 		packet[packet_index++] = payload[index];
 	}
-	PHY_send_with_cca (packet, packet_index);
+	// every radio serves part of the network
+	for (uint8_t radio = 0; radio < PHY_get_radio_count (); radio++)
+		PHY_send_on_radio (radio, packet, packet_index, true);
 	return true;
 }
 
@@ -806,37 +1997,64 @@ bool LINK_send_coord (bool to_ed, uint8_t * address, uint8_t * payload,
 											uint8_t len, uint8_t transfer_type)
 {
 	D_LINK printf("LINK_send_coord()\n");
-	if(transfer_type == LINK_DATA_HS4) {
-	// send data using four-way handshake
-	uint8_t free_index = get_free_index_tx ();
-		if (free_index >= LINK_TX_BUFFER_SIZE)
+	std::lock_guard < std::recursive_mutex > lock (LINK_STORAGE.mutex);
+	if (transfer_type == LINK_DATA_HS4 && LINK_STORAGE.two_way_enabled)
+		transfer_type = LINK_DATA_HS2;
+	// sequence number takes part of payload, longer DATA go by four-way handshake
+	if (transfer_type == LINK_DATA_HS2 && len > MAX_LINK_PAYLOAD_SIZE - LINK_HS2_HEADER_SIZE)
+		transfer_type = LINK_DATA_HS4;
+	if(transfer_type == LINK_DATA_HS4 || transfer_type == LINK_DATA_WINDOW
+		 || transfer_type == LINK_DATA_HS2) {
+		// send data using four-way handshake
+		uint16_t free_index = alloc_tx ();
+		if (free_index == LINK_NO_RECORD)
 			return false;
+		LINK_tx_buffer_record_t *record = &LINK_STORAGE.tx_buffer[free_index];
 		for (uint8_t i = 0; i < len; i++)
-			LINK_STORAGE.tx_buffer[free_index].data[i] = payload[i];
-		LINK_STORAGE.tx_buffer[free_index].len = len;
+			record->data[i] = payload[i];
+		record->len = len;
 		if (to_ed) {
 			for (uint8_t i = 0; i < EDID_LENGTH; i++)
-				LINK_STORAGE.tx_buffer[free_index].address.ed[i] = address[i];
+				record->address.ed[i] = address[i];
 		}
 		else {
-			LINK_STORAGE.tx_buffer[free_index].address.coord = *address;
+			record->address.coord = *address;
 		}
 		// 0 - packet is for ED, 1- packet is for COORD
-		LINK_STORAGE.tx_buffer[free_index].address_type = to_ed ? 1 : 0;
-		LINK_STORAGE.tx_buffer[free_index].state = DATA_SENT;
-		LINK_STORAGE.tx_buffer[free_index].transmits_to_error = LINK_STORAGE.tx_max_retries;
-		LINK_STORAGE.tx_buffer[free_index].expiration_time = LINK_STORAGE.timer_counter + 2;
-		LINK_STORAGE.tx_buffer[free_index].transfer_type = transfer_type;
-		LINK_STORAGE.tx_buffer[free_index].empty = 0;
-
-		if (LINK_STORAGE.tx_buffer[free_index].address_type)
-			send_data (false, true, LINK_STORAGE.tx_buffer[free_index].address.ed,
-								 LINK_STORAGE.tx_buffer[free_index].data,
-								 LINK_STORAGE.tx_buffer[free_index].len, transfer_type);
-		else
-			send_data (false, false, &LINK_STORAGE.tx_buffer[free_index].address.coord,
-								 LINK_STORAGE.tx_buffer[free_index].data,
-								 LINK_STORAGE.tx_buffer[free_index].len, transfer_type);
+		record->address_type = to_ed ? 1 : 0;
+		record->transfer_type = transfer_type == LINK_DATA_HS2 ? LINK_DATA_HS2 : LINK_DATA_HS4;
+		record->rate_control = 0;
+		record->waiting = 1;
+		// record can be reused, handshake state of previous packet is cleared
+		record->state = DATA_SENT;
+		record->timed = 0;
+		record->failed = 0;
+		record->sent_at = 0;
+		// windows are sent to coordinators only, sequence numbers take
+		// part of payload, longer DATA go by four-way handshake
+		record->windowed = !to_ed && transfer_type != LINK_DATA_HS2
+			&& len <= MAX_LINK_PAYLOAD_SIZE - LINK_WINDOW_HEADER_SIZE
+			&& (transfer_type == LINK_DATA_WINDOW || LINK_STORAGE.window_enabled);
+
+		// neighbour cannot distinguish handshakes, packets wait for previous ones
+		uint64_t key = neighbour_key (to_ed, address);
+		auto queue = LINK_STORAGE.tx_index.find (key);
+		if (queue == LINK_STORAGE.tx_index.end ()) {
+			LINK_tx_queue_t *created = &LINK_STORAGE.tx_index[key];
+			*created = LINK_tx_queue_t ();
+			created->first = free_index;
+			created->last = free_index;
+			start_queue (key, created);
+			return true;
+		}
+		LINK_STORAGE.tx_buffer[queue->second.last].next = free_index;
+		queue->second.last = free_index;
+		// DATA joins window in flight
+		if (LINK_STORAGE.tx_buffer[queue->second.first].windowed) {
+			window_fill (&queue->second);
+			if (queue->second.window == LINK_WINDOW_SIZE && !queue->second.commit_sent)
+				window_commit (key, &queue->second, true);
+		}
 	}
 	else if (transfer_type == LINK_DATA_WITHOUT_ACK) {
 		// send data without waiting for ACK message
@@ -850,7 +2068,7 @@ bool LINK_send_coord (bool to_ed, uint8_t * address, uint8_t * payload,
 		for (uint8_t index = 0; index < len; index++) {
 			packet[packet_index++] = payload[index];
 		}
-		PHY_send_with_cca (packet, packet_index);
+		send_packet (to_ed, address, packet, packet_index);
 	}
 	else if (transfer_type == LINK_DATA_BROADCAST) {
 		// send broadcast message
@@ -28,12 +28,30 @@
 #define LINK_DATA_JOIN_RESPONSE		0x04
 /*! ACK JOIN message */
 #define LINK_ACK_JOIN_REQUEST			0x05
+/*! bitrate switch of coordinator for the following exchange */
+#define LINK_RATE_SWITCH					0x06
+/*! data transfer using four-way handshake with window of DATA */
+#define LINK_DATA_WINDOW					0x07
+/*! data transfer using two-way handshake (DATA and ACK with sequence number) */
+#define LINK_DATA_HS2							0x09
+
+/*! maximum number of DATA in window */
+#define LINK_WINDOW_SIZE					4
+/*! size of sequence numbers preceding payload of windowed DATA */
+#define LINK_WINDOW_HEADER_SIZE		2
+/*! size of sequence number preceding payload of two-way handshake DATA */
+#define LINK_HS2_HEADER_SIZE			1
+
+/*! number of bitrates (DATA_RATE_5 - DATA_RATE_200) */
+#define LINK_RATE_COUNT						8
 
 /**
  * Structure for link layer (accessible for user).
  */
 struct LINK_init_t {
 	uint8_t tx_max_retries;	/**< Maximum number of packet retransmissions. */
+	uint16_t tx_buffer_size;	/**< Number of packets in four-way handshake or waiting for it, 0 for default (256). */
+	uint16_t rx_buffer_size;	/**< Number of received packets waiting for COMMIT, 0 for default (256). */
 };
 
 /**
@@ -75,6 +93,91 @@ void LINK_send_join_response (uint8_t * to, uint8_t * data, uint8_t len);
 bool LINK_send_coord (bool to_ed, uint8_t * address, uint8_t * payload,
 											uint8_t len, uint8_t transfer_type);
 
+/**
+ * Assigns radio to coordinator. Coordinators are reached by radio on which
+ * they were heard last, assignment takes precedence. Assigning radio to
+ * child of PAN moves its whole subtree, packets to the subtree go through it.
+ * Has to be called after LINK_init.
+ * @param cid 		Coordinator ID.
+ * @param radio 	Radio index, 0xff cancels assignment.
+ * @return Returns false if radio does not exist, true otherwise.
+ */
+bool LINK_set_coord_radio (uint8_t cid, uint8_t radio);
+
+/**
+ * Sends four-way handshakes to coordinators in windows. Up to
+ * LINK_WINDOW_SIZE DATA are in flight, one COMMIT acknowledges all DATA
+ * received in order. Coordinators have to support LINK_DATA_WINDOW.
+ * Disabled by default, LINK_DATA_WINDOW can be requested per packet.
+ * @param enable 	True to send four-way handshakes to coordinators in windows.
+ */
+void LINK_set_window (bool enable);
+
+/**
+ * Sends packets of four-way handshake by two-way handshake. DATA carry
+ * sequence number of neighbour and are delivered on receiving, single ACK
+ * finishes exchange and repeated DATA are only acknowledged. Suitable for
+ * idempotent traffic, neighbours have to support LINK_DATA_HS2. Takes
+ * precedence over windows, disabled by default, LINK_DATA_HS2 can be
+ * requested per packet.
+ * @param enable 	True to send packets by two-way handshake.
+ */
+void LINK_set_two_way (bool enable);
+
+/**
+ * Statistics of bitrates used for coordinator.
+ */
+struct LINK_rate_stats_t {
+	uint8_t best_throughput;								/**< Bitrate with the best throughput. */
+	uint8_t best_probability;								/**< Bitrate with the best success probability. */
+	uint16_t probability[LINK_RATE_COUNT];	/**< Success probability of bitrate (per mille). */
+	uint32_t attempts[LINK_RATE_COUNT];			/**< Number of frames sent at bitrate. */
+	uint32_t successes[LINK_RATE_COUNT];		/**< Number of frames acknowledged at bitrate. */
+};
+
+/**
+ * Enables bitrate adaptation. Four-way handshakes with coordinators run at
+ * bitrate with the best throughput, other bitrates are sampled occasionally
+ * and retransmissions fall back to more reliable bitrates. Coordinator is
+ * switched by RATE SWITCH packet for one exchange, then both return to
+ * bitrate of PHY_init. Disabled by default.
+ * @param enable 	True to enable bitrate adaptation.
+ */
+void LINK_set_rate_control (bool enable);
+
+/**
+ * Gets statistics of bitrates used for coordinator.
+ * @param cid 		Coordinator ID.
+ * @param stats 	Structure for statistics.
+ */
+void LINK_get_rate_stats (uint8_t cid, struct LINK_rate_stats_t *stats);
+
+/**
+ * Round-trip time statistics of neighbour. Retransmission timeout is
+ * smoothed round-trip time plus four times its variation bounded to
+ * 50 ms - 1 s, it is doubled by every timeout until ACK of packet sent
+ * once comes, up to 64 times and 60 s.
+ */
+struct LINK_rtt_stats_t {
+	uint32_t srtt_us;			/**< Smoothed round-trip time (us). */
+	uint32_t rttvar_us;		/**< Round-trip time variation (us). */
+	uint32_t min_us;			/**< The shortest round-trip time (us). */
+	uint32_t max_us;			/**< The longest round-trip time (us). */
+	uint32_t rto_ms;			/**< Current retransmission timeout including backoff (ms). */
+	uint32_t samples;			/**< Number of round-trip time samples. */
+	uint32_t timeouts;		/**< Number of retransmissions after timeout. */
+	uint8_t backoff;			/**< Exponent of retransmission timeout backoff. */
+};
+
+/**
+ * Gets round-trip time statistics of neighbour.
+ * @param ed 				True if address is end device ID, false if it is coordinator ID.
+ * @param address 	Coordinator ID or end device ID.
+ * @param stats 		Structure for statistics.
+ * @return Returns false if no packet was sent to neighbour, true otherwise.
+ */
+bool LINK_get_rtt_stats (bool ed, uint8_t* address, struct LINK_rtt_stats_t *stats);
+
 extern bool LINK_route (uint8_t * payload, uint8_t len, uint8_t transfer_type);
 
 extern void LINK_error_handler_coord ();
@@ -94,7 +197,14 @@ uint8_t LINK_get_measured_noise();
 
 extern void LINK_notify_send_done ();
 
-extern void LINK_save_msg_info (uint8_t* data, uint8_t len);
+/**
+ * Gets counter of 50 ms ticks which times JOIN and MOVE messages of network
+ * layer. It is derived from monotonic time, no timer keeps it.
+ * @return Returns number of ticks modulo 256.
+ */
+uint8_t LINK_tick_counter ();
+
+extern void LINK_save_msg_info (uint8_t* data, uint8_t len, const struct PHY_rx_info_t *info);
 
 uint8_t LINK_get_measured_noise();
 
@@ -74,7 +74,6 @@ struct NET_storage_t {
 	NET_sleepy_messages_t sleepy_messages[MAX_SLEEPY_MESSAGES];	/**< Structure for SLEEPY messages. */
 	NET_join_move_info_t join_info[MAX_JOIN_MESSAGES];					/**< Structure for JOIN REQUEST (ROUTE) messages. */
 	NET_join_move_info_t move_info[MAX_MOVE_MESSAGES];					/**< Structure for MOVE REQUEST (ROUTE) messages. */
-	uint8_t timer_counter;																			/**< Timer controlling JOIN RESPONSE (ROUTE) and MOVE RESPONSE (ROUTE) sending. */
 	uint16_t pair_mode_timeout;
 	uint16_t join_cnt_overflow_value;
 } NET_STORAGE;
@@ -703,7 +702,7 @@ bool save_join_message(uint8_t *edid, uint8_t cid, uint8_t RSSI, uint8_t device_
 				NET_STORAGE.join_info[i].RSSI = RSSI;
 				NET_STORAGE.join_info[i].device_type = device_type;
 				NET_STORAGE.join_info[i].valid = true;
-				NET_STORAGE.join_info[i].time = NET_STORAGE.timer_counter;
+				NET_STORAGE.join_info[i].time = LINK_tick_counter ();
 				D_NET printf("NET_STORAGE.join_info[i].scid: %02x RSSI: %d\n", NET_STORAGE.join_info[i].scid, NET_STORAGE.join_info[i].RSSI);
 				return true;
 		}
@@ -728,7 +727,7 @@ bool save_move_message(uint8_t message_type, uint8_t *edid, uint8_t cid, uint8_t
 				D_NET printf("maybe it will be updated ROUTE\n");
 				if (NET_STORAGE.move_info[i].RSSI < RSSI) {
 					NET_STORAGE.move_info[i].RSSI = RSSI;
-					NET_STORAGE.move_info[i].time = NET_STORAGE.timer_counter;
+					NET_STORAGE.move_info[i].time = LINK_tick_counter ();
 					D_NET printf("record actualized\n");
 				}
 				return true;
@@ -740,7 +739,7 @@ bool save_move_message(uint8_t message_type, uint8_t *edid, uint8_t cid, uint8_t
 				array_copy(edid, NET_STORAGE.move_info[i].edid, EDID_LENGTH);
 				NET_STORAGE.move_info[i].scid = cid;
 				NET_STORAGE.move_info[i].RSSI = RSSI;
-				NET_STORAGE.move_info[i].time = NET_STORAGE.timer_counter;
+				NET_STORAGE.move_info[i].time = LINK_tick_counter ();
 				NET_STORAGE.move_info[i].valid = true;
 				return true;
 			}
@@ -756,7 +755,7 @@ bool save_move_message(uint8_t message_type, uint8_t *edid, uint8_t cid, uint8_t
 					D_NET printf("Maybe it will be updated.\n");
 					if(NET_STORAGE.move_info[i].RSSI < RSSI) {
 						NET_STORAGE.move_info[i].RSSI = RSSI;
-						NET_STORAGE.move_info[i].time = NET_STORAGE.timer_counter;
+						NET_STORAGE.move_info[i].time = LINK_tick_counter ();
 						D_NET printf("Record actualized.\n");
 					}
 					return true;
@@ -769,7 +768,7 @@ bool save_move_message(uint8_t message_type, uint8_t *edid, uint8_t cid, uint8_t
 					NET_STORAGE.move_info[i].scid = 0x00;
 					NET_STORAGE.move_info[i].RSSI = LINK_get_measured_noise();
 					D_NET printf("RSSI: %d\n", NET_STORAGE.move_info[i].RSSI);
-					NET_STORAGE.move_info[i].time = NET_STORAGE.timer_counter;
+					NET_STORAGE.move_info[i].time = LINK_tick_counter ();
 					NET_STORAGE.move_info[i].valid = true;
 					return true;
 				}
@@ -1122,14 +1121,16 @@ void NET_set_pair_mode_timeout(uint8_t timeout)
  */
 void NET_joining()
 {
+	uint8_t timer_counter = LINK_tick_counter ();
+
 	for(int i = 0; i < MAX_JOIN_MESSAGES; i++){
 		if(NET_STORAGE.join_info[i].valid) {
-			if(NET_STORAGE.timer_counter == 0 && NET_STORAGE.join_info[i].time > NET_STORAGE.join_cnt_overflow_value)
+			if(timer_counter == 0 && NET_STORAGE.join_info[i].time > NET_STORAGE.join_cnt_overflow_value)
 			{
 				overflow_joining = true;
 				D_NET printf("overflow during joining\n");
 			}
-			if((NET_STORAGE.join_info[i].time <= NET_STORAGE.join_cnt_overflow_value && (abs(NET_STORAGE.timer_counter - NET_STORAGE.join_info[i].time) > NET_STORAGE.pair_mode_timeout)) || (overflow_joining && NET_STORAGE.timer_counter > (NET_STORAGE.pair_mode_timeout - (MAX_CNT_VALUE - NET_STORAGE.join_info[i].time))))
+			if((NET_STORAGE.join_info[i].time <= NET_STORAGE.join_cnt_overflow_value && (abs(timer_counter - NET_STORAGE.join_info[i].time) > NET_STORAGE.pair_mode_timeout)) || (overflow_joining && timer_counter > (NET_STORAGE.pair_mode_timeout - (MAX_CNT_VALUE - NET_STORAGE.join_info[i].time))))
 			{
 				D_NET printf("send JOIN RESPONSE\n");
 				uint8_t new_parent = fitp_find_parent(NET_STORAGE.join_info, NET_STORAGE.join_info[i].edid, MAX_JOIN_MESSAGES);
@@ -1253,12 +1254,14 @@ void NET_accepted_device(uint8_t edid[4])
  */
 void NET_moving()
 {
+	uint8_t timer_counter = LINK_tick_counter ();
+
 	for(int i = 0; i < MAX_MOVE_MESSAGES; i++){
 		if(NET_STORAGE.move_info[i].valid){
-			if(NET_STORAGE.timer_counter == 0 && NET_STORAGE.move_info[i].time > MOVE_CNT_OVERFLOW_VALUE)
+			if(timer_counter == 0 && NET_STORAGE.move_info[i].time > MOVE_CNT_OVERFLOW_VALUE)
 				overflow_moving = true;
-			if((NET_STORAGE.move_info[i].time <= MOVE_CNT_OVERFLOW_VALUE && (abs(NET_STORAGE.timer_counter - NET_STORAGE.move_info[i].time) > MAX_MOVE_DELAY)) ||
-			(overflow_moving && NET_STORAGE.timer_counter > (MAX_MOVE_DELAY - (MAX_CNT_VALUE - NET_STORAGE.move_info[i].time)))) {
+			if((NET_STORAGE.move_info[i].time <= MOVE_CNT_OVERFLOW_VALUE && (abs(timer_counter - NET_STORAGE.move_info[i].time) > MAX_MOVE_DELAY)) ||
+			(overflow_moving && timer_counter > (MAX_MOVE_DELAY - (MAX_CNT_VALUE - NET_STORAGE.move_info[i].time)))) {
 				uint8_t new_parent = fitp_find_parent(NET_STORAGE.move_info, NET_STORAGE.move_info[i].edid, MAX_MOVE_MESSAGES);
 				D_NET printf("New parent: %d\n",  NET_STORAGE.move_info[new_parent].scid);
 				if(new_parent == INVALID_CID)
@@ -1376,17 +1379,12 @@ bool NET_is_set_pair_mode ()
 	return false;
 }
 
-/*
- * Increments counter.
- */
-void LINK_timer_counter()
+void LINK_save_msg_info(uint8_t* data, uint8_t len, const struct PHY_rx_info_t *info)
 {
-    NET_STORAGE.timer_counter++;
-}
-
-void LINK_save_msg_info(uint8_t* data, uint8_t len)
-{
-	NET_save_msg_info((data[0] & 0xf0) >> 4, data[1], data + 6, data + 10, len - 10);
+	// too short to carry network header
+	if (len < NET_HEADER_SIZE)
+		return;
+	NET_save_msg_info((data[0] & 0xf0) >> 4, data[1], data + 6, data + 10, len - 10, info);
 	/*for (uint8_t i = 0; i > MAX_MESSAGES; i++) {
 		if (NET_STORAGE.received_packets[i].empty) {
 			NET_STORAGE.received_packets[i].empty = false;
@@ -95,8 +95,6 @@ extern void NET_received (const uint8_t from_cid,
 extern bool NET_accept_device (uint8_t parent_cid);
 
 
-extern void LINK_timer_counter();
-
 /**
  * Waits for timeout for joining process, then sends JOIN RESPONSE (ROUTE) packet.
  */
@@ -133,7 +131,8 @@ extern void NET_notify_send_done();
 
 void NET_set_pair_mode_timeout(uint8_t timeout);
 
-void NET_save_msg_info(uint8_t msg_type, uint8_t device_type, uint8_t* sedid, uint8_t* data, uint8_t len);
+void NET_save_msg_info(uint8_t msg_type, uint8_t device_type, uint8_t* sedid, uint8_t* data, uint8_t len,
+											 const struct PHY_rx_info_t *info);
 
 bool load_device_table();
 
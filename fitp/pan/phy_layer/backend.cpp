@@ -0,0 +1,296 @@
+#include <string.h>
+#include <iostream>
+#include <thread>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+#include "pan/debug.h"
+#include "phy.h"
+#include "backend.h"
+#include "rt.h"
+
+using namespace std;
+
+/**
+ * Extern functions.
+ */
+extern void PHY_process_packet (uint8_t * data, uint8_t len,
+																const struct PHY_rx_info_t *info);
+extern void PHY_timer_interrupt (void);
+extern void PHY_send_done (uint32_t id, uint8_t status);
+
+/*! time for synthesizer to settle on new channel before RSSI is sampled (us) */
+#define PHY_SURVEY_SETTLE_US 1000
+
+/*! registered backends, the first one is default */
+static const struct PHY_backend_t *const backends[] = {
+	&PHY_MRF89XA_BACKEND,
+	&PHY_LOOPBACK_BACKEND,
+	&PHY_SIMULATOR_BACKEND
+};
+
+/**
+ * Structure for backend selection and timer shared by all backends.
+ */
+struct PHY_backend_storage_t {
+	const struct PHY_backend_t *backend = backends[0];
+	bool running = false;
+	std::thread timer_interrupt_generator;
+	bool terminate_timer = false;
+	std::mutex timer_mutex;
+	std::condition_variable timer_cv;
+	// time of the next timer interrupt (ns), 0 if none
+	uint64_t timer_deadline = 0;
+	// settings shared by all radios, needed for number of channels
+	uint8_t band = BAND_863;
+	uint8_t bitrate = DATA_RATE_20;
+} BACKEND_STORAGE;
+
+/**
+ * Generates timer interrupt for link layer at deadline set by
+ * PHY_set_timer, thread sleeps while no deadline is set.
+ */
+void timer_interrupt_generator_f ()
+{
+	rt_thread_setup (PHY_THREAD_TIMER);
+	std::unique_lock < std::mutex > lock (BACKEND_STORAGE.timer_mutex);
+	while (!BACKEND_STORAGE.terminate_timer) {
+		uint64_t deadline = BACKEND_STORAGE.timer_deadline;
+		if (deadline == 0) {
+			BACKEND_STORAGE.timer_cv.wait (lock);
+			continue;
+		}
+		// steady_clock is the clock of PHY_monotonic_ns
+		auto at = std::chrono::steady_clock::time_point (std::chrono::nanoseconds (deadline));
+		BACKEND_STORAGE.timer_cv.wait_until (lock, at);
+		// deadline could be moved meanwhile
+		if (BACKEND_STORAGE.terminate_timer || BACKEND_STORAGE.timer_deadline != deadline
+				|| PHY_monotonic_ns () < deadline)
+			continue;
+		// link layer sets the next deadline during interrupt
+		BACKEND_STORAGE.timer_deadline = 0;
+		lock.unlock ();
+		rt_latency_record (PHY_THREAD_TIMER, deadline, PHY_monotonic_ns ());
+		PHY_timer_interrupt ();
+		lock.lock ();
+	}
+}
+
+void PHY_set_timer (uint64_t deadline)
+{
+	std::lock_guard < std::mutex > lock (BACKEND_STORAGE.timer_mutex);
+	BACKEND_STORAGE.timer_deadline = deadline;
+	BACKEND_STORAGE.timer_cv.notify_all ();
+}
+
+bool PHY_set_backend (const char *name)
+{
+	if (BACKEND_STORAGE.running) {
+		cerr << "PHY_set_backend(): backend cannot be changed while running!" << endl;
+		return false;
+	}
+	for (uint8_t i = 0; i < sizeof (backends) / sizeof (backends[0]); i++) {
+		if (strcmp (backends[i]->name, name) == 0) {
+			BACKEND_STORAGE.backend = backends[i];
+			return true;
+		}
+	}
+	return false;
+}
+
+const char *PHY_get_backend ()
+{
+	return BACKEND_STORAGE.backend->name;
+}
+
+void PHY_init (struct PHY_init_t *params)
+{
+	static const struct PHY_callbacks_t callbacks = {
+		PHY_process_packet,
+		PHY_send_done
+	};
+
+	D_PHY printf ("PHY_init(): %s backend\n", BACKEND_STORAGE.backend->name);
+	BACKEND_STORAGE.band = params->band;
+	BACKEND_STORAGE.bitrate = params->bitrate;
+	// before any stack thread starts, their stacks are locked too
+	rt_lock_memory ();
+	if (!BACKEND_STORAGE.backend->init (params, &callbacks))
+		cerr << "PHY_init(): " << BACKEND_STORAGE.backend->name << " backend is not ready!" << endl;
+	BACKEND_STORAGE.running = true;
+	BACKEND_STORAGE.terminate_timer = false;
+	BACKEND_STORAGE.timer_interrupt_generator = std::thread (timer_interrupt_generator_f);
+}
+
+void PHY_stop ()
+{
+	if (!BACKEND_STORAGE.running)
+		return;
+	{
+		std::lock_guard < std::mutex > lock (BACKEND_STORAGE.timer_mutex);
+		BACKEND_STORAGE.terminate_timer = true;
+		BACKEND_STORAGE.timer_deadline = 0;
+		BACKEND_STORAGE.timer_cv.notify_all ();
+	}
+	BACKEND_STORAGE.timer_interrupt_generator.join ();
+	BACKEND_STORAGE.backend->stop ();
+	BACKEND_STORAGE.running = false;
+	rt_unlock_memory ();
+}
+
+bool PHY_set_freq (uint8_t band)
+{
+	if (!BACKEND_STORAGE.backend->set_band (band))
+		return false;
+	BACKEND_STORAGE.band = band;
+	return true;
+}
+
+bool PHY_set_channel (uint8_t channel)
+{
+	return BACKEND_STORAGE.backend->set_channel (0, channel);
+}
+
+uint8_t PHY_get_channel (void)
+{
+	return BACKEND_STORAGE.backend->get_channel (0);
+}
+
+bool PHY_set_radio_channel (uint8_t radio, uint8_t channel)
+{
+	return BACKEND_STORAGE.backend->set_channel (radio, channel);
+}
+
+uint8_t PHY_get_radio_channel (uint8_t radio)
+{
+	return BACKEND_STORAGE.backend->get_channel (radio);
+}
+
+uint8_t PHY_get_radio_count ()
+{
+	return BACKEND_STORAGE.backend->get_radio_count ();
+}
+
+uint8_t PHY_get_rx_radio ()
+{
+	return BACKEND_STORAGE.backend->get_rx_radio ();
+}
+
+bool PHY_set_bitrate (uint8_t bitrate)
+{
+	if (!BACKEND_STORAGE.backend->set_bitrate (bitrate))
+		return false;
+	BACKEND_STORAGE.bitrate = bitrate;
+	return true;
+}
+
+bool PHY_set_power (uint8_t power)
+{
+	return BACKEND_STORAGE.backend->set_power (power);
+}
+
+uint8_t PHY_get_noise ()
+{
+	return BACKEND_STORAGE.backend->get_noise (0);
+}
+
+uint8_t PHY_get_measured_noise ()
+{
+	return BACKEND_STORAGE.backend->get_measured_noise ();
+}
+
+uint32_t PHY_send (const uint8_t * data, uint8_t len)
+{
+	D_PHY printf("PHY_send()\n");
+	return BACKEND_STORAGE.backend->send (0, data, len, false, PHY_BITRATE_BASE);
+}
+
+uint32_t PHY_send_with_cca (uint8_t * data, uint8_t len)
+{
+	return BACKEND_STORAGE.backend->send (0, data, len, true, PHY_BITRATE_BASE);
+}
+
+uint32_t PHY_send_on_radio (uint8_t radio, const uint8_t * data, uint8_t len, bool cca)
+{
+	return BACKEND_STORAGE.backend->send (radio, data, len, cca, PHY_BITRATE_BASE);
+}
+
+uint32_t PHY_send_at_bitrate (uint8_t radio, const uint8_t * data, uint8_t len, bool cca,
+															uint8_t bitrate)
+{
+	if (bitrate > DATA_RATE_200 && bitrate != PHY_BITRATE_BASE)
+		return 0;
+	return BACKEND_STORAGE.backend->send (radio, data, len, cca, bitrate);
+}
+
+uint64_t PHY_monotonic_ns ()
+{
+	// steady_clock is CLOCK_MONOTONIC, GPIO event timestamps are converted to it
+	// by gpio_dispatch()
+	return std::chrono::duration_cast < std::chrono::nanoseconds >
+		(std::chrono::steady_clock::now ().time_since_epoch ()).count ();
+}
+
+uint8_t PHY_channel_amount (uint8_t band, uint8_t bitrate)
+{
+	if ((band == BAND_863 || band == BAND_863_C950)
+			&& (bitrate == DATA_RATE_100 || bitrate == DATA_RATE_200)) {
+		return 25;
+	} else {
+		return 32;
+	}
+}
+
+uint8_t PHY_survey (uint8_t radio, uint16_t samples, uint16_t interval_us,
+										uint8_t busy_threshold, struct PHY_survey_t *table)
+{
+	const struct PHY_backend_t *backend = BACKEND_STORAGE.backend;
+	uint8_t channels = PHY_channel_amount (BACKEND_STORAGE.band, BACKEND_STORAGE.bitrate);
+
+	if (!BACKEND_STORAGE.running || radio >= backend->get_radio_count () || samples == 0)
+		return 0;
+	uint8_t original = backend->get_channel (radio);
+	for (uint8_t channel = 0; channel < channels; channel++) {
+		uint32_t sum = 0;
+		uint16_t busy = 0;
+		uint8_t max = 0;
+
+		table[channel].channel = channel;
+		if (!backend->set_channel (radio, channel)) {
+			// channel cannot be used, it goes to the end of table
+			table[channel].rssi_mean = 0xff;
+			table[channel].rssi_max = 0xff;
+			table[channel].busy = 100;
+			continue;
+		}
+		std::this_thread::sleep_for (std::chrono::microseconds (PHY_SURVEY_SETTLE_US));
+		for (uint16_t i = 0; i < samples; i++) {
+			if (i > 0 && interval_us > 0)
+				std::this_thread::sleep_for (std::chrono::microseconds (interval_us));
+			uint8_t rssi = backend->get_noise (radio);
+			sum += rssi;
+			if (rssi > max)
+				max = rssi;
+			if (rssi > busy_threshold)
+				busy++;
+		}
+		table[channel].rssi_mean = sum / samples;
+		table[channel].rssi_max = max;
+		table[channel].busy = (uint32_t) busy * 100 / samples;
+		D_PHY printf ("PHY_survey(): radio %d channel %d mean %d max %d busy %d%%\n", radio,
+									channel, table[channel].rssi_mean, max, table[channel].busy);
+	}
+	backend->set_channel (radio, original);
+
+	// the least occupied channel first, then the quietest one
+	std::stable_sort (table, table + channels,
+		[] (const struct PHY_survey_t &a, const struct PHY_survey_t &b) {
+			if (a.busy != b.busy)
+				return a.busy < b.busy;
+			if (a.rssi_mean != b.rssi_mean)
+				return a.rssi_mean < b.rssi_mean;
+			return a.rssi_max < b.rssi_max;
+		});
+	return channels;
+}
@@ -0,0 +1,47 @@
+#ifndef MRF_PHY_BACKEND_H
+#define MRF_PHY_BACKEND_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "phy.h"
+
+/**
+ * Functions of upper layer called by backend.
+ */
+struct PHY_callbacks_t {
+	void (*received) (uint8_t * data, uint8_t len,
+										const struct PHY_rx_info_t * info);			/**< Frame was received. */
+	void (*send_done) (uint32_t id, uint8_t status);	/**< Frame left TX queue. */
+};
+
+/**
+ * Implementation of physical layer.
+ * Public PHY_* functions are forwarded to the selected backend,
+ * functions without radio index work with radio 0.
+ */
+struct PHY_backend_t {
+	const char *name;																					/**< Backend name. */
+	bool (*init) (struct PHY_init_t * params,
+								const struct PHY_callbacks_t * callbacks);	/**< Starts backend. */
+	void (*stop) (void);																			/**< Stops backend. */
+	uint32_t (*send) (uint8_t radio, const uint8_t * data, uint8_t len,
+										bool cca, uint8_t bitrate);							/**< Queues frame. */
+	uint8_t (*get_noise) (uint8_t radio);											/**< Reads current RSSI. */
+	uint8_t (*get_measured_noise) (void);											/**< RSSI of processed frame. */
+	bool (*set_band) (uint8_t band);													/**< Sets band of all radios. */
+	bool (*set_channel) (uint8_t radio, uint8_t channel);			/**< Sets channel. */
+	uint8_t (*get_channel) (uint8_t radio);										/**< Gets channel. */
+	bool (*set_bitrate) (uint8_t bitrate);										/**< Sets bitrate of all radios. */
+	bool (*set_power) (uint8_t power);												/**< Sets output power of all radios. */
+	uint8_t (*get_radio_count) (void);												/**< Number of radios. */
+	uint8_t (*get_rx_radio) (void);														/**< Radio of processed frame. */
+};
+
+/*! MRF89XA on SPI and GPIO character device */
+extern const struct PHY_backend_t PHY_MRF89XA_BACKEND;
+/*! in-memory bus shared with harness endpoints */
+extern const struct PHY_backend_t PHY_LOOPBACK_BACKEND;
+/*! network simulator */
+extern const struct PHY_backend_t PHY_SIMULATOR_BACKEND;
+
+#endif
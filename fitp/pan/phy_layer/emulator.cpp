@@ -0,0 +1,648 @@
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <sys/eventfd.h>
+#include <linux/gpio.h>
+#include <iostream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <deque>
+#include "pan/debug.h"
+#include "common/phy_layer/constants.h"
+#include "emulator.h"
+
+using namespace std;
+
+/*! FIFO size of MRF89XA */
+#define EMULATOR_FIFO_SIZE 64
+/*! crystal of MRF89XA, bitrate is derived from it by BRREG */
+#define EMULATOR_FXTAL_HZ 12800000
+/*! bytes on air around frame: preamble, sync word, length byte, CRC */
+#define EMULATOR_FRAME_OVERHEAD (3 + 4 + 1 + 2)
+/*! bus clock used when transfer does not set it */
+#define EMULATOR_DEFAULT_SPEED_HZ 1000000
+
+/**
+ * State of emulated MRF89XA.
+ */
+struct EMULATOR_radio_t {
+	bool powered;									/**< Flag if SPI interfaces are open. */
+	bool initialized;							/**< Flag if registers got power-on values. */
+	int config_fd = -1;						/**< Descriptor of config interface. */
+	int data_fd = -1;							/**< Descriptor of data interface. */
+	int irq_fd[2] = { -1, -1 };		/**< Line descriptors of IRQ0 and IRQ1 given to PHY. */
+	int edge_fd[2] = { -1, -1 };	/**< Emulator ends of IRQ line descriptors. */
+	int reset_fd = -1;						/**< Line descriptor of RESET. */
+	bool irq_level[2];						/**< Levels of IRQ0 and IRQ1. */
+	bool reset_held;							/**< Level of RESET. */
+	uint8_t registers[32];				/**< Register file. */
+	std::deque < uint8_t > fifo;	/**< FIFO. */
+	bool fifo_overrun;						/**< FIFO overrun flag. */
+	bool rx_frame;								/**< Flag if FIFO holds received frame (CRCOK). */
+	bool tx_busy;									/**< Flag if frame is on air. */
+	bool tx_done;									/**< TXDONE flag. */
+	uint32_t tx_generation;				/**< Identifies transmission, aborted ones are ignored. */
+	uint8_t tx_len;								/**< Length of frame on air. */
+	uint8_t tx_frame[EMULATOR_FIFO_SIZE];	/**< Frame on air. */
+	uint8_t rssi;									/**< Reported RSSI. */
+	struct PHY_emulator_stats_t stats;
+};
+
+/**
+ * End of transmission.
+ */
+struct EMULATOR_event_t {
+	std::chrono::steady_clock::time_point deadline;	/**< Time of TXDONE. */
+	uint8_t radio;																	/**< Transmitting radio. */
+	uint32_t generation;														/**< Transmission. */
+};
+
+/**
+ * Structure for emulated radios and air between them.
+ */
+struct EMULATOR_storage_t {
+	std::mutex mutex;
+	std::condition_variable cv;
+	std::thread air_deamon;
+	bool air_running = false;
+	bool terminate_air = false;
+	std::deque < struct EMULATOR_event_t > events;
+	struct EMULATOR_radio_t radios[PHY_EMULATOR_MAX_RADIOS];
+	PHY_emulator_tx_t tx_handler = 0;
+	void *tx_arg = 0;
+	bool bus_delay = false;
+} EMULATOR_STORAGE;
+
+/**
+ * Parses index of emulated radio from device path.
+ * @param path 	Path "emu:<index>".
+ * @return Returns index of radio, -1 if path is not valid.
+ */
+static int parse_index (const char *path)
+{
+	char *end;
+
+	if (!emulator_match (path))
+		return -1;
+	const char *number = path + strlen (PHY_EMULATOR_PREFIX);
+	long index = strtol (number, &end, 10);
+	if (end == number || *end != '\0' || index < 0 || index >= PHY_EMULATOR_MAX_RADIOS)
+		return -1;
+	return index;
+}
+
+/**
+ * Finds radio owning SPI interface or line descriptor (mutex has to be locked).
+ * @param fd 	Descriptor.
+ * @return Returns radio, NULL if descriptor is not emulated.
+ */
+static struct EMULATOR_radio_t *find_radio (int fd)
+{
+	if (fd < 0)
+		return 0;
+	for (uint8_t i = 0; i < PHY_EMULATOR_MAX_RADIOS; i++) {
+		struct EMULATOR_radio_t *radio = &EMULATOR_STORAGE.radios[i];
+		if (radio->config_fd == fd || radio->data_fd == fd || radio->reset_fd == fd
+				|| radio->irq_fd[0] == fd || radio->irq_fd[1] == fd)
+			return radio;
+	}
+	return 0;
+}
+
+/**
+ * Drives IRQ line, rising edge is passed to line descriptor.
+ * @param radio 	Radio.
+ * @param line 		PHY_EMULATOR_LINE_IRQ0 or PHY_EMULATOR_LINE_IRQ1.
+ * @param level 	New level.
+ */
+static void set_irq (struct EMULATOR_radio_t *radio, uint8_t line, bool level)
+{
+	struct gpioevent_data event;
+
+	bool rising = level && !radio->irq_level[line];
+	radio->irq_level[line] = level;
+	if (!rising)
+		return;
+	if (line == PHY_EMULATOR_LINE_IRQ1)
+		radio->stats.irq1_edges++;
+	if (radio->edge_fd[line] < 0)
+		return;
+	memset (&event, 0, sizeof (event));
+	event.timestamp = std::chrono::duration_cast < std::chrono::nanoseconds >
+		(std::chrono::steady_clock::now ().time_since_epoch ()).count ();
+	event.id = GPIOEVENT_EVENT_RISING_EDGE;
+	// full pipe loses the edge like full kernel event queue does
+	if (write (radio->edge_fd[line], &event, sizeof (event)) != sizeof (event))
+		D_PHY printf ("emulator: IRQ%d edge lost!\n", line);
+}
+
+/**
+ * Puts radio into power-on state, registers are not set to datasheet
+ * values, only the operating mode is standby.
+ * @param radio 	Radio.
+ */
+static void power_on_reset (struct EMULATOR_radio_t *radio)
+{
+	memset (radio->registers, 0, sizeof (radio->registers));
+	radio->registers[GCONREG >> 1] = RF_STANDBY;
+	radio->fifo.clear ();
+	radio->fifo_overrun = false;
+	radio->rx_frame = false;
+	radio->tx_busy = false;
+	radio->tx_done = false;
+	radio->tx_generation++;
+	radio->irq_level[0] = false;
+	radio->irq_level[1] = false;
+	radio->initialized = true;
+}
+
+static uint8_t get_mode (const struct EMULATOR_radio_t *radio)
+{
+	return radio->registers[GCONREG >> 1] & 0xE0;
+}
+
+/**
+ * Computes time of frame on air from bitrate set in BRREG.
+ * @param radio 	Radio.
+ * @param len 		Frame length.
+ * @return Returns airtime.
+ */
+static std::chrono::nanoseconds airtime (const struct EMULATOR_radio_t *radio, uint8_t len)
+{
+	uint64_t bitrate = EMULATOR_FXTAL_HZ / (64 * ((uint32_t) radio->registers[BRREG >> 1] + 1));
+	uint64_t bits = (uint64_t) (EMULATOR_FRAME_OVERHEAD + len) * 8;
+	return std::chrono::nanoseconds (bits * 1000000000ULL / bitrate);
+}
+
+/**
+ * Starts transmission if radio is transmitter and FIFO holds whole frame
+ * (mutex has to be locked).
+ * @param radio 	Radio.
+ */
+static void check_transmission (struct EMULATOR_radio_t *radio)
+{
+	if (get_mode (radio) != RF_TRANSMITTER || radio->tx_busy || radio->fifo.empty ())
+		return;
+	uint8_t len = radio->fifo[0];
+	if (radio->fifo.size () < (size_t) len + 1)
+		return;
+	radio->fifo.pop_front ();
+	radio->tx_len = len;
+	for (uint8_t i = 0; i < len; i++) {
+		radio->tx_frame[i] = radio->fifo.front ();
+		radio->fifo.pop_front ();
+	}
+	radio->tx_busy = true;
+	radio->tx_done = false;
+
+	struct EMULATOR_event_t event;
+	event.deadline = std::chrono::steady_clock::now () + airtime (radio, len);
+	event.radio = radio - EMULATOR_STORAGE.radios;
+	event.generation = ++radio->tx_generation;
+	// airtimes differ by bitrate, queue is kept ordered by deadline
+	auto it = EMULATOR_STORAGE.events.begin ();
+	while (it != EMULATOR_STORAGE.events.end () && it->deadline <= event.deadline)
+		it++;
+	EMULATOR_STORAGE.events.insert (it, event);
+	EMULATOR_STORAGE.cv.notify_all ();
+}
+
+/**
+ * Changes operating mode, transmission in progress is aborted by leaving
+ * transmitter mode. IRQ1 is CRCOK in receiver mode and TXDONE in transmitter mode.
+ * @param radio 	Radio.
+ * @param value 	GCONREG setting.
+ */
+static void set_mode (struct EMULATOR_radio_t *radio, uint8_t value)
+{
+	radio->registers[GCONREG >> 1] = value;
+	if (get_mode (radio) == RF_TRANSMITTER) {
+		set_irq (radio, PHY_EMULATOR_LINE_IRQ1, radio->tx_done);
+		check_transmission (radio);
+		return;
+	}
+	if (radio->tx_busy) {
+		radio->tx_busy = false;
+		radio->tx_generation++;
+	}
+	radio->tx_done = false;
+	set_irq (radio, PHY_EMULATOR_LINE_IRQ1,
+					 get_mode (radio) == RF_RECEIVER && radio->rx_frame);
+}
+
+/**
+ * Puts frame into FIFO of receiving radio (mutex has to be locked).
+ * @param radio 	Radio.
+ * @param data 		Frame.
+ * @param len 		Frame length.
+ * @return Returns true if frame is in FIFO, false otherwise.
+ */
+static bool receive (struct EMULATOR_radio_t *radio, const uint8_t * data, uint8_t len)
+{
+	if (!radio->powered || radio->reset_held || get_mode (radio) != RF_RECEIVER
+			|| !radio->fifo.empty () || len + 1 > EMULATOR_FIFO_SIZE) {
+		radio->stats.rx_missed++;
+		return false;
+	}
+	radio->fifo.push_back (len);
+	for (uint8_t i = 0; i < len; i++)
+		radio->fifo.push_back (data[i]);
+	radio->rx_frame = true;
+	radio->stats.rx_frames++;
+	// sync word match, then CRC of whole frame
+	set_irq (radio, PHY_EMULATOR_LINE_IRQ0, true);
+	set_irq (radio, PHY_EMULATOR_LINE_IRQ0, false);
+	set_irq (radio, PHY_EMULATOR_LINE_IRQ1, true);
+	return true;
+}
+
+/**
+ * Checks if receiver hears transmitter: the same band, channel and sync word.
+ * @param tx 	Transmitting radio.
+ * @param rx 	Receiving radio.
+ * @return Returns true if frame can be received, false otherwise.
+ */
+static bool same_air (const struct EMULATOR_radio_t *tx, const struct EMULATOR_radio_t *rx)
+{
+	static const uint8_t addresses[] = {
+		R1CNTREG, P1CNTREG, S1CNTREG, BRREG, SYNCV31REG, SYNCV23REG, SYNCV15REG, SYNCV07REG
+	};
+
+	// band and VCO trim bits
+	if ((tx->registers[GCONREG >> 1] & 0x1E) != (rx->registers[GCONREG >> 1] & 0x1E))
+		return false;
+	for (uint8_t i = 0; i < sizeof (addresses); i++) {
+		if (tx->registers[addresses[i] >> 1] != rx->registers[addresses[i] >> 1])
+			return false;
+	}
+	return true;
+}
+
+/**
+ * Ends transmissions after their airtime, signals TXDONE and delivers
+ * frames to other emulated radios.
+ */
+static void air_deamon_f ()
+{
+	std::unique_lock < std::mutex > lock (EMULATOR_STORAGE.mutex);
+	while (!EMULATOR_STORAGE.terminate_air) {
+		if (EMULATOR_STORAGE.events.empty ()) {
+			EMULATOR_STORAGE.cv.wait (lock);
+			continue;
+		}
+		struct EMULATOR_event_t event = EMULATOR_STORAGE.events.front ();
+		if (std::chrono::steady_clock::now () < event.deadline) {
+			EMULATOR_STORAGE.cv.wait_until (lock, event.deadline);
+			continue;
+		}
+		EMULATOR_STORAGE.events.pop_front ();
+		struct EMULATOR_radio_t *radio = &EMULATOR_STORAGE.radios[event.radio];
+		if (!radio->tx_busy || radio->tx_generation != event.generation)
+			continue;
+		radio->tx_busy = false;
+		radio->tx_done = true;
+		radio->stats.tx_frames++;
+		set_irq (radio, PHY_EMULATOR_LINE_IRQ1, true);
+
+		for (uint8_t i = 0; i < PHY_EMULATOR_MAX_RADIOS; i++) {
+			struct EMULATOR_radio_t *receiver = &EMULATOR_STORAGE.radios[i];
+			if (receiver != radio && receiver->powered && same_air (radio, receiver))
+				receive (receiver, radio->tx_frame, radio->tx_len);
+		}
+		// handler is called without lock, it can inject frames
+		PHY_emulator_tx_t handler = EMULATOR_STORAGE.tx_handler;
+		void *arg = EMULATOR_STORAGE.tx_arg;
+		if (handler) {
+			uint8_t data[EMULATOR_FIFO_SIZE];
+			uint8_t len = radio->tx_len;
+			memcpy (data, radio->tx_frame, len);
+			lock.unlock ();
+			handler (arg, event.radio, data, len);
+			lock.lock ();
+		}
+	}
+}
+
+/**
+ * Reads register of radio.
+ * @param radio 	Radio.
+ * @param index 	Index of register (address / 2).
+ * @return Returns register value.
+ */
+static uint8_t read_register (struct EMULATOR_radio_t *radio, uint8_t index)
+{
+	uint8_t value = radio->registers[index];
+
+	radio->stats.register_reads++;
+	switch (index << 1) {
+		case FTXRXIREG:
+			// FIFO not empty and FIFO overrun flags
+			return (value & 0xFC) | (radio->fifo.empty () ? 0 : 0x02) | (radio->fifo_overrun ? 0x01 : 0);
+		case FTPRIREG:
+			// PLL is always locked
+			return (value & 0xDD) | (radio->tx_done ? 0x20 : 0) | 0x02;
+		case RSTSREG:
+			return radio->rssi << 1;
+	}
+	return value;
+}
+
+/**
+ * Writes register of radio.
+ * @param radio 	Radio.
+ * @param index 	Index of register (address / 2).
+ * @param value 	Register setting.
+ */
+static void write_register (struct EMULATOR_radio_t *radio, uint8_t index, uint8_t value)
+{
+	radio->stats.register_writes++;
+	switch (index << 1) {
+		case GCONREG:
+			set_mode (radio, value);
+			return;
+		case FTXRXIREG:
+			// writing 1 to FIFO overrun flag clears FIFO
+			if (value & 0x01) {
+				radio->fifo.clear ();
+				radio->fifo_overrun = false;
+				radio->rx_frame = false;
+				if (get_mode (radio) == RF_RECEIVER)
+					set_irq (radio, PHY_EMULATOR_LINE_IRQ1, false);
+			}
+			radio->registers[index] = value & 0xFC;
+			return;
+		case FTPRIREG:
+			radio->registers[index] = value & 0xDD;
+			return;
+		case RSTSREG:
+			return;
+	}
+	radio->registers[index] = value;
+}
+
+static uint8_t read_fifo (struct EMULATOR_radio_t *radio)
+{
+	radio->stats.fifo_reads++;
+	if (radio->fifo.empty ())
+		return 0;
+	uint8_t data = radio->fifo.front ();
+	radio->fifo.pop_front ();
+	if (radio->fifo.empty () && radio->rx_frame) {
+		radio->rx_frame = false;
+		if (get_mode (radio) == RF_RECEIVER)
+			set_irq (radio, PHY_EMULATOR_LINE_IRQ1, false);
+	}
+	return data;
+}
+
+static void write_fifo (struct EMULATOR_radio_t *radio, uint8_t data)
+{
+	radio->stats.fifo_writes++;
+	if (radio->fifo.size () >= EMULATOR_FIFO_SIZE) {
+		radio->fifo_overrun = true;
+		return;
+	}
+	radio->fifo.push_back (data);
+	check_transmission (radio);
+}
+
+bool PHY_emulator_inject (uint8_t radio, const uint8_t * data, uint8_t len)
+{
+	if (radio >= PHY_EMULATOR_MAX_RADIOS)
+		return false;
+	std::lock_guard < std::mutex > lock (EMULATOR_STORAGE.mutex);
+	return receive (&EMULATOR_STORAGE.radios[radio], data, len);
+}
+
+void PHY_emulator_set_tx_handler (PHY_emulator_tx_t handler, void *arg)
+{
+	std::lock_guard < std::mutex > lock (EMULATOR_STORAGE.mutex);
+	EMULATOR_STORAGE.tx_handler = handler;
+	EMULATOR_STORAGE.tx_arg = arg;
+}
+
+void PHY_emulator_set_rssi (uint8_t radio, uint8_t rssi)
+{
+	if (radio >= PHY_EMULATOR_MAX_RADIOS)
+		return;
+	std::lock_guard < std::mutex > lock (EMULATOR_STORAGE.mutex);
+	EMULATOR_STORAGE.radios[radio].rssi = rssi;
+}
+
+void PHY_emulator_set_bus_delay (bool enable)
+{
+	std::lock_guard < std::mutex > lock (EMULATOR_STORAGE.mutex);
+	EMULATOR_STORAGE.bus_delay = enable;
+}
+
+void PHY_emulator_get_stats (uint8_t radio, struct PHY_emulator_stats_t *stats)
+{
+	if (radio >= PHY_EMULATOR_MAX_RADIOS)
+		return;
+	std::lock_guard < std::mutex > lock (EMULATOR_STORAGE.mutex);
+	*stats = EMULATOR_STORAGE.radios[radio].stats;
+}
+
+void PHY_emulator_reset_stats (uint8_t radio)
+{
+	if (radio >= PHY_EMULATOR_MAX_RADIOS)
+		return;
+	std::lock_guard < std::mutex > lock (EMULATOR_STORAGE.mutex);
+	memset (&EMULATOR_STORAGE.radios[radio].stats, 0, sizeof (struct PHY_emulator_stats_t));
+}
+
+bool emulator_match (const char *path)
+{
+	return strncmp (path, PHY_EMULATOR_PREFIX, strlen (PHY_EMULATOR_PREFIX)) == 0;
+}
+
+bool emulator_spi_open (const char *config_dev, const char *data_dev, int *config_fd,
+												int *data_fd)
+{
+	int index = parse_index (config_dev);
+	if (index < 0 || parse_index (data_dev) != index) {
+		cerr << "Can't open emulated SPI device!" << endl;
+		return false;
+	}
+	std::lock_guard < std::mutex > lock (EMULATOR_STORAGE.mutex);
+	struct EMULATOR_radio_t *radio = &EMULATOR_STORAGE.radios[index];
+	if (radio->powered) {
+		cerr << "Emulated SPI device is busy!" << endl;
+		return false;
+	}
+	// descriptors only identify interfaces, nothing is read from them
+	radio->config_fd = eventfd (0, EFD_CLOEXEC);
+	radio->data_fd = eventfd (0, EFD_CLOEXEC);
+	if (radio->config_fd < 0 || radio->data_fd < 0) {
+		cerr << "Can't open emulated SPI device!" << endl;
+		if (radio->config_fd >= 0)
+			close (radio->config_fd);
+		if (radio->data_fd >= 0)
+			close (radio->data_fd);
+		radio->config_fd = -1;
+		radio->data_fd = -1;
+		return false;
+	}
+	if (!radio->initialized)
+		power_on_reset (radio);
+	radio->powered = true;
+	*config_fd = radio->config_fd;
+	*data_fd = radio->data_fd;
+	if (!EMULATOR_STORAGE.air_running) {
+		EMULATOR_STORAGE.terminate_air = false;
+		EMULATOR_STORAGE.air_running = true;
+		EMULATOR_STORAGE.air_deamon = std::thread (air_deamon_f);
+	}
+	D_PHY printf ("emulator: radio %d powered on\n", index);
+	return true;
+}
+
+void emulator_spi_close (int config_fd, int data_fd)
+{
+	std::unique_lock < std::mutex > lock (EMULATOR_STORAGE.mutex);
+	struct EMULATOR_radio_t *radio = find_radio (config_fd);
+	if (!radio || radio->data_fd != data_fd)
+		return;
+	close (radio->config_fd);
+	close (radio->data_fd);
+	radio->config_fd = -1;
+	radio->data_fd = -1;
+	// line descriptors are closed by their owner, only emulator ends are closed here
+	for (uint8_t line = 0; line < 2; line++) {
+		if (radio->edge_fd[line] >= 0)
+			close (radio->edge_fd[line]);
+		radio->edge_fd[line] = -1;
+		radio->irq_fd[line] = -1;
+	}
+	radio->reset_fd = -1;
+	radio->powered = false;
+	if (radio->tx_busy) {
+		radio->tx_busy = false;
+		radio->tx_generation++;
+	}
+
+	for (uint8_t i = 0; i < PHY_EMULATOR_MAX_RADIOS; i++) {
+		if (EMULATOR_STORAGE.radios[i].powered)
+			return;
+	}
+	if (!EMULATOR_STORAGE.air_running)
+		return;
+	EMULATOR_STORAGE.terminate_air = true;
+	EMULATOR_STORAGE.air_running = false;
+	EMULATOR_STORAGE.events.clear ();
+	EMULATOR_STORAGE.cv.notify_all ();
+	lock.unlock ();
+	EMULATOR_STORAGE.air_deamon.join ();
+}
+
+bool emulator_spi_message (int fd, const struct spi_ioc_transfer *xfer, uint8_t count)
+{
+	uint64_t bus_ns = 0;
+	{
+		std::lock_guard < std::mutex > lock (EMULATOR_STORAGE.mutex);
+		struct EMULATOR_radio_t *radio = find_radio (fd);
+		if (!radio || (fd != radio->config_fd && fd != radio->data_fd))
+			return false;
+		bool data_interface = fd == radio->data_fd;
+		// position of byte since chip select was activated
+		uint16_t position = 0;
+		uint8_t command = 0;
+
+		for (uint8_t i = 0; i < count; i++) {
+			const uint8_t *tx = (const uint8_t *) (uintptr_t) xfer[i].tx_buf;
+			uint8_t *rx = (uint8_t *) (uintptr_t) xfer[i].rx_buf;
+			for (uint32_t j = 0; j < xfer[i].len; j++, position++) {
+				uint8_t in = tx ? tx[j] : 0;
+				uint8_t out = 0;
+				if (data_interface) {
+					if (tx)
+						write_fifo (radio, in);
+					else
+						out = read_fifo (radio);
+				} else if (position == 0) {
+					//START_BIT|W/R|D|D|D|D|D|STOP_BIT
+					command = in;
+				} else if (command & 0x40) {
+					out = read_register (radio, (command >> 1) & 0x1f);
+				} else if (position == 1) {
+					write_register (radio, (command >> 1) & 0x1f, in);
+				}
+				if (rx)
+					rx[j] = out;
+			}
+			uint32_t speed_hz = xfer[i].speed_hz ? xfer[i].speed_hz : EMULATOR_DEFAULT_SPEED_HZ;
+			bus_ns += (uint64_t) xfer[i].len * 8 * 1000000000ULL / speed_hz;
+			radio->stats.bytes += xfer[i].len;
+			if (xfer[i].cs_change)
+				position = 0;
+		}
+		radio->stats.messages++;
+		radio->stats.transfers += count;
+		radio->stats.bus_ns += bus_ns;
+		if (!EMULATOR_STORAGE.bus_delay)
+			return true;
+	}
+	std::this_thread::sleep_for (std::chrono::nanoseconds (bus_ns));
+	return true;
+}
+
+int emulator_gpio_request (const char *chip, uint32_t line)
+{
+	int fds[2];
+
+	int index = parse_index (chip);
+	if (index < 0 || line > PHY_EMULATOR_LINE_RESET) {
+		cerr << "Can't request emulated GPIO line!" << endl;
+		return -1;
+	}
+	std::lock_guard < std::mutex > lock (EMULATOR_STORAGE.mutex);
+	struct EMULATOR_radio_t *radio = &EMULATOR_STORAGE.radios[index];
+	if (line == PHY_EMULATOR_LINE_RESET) {
+		radio->reset_fd = eventfd (0, EFD_CLOEXEC);
+		radio->reset_held = false;
+		return radio->reset_fd;
+	}
+	// edges are passed as gpioevent_data records through pipe
+	if (pipe2 (fds, O_CLOEXEC | O_NONBLOCK) < 0) {
+		cerr << "Can't request emulated GPIO line!" << endl;
+		return -1;
+	}
+	if (radio->edge_fd[line] >= 0)
+		close (radio->edge_fd[line]);
+	radio->irq_fd[line] = fds[0];
+	radio->edge_fd[line] = fds[1];
+	return fds[0];
+}
+
+bool emulator_gpio_set_value (int fd, uint8_t value)
+{
+	std::lock_guard < std::mutex > lock (EMULATOR_STORAGE.mutex);
+	struct EMULATOR_radio_t *radio = find_radio (fd);
+	if (!radio || fd != radio->reset_fd)
+		return false;
+	if (value && !radio->reset_held) {
+		power_on_reset (radio);
+		radio->stats.resets++;
+	}
+	radio->reset_held = value != 0;
+	return true;
+}
+
+bool emulator_gpio_get_value (int fd, uint8_t * value)
+{
+	std::lock_guard < std::mutex > lock (EMULATOR_STORAGE.mutex);
+	struct EMULATOR_radio_t *radio = find_radio (fd);
+	if (!radio)
+		return false;
+	if (fd == radio->reset_fd)
+		*value = radio->reset_held;
+	else if (fd == radio->irq_fd[0] || fd == radio->irq_fd[1])
+		*value = radio->irq_level[fd == radio->irq_fd[1]];
+	else
+		return false;
+	return true;
+}
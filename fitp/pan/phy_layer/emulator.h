@@ -0,0 +1,167 @@
+#ifndef MRF_EMULATOR_H
+#define MRF_EMULATOR_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <linux/spi/spidev.h>
+
+/*
+ * Userspace model of MRF89XA: register file, 64 B FIFO, operating modes,
+ * TXDONE/CRCOK on IRQ1 and RESET line. Radios are selected by paths
+ * "emu:<index>" in place of spidev devices and GPIO chip, so the MRF89XA
+ * backend runs unchanged on any Linux machine, e.g.:
+ *
+ *   { "emu:0", "emu:0", "emu:0", PHY_EMULATOR_LINE_IRQ0,
+ *     PHY_EMULATOR_LINE_IRQ1, PHY_EMULATOR_LINE_RESET, 0 }
+ *
+ * Frames sent by one emulated radio are received by the other ones which
+ * are in receiver mode on the same channel with the same sync word.
+ */
+
+/*! prefix of device paths served by emulator */
+#define PHY_EMULATOR_PREFIX "emu:"
+/*! maximum number of emulated radios */
+#define PHY_EMULATOR_MAX_RADIOS 4
+/*! line offsets on emulated GPIO chip */
+#define PHY_EMULATOR_LINE_IRQ0 0
+#define PHY_EMULATOR_LINE_IRQ1 1
+#define PHY_EMULATOR_LINE_RESET 2
+
+/**
+ * Handler of frame transmitted by emulated radio.
+ * @param arg 			Argument passed to PHY_emulator_set_tx_handler().
+ * @param radio 		Index of emulated radio.
+ * @param data 			Frame.
+ * @param len 			Frame length.
+ */
+typedef void (*PHY_emulator_tx_t) (void *arg, uint8_t radio, const uint8_t * data,
+																	 uint8_t len);
+
+/**
+ * Counters of emulated radio.
+ */
+struct PHY_emulator_stats_t {
+	uint32_t messages;				/**< Number of SPI messages (one ioctl each). */
+	uint32_t transfers;				/**< Number of SPI transfers. */
+	uint32_t bytes;						/**< Number of bytes clocked over the bus. */
+	uint64_t bus_ns;					/**< Bus time of transferred bytes at their clock (ns). */
+	uint32_t register_reads;	/**< Number of register reads. */
+	uint32_t register_writes;	/**< Number of register writes. */
+	uint32_t fifo_reads;			/**< Number of bytes read from FIFO. */
+	uint32_t fifo_writes;			/**< Number of bytes written to FIFO. */
+	uint32_t tx_frames;				/**< Number of transmitted frames. */
+	uint32_t rx_frames;				/**< Number of frames put into FIFO. */
+	uint32_t rx_missed;				/**< Number of frames lost (not receiving, FIFO occupied). */
+	uint32_t irq1_edges;			/**< Number of edges on IRQ1. */
+	uint32_t resets;					/**< Number of resets by RESET line. */
+};
+
+/**
+ * Puts frame into FIFO of emulated radio as if it was received over the air.
+ * The frame is lost if radio is not in receiver mode or its FIFO is not empty.
+ * @param radio 		Index of emulated radio.
+ * @param data 			Frame.
+ * @param len 			Frame length.
+ * @return Returns true if frame is in FIFO, false otherwise.
+ */
+bool PHY_emulator_inject (uint8_t radio, const uint8_t * data, uint8_t len);
+
+/**
+ * Sets handler of frames transmitted by emulated radios. It is called
+ * from emulator thread after TXDONE, NULL removes handler.
+ * @param handler 	Handler.
+ * @param arg 			Argument of handler.
+ */
+void PHY_emulator_set_tx_handler (PHY_emulator_tx_t handler, void *arg);
+
+/**
+ * Sets RSSI reported by emulated radio.
+ * @param radio 		Index of emulated radio.
+ * @param rssi 			RSSI value (as returned by PHY_get_noise()).
+ */
+void PHY_emulator_set_rssi (uint8_t radio, uint8_t rssi);
+
+/**
+ * Makes SPI messages take their bus time, so timing of PHY paths is close
+ * to real bus. Otherwise bus time is only counted.
+ * @param enable 	True to sleep for bus time, false to count it only.
+ */
+void PHY_emulator_set_bus_delay (bool enable);
+
+/**
+ * Gets counters of emulated radio.
+ * @param radio 		Index of emulated radio.
+ * @param stats 		Structure for counters.
+ */
+void PHY_emulator_get_stats (uint8_t radio, struct PHY_emulator_stats_t *stats);
+
+/**
+ * Clears counters of emulated radio.
+ * @param radio 		Index of emulated radio.
+ */
+void PHY_emulator_reset_stats (uint8_t radio);
+
+/**
+ * Checks if device path belongs to emulator.
+ * @param path 	Path to device.
+ * @return Returns true if path starts with PHY_EMULATOR_PREFIX.
+ */
+bool emulator_match (const char *path);
+
+/**
+ * Opens both SPI interfaces of emulated radio, radio is powered on by
+ * the first open.
+ * @param config_dev 	Path of config interface.
+ * @param data_dev 		Path of data interface (the same radio).
+ * @param config_fd 	Descriptor of config interface.
+ * @param data_fd 		Descriptor of data interface.
+ * @return Returns true if interfaces are opened, false otherwise.
+ */
+bool emulator_spi_open (const char *config_dev, const char *data_dev, int *config_fd,
+												int *data_fd);
+
+/**
+ * Closes SPI interfaces of emulated radio and its IRQ lines, registers
+ * keep their values.
+ * @param config_fd 	Descriptor of config interface.
+ * @param data_fd 		Descriptor of data interface.
+ */
+void emulator_spi_close (int config_fd, int data_fd);
+
+/**
+ * Executes transfers of one SPI message with spidev semantics, chip
+ * select is released after the last transfer and after every transfer
+ * with cs_change set.
+ * @param fd 			Descriptor of config or data interface.
+ * @param xfer 		Transfers.
+ * @param count 	Number of transfers.
+ * @return Returns true if transfers are done, false otherwise.
+ */
+bool emulator_spi_message (int fd, const struct spi_ioc_transfer *xfer, uint8_t count);
+
+/**
+ * Requests line of emulated GPIO chip. IRQ lines give descriptors with
+ * struct gpioevent_data records of rising edges, like line events do.
+ * @param chip 		Path of emulated chip.
+ * @param line 		Line offset (PHY_EMULATOR_LINE_*).
+ * @return Returns line descriptor, -1 on error.
+ */
+int emulator_gpio_request (const char *chip, uint32_t line);
+
+/**
+ * Sets value of emulated output line.
+ * @param fd 			Line descriptor.
+ * @param value 	Value.
+ * @return Returns false if descriptor is not emulated line, true otherwise.
+ */
+bool emulator_gpio_set_value (int fd, uint8_t value);
+
+/**
+ * Reads level of emulated line.
+ * @param fd 			Line descriptor.
+ * @param value 	Read value.
+ * @return Returns false if descriptor is not emulated line, true otherwise.
+ */
+bool emulator_gpio_get_value (int fd, uint8_t * value);
+
+#endif
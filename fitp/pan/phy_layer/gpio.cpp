@@ -0,0 +1,272 @@
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <linux/gpio.h>
+#include <iostream>
+#include "pan/debug.h"
+#include "gpio.h"
+#include "emulator.h"
+
+using namespace std;
+
+// epoll tag of eventfd, line events are tagged by index to irqs
+#define GPIO_WAKE_TAG GPIO_MAX_IRQS
+
+int gpio_request_irq (const char *chip, uint32_t line, const char *label)
+{
+	struct gpioevent_request req;
+
+	if (emulator_match (chip))
+		return emulator_gpio_request (chip, line);
+	int chip_fd = open (chip, O_RDWR | O_CLOEXEC);
+	if (chip_fd < 0) {
+		cerr << "Can't open GPIO chip!" << endl;
+		return -1;
+	}
+	memset (&req, 0, sizeof (req));
+	req.lineoffset = line;
+	req.handleflags = GPIOHANDLE_REQUEST_INPUT;
+	req.eventflags = GPIOEVENT_REQUEST_RISING_EDGE;
+	strncpy (req.consumer_label, label, sizeof (req.consumer_label) - 1);
+	int rc = ioctl (chip_fd, GPIO_GET_LINEEVENT_IOCTL, &req);
+	// line stays requested after the chip is closed
+	close (chip_fd);
+	if (rc < 0) {
+		cerr << "Can't request GPIO line event!" << endl;
+		return -1;
+	}
+	// edges are drained until EAGAIN
+	fcntl (req.fd, F_SETFL, fcntl (req.fd, F_GETFL) | O_NONBLOCK);
+	return req.fd;
+}
+
+int gpio_request_output (const char *chip, uint32_t line, uint8_t value,
+												 const char *label)
+{
+	struct gpiohandle_request req;
+
+	if (emulator_match (chip)) {
+		int fd = emulator_gpio_request (chip, line);
+		emulator_gpio_set_value (fd, value);
+		return fd;
+	}
+	int chip_fd = open (chip, O_RDWR | O_CLOEXEC);
+	if (chip_fd < 0) {
+		cerr << "Can't open GPIO chip!" << endl;
+		return -1;
+	}
+	memset (&req, 0, sizeof (req));
+	req.lineoffsets[0] = line;
+	req.lines = 1;
+	req.flags = GPIOHANDLE_REQUEST_OUTPUT;
+	req.default_values[0] = value;
+	strncpy (req.consumer_label, label, sizeof (req.consumer_label) - 1);
+	int rc = ioctl (chip_fd, GPIO_GET_LINEHANDLE_IOCTL, &req);
+	close (chip_fd);
+	if (rc < 0) {
+		cerr << "Can't request GPIO line handle!" << endl;
+		return -1;
+	}
+	return req.fd;
+}
+
+bool gpio_set_value (int fd, uint8_t value)
+{
+	struct gpiohandle_data data;
+
+	memset (&data, 0, sizeof (data));
+	data.values[0] = value;
+	if (fd < 0 || ioctl (fd, GPIOHANDLE_SET_LINE_VALUES_IOCTL, &data) < 0) {
+		// emulated lines are not line handles
+		if (fd >= 0 && errno == ENOTTY && emulator_gpio_set_value (fd, value))
+			return true;
+		D_PHY printf ("gpio_set_value(): ioctl failed!\n");
+		return false;
+	}
+	return true;
+}
+
+bool gpio_get_value (int fd, uint8_t * value)
+{
+	struct gpiohandle_data data;
+
+	memset (&data, 0, sizeof (data));
+	if (fd < 0 || ioctl (fd, GPIOHANDLE_GET_LINE_VALUES_IOCTL, &data) < 0)
+		return fd >= 0 && errno == ENOTTY && emulator_gpio_get_value (fd, value);
+	*value = data.values[0];
+	return true;
+}
+
+bool gpio_loop_init (struct GPIO_loop_t *loop)
+{
+	struct epoll_event ev;
+
+	loop->terminate = false;
+	loop->irq_count = 0;
+	loop->epoll_fd = epoll_create1 (EPOLL_CLOEXEC);
+	loop->wake_fd = eventfd (0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (loop->epoll_fd < 0 || loop->wake_fd < 0) {
+		cerr << "Can't create IRQ loop!" << endl;
+		gpio_loop_close (loop);
+		return false;
+	}
+	memset (&ev, 0, sizeof (ev));
+	ev.events = EPOLLIN;
+	ev.data.u32 = GPIO_WAKE_TAG;
+	if (epoll_ctl (loop->epoll_fd, EPOLL_CTL_ADD, loop->wake_fd, &ev) < 0) {
+		cerr << "Can't create IRQ loop!" << endl;
+		gpio_loop_close (loop);
+		return false;
+	}
+	return true;
+}
+
+bool gpio_loop_add (struct GPIO_loop_t *loop, int fd, GPIO_irq_handler_t handler,
+										void *arg)
+{
+	struct epoll_event ev;
+
+	if (fd < 0 || loop->epoll_fd < 0 || loop->irq_count >= GPIO_MAX_IRQS)
+		return false;
+	uint8_t index = loop->irq_count;
+	loop->irqs[index].fd = fd;
+	loop->irqs[index].handler = handler;
+	loop->irqs[index].arg = arg;
+	loop->irqs[index].events = 0;
+
+	memset (&ev, 0, sizeof (ev));
+	ev.events = EPOLLIN;
+	ev.data.u32 = index;
+	if (epoll_ctl (loop->epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+		cerr << "Can't watch GPIO line!" << endl;
+		return false;
+	}
+	loop->irq_count++;
+	return true;
+}
+
+static uint64_t clock_ns (clockid_t clock)
+{
+	struct timespec ts;
+
+	clock_gettime (clock, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * Converts timestamp of line event to CLOCK_MONOTONIC.
+ * Kernels before 5.7 stamp events by CLOCK_REALTIME, such a timestamp lies
+ * far in the future of monotonic clock and it is shifted by offset of clocks.
+ * @param timestamp 	Timestamp of the event (ns).
+ * @return Returns monotonic time of the event (ns).
+ */
+static uint64_t event_monotonic (uint64_t timestamp)
+{
+	uint64_t now = clock_ns (CLOCK_MONOTONIC);
+
+	if (timestamp <= now)
+		return timestamp;
+	uint64_t offset = clock_ns (CLOCK_REALTIME) - now;
+	if (timestamp < offset || timestamp - offset > now)
+		return now;
+	return timestamp - offset;
+}
+
+/**
+ * Reads pending edges of line and calls its handler for each of them.
+ * @param irq 	Interrupt line.
+ */
+static void gpio_dispatch (struct GPIO_irq_t *irq)
+{
+	struct gpioevent_data event;
+
+	while (read (irq->fd, &event, sizeof (event)) == sizeof (event)) {
+		irq->events++;
+		irq->handler (irq->arg, event_monotonic (event.timestamp));
+	}
+}
+
+void gpio_loop_set_poll (struct GPIO_loop_t *loop, GPIO_poll_handler_t handler, void *arg)
+{
+	loop->poll = handler;
+	loop->poll_arg = arg;
+}
+
+bool gpio_loop_enable (struct GPIO_loop_t *loop, int fd, bool enable)
+{
+	struct epoll_event ev;
+
+	for (uint8_t i = 0; i < loop->irq_count; i++) {
+		if (loop->irqs[i].fd != fd)
+			continue;
+		memset (&ev, 0, sizeof (ev));
+		ev.events = enable ? (uint32_t) EPOLLIN : 0;
+		ev.data.u32 = i;
+		if (epoll_ctl (loop->epoll_fd, EPOLL_CTL_MOD, fd, &ev) < 0) {
+			D_PHY printf ("gpio_loop_enable(): epoll_ctl failed!\n");
+			return false;
+		}
+		return true;
+	}
+	return false;
+}
+
+uint32_t gpio_drain (int fd)
+{
+	struct gpioevent_data event;
+	uint32_t count = 0;
+
+	while (read (fd, &event, sizeof (event)) == sizeof (event))
+		count++;
+	return count;
+}
+
+void gpio_loop_run (struct GPIO_loop_t *loop)
+{
+	struct epoll_event events[GPIO_MAX_IRQS + 1];
+	int timeout = -1;
+
+	while (!loop->terminate) {
+		int count = epoll_wait (loop->epoll_fd, events, GPIO_MAX_IRQS + 1, timeout);
+		if (count < 0) {
+			if (errno == EINTR)
+				continue;
+			cerr << "IRQ loop failed!" << endl;
+			return;
+		}
+		for (int i = 0; i < count && !loop->terminate; i++) {
+			if (events[i].data.u32 < loop->irq_count)
+				gpio_dispatch (&loop->irqs[events[i].data.u32]);
+		}
+		if (loop->poll && !loop->terminate)
+			timeout = loop->poll (loop->poll_arg);
+	}
+}
+
+void gpio_loop_stop (struct GPIO_loop_t *loop)
+{
+	uint64_t one = 1;
+
+	loop->terminate = true;
+	if (loop->wake_fd >= 0 && write (loop->wake_fd, &one, sizeof (one)) < 0)
+		D_PHY printf ("gpio_loop_stop(): write failed!\n");
+}
+
+void gpio_loop_close (struct GPIO_loop_t *loop)
+{
+	for (uint8_t i = 0; i < loop->irq_count; i++)
+		close (loop->irqs[i].fd);
+	loop->irq_count = 0;
+	if (loop->wake_fd >= 0)
+		close (loop->wake_fd);
+	if (loop->epoll_fd >= 0)
+		close (loop->epoll_fd);
+	loop->wake_fd = -1;
+	loop->epoll_fd = -1;
+}
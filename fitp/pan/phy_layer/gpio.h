@@ -0,0 +1,148 @@
+#ifndef MRF_GPIO_H
+#define MRF_GPIO_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <atomic>
+
+// maximum number of lines watched by one IRQ loop
+#define GPIO_MAX_IRQS 8
+
+/**
+ * Handler of interrupt line.
+ * @param arg 				Argument passed to gpio_loop_add().
+ * @param timestamp 	Monotonic time of the edge (ns), see PHY_monotonic_ns().
+ */
+typedef void (*GPIO_irq_handler_t) (void *arg, uint64_t timestamp);
+
+/**
+ * Handler called by IRQ loop after every wakeup (edges or timeout).
+ * @param arg 	Argument passed to gpio_loop_set_poll().
+ * @return Returns timeout of the next wait (ms), -1 to wait for edges only.
+ */
+typedef int (*GPIO_poll_handler_t) (void *arg);
+
+/**
+ * Interrupt line watched by IRQ loop.
+ */
+struct GPIO_irq_t {
+	int fd;												/**< Line event file descriptor. */
+	GPIO_irq_handler_t handler;		/**< Handler called for every edge. */
+	void *arg;										/**< Argument of handler. */
+	uint32_t events;							/**< Number of delivered edges. */
+};
+
+/**
+ * IRQ loop waiting for line events in epoll.
+ */
+struct GPIO_loop_t {
+	int epoll_fd = -1;												/**< Epoll instance. */
+	int wake_fd = -1;													/**< Eventfd used by gpio_loop_stop(). */
+	std::atomic < bool > terminate { false };	/**< Flag if loop has to end, set by other thread. */
+	uint8_t irq_count = 0;										/**< Number of watched lines. */
+	struct GPIO_irq_t irqs[GPIO_MAX_IRQS];		/**< Watched lines. */
+	GPIO_poll_handler_t poll = 0;							/**< Handler of wakeups, may be NULL. */
+	void *poll_arg = 0;												/**< Argument of poll handler. */
+};
+
+/**
+ * Requests line as interrupt source (rising edge) on GPIO character device
+ * or on emulated chip (path starting with PHY_EMULATOR_PREFIX).
+ * @param chip 		Path to GPIO chip (e.g. /dev/gpiochip0).
+ * @param line 		Line offset on the chip.
+ * @param label 	Consumer label.
+ * @return Returns line event file descriptor, -1 on error.
+ */
+int gpio_request_irq (const char *chip, uint32_t line, const char *label);
+
+/**
+ * Requests line as output on GPIO character device or on emulated chip.
+ * @param chip 		Path to GPIO chip (e.g. /dev/gpiochip0).
+ * @param line 		Line offset on the chip.
+ * @param value 	Initial value.
+ * @param label 	Consumer label.
+ * @return Returns line handle file descriptor, -1 on error.
+ */
+int gpio_request_output (const char *chip, uint32_t line, uint8_t value,
+												 const char *label);
+
+/**
+ * Sets value of output line.
+ * @param fd 			Line handle file descriptor.
+ * @param value 	Value.
+ * @return Returns true if value is set, false otherwise.
+ */
+bool gpio_set_value (int fd, uint8_t value);
+
+/**
+ * Reads current value of line.
+ * @param fd 			Line handle or line event file descriptor.
+ * @param value 	Read value.
+ * @return Returns true if value is read, false otherwise.
+ */
+bool gpio_get_value (int fd, uint8_t * value);
+
+/**
+ * Initializes IRQ loop.
+ * @param loop 	IRQ loop.
+ * @return Returns true if loop is ready, false otherwise.
+ */
+bool gpio_loop_init (struct GPIO_loop_t *loop);
+
+/**
+ * Adds interrupt line to IRQ loop.
+ * @param loop 			IRQ loop.
+ * @param fd 				Line event file descriptor.
+ * @param handler 	Handler called for every edge.
+ * @param arg 			Argument of handler.
+ * @return Returns true if line is added, false otherwise.
+ */
+bool gpio_loop_add (struct GPIO_loop_t *loop, int fd, GPIO_irq_handler_t handler,
+										void *arg);
+
+/**
+ * Sets handler called after every wakeup of IRQ loop, it decides
+ * timeout of the next wait, so lines can be polled between edges.
+ * Has to be set before gpio_loop_run().
+ * @param loop 			IRQ loop.
+ * @param handler 	Poll handler.
+ * @param arg 			Argument of handler.
+ */
+void gpio_loop_set_poll (struct GPIO_loop_t *loop, GPIO_poll_handler_t handler, void *arg);
+
+/**
+ * Masks or unmasks interrupt line in IRQ loop, edges of masked line
+ * stay queued in kernel until they are read or drained.
+ * @param loop 		IRQ loop.
+ * @param fd 			Line event file descriptor added by gpio_loop_add().
+ * @param enable 	False to mask line, true to unmask it.
+ * @return Returns true if line is (un)masked, false otherwise.
+ */
+bool gpio_loop_enable (struct GPIO_loop_t *loop, int fd, bool enable);
+
+/**
+ * Discards queued edges of line without calling its handler.
+ * @param fd 	Line event file descriptor.
+ * @return Returns number of discarded edges.
+ */
+uint32_t gpio_drain (int fd);
+
+/**
+ * Waits for edges and dispatches them to handlers until gpio_loop_stop().
+ * @param loop 	IRQ loop.
+ */
+void gpio_loop_run (struct GPIO_loop_t *loop);
+
+/**
+ * Wakes up IRQ loop and makes gpio_loop_run() return.
+ * @param loop 	IRQ loop.
+ */
+void gpio_loop_stop (struct GPIO_loop_t *loop);
+
+/**
+ * Closes IRQ loop and all watched lines.
+ * @param loop 	IRQ loop.
+ */
+void gpio_loop_close (struct GPIO_loop_t *loop);
+
+#endif
@@ -0,0 +1,313 @@
+#include <iostream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include "pan/debug.h"
+#include "phy.h"
+#include "backend.h"
+#include "loopback.h"
+
+using namespace std;
+
+/**
+ * Endpoint of loopback bus.
+ */
+struct LOOPBACK_endpoint_t {
+	bool used;								/**< Flag if endpoint is attached. */
+	uint8_t channel;					/**< Channel. */
+	PHY_loopback_rx_t rx;			/**< Handler of delivered frames. */
+	void *arg;								/**< Argument of handler. */
+};
+
+/**
+ * Frame waiting for delivery.
+ */
+struct LOOPBACK_frame_t {
+	int sender;													/**< Sending endpoint. */
+	uint8_t channel;										/**< Channel of sender. */
+	uint32_t id;												/**< Frame identifier. */
+	uint8_t len;												/**< Frame length. */
+	uint8_t data[MAX_PHY_PAYLOAD_SIZE];	/**< Frame. */
+};
+
+/**
+ * Structure for loopback bus and backend.
+ */
+struct LOOPBACK_storage_t {
+	std::mutex mutex;
+	std::condition_variable cv;
+	std::thread bus_deamon;
+	bool bus_running = false;
+	bool terminate_bus = false;
+	struct LOOPBACK_endpoint_t endpoints[LOOPBACK_MAX_ENDPOINTS];
+	uint8_t endpoint_count = 0;
+	std::deque < struct LOOPBACK_frame_t > queue;
+	uint32_t next_id = 0;
+	struct PHY_loopback_stats_t stats;
+
+	// backend state of the stack
+	int stack_endpoint = -1;
+	struct PHY_callbacks_t callbacks;
+	uint8_t channel;
+	uint8_t band;
+	uint8_t bitrate;
+	uint8_t power;
+} LOOPBACK_STORAGE;
+
+/**
+ * Delivers frames to endpoints.
+ */
+static void bus_deamon_f ()
+{
+	struct LOOPBACK_frame_t frame;
+	struct LOOPBACK_endpoint_t endpoints[LOOPBACK_MAX_ENDPOINTS];
+
+	while (true) {
+		{
+			std::unique_lock < std::mutex > lock (LOOPBACK_STORAGE.mutex);
+			LOOPBACK_STORAGE.cv.wait (lock,
+				[] { return LOOPBACK_STORAGE.terminate_bus || !LOOPBACK_STORAGE.queue.empty (); });
+			if (LOOPBACK_STORAGE.terminate_bus)
+				return;
+			frame = LOOPBACK_STORAGE.queue.front ();
+			LOOPBACK_STORAGE.queue.pop_front ();
+			// handlers are called without lock, they can send frames
+			for (uint8_t i = 0; i < LOOPBACK_MAX_ENDPOINTS; i++)
+				endpoints[i] = LOOPBACK_STORAGE.endpoints[i];
+		}
+		uint32_t delivered = 0;
+		for (uint8_t i = 0; i < LOOPBACK_MAX_ENDPOINTS; i++) {
+			if (!endpoints[i].used || i == frame.sender || endpoints[i].channel != frame.channel)
+				continue;
+			// every endpoint gets its own copy
+			uint8_t data[MAX_PHY_PAYLOAD_SIZE];
+			for (uint8_t j = 0; j < frame.len; j++)
+				data[j] = frame.data[j];
+			endpoints[i].rx (endpoints[i].arg, data, frame.len);
+			delivered++;
+		}
+		int stack_endpoint;
+		{
+			std::lock_guard < std::mutex > lock (LOOPBACK_STORAGE.mutex);
+			LOOPBACK_STORAGE.stats.delivered += delivered;
+			stack_endpoint = LOOPBACK_STORAGE.stack_endpoint;
+		}
+		if (frame.sender == stack_endpoint)
+			LOOPBACK_STORAGE.callbacks.send_done (frame.id, PHY_TX_OK);
+	}
+}
+
+int PHY_loopback_attach (uint8_t channel, PHY_loopback_rx_t rx, void *arg)
+{
+	std::lock_guard < std::mutex > lock (LOOPBACK_STORAGE.mutex);
+	for (uint8_t i = 0; i < LOOPBACK_MAX_ENDPOINTS; i++) {
+		if (LOOPBACK_STORAGE.endpoints[i].used)
+			continue;
+		LOOPBACK_STORAGE.endpoints[i].used = true;
+		LOOPBACK_STORAGE.endpoints[i].channel = channel;
+		LOOPBACK_STORAGE.endpoints[i].rx = rx;
+		LOOPBACK_STORAGE.endpoints[i].arg = arg;
+		if (LOOPBACK_STORAGE.endpoint_count++ == 0) {
+			LOOPBACK_STORAGE.terminate_bus = false;
+			LOOPBACK_STORAGE.bus_running = true;
+			LOOPBACK_STORAGE.bus_deamon = std::thread (bus_deamon_f);
+		}
+		return i;
+	}
+	return -1;
+}
+
+void PHY_loopback_detach (int endpoint)
+{
+	std::unique_lock < std::mutex > lock (LOOPBACK_STORAGE.mutex);
+	if (endpoint < 0 || endpoint >= LOOPBACK_MAX_ENDPOINTS
+			|| !LOOPBACK_STORAGE.endpoints[endpoint].used)
+		return;
+	LOOPBACK_STORAGE.endpoints[endpoint].used = false;
+	if (--LOOPBACK_STORAGE.endpoint_count > 0 || !LOOPBACK_STORAGE.bus_running)
+		return;
+	// the last endpoint, undelivered frames are dropped
+	LOOPBACK_STORAGE.terminate_bus = true;
+	LOOPBACK_STORAGE.bus_running = false;
+	LOOPBACK_STORAGE.queue.clear ();
+	LOOPBACK_STORAGE.cv.notify_all ();
+	lock.unlock ();
+	LOOPBACK_STORAGE.bus_deamon.join ();
+}
+
+uint32_t PHY_loopback_send (int endpoint, const uint8_t * data, uint8_t len)
+{
+	struct LOOPBACK_frame_t frame;
+
+	std::lock_guard < std::mutex > lock (LOOPBACK_STORAGE.mutex);
+	if (endpoint < 0 || endpoint >= LOOPBACK_MAX_ENDPOINTS
+			|| !LOOPBACK_STORAGE.endpoints[endpoint].used || len > MAX_PHY_PAYLOAD_SIZE)
+		return 0;
+	if (LOOPBACK_STORAGE.queue.size () >= LOOPBACK_QUEUE_SIZE) {
+		LOOPBACK_STORAGE.stats.dropped++;
+		return 0;
+	}
+	// identifier 0 is reserved for refused frames
+	if (++LOOPBACK_STORAGE.next_id == 0)
+		LOOPBACK_STORAGE.next_id = 1;
+	frame.sender = endpoint;
+	frame.channel = LOOPBACK_STORAGE.endpoints[endpoint].channel;
+	frame.id = LOOPBACK_STORAGE.next_id;
+	frame.len = len;
+	for (uint8_t i = 0; i < len; i++)
+		frame.data[i] = data[i];
+	LOOPBACK_STORAGE.queue.push_back (frame);
+	LOOPBACK_STORAGE.stats.sent++;
+	LOOPBACK_STORAGE.cv.notify_all ();
+	return frame.id;
+}
+
+void PHY_loopback_set_channel (int endpoint, uint8_t channel)
+{
+	std::lock_guard < std::mutex > lock (LOOPBACK_STORAGE.mutex);
+	if (endpoint >= 0 && endpoint < LOOPBACK_MAX_ENDPOINTS)
+		LOOPBACK_STORAGE.endpoints[endpoint].channel = channel;
+}
+
+void PHY_loopback_get_stats (struct PHY_loopback_stats_t *stats)
+{
+	std::lock_guard < std::mutex > lock (LOOPBACK_STORAGE.mutex);
+	*stats = LOOPBACK_STORAGE.stats;
+}
+
+/**
+ * Passes frame delivered to the stack endpoint to link layer.
+ * @param data 	Frame.
+ * @param len 	Frame length.
+ */
+static void loopback_received (void *, uint8_t * data, uint8_t len)
+{
+	struct PHY_rx_info_t info;
+
+	info.timestamp = PHY_monotonic_ns ();
+	info.rssi = 0;
+	info.channel = LOOPBACK_STORAGE.channel;
+	info.bitrate = LOOPBACK_STORAGE.bitrate;
+	info.radio = 0;
+	LOOPBACK_STORAGE.callbacks.received (data, len, &info);
+}
+
+/**
+ * Attaches the stack to loopback bus.
+ * @param params 			Parameters of physical layer.
+ * @param callbacks 	Functions of upper layer.
+ * @return Returns false if bus is full, true otherwise.
+ */
+static bool loopback_init (struct PHY_init_t *params,
+													 const struct PHY_callbacks_t *callbacks)
+{
+	LOOPBACK_STORAGE.callbacks = *callbacks;
+	LOOPBACK_STORAGE.channel = params->channel;
+	LOOPBACK_STORAGE.band = params->band;
+	LOOPBACK_STORAGE.bitrate = params->bitrate;
+	LOOPBACK_STORAGE.power = params->power;
+	int endpoint = PHY_loopback_attach (params->channel, loopback_received, 0);
+	std::lock_guard < std::mutex > lock (LOOPBACK_STORAGE.mutex);
+	LOOPBACK_STORAGE.stack_endpoint = endpoint;
+	return endpoint >= 0;
+}
+
+/**
+ * Detaches the stack from loopback bus.
+ */
+static void loopback_stop ()
+{
+	int endpoint;
+	{
+		std::lock_guard < std::mutex > lock (LOOPBACK_STORAGE.mutex);
+		endpoint = LOOPBACK_STORAGE.stack_endpoint;
+		LOOPBACK_STORAGE.stack_endpoint = -1;
+	}
+	PHY_loopback_detach (endpoint);
+}
+
+/**
+ * Puts frame of the stack on bus, the channel is always clear
+ * and all endpoints receive every bitrate.
+ * @param radio Radio index, the stack has only radio 0.
+ * @param data 	Frame.
+ * @param len 	Frame length.
+ * @return Returns frame identifier, 0 if frame is refused.
+ */
+static uint32_t loopback_send (uint8_t radio, const uint8_t * data, uint8_t len, bool,
+															 uint8_t)
+{
+	// bitrate switch alone has nothing to send
+	if (radio != 0 || len == 0)
+		return 0;
+	return PHY_loopback_send (LOOPBACK_STORAGE.stack_endpoint, data, len);
+}
+
+static uint8_t loopback_get_noise (uint8_t)
+{
+	return 0;
+}
+
+static uint8_t loopback_get_measured_noise ()
+{
+	return 0;
+}
+
+static bool loopback_set_band (uint8_t band)
+{
+	LOOPBACK_STORAGE.band = band;
+	return true;
+}
+
+static bool loopback_set_channel (uint8_t radio, uint8_t channel)
+{
+	if (radio != 0)
+		return false;
+	LOOPBACK_STORAGE.channel = channel;
+	PHY_loopback_set_channel (LOOPBACK_STORAGE.stack_endpoint, channel);
+	return true;
+}
+
+static uint8_t loopback_get_channel (uint8_t)
+{
+	return LOOPBACK_STORAGE.channel;
+}
+
+static bool loopback_set_bitrate (uint8_t bitrate)
+{
+	LOOPBACK_STORAGE.bitrate = bitrate;
+	return true;
+}
+
+static bool loopback_set_power (uint8_t power)
+{
+	LOOPBACK_STORAGE.power = power;
+	return true;
+}
+
+static uint8_t loopback_get_radio_count ()
+{
+	return 1;
+}
+
+static uint8_t loopback_get_rx_radio ()
+{
+	return 0;
+}
+
+const struct PHY_backend_t PHY_LOOPBACK_BACKEND = {
+	"loopback",
+	loopback_init,
+	loopback_stop,
+	loopback_send,
+	loopback_get_noise,
+	loopback_get_measured_noise,
+	loopback_set_band,
+	loopback_set_channel,
+	loopback_get_channel,
+	loopback_set_bitrate,
+	loopback_set_power,
+	loopback_get_radio_count,
+	loopback_get_rx_radio
+};
@@ -0,0 +1,71 @@
+#ifndef MRF_LOOPBACK_H
+#define MRF_LOOPBACK_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*! maximum number of endpoints on loopback bus */
+#define LOOPBACK_MAX_ENDPOINTS 16
+/*! maximum number of frames waiting for delivery */
+#define LOOPBACK_QUEUE_SIZE 256
+
+/**
+ * Handler of frame delivered to endpoint.
+ * @param arg 			Argument passed to PHY_loopback_attach().
+ * @param data 			Frame.
+ * @param len 			Frame length.
+ */
+typedef void (*PHY_loopback_rx_t) (void *arg, uint8_t * data, uint8_t len);
+
+/**
+ * Counters of loopback bus.
+ */
+struct PHY_loopback_stats_t {
+	uint32_t sent;				/**< Number of frames put on bus. */
+	uint32_t delivered;		/**< Number of frame deliveries to endpoints. */
+	uint32_t dropped;			/**< Number of frames refused because of full queue. */
+};
+
+/**
+ * Attaches endpoint to loopback bus. Every frame sent on the bus is
+ * delivered to all other endpoints on the same channel, from the bus
+ * thread, in the order of sending.
+ * The stack using loopback backend is one of the endpoints, the others
+ * are attached by test or benchmark code acting as remote devices.
+ * @param channel 	Channel of endpoint.
+ * @param rx 				Handler of delivered frames.
+ * @param arg 			Argument of handler.
+ * @return Returns endpoint identifier, -1 if bus is full.
+ */
+int PHY_loopback_attach (uint8_t channel, PHY_loopback_rx_t rx, void *arg);
+
+/**
+ * Detaches endpoint, bus thread ends with the last endpoint.
+ * Must not be called from a handler of delivered frames.
+ * @param endpoint 	Endpoint identifier.
+ */
+void PHY_loopback_detach (int endpoint);
+
+/**
+ * Sends frame from endpoint.
+ * @param endpoint 	Endpoint identifier.
+ * @param data 			Frame.
+ * @param len 			Frame length.
+ * @return Returns frame identifier, 0 if frame is refused.
+ */
+uint32_t PHY_loopback_send (int endpoint, const uint8_t * data, uint8_t len);
+
+/**
+ * Moves endpoint to another channel.
+ * @param endpoint 	Endpoint identifier.
+ * @param channel 	Channel.
+ */
+void PHY_loopback_set_channel (int endpoint, uint8_t channel);
+
+/**
+ * Gets counters of loopback bus.
+ * @param stats 	Structure for counters.
+ */
+void PHY_loopback_get_stats (struct PHY_loopback_stats_t *stats);
+
+#endif
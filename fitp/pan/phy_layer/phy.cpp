@@ -1,9 +1,9 @@
-#include <glib.h>
 #include <stdlib.h>
 #include <iostream>
-#include <fstream>
 #include <fcntl.h>
 #include <unistd.h>
+#include <errno.h>
+#include <sys/eventfd.h>
 #include <string>
 #include <linux/spi/spidev.h>
 #include <linux/types.h>
@@ -14,252 +14,414 @@
 #include <condition_variable>
 #include <mutex>
 #include <chrono>
+#include <random>
+#include <atomic>
 #include "pan/debug.h"
 #include "common/phy_layer/constants.h"
+#include "common/phy_layer/sync_word.h"
 #include "phy.h"
+#include "spi.h"
+#include "gpio.h"
+#include "ring.h"
+#include "backend.h"
+#include "rt.h"
 
 using namespace std;
 
-#define SYSGPIO "/sys/class/gpio"
-#define PIN_IRQ0 "gpio274"
-#define PIN_IRQ1 "gpio275"
-#define PIN_RESET "gpio260"
+// GPIO character device, line offsets of MRF89XA pins of the first radio
+#define GPIOCHIP "/dev/gpiochip0"
+#define LINE_IRQ0 274
+#define LINE_IRQ1 275
+#define LINE_RESET 260
 
-// process synchronization during sending
-bool waiting_send = false;
-std::mutex m, mm, mmm;
-std::condition_variable cv;
+// SPI config of the first radio
+// http://linux-sunxi.org/SPIdev
+// SPI bus 0, chipselect 0
+#define DEVSPI_CONFIG "/dev/spidev32766.0"
+// SPI bus 0, chipselect 1
+#define DEVSPI_DATA "/dev/spidev32766.1"
+
+/*! number of frames waiting for transmission */
+#define PHY_TX_QUEUE_SIZE 16
+/*! maximum time of frame transmission */
+#define PHY_TX_TIMEOUT_MS 2000
+/*! default CSMA/CA backoff slot (us) */
+#define PHY_CSMA_SLOT_TIME_US 1000
+/*! default minimum backoff exponent */
+#define PHY_CSMA_MIN_BE 3
+/*! default maximum backoff exponent */
+#define PHY_CSMA_MAX_BE 5
+/*! default number of CCA attempts per frame */
+#define PHY_CSMA_MAX_ATTEMPTS 5
+/*! number of channels tracked by noise estimator */
+#define PHY_NOISE_CHANNELS 32
+/*! number of RSSI histogram bins */
+#define PHY_NOISE_BINS 16
+/*! width of RSSI histogram bin (RSSI is 7 bits) */
+#define PHY_NOISE_BIN_WIDTH 8
+/*! histogram is halved when it holds this number of samples */
+#define PHY_NOISE_HISTORY 1024
+/*! period of RSSI sampling while radio is idle (ms) */
+#define PHY_NOISE_SAMPLE_MS 100
+/*! radio adapted to other bitrate returns to base one after TX is silent
+ * for this time (ms), link layer retransmits within it */
+#define PHY_RATE_HOLD_MS 1000
+/*! number of samples needed before CCA window follows the noise floor */
+#define PHY_NOISE_MIN_SAMPLES 32
+/*! default distance of CCA threshold above noise floor */
+#define PHY_CCA_MARGIN 10
+/*! default period of IRQ1 polling (ms) */
+#define PHY_RX_POLL_INTERVAL_MS 1
+/*! default time without frame ending IRQ1 polling (ms) */
+#define PHY_RX_POLL_IDLE_MS 50
+/*! default period of watchdog register check (ms) */
+#define PHY_WATCHDOG_PERIOD_MS 1000
+/*! default number of consecutive TXDONE timeouts causing recovery */
+#define PHY_WATCHDOG_TX_TIMEOUTS 2
 
-//uint8_t rssi[1000] = {0};
+/**
+ * Noise estimate of one channel.
+ */
+struct PHY_noise_t {
+	uint16_t floor;													/**< Smoothed RSSI, 4 fractional bits. */
+	uint32_t samples;												/**< Number of samples. */
+	uint16_t histogram_total;								/**< Number of samples in histogram. */
+	uint16_t histogram[PHY_NOISE_BINS];			/**< RSSI histogram. */
+};
 
-struct PHY_storage_t {
-	uint8_t mode;
+/**
+ * Frame waiting for transmission.
+ */
+struct PHY_tx_frame_t {
+	uint32_t id;												/**< Frame identifier. */
+	bool cca;														/**< Flag if channel has to be clear before sending. */
+	uint8_t bitrate;										/**< Bitrate of frame or PHY_BITRATE_BASE. */
+	uint8_t len;												/**< Data length. */
+	uint8_t data[MAX_PHY_PAYLOAD_SIZE];	/**< Data. */
+};
+
+/**
+ * One MRF89XA transceiver with its own SPI devices, IRQ lines,
+ * channel and TX queue.
+ */
+struct PHY_radio_t {
+	uint8_t index;
+	std::string spi_config;
+	std::string spi_data;
+	std::string gpiochip;
+	uint32_t line_irq0;
+	uint32_t line_irq1;
+	uint32_t line_reset;
+
+	// written by tx_deamon, read by IRQ thread to tell RX from TXDONE
+	std::atomic < uint8_t > mode { RF_STANDBY };
 	uint8_t channel;
 	uint8_t band;
 	uint8_t bitrate;
+	// bitrate of PHY_init or PHY_set_bitrate, frames can switch radio to another one
+	uint8_t base_bitrate;
+	// end of exchange at other bitrate than base one (ns), 0 if not adapted
+	uint64_t rate_hold = 0;
 	uint8_t power;
-	uint8_t received_packet[MAX_PHY_PAYLOAD_SIZE];
+	// sync word recognized by packet handler
+	uint8_t sync[SYNC_WORD_LENGTH] = { SYNCV31REG_SET, SYNCV23REG_SET,
+																		 SYNCV15REG_SET, SYNCV07REG_SET };
+	// length byte and payload of frame which does not fit into RX ring
+	uint8_t received_packet[MAX_PHY_PAYLOAD_SIZE + 1];
+
+	// SPI transport, devices are opened once in PHY_init
+	struct SPI_transport_t spi;
+	uint32_t rx_frames = 0;
+	uint32_t rx_syscalls = 0;
+	uint32_t tx_frames = 0;
+	uint32_t tx_syscalls = 0;
+
+	// shadow copy of MRF89XA register file (indexed by address >> 1)
+	uint8_t registers[32];
+	uint32_t registers_valid = 0;
+	uint32_t writes_skipped = 0;
+	uint32_t writes = 0;
+	uint32_t reads_cached = 0;
+
+	// RX drain and start of transmission
+	std::mutex mm;
+
+	// TX queue, frames are sent by tx_deamon only
+	std::thread tx_deamon;
+	std::mutex tx_mutex;
+	std::condition_variable tx_cv;
+	struct PHY_tx_frame_t tx_queue[PHY_TX_QUEUE_SIZE];
+	uint8_t tx_head = 0;
+	uint8_t tx_count = 0;
+	bool tx_done = false;
+	bool terminate_tx = false;
+	// radio is owned by tx_deamon or by setter of its parameters
+	bool tx_busy = false;
+	struct PHY_tx_stats_t tx_stats;
+
+	// channel access
+	struct PHY_csma_t csma = { PHY_CSMA_SLOT_TIME_US, PHY_CSMA_MIN_BE,
+														 PHY_CSMA_MAX_BE, PHY_CSMA_MAX_ATTEMPTS };
+	std::minstd_rand backoff_random;
+
+	// noise floor tracking, guarded by tx_mutex
+	struct PHY_noise_t noise[PHY_NOISE_CHANNELS];
+	uint8_t cca_margin = PHY_CCA_MARGIN;
+
+	// IRQ lines on GPIO character device
+	// shared by IRQ and TX threads
+	std::atomic < bool > irq1_enabled { false };
+	std::atomic < bool > irq0_enabled { false };
+	int reset_fd = -1;
+	int irq1_fd = -1;
+	uint64_t irq0_timestamp = 0;
+	uint64_t irq1_timestamp = 0;
+
+	// switching between IRQ1 edges and polling, used by IRQ thread only,
+	// stats are guarded by stats_mutex
+	bool polling = false;
+	uint64_t last_rx_edge = 0;
+	uint64_t poll_idle_since = 0;
+	std::mutex stats_mutex;
+	struct PHY_rx_poll_stats_t poll_stats;
+
+	// watchdog, run by tx_deamon, stats guarded by tx_mutex
+	std::atomic < uint64_t > last_rx;
+	// the first frame sent after the last received one, 0 if there is none
+	std::atomic < uint64_t > unanswered_since;
+	uint64_t silence_recovery = 0;
+	uint64_t last_check = 0;
+	uint8_t tx_timeouts = 0;
+	struct PHY_health_stats_t health;
+
+	// start of radio initialization, stats are guarded by stats_mutex
+	uint64_t init_start = 0;
+	uint32_t init_writes = 0;
+	struct PHY_init_stats_t init_stats;
+};
+
+//uint8_t rssi[1000] = {0};
+
+struct PHY_storage_t {
+	// radios, the first one carries joining and broadcasts of single radio setups
+	struct PHY_radio_t radios[PHY_MAX_RADIOS];
+	uint8_t radio_count = 1;
+	struct PHY_radio_config_t configs[PHY_MAX_RADIOS] = {
+		{ DEVSPI_CONFIG, DEVSPI_DATA, GPIOCHIP, LINE_IRQ0, LINE_IRQ1, LINE_RESET, 0 }
+	};
+	bool running = false;
+
 	uint8_t cca_noise_threshold_max;
 	uint8_t cca_noise_threshold_min;
+	// identifiers of frames are unique across radios
+	std::atomic < uint32_t > tx_next_id;
+
+	// metadata of frame being processed by rx_deamon
 	uint8_t signal_strength;
+	uint8_t rx_radio = 0;
+	uint64_t rx_timestamp = 0;
+
+	// RX ring filled by IRQ thread, processed by rx_deamon, shared by radios
+	struct RING_t rx_ring;
+	std::thread rx_deamon;
+	int rx_wake_fd = -1;
+	std::atomic < bool > terminate_rx { false };
+	// polling disabled by default
+	struct PHY_rx_poll_t rx_poll = { 0, PHY_RX_POLL_INTERVAL_MS, PHY_RX_POLL_IDLE_MS };
+	struct PHY_watchdog_t watchdog = { PHY_WATCHDOG_PERIOD_MS, PHY_WATCHDOG_TX_TIMEOUTS, 0 };
+	bool warm_start = false;
 
 	// PAN coordinator setting
 	std::thread irq_interrupt_deamon;
-	std::thread timer_interrupt_generator;
-	bool irq1_enabled = false;
-	bool irq0_enabled = false;
-	GMainLoop *gloop;
-	bool terminate_timer = false;
+	// IRQ lines of all radios are served by one loop
+	struct GPIO_loop_t irq_loop;
+	struct PHY_callbacks_t callbacks;
 } PHY_STORAGE;
 
-/**
- * Extern functions.
- */
-extern void PHY_process_packet (uint8_t * data, uint8_t len);
-extern void PHY_timer_interrupt (void);
-
 /**
  * Support functions.
  */
-void set_register (uint8_t address, uint8_t value);
-uint8_t get_register (uint8_t address);
-void write_fifo (uint8_t data);
-void set_rf_mode (uint8_t mode);
-bool set_power (uint8_t power);
-bool set_bitrate (uint8_t bitrate);
-bool set_channel_freq_rate (uint8_t channel, uint8_t band, uint8_t bitrate);
-void send_reload_radio ();
-uint8_t get_cca_noise ();
-uint8_t PHY_get_noise ();
+void set_register (struct PHY_radio_t *radio, uint8_t address, uint8_t value);
+uint8_t get_register (struct PHY_radio_t *radio, uint8_t address);
+void write_fifo (struct PHY_radio_t *radio, uint8_t data);
+uint8_t read_frame (struct PHY_radio_t *radio, uint8_t * frame);
+void write_frame (struct PHY_radio_t *radio, const uint8_t * data, uint8_t len);
+void set_rf_mode (struct PHY_radio_t *radio, uint8_t mode);
+bool set_power (struct PHY_radio_t *radio, uint8_t power);
+bool set_bitrate (struct PHY_radio_t *radio, uint8_t bitrate);
+bool set_channel_freq_rate (struct PHY_radio_t *radio, uint8_t channel, uint8_t band,
+														uint8_t bitrate);
+void send_reload_radio (struct PHY_radio_t *radio);
+uint8_t get_cca_noise (struct PHY_radio_t *radio);
+void tx_deamon_f (struct PHY_radio_t *radio);
+void rx_deamon_f ();
 
 /**
  * Implemented functions from hw layer.
  */
-void HW_irq0_occurred (void);
-void HW_irq1_occurred (void);
-
-// SPI config
-// http://linux-sunxi.org/SPIdev
-// SPI bus 0, chipselect 0
-static const char *devspi_config = "/dev/spidev32766.0";
-// SPI bus 0, chipselect 1
-static const char *devspi_data = "/dev/spidev32766.1";
-static uint8_t mode = SPI_MODE_0;
-const uint8_t spi_bits_per_word = 8;
-const uint32_t spi_speed_hz = 1000000;
-struct spi_ioc_transfer xfer[2];
-
-static gboolean on_irq0_event (GIOChannel * channel, GIOCondition,
-														 gpointer)
-{
-	GError *error = 0;
-	gsize bytes_read = 0;
-	const int buf_sz = 1024;
-	gchar buf[buf_sz] = { };
-
-	g_io_channel_seek_position (channel, 0, G_SEEK_SET, 0);
-	g_io_channel_read_chars (channel, buf, buf_sz - 1, &bytes_read, &error);
-	if (PHY_STORAGE.irq0_enabled) {
-		HW_irq0_occurred ();
-	}
-	return 1;
-}
+void HW_irq0_occurred (struct PHY_radio_t *radio);
+void HW_irq1_occurred (struct PHY_radio_t *radio);
 
-static gboolean on_irq1_event (GIOChannel * channel, GIOCondition,
-														 gpointer)
+/**
+ * Edge on IRQ0 line.
+ * @param arg 			Radio.
+ * @param timestamp Monotonic time of the edge (ns).
+ */
+static void on_irq0_event (void *arg, uint64_t timestamp)
 {
-	GError *error = 0;
-	gsize bytes_read = 0;
-	const int buf_sz = 1024;
-	gchar buf[buf_sz] = { };
-
-	g_io_channel_seek_position (channel, 0, G_SEEK_SET, 0);
-	g_io_channel_read_chars (channel, buf, buf_sz - 1, &bytes_read, &error);
-	if (PHY_STORAGE.irq0_enabled) {
-		HW_irq1_occurred ();
+	struct PHY_radio_t *radio = (struct PHY_radio_t *) arg;
+	rt_latency_record (PHY_THREAD_IRQ, timestamp, PHY_monotonic_ns ());
+	radio->irq0_timestamp = timestamp;
+	if (radio->irq0_enabled) {
+		HW_irq0_occurred (radio);
 	}
-	return 1;
 }
 
-int spi_open_config (void)
+/**
+ * Masks IRQ1 of radio, frames are drained by poll_radios() from now.
+ * @param radio Radio.
+ */
+static void enter_polling (struct PHY_radio_t *radio)
 {
-	int fd = open (devspi_config, O_RDWR);
-	if (fd < 0) {
-		cerr << "Can't open SPI device!" << endl;
-	}
-	return fd;
+	if (!gpio_loop_enable (&PHY_STORAGE.irq_loop, radio->irq1_fd, false))
+		return;
+	radio->polling = true;
+	radio->poll_idle_since = PHY_monotonic_ns ();
+	std::lock_guard < std::mutex > lock (radio->stats_mutex);
+	radio->poll_stats.entries++;
+	D_PHY printf ("radio %d: RX polling\n", radio->index);
 }
 
-int spi_open_data (void)
+/**
+ * Unmasks IRQ1 of radio. Edges queued while polling are stale, frames
+ * were drained according to line level, so they are discarded and the
+ * level is checked once more for edge lost in between.
+ * @param radio Radio.
+ */
+static void leave_polling (struct PHY_radio_t *radio)
 {
-	int fd = open (devspi_data, O_RDWR);
-
-	if (fd < 0) {
-		cerr << "Can't open SPI device!" << endl;
+	uint8_t level;
+	uint32_t drained = gpio_drain (radio->irq1_fd);
+
+	gpio_loop_enable (&PHY_STORAGE.irq_loop, radio->irq1_fd, true);
+	radio->polling = false;
+	{
+		std::lock_guard < std::mutex > lock (radio->stats_mutex);
+		radio->poll_stats.drained_edges += drained;
+		radio->poll_stats.exits++;
 	}
-	if (ioctl (fd, SPI_IOC_WR_MODE, &mode) < 0) {
-		cerr << "Can't set spi mode!" << endl;
-		return -1;
+	D_PHY printf ("radio %d: RX interrupts\n", radio->index);
+	if (gpio_get_value (radio->irq1_fd, &level) && level) {
+		// no edge of this frame, the level is seen now
+		radio->irq1_timestamp = PHY_monotonic_ns ();
+		HW_irq1_occurred (radio);
 	}
-	return fd;
-}
-
-int spi_bus_config (int)
-{
-	// length of command to write
-	//xfer[0].len = 3;
-	// keep CS activated
-	xfer[0].cs_change = 0;
-	// delay in us
-	xfer[0].delay_usecs = 0;
-	// speed
-	xfer[0].speed_hz = spi_speed_hz;
-	// bites per word 8
-	xfer[0].bits_per_word = spi_bits_per_word;
-
-	// length of command to write
-	//xfer[0].len = 3;
-	// keep CS activated
-	xfer[1].cs_change = 0;
-	// delay in us
-	xfer[1].delay_usecs = 0;
-	// speed
-	xfer[1].speed_hz = spi_speed_hz;
-	// bites per word 8
-	xfer[1].bits_per_word = spi_bits_per_word;
-	return 0;
-}
-
-void gpio_export (int pin)
-{
-	ofstream fd;
-	fd.open (SYSGPIO "/export");
-	// IRQ0
-	fd << int (pin);
-	fd.close ();
-}
-
-void gpio_set_direction (string gpio, string dir)
-{
-	ofstream fd;
-	string dir_file = string (SYSGPIO "/") + gpio + string ("/direction");
-	fd.open (dir_file.c_str ());
-	fd << dir.c_str ();
-	fd.close ();
-}
-
-void gpio_set_edge (string gpio, string edge)
-{
-	ofstream fd;
-	string edge_file = string (SYSGPIO "/") + gpio + string ("/edge");
-	fd.open (edge_file.c_str ());
-	fd << edge.c_str ();
-	fd.close ();
 }
 
-void gpio_set_value (string gpio, string value)
+/**
+ * Polls IRQ1 level of radios in burst, called by IRQ loop after every wakeup.
+ * @return Returns time to the next poll (ms), -1 if no radio is polled.
+ */
+static int poll_radios (void *)
 {
-	ofstream fd;
-	string value_file = string (SYSGPIO "/") + gpio + string ("/value");
-	fd.open (value_file.c_str ());
-	fd << value.c_str ();
-	fd.close ();
+	bool polling = false;
+	uint64_t now = PHY_monotonic_ns ();
+
+	for (uint8_t i = 0; i < PHY_STORAGE.radio_count; i++) {
+		struct PHY_radio_t *radio = &PHY_STORAGE.radios[i];
+		uint8_t level;
+
+		if (!radio->polling)
+			continue;
+		// TXDONE is signalled by edge
+		if (radio->mode != RF_RECEIVER) {
+			leave_polling (radio);
+			continue;
+		}
+		{
+			std::lock_guard < std::mutex > lock (radio->stats_mutex);
+			radio->poll_stats.polls++;
+		}
+		if (gpio_get_value (radio->irq1_fd, &level) && level) {
+			// last edge belongs to the frame which started the burst
+			radio->irq1_timestamp = now;
+			HW_irq1_occurred (radio);
+			radio->poll_idle_since = now;
+			std::lock_guard < std::mutex > lock (radio->stats_mutex);
+			radio->poll_stats.polled_frames++;
+		}
+		else if (now - radio->poll_idle_since >= PHY_STORAGE.rx_poll.idle_ms * 1000000ULL) {
+			leave_polling (radio);
+			continue;
+		}
+		polling = true;
+	}
+	return polling ? PHY_STORAGE.rx_poll.interval_ms : -1;
 }
 
-bool gpio_get_value (string gpio)
+/**
+ * Edge on IRQ1 line.
+ * @param arg 			Radio.
+ * @param timestamp Monotonic time of the edge (ns).
+ */
+static void on_irq1_event (void *arg, uint64_t timestamp)
 {
-	ifstream fd;
-	char val[1];
-	string value_file = string (SYSGPIO "/") + gpio + string ("/value");
-	fd.open (value_file.c_str ());
-	fd.read (val, 1);
-	//fd << value.c_str();
-	fd.close ();
-	if (val[0] == '0')
-		return false;
-	return true;
+	struct PHY_radio_t *radio = (struct PHY_radio_t *) arg;
+	rt_latency_record (PHY_THREAD_IRQ, timestamp, PHY_monotonic_ns ());
+	radio->irq1_timestamp = timestamp;
+	if (radio->irq1_enabled) {
+		bool receiving = radio->mode == RF_RECEIVER;
+		HW_irq1_occurred (radio);
+		if (receiving) {
+			{
+				std::lock_guard < std::mutex > lock (radio->stats_mutex);
+				radio->poll_stats.irq_edges++;
+			}
+			// frames come close to each other, burst is starting
+			if (PHY_STORAGE.rx_poll.enter_gap_ms > 0 && radio->last_rx_edge > 0 && !radio->polling
+					&& timestamp - radio->last_rx_edge < PHY_STORAGE.rx_poll.enter_gap_ms * 1000000ULL)
+				enter_polling (radio);
+			radio->last_rx_edge = timestamp;
+		}
+	}
 }
 
-void reset_MRF (void)
+void reset_MRF (struct PHY_radio_t *radio)
 {
-	gpio_set_value (PIN_RESET, "1");
+	// register file returns to power-on values
+	radio->registers_valid = 0;
+	gpio_set_value (radio->reset_fd, 1);
 	usleep (100);
-	gpio_set_value (PIN_RESET, "0");
+	gpio_set_value (radio->reset_fd, 0);
 	// waiting for 10 ms, then MRF is ready
 	usleep (10000);
 }
 
-void init_io (void)
+/**
+ * Requests RESET and IRQ lines of radio, IRQ lines are added to shared loop.
+ * @param radio Radio.
+ */
+void init_io (struct PHY_radio_t *radio)
 {
-	ofstream fd;
-	GIOChannel *channel;
-	GIOCondition cond;
-	int irq0_fd, irq1_fd;
+	const char *chip = radio->gpiochip.c_str ();
 
-	// export gpio (default input direction)
-	// IRQ0
-	gpio_export (274);
-	// IRQ1
-	gpio_export (275);
 	// RESET
-	gpio_export (260);
-	gpio_set_direction (PIN_RESET, "out");
-	gpio_set_value (PIN_RESET, "0");
-
-	// set gpio interrupt edge
-	gpio_set_edge (PIN_IRQ0, "rising");
-	gpio_set_edge (PIN_IRQ1, "rising");
-
-	// init callbacks
-	irq0_fd = open (SYSGPIO "/gpio274/value", O_RDONLY | O_NONBLOCK);
-	channel = g_io_channel_unix_new (irq0_fd);
-	cond = GIOCondition (G_IO_PRI);
-	/*guint idIRQ0 = */ g_io_add_watch (channel, cond, on_irq0_event, 0);
-
-	irq1_fd = open (SYSGPIO "/gpio275/value", O_RDONLY | O_NONBLOCK);
-	channel = g_io_channel_unix_new (irq1_fd);
-	cond = GIOCondition (G_IO_PRI);
-	/*guint idIRQ1 = */ g_io_add_watch (channel, cond, on_irq1_event, 0);
+	radio->reset_fd = gpio_request_output (chip, radio->line_reset, 0, "fitp-reset");
+	// IRQ0, IRQ1 (rising edge)
+	int irq0_fd = gpio_request_irq (chip, radio->line_irq0, "fitp-irq0");
+	int irq1_fd = gpio_request_irq (chip, radio->line_irq1, "fitp-irq1");
+	radio->irq1_fd = irq1_fd;
+	// lines added to loop are closed by gpio_loop_close()
+	bool irq0_added = gpio_loop_add (&PHY_STORAGE.irq_loop, irq0_fd, on_irq0_event, radio);
+	if (irq0_added && gpio_loop_add (&PHY_STORAGE.irq_loop, irq1_fd, on_irq1_event, radio))
+		return;
+	cerr << "init_io(): IRQ lines of radio " << (int) radio->index
+		<< " are not available!" << endl;
+	if (!irq0_added && irq0_fd >= 0)
+		close (irq0_fd);
+	if (irq1_fd >= 0)
+		close (irq1_fd);
+	radio->irq1_fd = -1;
 }
 
 // Constant table
@@ -280,22 +442,6 @@ uint16_t _channel_compare (uint8_t band, uint8_t channel, uint8_t bitrate)
 	return (uint16_t) (channel_compare_tmp / ((uint32_t) 9 * FXTAL));
 }
 
-/**
- * Finds out number of channels.
- * @params band 		Band.
- * @params bitrate 	Bitrate.
- * @return Returns number of channels for band and bitrate.
- */
-uint8_t channel_amount (uint8_t band, uint8_t bitrate)
-{
-	if ((band == BAND_863 || band == BAND_863_C950)
-			&& (bitrate == DATA_RATE_100 || bitrate == DATA_RATE_200)) {
-		return 25;
-	} else {
-		return 32;
-	}
-}
-
 /**
  * Defines rvalue.
  * @return Returns rvalue.
@@ -336,114 +482,158 @@ uint8_t s_value (uint8_t band, uint8_t channel, uint8_t bitrate)
 }
 
 /**
- * Accesses control register of MRF89XA.
+ * Checks if register can be changed by MRF89XA itself or if writing
+ * to it has side effects (FIFO overrun and PLL lock bits are cleared
+ * by writing 1). Such registers are never served from shadow copy.
  * @param address Address of register.
- * @param value   Register setting.
+ * @return Returns true if register is volatile, false otherwise.
  */
-void set_register (const uint8_t address, const uint8_t value)
+bool is_volatile_register (uint8_t address)
 {
-	int fd;
-	char wr_buf[2];
-
-	fd = spi_open_config ();
-	spi_bus_config (fd);
+	return address == FTXRXIREG || address == FTPRIREG || address == RSTSREG;
+}
 
-	wr_buf[0] = address;
-	wr_buf[1] = value;
+/**
+ * Drops registers whose queued write failed from shadow copy
+ * (SPI mutex has to be locked).
+ * @param radio Radio.
+ */
+static void drop_lost_writes (struct PHY_radio_t *radio)
+{
+	radio->registers_valid &= ~radio->spi.lost_writes;
+	radio->spi.lost_writes = 0;
+}
 
-	xfer[0].tx_buf = (unsigned long) wr_buf;
-	xfer[0].len = 2;
-	xfer[0].rx_buf = 0;
-	if (ioctl (fd, SPI_IOC_MESSAGE (1), xfer) < 0) {
-		D_PHY printf ("set_register(): Can't write register!\n");
+/**
+ * Accesses control register of MRF89XA.
+ * Write is skipped if shadow copy holds the same value, shadow copy
+ * takes only values which were sent to the chip.
+ * @param address Address of register.
+ * @param value   Register setting.
+ */
+void set_register (struct PHY_radio_t *radio, const uint8_t address, const uint8_t value)
+{
+	uint8_t index = (address >> 1) & 0x1f;
+
+	std::lock_guard < std::recursive_mutex > lock (radio->spi.mutex);
+	drop_lost_writes (radio);
+	if (!is_volatile_register (address)
+			&& (radio->registers_valid & (1UL << index))
+			&& radio->registers[index] == value) {
+		radio->writes_skipped++;
+		return;
+	}
+	radio->writes++;
+	if (!spi_write_register (&radio->spi, address, value)) {
+		// value is unknown, the next write is not skipped
+		radio->registers_valid &= ~(1UL << index);
 		return;
 	}
-	close (fd);
+	// queued write which fails later is dropped by drop_lost_writes()
+	if (!is_volatile_register (address)) {
+		radio->registers[index] = value;
+		radio->registers_valid |= (1UL << index);
+	}
 }
 
 /**
  * Reads back register value.
+ * Static registers are served from shadow copy.
  * @param 	address Address of register.
  * @return  Return register value.
  */
-uint8_t get_register (uint8_t address)
+uint8_t get_register (struct PHY_radio_t *radio, uint8_t address)
 {
-	int fd;
-	char wr_buf[1];
-	char rd_buf[1];
-
-	std::lock_guard < std::mutex > lock (mmm);
-
-	fd = spi_open_config ();
-	spi_bus_config (fd);
-
-	wr_buf[0] = (address | 0x40) & 0x7e;
-	xfer[0].tx_buf = (unsigned long) wr_buf;
-	xfer[0].len = 1;
-	xfer[0].rx_buf = 0;
-	xfer[1].rx_buf = (unsigned long) rd_buf;
-	xfer[1].len = 1;
-
-	if (ioctl (fd, SPI_IOC_MESSAGE (2), xfer) < 0) {
+	uint8_t index = (address >> 1) & 0x1f;
+
+	std::lock_guard < std::recursive_mutex > lock (radio->spi.mutex);
+	drop_lost_writes (radio);
+	if (!is_volatile_register (address)
+			&& (radio->registers_valid & (1UL << index))) {
+		radio->reads_cached++;
+		return radio->registers[index];
+	}
+	uint8_t value = 0;
+	if (!spi_read_registers (&radio->spi, &address, &value, 1)) {
 		cerr << "Can't read register!" << endl;
-		return 0;
+		return value;
 	}
-
-	close (fd);
-	return (uint8_t) rd_buf[0];
+	if (!is_volatile_register (address)) {
+		radio->registers[index] = value;
+		radio->registers_valid |= (1UL << index);
+	}
+	return value;
 }
 
 /**
  * Reads FIFO.
  * @return Returns read char.
  */
-uint8_t read_fifo (void)
+uint8_t read_fifo (struct PHY_radio_t *radio)
 {
-	int fd = 0;
-
-	char rd_buf[1];
-	fd = spi_open_data ();
-	spi_bus_config (fd);
-	if (read (fd, rd_buf, 1) != 1) {
-		cerr << "Read error" << endl;
-		return -1;
-	}
-	close (fd);
-	return rd_buf[0];
+	return spi_read_fifo (&radio->spi);
 }
 
 /**
  * Fills FIFO.
  * @param data Data to be sent to FIFO.
  */
-void write_fifo (const uint8_t data)
+void write_fifo (struct PHY_radio_t *radio, const uint8_t data)
 {
-	int fd;
-	uint8_t data_nostack = data;
+	spi_write_fifo (&radio->spi, data);
+}
 
-	fd = spi_open_data ();
-	spi_bus_config (fd);
+/**
+ * Drains one frame from FIFO.
+ * Length byte is read first, then the whole payload is fetched by one
+ * chained transfer on data interface.
+ * @param frame Array for length byte and payload (MAX_PHY_PAYLOAD_SIZE + 1).
+ * @return Returns number of read bytes including length byte,
+ *         0 if FIFO is empty or frame is malformed.
+ */
+uint8_t read_frame (struct PHY_radio_t *radio, uint8_t * frame)
+{
+	if ((get_register (radio, FTXRXIREG) & 0x02) == 0)
+		return 0;
 
-	xfer[0].tx_buf = (unsigned long) &data_nostack;
-	xfer[0].len = 1;
-	xfer[0].rx_buf = 0;
-	if (ioctl (fd, SPI_IOC_MESSAGE (1), xfer) < 0) {
-		D_PHY printf ("Can't write register!\n");
-		return;
+	frame[0] = read_fifo (radio);
+	if (frame[0] == 0 || frame[0] > MAX_PHY_PAYLOAD_SIZE
+			|| !spi_read_fifo_burst (&radio->spi, frame + 1, frame[0])) {
+		// invalid length, drop rest of FIFO (64 B at most)
+		for (uint8_t i = 0; i < 64 && (get_register (radio, FTXRXIREG) & 0x02); i++)
+			read_fifo (radio);
+		return 0;
 	}
-	close (fd);
+	return frame[0] + 1;
+}
+
+/**
+ * Fills FIFO with length byte and frame by one chained transfer.
+ * @param data 	Data.
+ * @param len 	Data length.
+ */
+void write_frame (struct PHY_radio_t *radio, const uint8_t * data, uint8_t len)
+{
+	uint8_t frame[MAX_PHY_PAYLOAD_SIZE + 1];
+
+	if (len > MAX_PHY_PAYLOAD_SIZE)
+		len = MAX_PHY_PAYLOAD_SIZE;
+	frame[0] = len;
+	for (uint8_t i = 0; i < len; i++)
+		frame[i + 1] = data[i];
+	spi_write_fifo_burst (&radio->spi, frame, len + 1);
 }
 
 /**
  * Sets MRF89XA transceiver operating mode to sleep, transmit, receive or standby.
  * @param mode Mode.
  */
-void set_rf_mode (uint8_t mode)
+void set_rf_mode (struct PHY_radio_t *radio, uint8_t mode)
 {
 	if ((mode == RF_TRANSMITTER) || (mode == RF_RECEIVER) ||
 			(mode == RF_SYNTHESIZER) || (mode == RF_STANDBY) || (mode == RF_SLEEP)) {
-		set_register (GCONREG, (GCONREG_SET & 0x1F) | mode);
-		PHY_STORAGE.mode = mode;
+		set_register (radio, GCONREG, (GCONREG_SET & 0x1F) | mode);
+		radio->mode = mode;
 	}
 }
 
@@ -455,29 +645,47 @@ void set_rf_mode (uint8_t mode)
  * @param bitrate		Bitrate.
  * @return Returns true, if channel setting is successful, false otherwise.
  */
-bool set_channel_freq_rate (uint8_t channel, uint8_t band, uint8_t bitrate)
+bool set_channel_freq_rate (struct PHY_radio_t *radio, uint8_t channel, uint8_t band,
+														uint8_t bitrate)
 {
-	if (channel >= channel_amount (band, bitrate)) {
+	if (channel >= PHY_channel_amount (band, bitrate)) {
 		return false;
 	}
-	PHY_STORAGE.channel = channel;
-	PHY_STORAGE.band = band;
-	PHY_STORAGE.bitrate = bitrate;
-	D_PHY printf ("channel %d, band %d, bitrate %d\n", channel, band, bitrate);
+	radio->channel = channel;
+	radio->band = band;
+	radio->bitrate = bitrate;
+	D_PHY printf ("radio %d: channel %d, band %d, bitrate %d\n", radio->index, channel, band,
+							bitrate);
 	// R, P, S register setting
-	set_register (R1CNTREG, r_value ());
-	set_register (P1CNTREG, p_value (band, channel, bitrate));
-	set_register (S1CNTREG, s_value (band, channel, bitrate));
+	spi_batch_begin (&radio->spi);
+	set_register (radio, R1CNTREG, r_value ());
+	set_register (radio, P1CNTREG, p_value (band, channel, bitrate));
+	set_register (radio, S1CNTREG, s_value (band, channel, bitrate));
+	spi_batch_end (&radio->spi);
 
 	return true;
 }
 
+/**
+ * Writes sync word of radio to SYNCV31REG - SYNCV07REG.
+ * @param radio Radio.
+ */
+void set_sync_word (struct PHY_radio_t *radio)
+{
+	spi_batch_begin (&radio->spi);
+	set_register (radio, SYNCV31REG, radio->sync[0]);
+	set_register (radio, SYNCV23REG, radio->sync[1]);
+	set_register (radio, SYNCV15REG, radio->sync[2]);
+	set_register (radio, SYNCV07REG, radio->sync[3]);
+	spi_batch_end (&radio->spi);
+}
+
 /**
  * Sets bitrate for RF transceiver.
  * @param bitrate Bitrate.
  * @return Returns true, if bitrate setting is successful, false otherwise.
  */
-bool set_bitrate (uint8_t bitrate)
+bool set_bitrate (struct PHY_radio_t *radio, uint8_t bitrate)
 {
 	uint8_t datarate;
 	uint8_t bandwidth;
@@ -537,9 +745,11 @@ bool set_bitrate (uint8_t bitrate)
 		filcon_set = FILCON_SET_987;
 		break;
 	}
-	set_register (BRREG, datarate);
-	set_register (FILCONREG, filcon_set | bandwidth);
-	set_register (FDEVREG, freq_dev);
+	spi_batch_begin (&radio->spi);
+	set_register (radio, BRREG, datarate);
+	set_register (radio, FILCONREG, filcon_set | bandwidth);
+	set_register (radio, FDEVREG, freq_dev);
+	spi_batch_end (&radio->spi);
 	return true;
 }
 
@@ -548,99 +758,177 @@ bool set_bitrate (uint8_t bitrate)
  * @param power RF transceiver output power.
  * @return Returns true, if output power setting is successful, false otherwise.
  */
-bool set_power (uint8_t power)
+bool set_power (struct PHY_radio_t *radio, uint8_t power)
 {
 	if (power > TX_POWER_N_8_DB) {
 		return false;
 	}
 	//set value 1111xxx(r)
-	set_register (TXPARAMREG, 0xF0 | (power << 1));
-	PHY_STORAGE.power = power;
+	set_register (radio, TXPARAMREG, 0xF0 | (power << 1));
+	radio->power = power;
 	return true;
 }
 
 /**
  * Synthetises RF.
  */
-void send_reload_radio ()
+void send_reload_radio (struct PHY_radio_t *radio)
 {
-	set_rf_mode (RF_STANDBY);
-	set_rf_mode (RF_SYNTHESIZER);
-	set_register (FTPRIREG, (FTPRIREG_SET & 0xFD) | 0x02);
-	set_rf_mode (RF_STANDBY);
-	set_rf_mode (RF_RECEIVER);
+	set_rf_mode (radio, RF_STANDBY);
+	set_rf_mode (radio, RF_SYNTHESIZER);
+	set_register (radio, FTPRIREG, (FTPRIREG_SET & 0xFD) | 0x02);
+	set_rf_mode (radio, RF_STANDBY);
+	set_rf_mode (radio, RF_RECEIVER);
 }
 
 /**
  * Reads RSSI value.
  * @return Returns RSSI value.
  */
-uint8_t get_cca_noise ()
+uint8_t get_cca_noise (struct PHY_radio_t *radio)
 {
-	return get_register (RSTSREG) >> 1;
+	return get_register (radio, RSTSREG) >> 1;
 }
 
 /**
  * Reads stored RSSI value.
  * @return Returns stored RSSI value.
  */
-uint8_t PHY_get_measured_noise()
+static uint8_t mrf_get_measured_noise ()
 {
 	return PHY_STORAGE.signal_strength;
 }
 
+/*! registers which keep configured value in every mode, checked for radio health */
+static const uint8_t sentinel_registers[] = { FIFOCREG, SYNCREG, SYNCV31REG, SYNCV07REG, PCONREG };
+
+/**
+ * Reads back register file of radio left running by previous start.
+ * If sentinel registers hold values of initial configuration, radio is
+ * healthy, reset is skipped and shadow copy is filled, so configure_radio()
+ * rewrites only registers which differ.
+ * @param radio Radio.
+ * @return Returns true if radio can be started warm, false otherwise.
+ */
+static bool warm_start_radio (struct PHY_radio_t *radio)
+{
+	uint8_t addresses[32];
+	uint8_t values[32];
+
+	for (uint8_t i = 0; i < 32; i++)
+		addresses[i] = i << 1;
+	if (radio->spi.config_fd < 0 || !spi_read_registers (&radio->spi, addresses, values, 32))
+		return false;
+	for (uint8_t i = 0; i < sizeof (sentinel_registers); i++) {
+		uint8_t address = sentinel_registers[i];
+		// sync word is set by upper layer after start (NID derived one with
+		// sync filter), the previous run could leave any of them
+		if (address >= SYNCV31REG && address <= SYNCV07REG)
+			continue;
+		if (values[(address >> 1) & 0x1f] != init_config_regs[(address >> 1) & 0x1f]) {
+			D_PHY printf ("radio %d: register 0x%02x is 0x%02x, cold start\n", radio->index,
+										address, values[(address >> 1) & 0x1f]);
+			return false;
+		}
+	}
+	std::lock_guard < std::recursive_mutex > lock (radio->spi.mutex);
+	radio->registers_valid = 0;
+	for (uint8_t i = 0; i < 32; i++) {
+		if (is_volatile_register (i << 1))
+			continue;
+		radio->registers[i] = values[i];
+		radio->registers_valid |= (1UL << i);
+	}
+	return true;
+}
+
 /*
- * Initializes HW layer.
+ * Initializes HW layer of radio, SPI transport has to be open.
+ * @param radio Radio.
  */
-void HW_init (void)
+void HW_init (struct PHY_radio_t *radio)
 {
-	init_io ();
-	reset_MRF ();
+	init_io (radio);
+	bool warm = PHY_STORAGE.warm_start && warm_start_radio (radio);
+	{
+		std::lock_guard < std::mutex > lock (radio->stats_mutex);
+		radio->init_stats.warm = warm;
+	}
+	if (!warm)
+		reset_MRF (radio);
 }
 
 /**
  * Interrupt request 0 (IRQ0) occured.
+ * @param radio Radio.
  */
-void HW_irq0_occurred (void)
+void HW_irq0_occurred (struct PHY_radio_t *)
 {
 }
 
 /**
  * Interrupt request 1 (IRQ1) occured.
+ * IRQ thread of all radios is the only producer of RX ring.
+ * @param radio Radio.
  */
-void HW_irq1_occurred (void)
+void HW_irq1_occurred (struct PHY_radio_t *radio)
 {
 	//cout << "in HW_irq1_occurred\n";
-	if (PHY_STORAGE.mode == RF_RECEIVER) {
-		PHY_STORAGE.signal_strength = PHY_get_noise();
-		//D_PHY printf("RSSI: %d\n", PHY_STORAGE.signal_strength);
+	if (radio->mode == RF_RECEIVER) {
+		// FIFO is drained even if RX ring is full, the frame is lost then
+		struct RING_slot_t *slot = ring_reserve (&PHY_STORAGE.rx_ring);
+		uint8_t *frame = slot ? slot->data : radio->received_packet;
+		uint8_t rssi = get_cca_noise (radio);
+		//D_PHY printf("RSSI: %d\n", rssi);
 		uint8_t received_len = 0;
 		//D_PHY printf ("RF_RECEIVER\n");
 		{
-			std::lock_guard < std::mutex > lock (mm);
-			PHY_STORAGE.irq1_enabled = false;
-			PHY_STORAGE.irq0_enabled = false;
-
-			uint8_t fifo_stat = get_register (FTXRXIREG);
+			std::lock_guard < std::mutex > lock (radio->mm);
+			uint32_t syscalls = radio->spi.stats.syscalls;
+			radio->irq1_enabled = false;
+			radio->irq0_enabled = false;
 
-			while (fifo_stat & 0x02) {
-				PHY_STORAGE.received_packet[received_len++] = read_fifo ();
-				fifo_stat = get_register (FTXRXIREG);
-			}
+			received_len = read_frame (radio, frame);
 
 			/*for(uint8_t i = 0; i < received_len; i++)
-				printf("%02x ", PHY_STORAGE.received_packet[i]);
+				printf("%02x ", frame[i]);
 			printf("\n");*/
-			PHY_STORAGE.irq1_enabled = true;
-			PHY_STORAGE.irq0_enabled = true;
+			radio->irq1_enabled = true;
+			radio->irq0_enabled = true;
+			if (received_len > 0)
+				radio->rx_frames++;
+			radio->rx_syscalls += radio->spi.stats.syscalls - syscalls;
 		}
 
-		if (received_len == 0 || received_len - 1 != PHY_STORAGE.received_packet[0]) {
+		if (received_len == 0 || received_len - 1 != frame[0]) {
 			//cout << "empty\n ";
 			return;
 		}
-		// send data without the first byte
-		PHY_process_packet (PHY_STORAGE.received_packet + 1, received_len - 1);
+		if (!slot) {
+			D_PHY printf ("HW_irq1_occurred(): RX ring overflow!\n");
+			PHY_STORAGE.rx_ring.stats.overflows++;
+			return;
+		}
+		slot->len = received_len - 1;
+		slot->rssi = rssi;
+		slot->timestamp = radio->irq1_timestamp;
+		slot->radio = radio->index;
+		slot->channel = radio->channel;
+		slot->bitrate = radio->bitrate;
+		ring_commit (&PHY_STORAGE.rx_ring);
+		radio->last_rx = PHY_monotonic_ns ();
+		radio->unanswered_since = 0;
+
+		// wake up RX deamon
+		uint64_t one = 1;
+		if (write (PHY_STORAGE.rx_wake_fd, &one, sizeof (one)) < 0)
+			D_PHY printf ("HW_irq1_occurred(): wake up failed!\n");
+	}
+	else if (radio->mode == RF_TRANSMITTER) {
+		// TXDONE, wake up TX deamon
+		std::lock_guard < std::mutex > lock (radio->tx_mutex);
+		radio->tx_done = true;
+		radio->tx_cv.notify_all ();
 	}
 	else {
 		D_PHY printf("HW_irq1occurred(): NOT in RF_RECEIVER mode\n");
@@ -648,53 +936,72 @@ void HW_irq1_occurred (void)
 }
 
 /*
- * Interrupt waiting thread.
+ * Protocol thread, processes frames stored in RX ring by IRQ thread.
  */
-void irq_interrupt_deamon_f ()
+void rx_deamon_f ()
 {
-	PHY_STORAGE.gloop = g_main_loop_new (0, 0);
-	g_main_loop_run (PHY_STORAGE.gloop);
+	uint64_t events;
+	struct RING_slot_t *slot;
+	struct PHY_rx_info_t info;
+
+	rt_thread_setup (PHY_THREAD_RX);
+	while (!PHY_STORAGE.terminate_rx) {
+		while ((slot = ring_peek (&PHY_STORAGE.rx_ring)) != 0) {
+			rt_latency_record (PHY_THREAD_RX, slot->timestamp, PHY_monotonic_ns ());
+			// metadata of frame being processed
+			PHY_STORAGE.signal_strength = slot->rssi;
+			PHY_STORAGE.rx_timestamp = slot->timestamp;
+			PHY_STORAGE.rx_radio = slot->radio;
+			info.timestamp = slot->timestamp;
+			info.rssi = slot->rssi;
+			info.channel = slot->channel;
+			info.bitrate = slot->bitrate;
+			info.radio = slot->radio;
+			// send data without the first byte
+			PHY_STORAGE.callbacks.received (slot->data + 1, slot->len, &info);
+			ring_release (&PHY_STORAGE.rx_ring);
+		}
+		// blocks until the next frame is committed
+		if (read (PHY_STORAGE.rx_wake_fd, &events, sizeof (events)) < 0 && errno != EINTR) {
+			cerr << "rx_deamon_f(): wake up failed!" << endl;
+			return;
+		}
+	}
 }
 
-
-void timer_interrupt_generator_f ()
+/*
+ * Interrupt waiting thread.
+ */
+void irq_interrupt_deamon_f ()
 {
-	while (!PHY_STORAGE.terminate_timer) {
-		std::this_thread::sleep_for (std::chrono::milliseconds (50/*300*/));
-
-		PHY_timer_interrupt ();
-	}
+	rt_thread_setup (PHY_THREAD_IRQ);
+	gpio_loop_run (&PHY_STORAGE.irq_loop);
 }
 
 /**
- * Initializes physical layer.
- * @param phy_params Parameters of physical layer.
+ * Tunes radio and writes the rest of its register file.
+ * @param radio 			Radio.
+ * @param phy_params 	Parameters of physical layer.
+ * @param channel 		Channel of radio.
  */
-void PHY_init (struct PHY_init_t* phy_params)
+static void configure_radio (struct PHY_radio_t *radio, struct PHY_init_t *phy_params,
+														 uint8_t channel)
 {
-	HW_init ();
-	PHY_STORAGE.irq_interrupt_deamon = std::thread (irq_interrupt_deamon_f);
-	PHY_STORAGE.timer_interrupt_generator = std::thread (timer_interrupt_generator_f);
-
-	PHY_STORAGE.cca_noise_threshold_max = phy_params->cca_noise_threshold_max;
-	PHY_STORAGE.cca_noise_threshold_min = phy_params->cca_noise_threshold_min;
-
-	D_PHY printf ("channel %d band %d bitrate %d power %d\n", phy_params->channel,
-					phy_params->band, phy_params->bitrate, phy_params->power);
-
+	// whole register file goes out in one SPI transaction
+	spi_batch_begin (&radio->spi);
 	for (uint8_t i = 0; i <= 31; i++) {
 		if ((i << 1) == R1CNTREG) {
-			set_channel_freq_rate (phy_params->channel, phy_params->band, phy_params->bitrate);
+			set_channel_freq_rate (radio, channel, phy_params->band, phy_params->bitrate);
 			// jump over R1CNTREG, P1CNTREG, S1CNTREG
 			i += 3;
 		}
 		if ((i << 1) == TXPARAMREG) {
-			set_power (phy_params->power);
+			set_power (radio, phy_params->power);
 			// jump over TXPARAMREG
 			i += 1;
 		}
 		if ((i << 1) == FDEVREG) {
-			set_bitrate (phy_params->bitrate);
+			set_bitrate (radio, phy_params->bitrate);
 			// jump over FDEVREG, BRREG
 			i += 2;
 		}
@@ -702,152 +1009,1052 @@ void PHY_init (struct PHY_init_t* phy_params)
 			// already done in previous call of set_bitrate(params.bitrate);
 			i += 1;
 		}
-		set_register (i << 1, init_config_regs[i]);
+		if ((i << 1) == SYNCV31REG) {
+			set_sync_word (radio);
+			// jump over SYNCV31REG, SYNCV23REG, SYNCV15REG, SYNCV07REG
+			i += 4;
+		}
+		set_register (radio, i << 1, init_config_regs[i]);
 	}
+	spi_batch_end (&radio->spi);
 
-	/*
-	for (uint8_t i = 0; i <= 31; i++) {
-		uint8_t reg_val = get_register (i << 1);
-	}*/
-
-	send_reload_radio ();
-	PHY_STORAGE.irq0_enabled = true;
-	PHY_STORAGE.irq1_enabled = true;
+	send_reload_radio (radio);
+	radio->irq0_enabled = true;
+	radio->irq1_enabled = true;
 }
 
+/**
+ * Initializes MRF89XA backend, all configured radios are started.
+ * @param phy_params 	Parameters of physical layer, channel is used by the first radio.
+ * @param callbacks 	Functions of upper layer.
+ * @return Returns false if SPI transport of any radio is not available, true otherwise.
+ */
+static bool mrf_init (struct PHY_init_t* phy_params,
+											const struct PHY_callbacks_t *callbacks)
+{
+	bool spi_ready = true;
+
+	PHY_STORAGE.callbacks = *callbacks;
+	PHY_STORAGE.cca_noise_threshold_max = phy_params->cca_noise_threshold_max;
+	PHY_STORAGE.cca_noise_threshold_min = phy_params->cca_noise_threshold_min;
+	if (!gpio_loop_init (&PHY_STORAGE.irq_loop))
+		cerr << "PHY_init(): IRQ loop is not available!" << endl;
+	gpio_loop_set_poll (&PHY_STORAGE.irq_loop, poll_radios, 0);
+
+	for (uint8_t i = 0; i < PHY_STORAGE.radio_count; i++) {
+		struct PHY_radio_t *radio = &PHY_STORAGE.radios[i];
+		const struct PHY_radio_config_t *config = &PHY_STORAGE.configs[i];
+		radio->index = i;
+		radio->spi_config = config->spi_config;
+		radio->spi_data = config->spi_data;
+		radio->gpiochip = config->gpiochip;
+		radio->line_irq0 = config->line_irq0;
+		radio->line_irq1 = config->line_irq1;
+		radio->line_reset = config->line_reset;
+		radio->terminate_tx = false;
+		radio->polling = false;
+		radio->last_rx_edge = 0;
+		radio->last_rx = PHY_monotonic_ns ();
+		radio->last_check = radio->last_rx;
+		radio->unanswered_since = 0;
+		radio->silence_recovery = 0;
+		radio->tx_timeouts = 0;
+		radio->init_start = PHY_monotonic_ns ();
+		if (!spi_open (&radio->spi, radio->spi_config.c_str (), radio->spi_data.c_str ())) {
+			cerr << "PHY_init(): SPI transport of radio " << (int) i << " is not available!" << endl;
+			spi_ready = false;
+		}
+		HW_init (radio);
+	}
+	ring_init (&PHY_STORAGE.rx_ring);
+	PHY_STORAGE.rx_wake_fd = eventfd (0, EFD_CLOEXEC);
+	if (PHY_STORAGE.rx_wake_fd < 0)
+		cerr << "PHY_init(): RX ring is not available!" << endl;
+	PHY_STORAGE.terminate_rx = false;
+	PHY_STORAGE.rx_deamon = std::thread (rx_deamon_f);
+	PHY_STORAGE.irq_interrupt_deamon = std::thread (irq_interrupt_deamon_f);
+
+	for (uint8_t i = 0; i < PHY_STORAGE.radio_count; i++) {
+		struct PHY_radio_t *radio = &PHY_STORAGE.radios[i];
+		uint8_t channel = i == 0 ? phy_params->channel : PHY_STORAGE.configs[i].channel;
+		D_PHY printf ("radio %d: channel %d band %d bitrate %d power %d\n", i, channel,
+						phy_params->band, phy_params->bitrate, phy_params->power);
+		radio->init_writes = radio->writes;
+		radio->base_bitrate = phy_params->bitrate;
+		configure_radio (radio, phy_params, channel);
+		{
+			std::lock_guard < std::mutex > lock (radio->stats_mutex);
+			radio->init_stats.registers_written = radio->writes - radio->init_writes;
+			radio->init_stats.init_us = (PHY_monotonic_ns () - radio->init_start) / 1000;
+			D_PHY printf ("radio %d: %s start in %u us, %u register writes\n", i,
+										radio->init_stats.warm ? "warm" : "cold", radio->init_stats.init_us,
+										radio->init_stats.registers_written);
+		}
+		radio->backoff_random.seed (std::chrono::steady_clock::now ().time_since_epoch ().count () + i);
+		radio->tx_deamon = std::thread (tx_deamon_f, radio);
+	}
+	PHY_STORAGE.running = true;
+	return spi_ready;
+}
 
-void PHY_stop ()
+/**
+ * Stops MRF89XA backend.
+ */
+static void mrf_stop ()
 {
-	g_main_loop_quit (PHY_STORAGE.gloop);
-	PHY_STORAGE.terminate_timer = true;
+	gpio_loop_stop (&PHY_STORAGE.irq_loop);
+	for (uint8_t i = 0; i < PHY_STORAGE.radio_count; i++) {
+		struct PHY_radio_t *radio = &PHY_STORAGE.radios[i];
+		std::lock_guard < std::mutex > lock (radio->tx_mutex);
+		radio->terminate_tx = true;
+		radio->tx_cv.notify_all ();
+	}
 	// waiting for termination of next threads
+	for (uint8_t i = 0; i < PHY_STORAGE.radio_count; i++)
+		PHY_STORAGE.radios[i].tx_deamon.join ();
 	PHY_STORAGE.irq_interrupt_deamon.join ();
-	PHY_STORAGE.timer_interrupt_generator.join ();
+	// IRQ thread is stopped, nothing is put into RX ring any more
+	uint64_t one = 1;
+	PHY_STORAGE.terminate_rx = true;
+	if (write (PHY_STORAGE.rx_wake_fd, &one, sizeof (one)) < 0)
+		D_PHY printf ("PHY_stop(): wake up failed!\n");
+	PHY_STORAGE.rx_deamon.join ();
+	close (PHY_STORAGE.rx_wake_fd);
+	PHY_STORAGE.rx_wake_fd = -1;
+	gpio_loop_close (&PHY_STORAGE.irq_loop);
+	for (uint8_t i = 0; i < PHY_STORAGE.radio_count; i++) {
+		struct PHY_radio_t *radio = &PHY_STORAGE.radios[i];
+		spi_close (&radio->spi);
+		if (radio->reset_fd >= 0)
+			close (radio->reset_fd);
+		radio->reset_fd = -1;
+	}
+	PHY_STORAGE.running = false;
 }
 
 /**
- * Sends data.
+ * Starts transmission of frame, radio signals TXDONE on IRQ1.
+ * @param radio Radio.
  * @param data 	Data.
  * @param len 	Data length.
  */
-void PHY_send (const uint8_t * data, uint8_t len)
+static void start_transmission (struct PHY_radio_t *radio, const uint8_t * data, uint8_t len)
 {
-	D_PHY printf("PHY_send()\n");
-	PHY_STORAGE.irq1_enabled = false;
-	PHY_STORAGE.irq0_enabled = false;
-
-	set_rf_mode (RF_STANDBY);
-	set_register (FTXRXIREG, FTXRXIREG_SET | 0x01);
-	write_fifo (len);
-	for (int i = 0; i < len; i++) {
-		write_fifo (data[i]);
+	radio->irq1_enabled = false;
+	radio->irq0_enabled = false;
+
+	spi_batch_begin (&radio->spi);
+	set_rf_mode (radio, RF_STANDBY);
+	set_register (radio, FTXRXIREG, FTXRXIREG_SET | 0x01);
+	spi_batch_end (&radio->spi);
+	write_frame (radio, data, len);
+	{
+		std::lock_guard < std::mutex > lock (radio->tx_mutex);
+		radio->tx_done = false;
 	}
-	set_rf_mode (RF_TRANSMITTER);
+	set_rf_mode (radio, RF_TRANSMITTER);
+
+	radio->irq1_enabled = true;
+	radio->irq0_enabled = true;
+}
 
-	PHY_STORAGE.irq1_enabled = true;
-	PHY_STORAGE.irq0_enabled = true;
+/**
+ * Adds RSSI sample to noise estimate of channel (tx_mutex has to be locked).
+ * @param radio 	Radio.
+ * @param channel Channel number.
+ * @param rssi 		Measured RSSI.
+ */
+static void noise_add_sample (struct PHY_radio_t *radio, uint8_t channel, uint8_t rssi)
+{
+	if (channel >= PHY_NOISE_CHANNELS)
+		return;
+	struct PHY_noise_t *noise = &radio->noise[channel];
+	// EWMA with weight 1/16, the first sample initializes the floor
+	if (noise->samples == 0)
+		noise->floor = rssi << 4;
+	else
+		noise->floor = noise->floor - (noise->floor >> 4) + rssi;
+	noise->samples++;
+
+	uint8_t bin = rssi / PHY_NOISE_BIN_WIDTH;
+	if (bin >= PHY_NOISE_BINS)
+		bin = PHY_NOISE_BINS - 1;
+	noise->histogram[bin]++;
+	// older samples lose weight, so histogram follows the channel
+	if (++noise->histogram_total >= PHY_NOISE_HISTORY) {
+		noise->histogram_total = 0;
+		for (uint8_t i = 0; i < PHY_NOISE_BINS; i++) {
+			noise->histogram[i] >>= 1;
+			noise->histogram_total += noise->histogram[i];
+		}
+	}
+}
 
-	uint32_t tout = 0;
-	while ((get_register (FTPRIREG) & 0x20) == 0) {
-		usleep (500);
-		tout++;
-		if (tout > 4000)
+/**
+ * Gets RSSI below which given percentage of samples lies (tx_mutex has to be locked).
+ * @param noise 		Noise estimate.
+ * @param percent 	Percentage.
+ * @return Returns RSSI (middle of histogram bin).
+ */
+static uint8_t noise_percentile (const struct PHY_noise_t *noise, uint8_t percent)
+{
+	if (noise->histogram_total == 0)
+		return 0;
+	uint32_t limit = (uint32_t) noise->histogram_total * percent / 100;
+	uint32_t count = 0;
+	uint8_t i;
+	for (i = 0; i < PHY_NOISE_BINS - 1; i++) {
+		count += noise->histogram[i];
+		if (count > limit)
 			break;
 	}
-	/*for(uint8_t i = 0; i < len; i++)
-		printf("%02x ", data[i]);
-	printf("\n");*/
+	return i * PHY_NOISE_BIN_WIDTH + PHY_NOISE_BIN_WIDTH / 2;
+}
+
+/**
+ * Gets maximum acceptable noise of CCA on channel (tx_mutex has to be locked).
+ * Static threshold is used until enough samples are collected or if
+ * adaptive CCA is disabled.
+ * @param radio 	Radio.
+ * @param channel Channel number.
+ * @return Returns CCA threshold.
+ */
+static uint8_t cca_threshold_max (struct PHY_radio_t *radio, uint8_t channel)
+{
+	if (radio->cca_margin == 0 || channel >= PHY_NOISE_CHANNELS
+			|| radio->noise[channel].samples < PHY_NOISE_MIN_SAMPLES)
+		return PHY_STORAGE.cca_noise_threshold_max;
+	uint16_t threshold = (radio->noise[channel].floor >> 4) + radio->cca_margin;
+	if (threshold < PHY_STORAGE.cca_noise_threshold_min)
+		threshold = PHY_STORAGE.cca_noise_threshold_min;
+	return threshold > 0xff ? 0xff : threshold;
+}
+
+/**
+ * Samples RSSI while radio is idle in receiver mode.
+ * @param radio Radio.
+ */
+static void sample_noise (struct PHY_radio_t *radio)
+{
+	uint8_t rssi;
+	uint8_t channel;
+	{
+		std::lock_guard < std::mutex > lock (radio->mm);
+		if (radio->mode != RF_RECEIVER)
+			return;
+		rssi = get_cca_noise (radio);
+		channel = radio->channel;
+	}
+	std::lock_guard < std::mutex > lock (radio->tx_mutex);
+	noise_add_sample (radio, channel, rssi);
+}
+
+/**
+ * Checks if channel is clear.
+ * @param noise 		Measured RSSI.
+ * @param max_noise Maximum acceptable RSSI.
+ * @return Returns true if noise is inside CCA window, false otherwise.
+ */
+static bool channel_clear (uint8_t noise, uint8_t max_noise)
+{
+	return noise >= PHY_STORAGE.cca_noise_threshold_min && noise <= max_noise;
+}
+
+/**
+ * Waits random number of backoff slots, 0 to 2^be - 1.
+ * @param radio Radio.
+ * @param csma 	Channel access parameters.
+ * @param be 		Backoff exponent.
+ * @return Returns false if physical layer is being stopped, true otherwise.
+ */
+static bool backoff (struct PHY_radio_t *radio, const struct PHY_csma_t *csma, uint8_t be)
+{
+	std::uniform_int_distribution < uint32_t > slots (0, (1u << be) - 1);
+	uint32_t delay = slots (radio->backoff_random) * csma->slot_time_us;
+
+	std::unique_lock < std::mutex > lock (radio->tx_mutex);
+	if (delay > 0)
+		radio->tx_cv.wait_for (lock, std::chrono::microseconds (delay),
+			[radio] { return radio->terminate_tx; });
+	return !radio->terminate_tx;
+}
+
+/**
+ * Accesses channel using unslotted CSMA/CA and starts transmission of frame.
+ * @param radio Radio.
+ * @param frame Frame.
+ * @return Returns PHY_TX_OK if transmission is started, reason of failure otherwise.
+ */
+static uint8_t access_channel (struct PHY_radio_t *radio, const struct PHY_tx_frame_t *frame)
+{
+	struct PHY_csma_t csma;
+	uint8_t max_noise;
+	{
+		std::lock_guard < std::mutex > lock (radio->tx_mutex);
+		csma = radio->csma;
+		max_noise = cca_threshold_max (radio, radio->channel);
+	}
+	auto started = std::chrono::steady_clock::now ();
+	uint8_t be = csma.min_be;
+	uint8_t attempts = 0;
+	bool clear = false;
+
+	while (true) {
+		if (frame->cca && !backoff (radio, &csma, be))
+			return PHY_TX_ABORTED;
+		{
+			std::lock_guard < std::mutex > lock (radio->mm);
+			clear = !frame->cca || channel_clear (get_cca_noise (radio), max_noise);
+			if (clear)
+				start_transmission (radio, frame->data, frame->len);
+		}
+		if (!frame->cca)
+			return PHY_TX_OK;
+
+		attempts++;
+		uint32_t waited = std::chrono::duration_cast < std::chrono::microseconds >
+			(std::chrono::steady_clock::now () - started).count ();
+		std::lock_guard < std::mutex > lock (radio->tx_mutex);
+		radio->tx_stats.cca_attempts++;
+		if (clear || attempts >= csma.max_attempts) {
+			radio->tx_stats.cca_wait_us += waited;
+			if (waited > radio->tx_stats.cca_wait_max_us)
+				radio->tx_stats.cca_wait_max_us = waited;
+		}
+		if (clear)
+			return PHY_TX_OK;
+		radio->tx_stats.cca_busy++;
+		if (attempts >= csma.max_attempts) {
+			D_PHY printf ("access_channel(): radio %d: channel busy!\n", radio->index);
+			radio->tx_stats.channel_busy++;
+			return PHY_TX_CHANNEL_BUSY;
+		}
+		if (be < csma.max_be)
+			be++;
+	}
+}
+
+/**
+ * Sends frame and waits for TXDONE interrupt.
+ * @param radio Radio.
+ * @param frame Frame.
+ * @return Returns status of transmission.
+ */
+static uint8_t transmit_frame (struct PHY_radio_t *radio, const struct PHY_tx_frame_t *frame)
+{
+	D_PHY printf("transmit_frame()\n");
+	uint32_t syscalls = radio->spi.stats.syscalls;
+	uint8_t status = access_channel (radio, frame);
+	if (status != PHY_TX_OK) {
+		radio->tx_syscalls += radio->spi.stats.syscalls - syscalls;
+		return status;
+	}
+
+	bool done;
+	uint64_t started = PHY_monotonic_ns ();
+	{
+		std::unique_lock < std::mutex > lock (radio->tx_mutex);
+		done = radio->tx_cv.wait_for (lock,
+			std::chrono::milliseconds (PHY_TX_TIMEOUT_MS),
+			[radio] { return radio->tx_done || radio->terminate_tx; });
+		done = done && radio->tx_done;
+	}
+	// edge could be missed, TXDONE flag is authoritative
+	if (!done && (get_register (radio, FTPRIREG) & 0x20))
+		done = true;
+	if (done) {
+		uint32_t latency = (PHY_monotonic_ns () - started) / 1000;
+		std::lock_guard < std::mutex > lock (radio->tx_mutex);
+		if (latency > radio->health.max_tx_done_us)
+			radio->health.max_tx_done_us = latency;
+	}
+
+	set_rf_mode (radio, RF_STANDBY);
+	set_rf_mode (radio, RF_RECEIVER);
+	radio->tx_frames++;
+	radio->tx_syscalls += radio->spi.stats.syscalls - syscalls;
+	if (!done) {
+		D_PHY printf ("transmit_frame(): radio %d: TXDONE timeout!\n", radio->index);
+		return radio->terminate_tx ? PHY_TX_ABORTED : PHY_TX_TIMEOUT;
+	}
+	return PHY_TX_OK;
+}
+
+/**
+ * Resets radio and writes its register file again, settings of radio
+ * are kept, so link and network layers do not notice anything.
+ * Called by TX thread of radio, so no frame is being sent.
+ * @param radio 	Radio.
+ * @param reason 	Cause of recovery.
+ */
+static void recover_radio (struct PHY_radio_t *radio, const char *reason)
+{
+	struct PHY_init_t params;
+	uint64_t start = PHY_monotonic_ns ();
+
+	cerr << "radio " << (int) radio->index << ": " << reason << ", recovering" << endl;
+	{
+		std::lock_guard < std::mutex > lock (radio->mm);
+		params.channel = radio->channel;
+		params.band = radio->band;
+		// adapted bitrate of neighbour is not kept
+		params.bitrate = radio->base_bitrate;
+		params.power = radio->power;
+		params.cca_noise_threshold_max = PHY_STORAGE.cca_noise_threshold_max;
+		params.cca_noise_threshold_min = PHY_STORAGE.cca_noise_threshold_min;
+		radio->irq1_enabled = false;
+		radio->irq0_enabled = false;
+		reset_MRF (radio);
+		configure_radio (radio, &params, params.channel);
+	}
+	radio->rate_hold = 0;
+	uint64_t now = PHY_monotonic_ns ();
+	uint32_t duration = (now - start) / 1000;
+	radio->unanswered_since = 0;
+	radio->tx_timeouts = 0;
+	std::lock_guard < std::mutex > lock (radio->tx_mutex);
+	radio->health.recoveries++;
+	radio->health.last_recovery_us = duration;
+	if (duration > radio->health.max_recovery_us)
+		radio->health.max_recovery_us = duration;
+}
+
+/**
+ * Compares sentinel registers read from radio with their shadow copy.
+ * @param radio Radio.
+ * @return Returns false if any register differs or cannot be read, true otherwise.
+ */
+static bool check_registers (struct PHY_radio_t *radio)
+{
+	uint8_t values[sizeof (sentinel_registers)];
+
+	std::lock_guard < std::mutex > lock (radio->mm);
+	if (!spi_read_registers (&radio->spi, sentinel_registers, values, sizeof (sentinel_registers)))
+		return false;
+	for (uint8_t i = 0; i < sizeof (sentinel_registers); i++) {
+		uint8_t index = (sentinel_registers[i] >> 1) & 0x1f;
+		if ((radio->registers_valid & (1UL << index)) && radio->registers[index] != values[i]) {
+			D_PHY printf ("radio %d: register 0x%02x is 0x%02x, expected 0x%02x\n", radio->index,
+										sentinel_registers[i], values[i], radio->registers[index]);
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * Checks health of idle radio, recovers it if it is wedged.
+ * @param radio Radio.
+ */
+static void watchdog_check (struct PHY_radio_t *radio)
+{
+	const struct PHY_watchdog_t &watchdog = PHY_STORAGE.watchdog;
+	uint64_t now = PHY_monotonic_ns ();
+
+	// radio without SPI transport cannot be checked
+	if (watchdog.period_ms == 0 || radio->spi.config_fd < 0)
+		return;
+	if (now - radio->last_check < watchdog.period_ms * 1000000ULL)
+		return;
+	radio->last_check = now;
+	bool registers_ok = check_registers (radio);
+	{
+		std::lock_guard < std::mutex > lock (radio->tx_mutex);
+		radio->health.checks++;
+		if (!registers_ok)
+			radio->health.register_faults++;
+	}
+	if (!registers_ok) {
+		recover_radio (radio, "register readback failed");
+		return;
+	}
+	// quiet network is not silence of radio, only frames sent without any
+	// answer count, recovery which did not help is not repeated until
+	// a frame is received
+	uint64_t unanswered = radio->unanswered_since;
+	if (watchdog.rx_silence_ms > 0 && unanswered > 0
+			&& now - unanswered > watchdog.rx_silence_ms * 1000000ULL
+			&& radio->last_rx >= radio->silence_recovery) {
+		{
+			std::lock_guard < std::mutex > lock (radio->tx_mutex);
+			radio->health.rx_silences++;
+		}
+		recover_radio (radio, "no frame received");
+		radio->silence_recovery = PHY_monotonic_ns ();
+	}
+}
+
+/**
+ * Takes radio when it does not send, so its settings are not changed
+ * in the middle of frame. Other owners wait until release_radio().
+ * @param radio Radio.
+ */
+static void acquire_radio (struct PHY_radio_t *radio)
+{
+	std::unique_lock < std::mutex > lock (radio->tx_mutex);
+	radio->tx_cv.wait (lock, [radio] { return !radio->tx_busy; });
+	radio->tx_busy = true;
+}
+
+/**
+ * Gives radio back to tx_deamon or to the next setter.
+ * @param radio Radio.
+ */
+static void release_radio (struct PHY_radio_t *radio)
+{
+	std::lock_guard < std::mutex > lock (radio->tx_mutex);
+	radio->tx_busy = false;
+	radio->tx_cv.notify_all ();
+}
+
+/**
+ * Switches radio to bitrate of frame, radio stays on it for receiving
+ * until exchange at that bitrate ends.
+ * @param radio Radio.
+ * @param bitrate Bitrate of frame or PHY_BITRATE_BASE.
+ * @return Returns false if channel of radio does not exist at bitrate of frame.
+ */
+static bool switch_bitrate (struct PHY_radio_t *radio, uint8_t bitrate)
+{
+	if (bitrate == PHY_BITRATE_BASE)
+		bitrate = radio->base_bitrate;
+	radio->rate_hold = bitrate == radio->base_bitrate ? 0
+		: PHY_monotonic_ns () + PHY_RATE_HOLD_MS * 1000000ULL;
+	if (bitrate == radio->bitrate)
+		return true;
+	if (radio->channel >= PHY_channel_amount (radio->band, bitrate)) {
+		D_PHY printf ("radio %d: channel %d does not exist at bitrate %d!\n", radio->index,
+									radio->channel, bitrate);
+		return false;
+	}
+	{
+		std::lock_guard < std::mutex > lock (radio->mm);
+		spi_batch_begin (&radio->spi);
+		set_bitrate (radio, bitrate);
+		set_channel_freq_rate (radio, radio->channel, radio->band, bitrate);
+		spi_batch_end (&radio->spi);
+		send_reload_radio (radio);
+	}
+	std::lock_guard < std::mutex > lock (radio->tx_mutex);
+	radio->tx_stats.bitrate_switches++;
+	return true;
+}
+
+/*
+ * Transmission thread of radio, the only owner of radio while sending,
+ * setters of radio parameters take it between frames.
+ * @param radio Radio.
+ */
+void tx_deamon_f (struct PHY_radio_t *radio)
+{
+	struct PHY_tx_frame_t frame;
+
+	rt_thread_setup (PHY_THREAD_TX);
+	while (true) {
+		{
+			std::unique_lock < std::mutex > lock (radio->tx_mutex);
+			bool ready = radio->tx_cv.wait_for (lock,
+				std::chrono::milliseconds (PHY_NOISE_SAMPLE_MS),
+				[radio] { return radio->terminate_tx || (radio->tx_count > 0 && !radio->tx_busy); });
+			if (radio->terminate_tx)
+				return;
+			// setter owns radio
+			if (radio->tx_busy)
+				continue;
+			radio->tx_busy = true;
+			if (!ready) {
+				// radio is idle, track noise floor and health
+				lock.unlock ();
+				// exchange at other bitrate is over, ACK will not come anymore
+				if (radio->rate_hold > 0 && PHY_monotonic_ns () >= radio->rate_hold)
+					switch_bitrate (radio, PHY_BITRATE_BASE);
+				sample_noise (radio);
+				watchdog_check (radio);
+				release_radio (radio);
+				continue;
+			}
+			frame = radio->tx_queue[radio->tx_head];
+			radio->tx_head = (radio->tx_head + 1) % PHY_TX_QUEUE_SIZE;
+			radio->tx_count--;
+		}
+		uint8_t status = switch_bitrate (radio, frame.bitrate) ? PHY_TX_OK : PHY_TX_ABORTED;
+		if (frame.len == 0) {
+			// frame only switches bitrate
+			release_radio (radio);
+			PHY_STORAGE.callbacks.send_done (frame.id, status);
+			continue;
+		}
+		if (status == PHY_TX_OK)
+			status = transmit_frame (radio, &frame);
+		bool wedged = false;
+		{
+			std::lock_guard < std::mutex > lock (radio->tx_mutex);
+			if (status == PHY_TX_OK) {
+				radio->tx_stats.sent++;
+				uint64_t none = 0;
+				radio->unanswered_since.compare_exchange_strong (none, PHY_monotonic_ns ());
+			}
+			else
+				radio->tx_stats.failed++;
+			// busy channel says nothing about radio, only missing TXDONE does
+			if (status == PHY_TX_OK)
+				radio->tx_timeouts = 0;
+			else if (status == PHY_TX_TIMEOUT && ++radio->tx_timeouts >= PHY_STORAGE.watchdog.tx_timeouts
+							 && PHY_STORAGE.watchdog.tx_timeouts > 0 && PHY_STORAGE.watchdog.period_ms > 0) {
+				radio->health.tx_faults++;
+				wedged = true;
+			}
+		}
+		if (wedged)
+			recover_radio (radio, "TXDONE timeouts");
+		release_radio (radio);
+		PHY_STORAGE.callbacks.send_done (frame.id, status);
+	}
+}
 
-	set_rf_mode (RF_STANDBY);
-	set_rf_mode (RF_RECEIVER);
+/**
+ * Gets radio by index.
+ * @param index Radio index.
+ * @return Returns radio, NULL if radio is not configured.
+ */
+static struct PHY_radio_t *get_radio (uint8_t index)
+{
+	if (index >= PHY_STORAGE.radio_count)
+		return NULL;
+	return &PHY_STORAGE.radios[index];
 }
 
 /**
- * Sends data if noise on medium is acceptable.
+ * Puts frame into TX queue of radio.
+ * @param index Radio index.
  * @param data 	Data.
  * @param len 	Data length.
+ * @param cca 	Flag if channel has to be clear before sending.
+ * @param bitrate Bitrate of frame, PHY_BITRATE_BASE for bitrate of radio.
+ * @return Returns frame identifier, 0 if TX queue is full.
  */
-void PHY_send_with_cca (uint8_t * data, uint8_t len)
+static uint32_t enqueue_frame (uint8_t index, const uint8_t * data, uint8_t len, bool cca,
+															 uint8_t bitrate)
 {
-	uint8_t noise;
-	std::lock_guard < std::mutex > lock (mm);
-	do {
-		noise = PHY_get_noise ();
-	} while(noise > PHY_STORAGE.cca_noise_threshold_max || noise < PHY_STORAGE.cca_noise_threshold_min);
-	PHY_send (data, len);
+	struct PHY_radio_t *radio = get_radio (index);
+	if (!radio)
+		return 0;
+	std::lock_guard < std::mutex > lock (radio->tx_mutex);
+	if (radio->tx_count >= PHY_TX_QUEUE_SIZE || len > MAX_PHY_PAYLOAD_SIZE) {
+		D_PHY printf ("enqueue_frame(): radio %d: frame dropped!\n", index);
+		radio->tx_stats.dropped++;
+		return 0;
+	}
+	uint8_t slot = (radio->tx_head + radio->tx_count) % PHY_TX_QUEUE_SIZE;
+	struct PHY_tx_frame_t *frame = &radio->tx_queue[slot];
+	// identifier 0 is reserved for dropped frames
+	uint32_t id;
+	while ((id = ++PHY_STORAGE.tx_next_id) == 0)
+		;
+	frame->id = id;
+	frame->cca = cca;
+	frame->bitrate = bitrate;
+	frame->len = len;
+	for (uint8_t i = 0; i < len; i++)
+		frame->data[i] = data[i];
+	radio->tx_count++;
+	radio->tx_stats.queued++;
+	if (radio->tx_count > radio->tx_stats.max_queue)
+		radio->tx_stats.max_queue = radio->tx_count;
+	radio->tx_cv.notify_all ();
+	return frame->id;
 }
 
 /**
- * Sets band.
+ * Sets band of all radios.
  * @param band Band.
  * @return Returns true if band setting is successful, false otherwise.
  */
-bool PHY_set_freq (uint8_t band)
+static bool mrf_set_band (uint8_t band)
 {
-	if (band == PHY_STORAGE.band)
-		return true;
-	bool holder = set_channel_freq_rate (PHY_STORAGE.channel, band, PHY_STORAGE.bitrate);
-	send_reload_radio ();
+	bool holder = true;
+	for (uint8_t i = 0; i < PHY_STORAGE.radio_count; i++) {
+		struct PHY_radio_t *radio = &PHY_STORAGE.radios[i];
+		acquire_radio (radio);
+		if (band != radio->band) {
+			std::lock_guard < std::mutex > lock (radio->mm);
+			holder = set_channel_freq_rate (radio, radio->channel, band, radio->bitrate) && holder;
+			send_reload_radio (radio);
+		}
+		release_radio (radio);
+	}
 	return holder;
 }
 
 /**
- * Sets channel number.
+ * Sets channel number of radio.
+ * @param index 	Radio index.
  * @param channel Channel number.
  * @return Returns true if channel number setting is successful, false otherwise.
  */
-bool PHY_set_channel (uint8_t channel)
+static bool mrf_set_channel (uint8_t index, uint8_t channel)
 {
-	if (channel == PHY_STORAGE.channel)
-		return true;
-	bool holder = set_channel_freq_rate (channel, PHY_STORAGE.band, PHY_STORAGE.bitrate);
-	send_reload_radio ();
+	struct PHY_radio_t *radio = get_radio (index);
+	if (!radio)
+		return false;
+	bool holder = true;
+	acquire_radio (radio);
+	if (channel != radio->channel) {
+		std::lock_guard < std::mutex > lock (radio->mm);
+		holder = set_channel_freq_rate (radio, channel, radio->band, radio->bitrate);
+		send_reload_radio (radio);
+	}
+	release_radio (radio);
 	return holder;
 }
 
 /**
- * Searches set channel number.
+ * Searches set channel number of radio.
+ * @param index Radio index.
  * @return Returns channel number.
  */
-uint8_t PHY_get_channel (void)
+static uint8_t mrf_get_channel (uint8_t index)
 {
-	D_PHY printf ("Channel: %d\n", PHY_STORAGE.channel);
-	return PHY_STORAGE.channel;
+	struct PHY_radio_t *radio = get_radio (index);
+	if (!radio)
+		return 0;
+	D_PHY printf ("Channel: %d\n", radio->channel);
+	return radio->channel;
 }
 
 /**
- * Sets bitrate.
+ * Sets bitrate of all radios.
  * @param bitrate Bitrate.
  * @return Returns true if bitrate setting is successful, false otherwise.
  */
-bool PHY_set_bitrate (uint8_t bitrate)
+static bool mrf_set_bitrate (uint8_t bitrate)
 {
-	if (bitrate == PHY_STORAGE.bitrate)
-		return true;
-	if (set_bitrate (bitrate) == false)
+	bool holder = true;
+	if (bitrate > DATA_RATE_200)
 		return false;
-	bool holder = set_channel_freq_rate (PHY_STORAGE.channel, PHY_STORAGE.band, bitrate);
-	send_reload_radio ();
+	for (uint8_t i = 0; i < PHY_STORAGE.radio_count; i++) {
+		struct PHY_radio_t *radio = &PHY_STORAGE.radios[i];
+		// radio adapted to bitrate of neighbour is switched as well
+		acquire_radio (radio);
+		radio->base_bitrate = bitrate;
+		radio->rate_hold = 0;
+		if (bitrate != radio->bitrate) {
+			std::lock_guard < std::mutex > lock (radio->mm);
+			set_bitrate (radio, bitrate);
+			holder = set_channel_freq_rate (radio, radio->channel, radio->band, bitrate) && holder;
+			send_reload_radio (radio);
+		}
+		release_radio (radio);
+	}
 	return holder;
 }
 
 /**
- * Sets output power.
+ * Sets output power of all radios.
  * @param power Power.
  * @return Returns true if power setting is successful, false otherwise.
  */
-bool PHY_set_power (uint8_t power)
+static bool mrf_set_power (uint8_t power)
 {
-	if (power == PHY_STORAGE.power)
-		return true;
-	return set_power (power);
+	if (power > TX_POWER_N_8_DB)
+		return false;
+	for (uint8_t i = 0; i < PHY_STORAGE.radio_count; i++) {
+		struct PHY_radio_t *radio = &PHY_STORAGE.radios[i];
+		acquire_radio (radio);
+		if (power != radio->power) {
+			std::lock_guard < std::mutex > lock (radio->mm);
+			set_power (radio, power);
+		}
+		release_radio (radio);
+	}
+	return true;
 }
 
 /**
  * Reads RSSI value.
+ * @param index Radio index.
  * @return Returns RSSI value.
  */
-uint8_t PHY_get_noise ()
+static uint8_t mrf_get_noise (uint8_t index)
+{
+	struct PHY_radio_t *radio = get_radio (index);
+	if (!radio)
+		return 0;
+	return get_cca_noise (radio);
+}
+
+/**
+ * Gets number of radios.
+ * @return Returns number of configured radios.
+ */
+static uint8_t mrf_get_radio_count ()
+{
+	return PHY_STORAGE.radio_count;
+}
+
+/**
+ * Gets radio which received frame being processed.
+ * @return Returns radio index.
+ */
+static uint8_t mrf_get_rx_radio ()
+{
+	return PHY_STORAGE.rx_radio;
+}
+
+const struct PHY_backend_t PHY_MRF89XA_BACKEND = {
+	"mrf89xa",
+	mrf_init,
+	mrf_stop,
+	enqueue_frame,
+	mrf_get_noise,
+	mrf_get_measured_noise,
+	mrf_set_band,
+	mrf_set_channel,
+	mrf_get_channel,
+	mrf_set_bitrate,
+	mrf_set_power,
+	mrf_get_radio_count,
+	mrf_get_rx_radio
+};
+
+/**
+ * Sets wiring of radios driven by MRF89XA backend, radios must not run yet.
+ * @param radios Wiring of radios.
+ * @param count  Number of radios.
+ * @return Returns false if radios run or count is invalid, true otherwise.
+ */
+bool PHY_set_radios (const struct PHY_radio_config_t *radios, uint8_t count)
+{
+	if (PHY_STORAGE.running || count == 0 || count > PHY_MAX_RADIOS) {
+		cerr << "PHY_set_radios(): radios cannot be configured!" << endl;
+		return false;
+	}
+	for (uint8_t i = 0; i < count; i++)
+		PHY_STORAGE.configs[i] = radios[i];
+	PHY_STORAGE.radio_count = count;
+	return true;
+}
+
+/**
+ * Gets counters of SPI transport of radio.
+ * @param index Radio index.
+ * @param stats Structure for counters.
+ * @return Returns false if radio is not configured, true otherwise.
+ */
+bool PHY_get_spi_stats (uint8_t index, struct PHY_spi_stats_t *stats)
+{
+	struct PHY_radio_t *radio = get_radio (index);
+	if (!radio)
+		return false;
+	std::lock_guard < std::recursive_mutex > lock (radio->spi.mutex);
+	stats->opens = radio->spi.stats.opens;
+	stats->syscalls = radio->spi.stats.syscalls;
+	stats->transfers = radio->spi.stats.transfers;
+	stats->bytes = radio->spi.stats.bytes;
+	stats->errors = radio->spi.stats.errors;
+	stats->rx_frames = radio->rx_frames;
+	stats->rx_syscalls = radio->rx_syscalls;
+	stats->tx_frames = radio->tx_frames;
+	stats->tx_syscalls = radio->tx_syscalls;
+	stats->writes_skipped = radio->writes_skipped;
+	stats->reads_cached = radio->reads_cached;
+	return true;
+}
+
+/**
+ * Gets arrival time of the last received frame.
+ * @return Returns monotonic time (ns) of IRQ1 edge or poll which signalled frame.
+ */
+uint64_t PHY_get_rx_timestamp ()
+{
+	return PHY_STORAGE.rx_timestamp;
+}
+
+/**
+ * Gets counters of TX queue of radio.
+ * @param index Radio index.
+ * @param stats Structure for counters.
+ * @return Returns false if radio is not configured, true otherwise.
+ */
+bool PHY_get_tx_stats (uint8_t index, struct PHY_tx_stats_t *stats)
+{
+	struct PHY_radio_t *radio = get_radio (index);
+	if (!radio)
+		return false;
+	std::lock_guard < std::mutex > lock (radio->tx_mutex);
+	*stats = radio->tx_stats;
+	return true;
+}
+
+/**
+ * Sets parameters of channel access of all radios.
+ * @param csma Channel access parameters.
+ * @return Returns true if parameters are valid, false otherwise.
+ */
+bool PHY_set_csma (const struct PHY_csma_t *csma)
+{
+	if (csma->min_be > csma->max_be || csma->max_be > PHY_CSMA_BE_LIMIT
+			|| csma->max_attempts == 0)
+		return false;
+	for (uint8_t i = 0; i < PHY_MAX_RADIOS; i++) {
+		std::lock_guard < std::mutex > lock (PHY_STORAGE.radios[i].tx_mutex);
+		PHY_STORAGE.radios[i].csma = *csma;
+	}
+	return true;
+}
+
+/**
+ * Sets sync word of radio, it is used immediately if radio is running.
+ * @param index Radio index.
+ * @param sync 	Sync word (SYNC_WORD_LENGTH bytes).
+ * @return Returns false if radio does not exist, true otherwise.
+ */
+bool PHY_set_sync_word (uint8_t index, const uint8_t * sync)
+{
+	if (index >= PHY_MAX_RADIOS)
+		return false;
+	struct PHY_radio_t *radio = &PHY_STORAGE.radios[index];
+	// pair mode switches sync word while radio sends
+	acquire_radio (radio);
+	{
+		std::lock_guard < std::mutex > lock (radio->mm);
+		for (uint8_t i = 0; i < SYNC_WORD_LENGTH; i++)
+			radio->sync[i] = sync[i];
+		if (PHY_STORAGE.running && index < PHY_STORAGE.radio_count)
+			set_sync_word (radio);
+	}
+	release_radio (radio);
+	return true;
+}
+
+/**
+ * Sets distance of adaptive CCA threshold above noise floor of all radios.
+ * @param margin Margin, 0 disables adaptive CCA (static thresholds are used).
+ */
+void PHY_set_cca_margin (uint8_t margin)
+{
+	for (uint8_t i = 0; i < PHY_MAX_RADIOS; i++) {
+		std::lock_guard < std::mutex > lock (PHY_STORAGE.radios[i].tx_mutex);
+		PHY_STORAGE.radios[i].cca_margin = margin;
+	}
+}
+
+/**
+ * Gets noise estimate of channel measured by radio.
+ * @param index 	Radio index.
+ * @param channel Channel number.
+ * @param stats 	Structure for noise estimate.
+ * @return Returns false if radio is not configured or channel is not tracked, true otherwise.
+ */
+bool PHY_get_noise_stats (uint8_t index, uint8_t channel, struct PHY_noise_stats_t *stats)
+{
+	struct PHY_radio_t *radio = get_radio (index);
+	if (!radio || channel >= PHY_NOISE_CHANNELS)
+		return false;
+	std::lock_guard < std::mutex > lock (radio->tx_mutex);
+	const struct PHY_noise_t *noise = &radio->noise[channel];
+	stats->channel = channel;
+	stats->samples = noise->samples;
+	stats->floor = noise->floor / 16.0;
+	stats->p10 = noise_percentile (noise, 10);
+	stats->p50 = noise_percentile (noise, 50);
+	stats->p90 = noise_percentile (noise, 90);
+	stats->cca_threshold_max = cca_threshold_max (radio, channel);
+	return true;
+}
+
+/**
+ * Sets parameters of IRQ1 polling during RX bursts, radios must not run yet.
+ * @param poll Parameters of polling.
+ * @return Returns false if radios run or parameters are invalid.
+ */
+bool PHY_set_rx_poll (const struct PHY_rx_poll_t *poll)
+{
+	if (PHY_STORAGE.running || poll->interval_ms == 0 || poll->idle_ms < poll->interval_ms)
+		return false;
+	PHY_STORAGE.rx_poll = *poll;
+	return true;
+}
+
+/**
+ * Sets health checks of radios, radios must not run yet.
+ * @param watchdog Parameters of watchdog.
+ * @return Returns false if radios run, true otherwise.
+ */
+bool PHY_set_watchdog (const struct PHY_watchdog_t *watchdog)
+{
+	if (PHY_STORAGE.running)
+		return false;
+	PHY_STORAGE.watchdog = *watchdog;
+	return true;
+}
+
+/**
+ * Gets counters of watchdog of radio.
+ * @param index Radio index.
+ * @param stats Structure for counters.
+ * @return Returns false if radio is not configured, true otherwise.
+ */
+bool PHY_get_health_stats (uint8_t index, struct PHY_health_stats_t *stats)
+{
+	struct PHY_radio_t *radio = get_radio (index);
+	if (!radio)
+		return false;
+	std::lock_guard < std::mutex > lock (radio->tx_mutex);
+	*stats = radio->health;
+	return true;
+}
+
+/**
+ * Enables warm start of radios, it takes effect in the next PHY_init.
+ * @param enable True to skip reset of radios which keep their configuration.
+ */
+void PHY_set_warm_start (bool enable)
+{
+	PHY_STORAGE.warm_start = enable;
+}
+
+/**
+ * Gets duration and kind of the last start of radio.
+ * @param index Radio index.
+ * @param stats Structure for counters.
+ * @return Returns false if radio is not configured, true otherwise.
+ */
+bool PHY_get_init_stats (uint8_t index, struct PHY_init_stats_t *stats)
+{
+	struct PHY_radio_t *radio = get_radio (index);
+	if (!radio)
+		return false;
+	std::lock_guard < std::mutex > lock (radio->stats_mutex);
+	*stats = radio->init_stats;
+	return true;
+}
+
+/**
+ * Gets counters of RX interrupts and polling of radio.
+ * @param index Radio index.
+ * @param stats Structure for counters.
+ * @return Returns false if radio is not configured, true otherwise.
+ */
+bool PHY_get_rx_poll_stats (uint8_t index, struct PHY_rx_poll_stats_t *stats)
+{
+	struct PHY_radio_t *radio = get_radio (index);
+	if (!radio)
+		return false;
+	std::lock_guard < std::mutex > lock (radio->stats_mutex);
+	*stats = radio->poll_stats;
+	return true;
+}
+
+/**
+ * Gets counters of RX ring shared by radios.
+ * @param stats Structure for counters.
+ */
+void PHY_get_rx_stats (struct PHY_rx_stats_t *stats)
 {
-	return get_cca_noise ();
+	stats->slots = RING_SLOTS;
+	stats->occupancy = ring_occupancy (&PHY_STORAGE.rx_ring);
+	stats->frames = PHY_STORAGE.rx_ring.stats.pushed;
+	stats->overflows = PHY_STORAGE.rx_ring.stats.overflows;
+	stats->high_watermark = PHY_STORAGE.rx_ring.stats.high_watermark;
 }
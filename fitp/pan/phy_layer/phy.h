@@ -36,6 +36,22 @@ struct PHY_init_t {
 	uint8_t cca_noise_threshold_min;
 };
 
+/*! maximum number of radios driven by one PAN */
+#define PHY_MAX_RADIOS 4
+
+/**
+ * Wiring of one MRF89XA transceiver.
+ */
+struct PHY_radio_config_t {
+	const char *spi_config;		/**< spidev of configuration interface. */
+	const char *spi_data;			/**< spidev of data interface. */
+	const char *gpiochip;			/**< GPIO character device of IRQ and RESET lines. */
+	uint32_t line_irq0;				/**< Line offset of IRQ0. */
+	uint32_t line_irq1;				/**< Line offset of IRQ1. */
+	uint32_t line_reset;			/**< Line offset of RESET. */
+	uint8_t channel;					/**< Channel, radio 0 uses PHY_init_t.channel. */
+};
+
 /**
  * @def PHY_init
  * @brief initialize physical layer
@@ -46,6 +62,49 @@ struct PHY_init_t {
  */
 void PHY_init (struct PHY_init_t *params);
 
+/**
+ * @def PHY_set_backend
+ * @brief select implementation of physical layer, has to be called before PHY_init
+ * available backends are "mrf89xa" (default), "loopback" and "simulator"
+ * @param name const char* backend name
+ * @return false if backend is unknown or physical layer is running
+ */
+bool PHY_set_backend (const char *name);
+
+/**
+ * @def PHY_set_radios
+ * @brief set transceivers driven by "mrf89xa" backend, has to be called
+ * before PHY_init, by default one radio is wired to /dev/spidev32766.0,
+ * /dev/spidev32766.1 and lines 274, 275, 260 of /dev/gpiochip0
+ * radios share band, bitrate and power, each has its own channel and TX queue
+ * paths "emu:<index>" select radio emulated in userspace (see emulator.h)
+ * @param radios PHY_radio_config_t* wiring, strings have to be valid until PHY_init
+ * @param count uint8_t number of radios, 1 to PHY_MAX_RADIOS
+ * @return false if count is invalid or physical layer is running
+ */
+bool PHY_set_radios (const struct PHY_radio_config_t *radios, uint8_t count);
+
+/**
+ * @def PHY_get_radio_count
+ * @brief read number of radios of selected backend
+ * @return uint8_t number of radios
+ */
+uint8_t PHY_get_radio_count ();
+
+/**
+ * @def PHY_get_rx_radio
+ * @brief read radio which received the frame being processed
+ * @return uint8_t radio index
+ */
+uint8_t PHY_get_rx_radio ();
+
+/**
+ * @def PHY_get_backend
+ * @brief read name of selected implementation of physical layer
+ * @return const char* backend name
+ */
+const char *PHY_get_backend ();
+
 /**
  * @def PHY_stop
  * @brief deactivate radio
@@ -109,25 +168,498 @@ uint8_t PHY_get_noise ();
 
 /**
  * @def PHY_send
- * @brief send raw data to air
+ * @brief queue raw data for sending to air, returns immediately
  * @param data uint8_t* data to be send
  * @param len  uint8_t data lenght
- * @return void
+ * @see PHY_send_done
+ * @return uint32_t frame identifier, 0 if TX queue is full
  */
-void PHY_send (const uint8_t * data, uint8_t len);
+uint32_t PHY_send (const uint8_t * data, uint8_t len);
 
 /**
  * @def PHY_send_with_cca
- * @brief send raw data to air wait to cca noise under specified level
+ * @brief queue raw data for sending to air, frame is sent when cca noise
+ * is under specified level, channel is accessed using CSMA/CA
+ * @see PHY_set_csma
  * @param data uint8_t* data to be send
  * @param len  uint8_t data lenght
  * @see PHY_init_t.cca_noise_threshold
  * @see PHY_send
+ * @return uint32_t frame identifier, 0 if TX queue is full
+ */
+uint32_t PHY_send_with_cca (uint8_t * data, uint8_t len);
+
+/**
+ * @def PHY_get_channel
+ * @brief read channel used by radio
+ * @return uint8_t channel number
+ */
+uint8_t PHY_get_channel (void);
+
+/**
+ * @def PHY_send_on_radio
+ * @brief queue raw data for sending by given radio, returns immediately
+ * @param radio uint8_t radio index
+ * @param data uint8_t* data to be send
+ * @param len  uint8_t data lenght
+ * @param cca bool true if channel is accessed using CSMA/CA
+ * @return uint32_t frame identifier, 0 if TX queue is full or radio does not exist
+ */
+uint32_t PHY_send_on_radio (uint8_t radio, const uint8_t * data, uint8_t len, bool cca);
+
+/*! frame is sent at bitrate set by PHY_init or PHY_set_bitrate */
+#define PHY_BITRATE_BASE 0xff
+
+/**
+ * @def PHY_send_at_bitrate
+ * @brief queue raw data for sending by given radio at given bitrate, radio
+ * switches bitrate right before the frame and keeps it for receiving replies,
+ * the next frame sent at PHY_BITRATE_BASE switches it back, radio returns
+ * to PHY_BITRATE_BASE by itself when it sends nothing for a second, frames queued
+ * by other PHY_send* functions are sent at PHY_BITRATE_BASE
+ * frame of zero length is not sent, it only switches bitrate in order of TX queue
+ * @param radio uint8_t radio index
+ * @param data uint8_t* data to be send
+ * @param len  uint8_t data lenght
+ * @param cca bool true if channel is accessed using CSMA/CA
+ * @param bitrate uint8_t DATA_RATE_* or PHY_BITRATE_BASE
+ * @return uint32_t frame identifier, 0 if TX queue is full or radio does not exist
+ */
+uint32_t PHY_send_at_bitrate (uint8_t radio, const uint8_t * data, uint8_t len, bool cca,
+															uint8_t bitrate);
+
+/**
+ * @def PHY_set_radio_channel
+ * @brief set channel used by given radio
+ * @param radio uint8_t radio index
+ * @param channel uint8_t channel to set
+ * @return boolean true if radio and channel are valid
+ */
+bool PHY_set_radio_channel (uint8_t radio, uint8_t channel);
+
+/**
+ * @def PHY_get_radio_channel
+ * @brief read channel used by given radio
+ * @param radio uint8_t radio index
+ * @return uint8_t channel number
+ */
+uint8_t PHY_get_radio_channel (uint8_t radio);
+
+/*! maximum number of channels (band and bitrate dependent) */
+#define PHY_MAX_CHANNELS 32
+
+/**
+ * Occupancy of channel measured by energy detection.
+ */
+struct PHY_survey_t {
+	uint8_t channel;		/**< Channel number. */
+	uint8_t rssi_mean;	/**< Mean RSSI. */
+	uint8_t rssi_max;		/**< Highest RSSI. */
+	uint8_t busy;				/**< Percentage of samples above busy threshold. */
+};
+
+/**
+ * @def PHY_channel_amount
+ * @brief read number of channels available for band and bitrate
+ * @param band uint8_t band
+ * @param bitrate uint8_t bitrate
+ * @return uint8_t number of channels (25 or 32)
+ */
+uint8_t PHY_channel_amount (uint8_t band, uint8_t bitrate);
+
+/**
+ * @def PHY_survey
+ * @brief step radio through all channels and sample RSSI on each of them,
+ * the original channel is restored, radio has to be idle (no frames queued)
+ * survey takes about channels * samples * interval_us
+ * @param radio uint8_t radio index
+ * @param samples uint16_t number of RSSI samples per channel
+ * @param interval_us uint16_t time between samples (us)
+ * @param busy_threshold uint8_t RSSI above which sample counts as busy
+ * @param table PHY_survey_t* array of PHY_MAX_CHANNELS records, filled
+ * in order of increasing occupancy (busy, then rssi_mean)
+ * @return uint8_t number of surveyed channels, 0 if radio is not running
+ */
+uint8_t PHY_survey (uint8_t radio, uint16_t samples, uint16_t interval_us,
+										uint8_t busy_threshold, struct PHY_survey_t *table);
+
+/**
+ * @def PHY_get_measured_noise
+ * @brief read RSSI stored during last frame reception
+ * @return uint8_t RSSI value
+ */
+uint8_t PHY_get_measured_noise ();
+
+/**
+ * Counters of SPI traffic between PAN and radio.
+ */
+struct PHY_spi_stats_t {
+	uint32_t opens;				/**< Number of spidev device opens. */
+	uint32_t syscalls;		/**< Number of spidev ioctl calls. */
+	uint32_t transfers;		/**< Number of SPI transfers. */
+	uint32_t bytes;				/**< Number of bytes on SPI bus. */
+	uint32_t errors;			/**< Number of failed ioctl calls. */
+	uint32_t rx_frames;		/**< Number of received frames. */
+	uint32_t rx_syscalls;	/**< Number of ioctl calls spent on frame reception. */
+	uint32_t tx_frames;		/**< Number of sent frames. */
+	uint32_t tx_syscalls;	/**< Number of ioctl calls spent on frame sending. */
+	uint32_t writes_skipped;	/**< Number of register writes skipped by shadow copy. */
+	uint32_t reads_cached;		/**< Number of register reads served from shadow copy. */
+};
+
+/**
+ * @def PHY_get_spi_stats
+ * @brief read counters of SPI transport of radio
+ * syscalls per frame are rx_syscalls / rx_frames and tx_syscalls / tx_frames
+ * @param radio uint8_t radio index
+ * @param stats PHY_spi_stats_t* structure to be filled
+ * @return false if radio does not exist
+ */
+bool PHY_get_spi_stats (uint8_t radio, struct PHY_spi_stats_t *stats);
+
+/**
+ * Noise estimate of channel tracked while radio is idle.
+ */
+struct PHY_noise_stats_t {
+	uint8_t channel;						/**< Channel number. */
+	uint32_t samples;						/**< Number of RSSI samples. */
+	double floor;								/**< Smoothed noise floor. */
+	uint8_t p10;								/**< 10th percentile of RSSI. */
+	uint8_t p50;								/**< Median of RSSI. */
+	uint8_t p90;								/**< 90th percentile of RSSI. */
+	uint8_t cca_threshold_max;	/**< Maximum noise accepted by CCA. */
+};
+
+/**
+ * @def PHY_get_noise_stats
+ * @brief read noise floor and RSSI percentiles of channel measured by radio
+ * @param radio uint8_t radio index
+ * @param channel uint8_t channel number
+ * @param stats PHY_noise_stats_t* structure to be filled
+ * @return false if radio does not exist or channel is not tracked
+ */
+bool PHY_get_noise_stats (uint8_t radio, uint8_t channel, struct PHY_noise_stats_t *stats);
+
+/**
+ * @def PHY_set_cca_margin
+ * @brief set distance of CCA threshold above noise floor, CCA window is
+ * cca_noise_threshold_min .. floor + margin
+ * @param margin uint8_t margin, 0 means static cca_noise_threshold_max
+ * @return void
+ */
+void PHY_set_cca_margin (uint8_t margin);
+
+/**
+ * @def PHY_set_sync_word
+ * @brief set sync word of MRF89XA radio, frames with other sync word are
+ * dropped by packet handler, other backends ignore it
+ * @param radio uint8_t radio index
+ * @param sync const uint8_t* sync word (SYNC_WORD_LENGTH bytes)
+ * @see sync_word_from_nid
+ * @return false if radio does not exist
+ */
+bool PHY_set_sync_word (uint8_t radio, const uint8_t * sync);
+
+/**
+ * Counters of RX ring between IRQ thread and protocol thread.
+ */
+struct PHY_rx_stats_t {
+	uint8_t slots;						/**< Number of ring slots. */
+	uint8_t occupancy;				/**< Number of frames waiting for processing. */
+	uint8_t high_watermark;		/**< Highest occupancy. */
+	uint32_t frames;					/**< Number of frames stored into ring. */
+	uint32_t overflows;				/**< Number of frames lost because ring was full. */
+};
+
+/**
+ * @def PHY_get_rx_stats
+ * @brief read counters of RX ring shared by all radios
+ * @param stats PHY_rx_stats_t* structure to be filled
  * @return void
  */
-void PHY_send_with_cca (uint8_t * data, uint8_t len);
+void PHY_get_rx_stats (struct PHY_rx_stats_t *stats);
 
-//uint8_t PHY_get_measured_noise();
+/**
+ * Switching of RX between interrupts and polling (NAPI-like).
+ * Two frames closer than enter_gap_ms start burst: IRQ1 line is masked
+ * and its level is polled every interval_ms, frames are drained without
+ * interrupts. Polling ends and IRQ1 is unmasked when no frame comes for
+ * idle_ms or radio starts transmitting.
+ */
+struct PHY_rx_poll_t {
+	uint16_t enter_gap_ms;	/**< Maximum gap of frames starting polling, 0 disables polling. */
+	uint16_t interval_ms;		/**< Period of polling. */
+	uint16_t idle_ms;				/**< Time without frame ending polling. */
+};
 
+/**
+ * Counters of RX interrupts and polling of radio.
+ */
+struct PHY_rx_poll_stats_t {
+	uint32_t irq_edges;				/**< Number of IRQ1 edges served in receiver mode. */
+	uint32_t polled_frames;		/**< Number of frames drained by polling. */
+	uint32_t polls;						/**< Number of IRQ1 level checks. */
+	uint32_t entries;					/**< Number of switches to polling. */
+	uint32_t exits;						/**< Number of switches back to interrupts. */
+	uint32_t drained_edges;		/**< Number of edges discarded after polling. */
+};
+
+/**
+ * @def PHY_set_rx_poll
+ * @brief set switching of RX between interrupts and polling of MRF89XA radios,
+ * has to be called before PHY_init
+ * @param poll PHY_rx_poll_t* thresholds
+ * @return false if stack is running or thresholds are invalid
+ */
+bool PHY_set_rx_poll (const struct PHY_rx_poll_t *poll);
+
+/**
+ * Health checks of MRF89XA radios done by their TX threads while idle.
+ * Radio is reset and reconfigured in place (channel, band, bitrate,
+ * power and sync word are kept) when sentinel registers do not read
+ * back as written, TXDONE does not come for tx_timeouts frames in a row
+ * or no frame is received for rx_silence_ms after a frame was sent.
+ * Silence recovery is repeated only after radio receives a frame.
+ */
+struct PHY_watchdog_t {
+	uint16_t period_ms;				/**< Period of register check, 0 disables watchdog. */
+	uint8_t tx_timeouts;			/**< Consecutive TXDONE timeouts causing recovery, 0 disables. */
+	uint32_t rx_silence_ms;		/**< RX silence after sent frame causing recovery, 0 disables. */
+};
+
+/**
+ * Counters of radio watchdog.
+ */
+struct PHY_health_stats_t {
+	uint32_t checks;						/**< Number of register checks. */
+	uint32_t register_faults;		/**< Number of sentinel register mismatches. */
+	uint32_t tx_faults;					/**< Number of recoveries caused by TXDONE timeouts. */
+	uint32_t rx_silences;				/**< Number of recoveries caused by RX silence. */
+	uint32_t recoveries;				/**< Number of resets and reconfigurations. */
+	uint32_t last_recovery_us;	/**< Duration of the last recovery (us). */
+	uint32_t max_recovery_us;		/**< Longest recovery (us). */
+	uint32_t max_tx_done_us;		/**< Longest time from start of transmission to TXDONE (us). */
+};
+
+/**
+ * @def PHY_set_watchdog
+ * @brief set health checks of MRF89XA radios, has to be called before PHY_init,
+ * watchdog of running radios is not changed
+ * @param watchdog PHY_watchdog_t* parameters of watchdog
+ * @return false if stack is running
+ */
+bool PHY_set_watchdog (const struct PHY_watchdog_t *watchdog);
+
+/**
+ * @def PHY_get_health_stats
+ * @brief read counters of watchdog of radio
+ * @param radio uint8_t radio index
+ * @param stats PHY_health_stats_t* structure to be filled
+ * @return false if radio does not exist
+ */
+bool PHY_get_health_stats (uint8_t radio, struct PHY_health_stats_t *stats);
+
+/**
+ * Startup of radio measured by PHY_init.
+ */
+struct PHY_init_stats_t {
+	bool warm;									/**< Flag if reset was skipped. */
+	uint32_t init_us;						/**< Time from opening SPI to receiver mode (us). */
+	uint32_t registers_written;	/**< Number of register writes during configuration. */
+};
+
+/**
+ * @def PHY_set_warm_start
+ * @brief skip reset of MRF89XA radios which keep configuration from previous
+ * start, register file is read back and only differing registers are written
+ * @param enable bool true to enable warm start
+ * @return void
+ */
+void PHY_set_warm_start (bool enable);
+
+/**
+ * @def PHY_get_init_stats
+ * @brief read duration and kind of the last start of radio
+ * @param radio uint8_t radio index
+ * @param stats PHY_init_stats_t* structure to be filled
+ * @return false if radio does not exist
+ */
+bool PHY_get_init_stats (uint8_t radio, struct PHY_init_stats_t *stats);
+
+/**
+ * @def PHY_get_rx_poll_stats
+ * @brief read counters of RX interrupts and polling of radio
+ * @param radio uint8_t radio index
+ * @param stats PHY_rx_poll_stats_t* structure to be filled
+ * @return false if radio does not exist
+ */
+bool PHY_get_rx_poll_stats (uint8_t radio, struct PHY_rx_poll_stats_t *stats);
+
+/**
+ * @def PHY_get_rx_timestamp
+ * @brief read arrival time of the last received frame
+ * @return monotonic time (ns) of IRQ1 edge which signalled the frame,
+ * or of the poll which found the frame, see PHY_monotonic_ns()
+ */
+uint64_t PHY_get_rx_timestamp ();
+
+/**
+ * Classes of stack threads with own scheduling settings.
+ */
+enum PHY_thread_t {
+	PHY_THREAD_IRQ,			/**< Waits for interrupts of radios. */
+	PHY_THREAD_RX,			/**< Processes received frames (protocol thread). */
+	PHY_THREAD_TX,			/**< Sends frames, one per radio. */
+	PHY_THREAD_TIMER,		/**< Wakes link layer at its deadlines. */
+	PHY_THREAD_COUNT
+};
+
+/*! wakeup later than this is counted as late (ns) */
+#define PHY_LATENCY_LATE_NS 1000000ULL
+/*! longer wakeup latency is a clock mismatch, not a sample (ns) */
+#define PHY_LATENCY_VALID_NS 1000000000ULL
+
+/**
+ * Wakeup latency of thread class: IRQ edge to handler for IRQ thread,
+ * IRQ edge to processing for RX thread, deadline to tick for timer thread.
+ */
+struct PHY_latency_stats_t {
+	uint32_t samples;		/**< Number of measured wakeups. */
+	uint32_t mean_us;		/**< Mean latency (us). */
+	uint32_t max_us;		/**< Highest latency (us). */
+	uint32_t late;			/**< Wakeups later than PHY_LATENCY_LATE_NS. */
+};
+
+/**
+ * @def PHY_set_thread_sched
+ * @brief set scheduling of thread class, has to be called before PHY_init,
+ * real-time priority needs CAP_SYS_NICE, failure is reported by the thread
+ * @param thread uint8_t thread class (PHY_THREAD_*)
+ * @param priority int SCHED_FIFO priority, 0 for normal scheduling
+ * @param cpu int CPU the threads are pinned to, -1 for any CPU
+ * @return false if thread class, priority or CPU is invalid
+ */
+bool PHY_set_thread_sched (uint8_t thread, int priority, int cpu);
+
+/**
+ * @def PHY_set_memory_lock
+ * @brief lock all process memory (mlockall) in PHY_init and prefault stacks
+ * of stack threads, needs CAP_IPC_LOCK or sufficient RLIMIT_MEMLOCK
+ * @param enable bool true to lock memory
+ * @return void
+ */
+void PHY_set_memory_lock (bool enable);
+
+/**
+ * @def PHY_get_latency_stats
+ * @brief read wakeup latency of thread class
+ * @param thread uint8_t thread class (PHY_THREAD_*)
+ * @param stats PHY_latency_stats_t* structure to be filled
+ * @return false if thread class does not exist
+ */
+bool PHY_get_latency_stats (uint8_t thread, struct PHY_latency_stats_t *stats);
+
+/**
+ * @def PHY_reset_latency_stats
+ * @brief clear wakeup latency of all thread classes
+ * @return void
+ */
+void PHY_reset_latency_stats ();
+
+/*! frame was sent */
+#define PHY_TX_OK 0
+/*! TXDONE interrupt did not come in time */
+#define PHY_TX_TIMEOUT 1
+/*! physical layer was stopped before frame was sent */
+#define PHY_TX_ABORTED 2
+/*! channel was busy in all CCA attempts */
+#define PHY_TX_CHANNEL_BUSY 3
+
+/*! highest allowed backoff exponent */
+#define PHY_CSMA_BE_LIMIT 10
+
+/**
+ * Parameters of channel access (unslotted CSMA/CA).
+ * Before each CCA the sender waits random number of slots from
+ * 0 to 2^be - 1, be grows from min_be to max_be with each busy channel.
+ */
+struct PHY_csma_t {
+	uint16_t slot_time_us;	/**< Duration of backoff slot (us). */
+	uint8_t min_be;					/**< Initial backoff exponent. */
+	uint8_t max_be;					/**< Maximum backoff exponent. */
+	uint8_t max_attempts;		/**< Number of CCA attempts before frame is dropped. */
+};
+
+/**
+ * @def PHY_set_csma
+ * @brief set parameters of channel access used by PHY_send_with_cca
+ * @param csma PHY_csma_t* parameters
+ * @return true if parameters are valid
+ */
+bool PHY_set_csma (const struct PHY_csma_t *csma);
+
+/**
+ * Counters of TX queue.
+ */
+struct PHY_tx_stats_t {
+	uint32_t queued;		/**< Number of frames put into TX queue. */
+	uint32_t sent;			/**< Number of frames confirmed by TXDONE. */
+	uint32_t failed;		/**< Number of frames which were not sent. */
+	uint32_t dropped;		/**< Number of frames refused because of full TX queue. */
+	uint8_t max_queue;	/**< Highest number of frames waiting in TX queue. */
+	uint32_t cca_attempts;		/**< Number of clear channel assessments. */
+	uint32_t cca_busy;				/**< Number of assessments which found channel busy (retries). */
+	uint32_t channel_busy;		/**< Number of frames dropped because of busy channel. */
+	uint64_t cca_wait_us;			/**< Total time spent in channel access (us). */
+	uint32_t cca_wait_max_us;	/**< Longest channel access (us). */
+	uint32_t bitrate_switches;	/**< Number of bitrate changes made for queued frames. */
+};
+
+/**
+ * @def PHY_get_tx_stats
+ * @brief read counters of TX queue of radio
+ * @param radio uint8_t radio index
+ * @param stats PHY_tx_stats_t* structure to be filled
+ * @return false if radio does not exist
+ */
+bool PHY_get_tx_stats (uint8_t radio, struct PHY_tx_stats_t *stats);
+
+/**
+ * Metadata of received frame, filled when frame is signalled.
+ */
+struct PHY_rx_info_t {
+	uint64_t timestamp;		/**< Monotonic arrival time (ns). */
+	uint8_t rssi;					/**< RSSI measured during frame. */
+	uint8_t channel;			/**< Channel of receiving radio. */
+	uint8_t bitrate;			/**< Bitrate of receiving radio. */
+	uint8_t radio;				/**< Index of receiving radio. */
+};
+
+/**
+ * @def PHY_monotonic_ns
+ * @brief read monotonic clock used for timestamps of received frames
+ * @return CLOCK_MONOTONIC time (ns)
+ */
+uint64_t PHY_monotonic_ns ();
+
+extern void PHY_process_packet (uint8_t * data, uint8_t len,
+																const struct PHY_rx_info_t *info);
+
+extern void PHY_timer_interrupt (void);
+
+/**
+ * @def PHY_set_timer
+ * @brief set time of the next PHY_timer_interrupt call, timer thread
+ * sleeps until then
+ * @param deadline 	CLOCK_MONOTONIC time (ns), 0 stops timer
+ */
+void PHY_set_timer (uint64_t deadline);
+
+/**
+ * Called by TX thread when frame leaves TX queue.
+ * @param id 			Frame identifier returned by PHY_send.
+ * @param status 	PHY_TX_OK or reason of failure.
+ */
+extern void PHY_send_done (uint32_t id, uint8_t status);
 
 #endif
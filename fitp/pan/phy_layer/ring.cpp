@@ -0,0 +1,52 @@
+#include "ring.h"
+
+static_assert ((RING_SLOTS & (RING_SLOTS - 1)) == 0, "RING_SLOTS has to be power of two");
+
+void ring_init (struct RING_t *ring)
+{
+	ring->head.store (0);
+	ring->tail.store (0);
+	ring->stats.pushed.store (0);
+	ring->stats.overflows.store (0);
+	ring->stats.high_watermark.store (0);
+}
+
+struct RING_slot_t *ring_reserve (struct RING_t *ring)
+{
+	uint32_t head = ring->head.load (std::memory_order_relaxed);
+	uint32_t tail = ring->tail.load (std::memory_order_acquire);
+	if (head - tail >= RING_SLOTS)
+		return 0;
+	return &ring->slots[head & (RING_SLOTS - 1)];
+}
+
+void ring_commit (struct RING_t *ring)
+{
+	uint32_t head = ring->head.load (std::memory_order_relaxed) + 1;
+	ring->head.store (head, std::memory_order_release);
+
+	uint32_t occupancy = head - ring->tail.load (std::memory_order_relaxed);
+	ring->stats.pushed.fetch_add (1, std::memory_order_relaxed);
+	if (occupancy > ring->stats.high_watermark.load (std::memory_order_relaxed))
+		ring->stats.high_watermark.store (occupancy, std::memory_order_relaxed);
+}
+
+struct RING_slot_t *ring_peek (struct RING_t *ring)
+{
+	uint32_t tail = ring->tail.load (std::memory_order_relaxed);
+	if (tail == ring->head.load (std::memory_order_acquire))
+		return 0;
+	return &ring->slots[tail & (RING_SLOTS - 1)];
+}
+
+void ring_release (struct RING_t *ring)
+{
+	uint32_t tail = ring->tail.load (std::memory_order_relaxed);
+	ring->tail.store (tail + 1, std::memory_order_release);
+}
+
+uint8_t ring_occupancy (struct RING_t *ring)
+{
+	return ring->head.load (std::memory_order_acquire)
+		- ring->tail.load (std::memory_order_acquire);
+}
@@ -0,0 +1,87 @@
+#ifndef MRF_RING_H
+#define MRF_RING_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <atomic>
+
+/*! number of ring slots (power of two) */
+#define RING_SLOTS 16
+/*! size of slot buffer, length byte and the longest frame */
+#define RING_SLOT_SIZE 64
+
+/**
+ * Received frame stored in ring slot.
+ */
+struct RING_slot_t {
+	uint8_t len;										/**< Payload length. */
+	uint8_t data[RING_SLOT_SIZE];		/**< Length byte and payload as read from FIFO. */
+	uint8_t rssi;										/**< RSSI measured when frame was signalled. */
+	uint64_t timestamp;							/**< Monotonic arrival time (ns). */
+	uint8_t radio;									/**< Index of receiving radio. */
+	uint8_t channel;								/**< Channel of receiving radio. */
+	uint8_t bitrate;								/**< Bitrate of receiving radio. */
+};
+
+/**
+ * Counters of ring, written by producer and read by any thread.
+ */
+struct RING_stats_t {
+	std::atomic < uint32_t > pushed;					/**< Number of stored frames. */
+	std::atomic < uint32_t > overflows;				/**< Number of frames lost because ring was full. */
+	std::atomic < uint8_t > high_watermark;		/**< Highest occupancy. */
+};
+
+/**
+ * Lock-free single-producer/single-consumer ring of preallocated slots.
+ * Producer reserves slot, fills it and commits it; consumer peeks the
+ * oldest slot and releases it when it is processed.
+ */
+struct RING_t {
+	std::atomic < uint32_t > head;					/**< Next slot of producer. */
+	std::atomic < uint32_t > tail;					/**< Next slot of consumer. */
+	struct RING_slot_t slots[RING_SLOTS];		/**< Slots. */
+	struct RING_stats_t stats;							/**< Counters (updated by producer). */
+};
+
+/**
+ * Empties ring and clears its counters.
+ * @param ring 	Ring.
+ */
+void ring_init (struct RING_t *ring);
+
+/**
+ * Gets free slot for producer.
+ * Producer counts lost frame in stats.overflows if ring is full.
+ * @param ring 	Ring.
+ * @return Returns free slot, NULL if ring is full.
+ */
+struct RING_slot_t *ring_reserve (struct RING_t *ring);
+
+/**
+ * Makes reserved slot visible to consumer.
+ * @param ring 	Ring.
+ */
+void ring_commit (struct RING_t *ring);
+
+/**
+ * Gets the oldest committed slot for consumer.
+ * @param ring 	Ring.
+ * @return Returns slot, NULL if ring is empty.
+ */
+struct RING_slot_t *ring_peek (struct RING_t *ring);
+
+/**
+ * Returns processed slot to producer.
+ * @param ring 	Ring.
+ */
+void ring_release (struct RING_t *ring);
+
+/**
+ * Gets number of committed slots.
+ * @param ring 	Ring.
+ * @return Returns occupancy.
+ */
+uint8_t ring_occupancy (struct RING_t *ring);
+
+#endif
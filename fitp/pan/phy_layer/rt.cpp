@@ -0,0 +1,158 @@
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <iostream>
+#include <atomic>
+#include "pan/debug.h"
+#include "phy.h"
+#include "rt.h"
+
+using namespace std;
+
+/**
+ * Settings of thread class.
+ */
+struct RT_thread_config_t {
+	int priority = 0;		// SCHED_FIFO priority, 0 keeps SCHED_OTHER
+	int cpu = -1;				// CPU of thread, -1 for any CPU
+};
+
+/**
+ * Wakeup latency counters of thread class, written only by the thread.
+ */
+struct RT_latency_t {
+	std::atomic < uint32_t > samples;
+	std::atomic < uint64_t > sum_ns;
+	std::atomic < uint64_t > max_ns;
+	std::atomic < uint32_t > late;
+};
+
+/**
+ * Structure for real-time settings of stack threads.
+ */
+struct RT_storage_t {
+	struct RT_thread_config_t threads[PHY_THREAD_COUNT];
+	bool lock_memory = false;
+	bool memory_locked = false;
+	struct RT_latency_t latency[PHY_THREAD_COUNT];
+} RT_STORAGE;
+
+static const char *const thread_names[PHY_THREAD_COUNT] = {
+	"irq", "rx", "tx", "timer"
+};
+
+/**
+ * Touches thread stack so that locked pages are present before deadlines.
+ */
+static void __attribute__ ((noinline)) prefault_stack ()
+{
+	volatile uint8_t buffer[RT_STACK_PREFAULT];
+
+	for (uint32_t i = 0; i < sizeof (buffer); i += 4096)
+		buffer[i] = 0;
+}
+
+void rt_thread_setup (uint8_t thread)
+{
+	const struct RT_thread_config_t &config = RT_STORAGE.threads[thread];
+
+	if (config.cpu >= 0) {
+		cpu_set_t set;
+		CPU_ZERO (&set);
+		CPU_SET (config.cpu, &set);
+		int err = pthread_setaffinity_np (pthread_self (), sizeof (set), &set);
+		if (err != 0)
+			cerr << "rt_thread_setup(): " << thread_names[thread] << " thread cannot run on CPU "
+				<< config.cpu << ": " << strerror (err) << endl;
+	}
+	if (config.priority > 0) {
+		struct sched_param param;
+		param.sched_priority = config.priority;
+		int err = pthread_setschedparam (pthread_self (), SCHED_FIFO, &param);
+		if (err != 0)
+			cerr << "rt_thread_setup(): " << thread_names[thread] << " thread cannot use SCHED_FIFO "
+				<< config.priority << ": " << strerror (err) << endl;
+	}
+	if (RT_STORAGE.memory_locked)
+		prefault_stack ();
+	D_PHY printf ("rt_thread_setup(): %s thread priority %d cpu %d\n", thread_names[thread],
+								config.priority, config.cpu);
+}
+
+bool rt_lock_memory ()
+{
+	if (!RT_STORAGE.lock_memory || RT_STORAGE.memory_locked)
+		return true;
+	if (mlockall (MCL_CURRENT | MCL_FUTURE) != 0) {
+		cerr << "rt_lock_memory(): mlockall failed: " << strerror (errno) << endl;
+		return false;
+	}
+	RT_STORAGE.memory_locked = true;
+	return true;
+}
+
+void rt_unlock_memory ()
+{
+	if (!RT_STORAGE.memory_locked)
+		return;
+	munlockall ();
+	RT_STORAGE.memory_locked = false;
+}
+
+void rt_latency_record (uint8_t thread, uint64_t event, uint64_t now)
+{
+	struct RT_latency_t &latency = RT_STORAGE.latency[thread];
+
+	// event timestamp which could not be converted to monotonic clock
+	if (now < event || now - event > PHY_LATENCY_VALID_NS)
+		return;
+	uint64_t delay = now - event;
+	latency.samples.fetch_add (1, std::memory_order_relaxed);
+	latency.sum_ns.fetch_add (delay, std::memory_order_relaxed);
+	if (delay > latency.max_ns.load (std::memory_order_relaxed))
+		latency.max_ns.store (delay, std::memory_order_relaxed);
+	if (delay > PHY_LATENCY_LATE_NS)
+		latency.late.fetch_add (1, std::memory_order_relaxed);
+}
+
+bool PHY_set_thread_sched (uint8_t thread, int priority, int cpu)
+{
+	if (thread >= PHY_THREAD_COUNT)
+		return false;
+	if (priority < 0 || priority > sched_get_priority_max (SCHED_FIFO))
+		return false;
+	if (cpu < -1 || cpu >= CPU_SETSIZE)
+		return false;
+	RT_STORAGE.threads[thread].priority = priority;
+	RT_STORAGE.threads[thread].cpu = cpu;
+	return true;
+}
+
+void PHY_set_memory_lock (bool enable)
+{
+	RT_STORAGE.lock_memory = enable;
+}
+
+bool PHY_get_latency_stats (uint8_t thread, struct PHY_latency_stats_t *stats)
+{
+	if (thread >= PHY_THREAD_COUNT)
+		return false;
+	struct RT_latency_t &latency = RT_STORAGE.latency[thread];
+	stats->samples = latency.samples.load ();
+	stats->mean_us = stats->samples ? latency.sum_ns.load () / stats->samples / 1000 : 0;
+	stats->max_us = latency.max_ns.load () / 1000;
+	stats->late = latency.late.load ();
+	return true;
+}
+
+void PHY_reset_latency_stats ()
+{
+	for (uint8_t i = 0; i < PHY_THREAD_COUNT; i++) {
+		RT_STORAGE.latency[i].samples = 0;
+		RT_STORAGE.latency[i].sum_ns = 0;
+		RT_STORAGE.latency[i].max_ns = 0;
+		RT_STORAGE.latency[i].late = 0;
+	}
+}
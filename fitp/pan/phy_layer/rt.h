@@ -0,0 +1,37 @@
+#ifndef MRF_RT_H
+#define MRF_RT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*! bytes of thread stack touched before real-time work starts */
+#define RT_STACK_PREFAULT (64 * 1024)
+
+/**
+ * Applies scheduling policy, CPU affinity and stack prefault set for
+ * class of stack threads, has to be called by the thread itself.
+ * Failures are reported and the thread continues with previous settings.
+ * @param thread 	Thread class (PHY_THREAD_*).
+ */
+void rt_thread_setup (uint8_t thread);
+
+/**
+ * Locks process memory if it was requested.
+ * @return Returns false if memory cannot be locked, true otherwise.
+ */
+bool rt_lock_memory ();
+
+/**
+ * Unlocks memory locked by rt_lock_memory().
+ */
+void rt_unlock_memory ();
+
+/**
+ * Adds wakeup latency sample, called only by thread of given class.
+ * @param thread 	Thread class (PHY_THREAD_*).
+ * @param event 	Monotonic time when thread should have run (ns).
+ * @param now 		Monotonic time when thread runs (ns).
+ */
+void rt_latency_record (uint8_t thread, uint64_t event, uint64_t now);
+
+#endif
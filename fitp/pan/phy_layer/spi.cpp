@@ -0,0 +1,281 @@
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdio.h>
+#include <sys/ioctl.h>
+#include <iostream>
+#include "pan/debug.h"
+#include "spi.h"
+#include "emulator.h"
+
+using namespace std;
+
+static uint8_t spi_mode = SPI_MODE_0;
+const uint8_t spi_bits_per_word = 8;
+const uint32_t spi_speed_hz = 1000000;
+
+/**
+ * Prepares transfer with common bus settings.
+ * @param xfer 	Transfer.
+ */
+static void spi_bus_config (struct spi_ioc_transfer *xfer)
+{
+	memset (xfer, 0, sizeof (*xfer));
+	// keep CS activated
+	xfer->cs_change = 0;
+	// delay in us
+	xfer->delay_usecs = 0;
+	// speed
+	xfer->speed_hz = spi_speed_hz;
+	// bites per word 8
+	xfer->bits_per_word = spi_bits_per_word;
+}
+
+/**
+ * Sends transfers in one ioctl.
+ * Chip select between transfers is driven by cs_change of each transfer.
+ * @param spi 				SPI transport.
+ * @param fd 					Device.
+ * @param xfer 				Transfers.
+ * @param count 			Number of transfers.
+ * @return Returns true if transfers are done, false otherwise.
+ */
+static bool spi_message (struct SPI_transport_t *spi, int fd,
+												 struct spi_ioc_transfer *xfer, uint8_t count)
+{
+	if (fd < 0 || count == 0)
+		return false;
+	spi->stats.syscalls++;
+	spi->stats.transfers += count;
+	for (uint8_t i = 0; i < count; i++)
+		spi->stats.bytes += xfer[i].len;
+	if (spi->emulated ? !emulator_spi_message (fd, xfer, count)
+			: ioctl (fd, SPI_IOC_MESSAGE (count), xfer) < 0) {
+		spi->stats.errors++;
+		D_PHY printf ("spi_message(): ioctl failed!\n");
+		return false;
+	}
+	return true;
+}
+
+/**
+ * Sends queued register writes, registers whose write failed are added
+ * to lost_writes.
+ * @param spi 	SPI transport.
+ * @return Returns true if writes are done, false otherwise.
+ */
+static bool spi_flush (struct SPI_transport_t *spi)
+{
+	if (spi->batch_len == 0)
+		return true;
+	// release CS between registers, keep the last one as usual
+	for (uint8_t i = 0; i < spi->batch_len - 1; i++)
+		spi->batch[i].cs_change = 1;
+	bool done = spi_message (spi, spi->config_fd, spi->batch, spi->batch_len);
+	if (!done) {
+		for (uint8_t i = 0; i < spi->batch_len; i++)
+			spi->lost_writes |= 1UL << ((spi->batch_tx[i][0] >> 1) & 0x1f);
+	}
+	spi->batch_len = 0;
+	return done;
+}
+
+bool spi_open (struct SPI_transport_t *spi, const char *config_dev, const char *data_dev)
+{
+	std::lock_guard < std::recursive_mutex > lock (spi->mutex);
+
+	spi->batch_depth = 0;
+	spi->batch_len = 0;
+	spi->emulated = emulator_match (config_dev);
+	if (spi->emulated) {
+		spi->stats.opens += 2;
+		return emulator_spi_open (config_dev, data_dev, &spi->config_fd, &spi->data_fd);
+	}
+	spi->config_fd = open (config_dev, O_RDWR);
+	spi->stats.opens++;
+	if (spi->config_fd < 0) {
+		cerr << "Can't open SPI device!" << endl;
+		return false;
+	}
+
+	spi->data_fd = open (data_dev, O_RDWR);
+	spi->stats.opens++;
+	if (spi->data_fd < 0) {
+		cerr << "Can't open SPI device!" << endl;
+		close (spi->config_fd);
+		spi->config_fd = -1;
+		return false;
+	}
+	spi->stats.syscalls++;
+	if (ioctl (spi->data_fd, SPI_IOC_WR_MODE, &spi_mode) < 0) {
+		cerr << "Can't set spi mode!" << endl;
+		spi_close (spi);
+		return false;
+	}
+	return true;
+}
+
+void spi_close (struct SPI_transport_t *spi)
+{
+	std::lock_guard < std::recursive_mutex > lock (spi->mutex);
+
+	spi_flush (spi);
+	if (spi->emulated) {
+		emulator_spi_close (spi->config_fd, spi->data_fd);
+	} else {
+		if (spi->config_fd >= 0)
+			close (spi->config_fd);
+		if (spi->data_fd >= 0)
+			close (spi->data_fd);
+	}
+	spi->config_fd = -1;
+	spi->data_fd = -1;
+}
+
+void spi_batch_begin (struct SPI_transport_t *spi)
+{
+	spi->mutex.lock ();
+	spi->batch_depth++;
+}
+
+void spi_batch_end (struct SPI_transport_t *spi)
+{
+	if (spi->batch_depth > 0 && --spi->batch_depth == 0)
+		spi_flush (spi);
+	spi->mutex.unlock ();
+}
+
+bool spi_write_register (struct SPI_transport_t *spi, uint8_t address, uint8_t value)
+{
+	std::lock_guard < std::recursive_mutex > lock (spi->mutex);
+
+	if (spi->batch_len >= SPI_MAX_BATCH)
+		spi_flush (spi);
+
+	uint8_t index = spi->batch_len++;
+	//0x3E = 0b00111110 START_BIT|_W_/R|D|D|D|D|D|STOP_BIT
+	spi->batch_tx[index][0] = address & 0x3e;
+	spi->batch_tx[index][1] = value;
+	spi_bus_config (&spi->batch[index]);
+	spi->batch[index].tx_buf = (unsigned long) spi->batch_tx[index];
+	spi->batch[index].len = 2;
+
+	if (spi->batch_depth == 0)
+		return spi_flush (spi);
+	return true;
+}
+
+uint8_t spi_read_register (struct SPI_transport_t *spi, uint8_t address)
+{
+	uint8_t value = 0;
+	if (!spi_read_registers (spi, &address, &value, 1))
+		cerr << "Can't read register!" << endl;
+	return value;
+}
+
+bool spi_read_registers (struct SPI_transport_t *spi, const uint8_t *addresses,
+												 uint8_t *values, uint8_t count)
+{
+	struct spi_ioc_transfer xfer[SPI_MAX_BATCH];
+	uint8_t wr_buf[SPI_MAX_BATCH / 2];
+
+	std::lock_guard < std::recursive_mutex > lock (spi->mutex);
+	// queued writes have to reach the chip before reading back
+	spi_flush (spi);
+
+	while (count > 0) {
+		uint8_t chunk = count < SPI_MAX_BATCH / 2 ? count : SPI_MAX_BATCH / 2;
+		for (uint8_t i = 0; i < chunk; i++) {
+			//0x7E = 0b01111110 START_BIT|W/_R_|D|D|D|D|D|STOP_BIT
+			wr_buf[i] = (addresses[i] | 0x40) & 0x7e;
+			spi_bus_config (&xfer[2 * i]);
+			xfer[2 * i].tx_buf = (unsigned long) &wr_buf[i];
+			xfer[2 * i].len = 1;
+			spi_bus_config (&xfer[2 * i + 1]);
+			xfer[2 * i + 1].rx_buf = (unsigned long) &values[i];
+			xfer[2 * i + 1].len = 1;
+			// release CS after each register except the last one
+			xfer[2 * i + 1].cs_change = (i + 1 < chunk) ? 1 : 0;
+		}
+		if (!spi_message (spi, spi->config_fd, xfer, 2 * chunk))
+			return false;
+		addresses += chunk;
+		values += chunk;
+		count -= chunk;
+	}
+	return true;
+}
+
+uint8_t spi_read_fifo (struct SPI_transport_t *spi)
+{
+	struct spi_ioc_transfer xfer;
+	uint8_t rd_buf = 0;
+
+	std::lock_guard < std::recursive_mutex > lock (spi->mutex);
+	spi_bus_config (&xfer);
+	xfer.rx_buf = (unsigned long) &rd_buf;
+	xfer.len = 1;
+	if (!spi_message (spi, spi->data_fd, &xfer, 1)) {
+		cerr << "Read error" << endl;
+		return -1;
+	}
+	return rd_buf;
+}
+
+void spi_write_fifo (struct SPI_transport_t *spi, uint8_t data)
+{
+	struct spi_ioc_transfer xfer;
+
+	std::lock_guard < std::recursive_mutex > lock (spi->mutex);
+	spi_bus_config (&xfer);
+	xfer.tx_buf = (unsigned long) &data;
+	xfer.len = 1;
+	spi_message (spi, spi->data_fd, &xfer, 1);
+}
+
+/**
+ * Prepares chained one byte transfers on data interface.
+ * @param xfer 	Transfers.
+ * @param len 	Number of transfers.
+ */
+static void spi_fifo_chain (struct spi_ioc_transfer *xfer, uint8_t len)
+{
+	for (uint8_t i = 0; i < len; i++) {
+		spi_bus_config (&xfer[i]);
+		xfer[i].len = 1;
+		// MRF89XA takes one FIFO byte per CSDATA cycle
+		xfer[i].cs_change = (i + 1 < len) ? 1 : 0;
+	}
+}
+
+bool spi_read_fifo_burst (struct SPI_transport_t *spi, uint8_t *data, uint8_t len)
+{
+	struct spi_ioc_transfer xfer[SPI_MAX_BATCH];
+
+	if (len == 0)
+		return true;
+	if (len > SPI_MAX_BATCH)
+		return false;
+
+	std::lock_guard < std::recursive_mutex > lock (spi->mutex);
+	spi_fifo_chain (xfer, len);
+	for (uint8_t i = 0; i < len; i++)
+		xfer[i].rx_buf = (unsigned long) &data[i];
+	return spi_message (spi, spi->data_fd, xfer, len);
+}
+
+bool spi_write_fifo_burst (struct SPI_transport_t *spi, const uint8_t *data, uint8_t len)
+{
+	struct spi_ioc_transfer xfer[SPI_MAX_BATCH];
+
+	if (len == 0)
+		return true;
+	if (len > SPI_MAX_BATCH)
+		return false;
+
+	std::lock_guard < std::recursive_mutex > lock (spi->mutex);
+	spi_fifo_chain (xfer, len);
+	for (uint8_t i = 0; i < len; i++)
+		xfer[i].tx_buf = (unsigned long) &data[i];
+	return spi_message (spi, spi->data_fd, xfer, len);
+}
@@ -0,0 +1,134 @@
+#ifndef MRF_SPI_H
+#define MRF_SPI_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <linux/spi/spidev.h>
+#include <mutex>
+
+// maximum number of transfers queued into one SPI_IOC_MESSAGE
+#define SPI_MAX_BATCH 64
+
+/**
+ * Counters of SPI transport activity.
+ */
+struct SPI_stats_t {
+	uint32_t opens;					/**< Number of open() calls on spidev devices. */
+	uint32_t syscalls;			/**< Number of ioctl() calls issued on spidev devices. */
+	uint32_t transfers;			/**< Number of SPI transfers (chip select cycles). */
+	uint32_t bytes;					/**< Number of bytes clocked over the bus. */
+	uint32_t errors;				/**< Number of failed ioctl() calls. */
+};
+
+/**
+ * SPI transport for MRF89XA.
+ * Keeps both spidev devices (config and data chip select) open and queues
+ * register writes into a single SPI_IOC_MESSAGE(n) while a batch is open.
+ */
+struct SPI_transport_t {
+	int config_fd = -1;												/**< Config interface (CSCON). */
+	int data_fd = -1;													/**< Data interface (CSDATA). */
+	bool emulated = false;										/**< Flag if interfaces belong to emulator. */
+	uint8_t batch_depth = 0;									/**< Nesting level of open batches. */
+	uint8_t batch_len = 0;										/**< Number of queued transfers. */
+	struct spi_ioc_transfer batch[SPI_MAX_BATCH];	/**< Queued transfers. */
+	uint8_t batch_tx[SPI_MAX_BATCH][2];				/**< TX buffers of queued register writes. */
+	uint32_t lost_writes = 0;									/**< Registers (address >> 1) whose queued write failed. */
+	std::recursive_mutex mutex;								/**< Serializes access to the bus. */
+	struct SPI_stats_t stats;									/**< Activity counters. */
+};
+
+/**
+ * Opens both spidev devices and keeps them open. Paths starting with
+ * PHY_EMULATOR_PREFIX open interfaces of emulated radio instead.
+ * @param spi 					SPI transport.
+ * @param config_dev		Path to spidev device of config interface.
+ * @param data_dev			Path to spidev device of data interface.
+ * @return Returns true if both devices are opened, false otherwise.
+ */
+bool spi_open (struct SPI_transport_t *spi, const char *config_dev, const char *data_dev);
+
+/**
+ * Flushes queued transfers and closes spidev devices.
+ * @param spi 	SPI transport.
+ */
+void spi_close (struct SPI_transport_t *spi);
+
+/**
+ * Starts queueing register writes. Batches can be nested, the queued
+ * transfers are sent by the outermost spi_batch_end().
+ * The bus stays locked for the calling thread until the batch ends.
+ * @param spi 	SPI transport.
+ */
+void spi_batch_begin (struct SPI_transport_t *spi);
+
+/**
+ * Ends batch and sends queued transfers in one ioctl.
+ * @param spi 	SPI transport.
+ */
+void spi_batch_end (struct SPI_transport_t *spi);
+
+/**
+ * Writes register, queues write if batch is open. Failure of queued
+ * write is recorded in lost_writes when the batch is sent.
+ * @param spi 			SPI transport.
+ * @param address 	Address of register.
+ * @param value 		Register setting.
+ * @return Returns false if write failed, true if it is done or queued.
+ */
+bool spi_write_register (struct SPI_transport_t *spi, uint8_t address, uint8_t value);
+
+/**
+ * Reads register (queued writes are flushed first).
+ * @param spi 			SPI transport.
+ * @param address 	Address of register.
+ * @return Returns register value.
+ */
+uint8_t spi_read_register (struct SPI_transport_t *spi, uint8_t address);
+
+/**
+ * Reads several registers in one ioctl.
+ * @param spi 				SPI transport.
+ * @param addresses 	Addresses of registers.
+ * @param values 			Array for register values.
+ * @param count 			Number of registers.
+ * @return Returns true if registers are read, false otherwise.
+ */
+bool spi_read_registers (struct SPI_transport_t *spi, const uint8_t *addresses,
+												 uint8_t *values, uint8_t count);
+
+/**
+ * Reads one byte from FIFO.
+ * @param spi 	SPI transport.
+ * @return Returns read byte.
+ */
+uint8_t spi_read_fifo (struct SPI_transport_t *spi);
+
+/**
+ * Writes one byte to FIFO.
+ * @param spi 	SPI transport.
+ * @param data 	Data.
+ */
+void spi_write_fifo (struct SPI_transport_t *spi, uint8_t data);
+
+/**
+ * Reads several bytes from FIFO in one ioctl.
+ * Chip select of data interface is released after every byte.
+ * @param spi 	SPI transport.
+ * @param data 	Array for read bytes.
+ * @param len 	Number of bytes (at most SPI_MAX_BATCH).
+ * @return Returns true if bytes are read, false otherwise.
+ */
+bool spi_read_fifo_burst (struct SPI_transport_t *spi, uint8_t *data, uint8_t len);
+
+/**
+ * Writes several bytes to FIFO in one ioctl.
+ * Chip select of data interface is released after every byte.
+ * @param spi 	SPI transport.
+ * @param data 	Data.
+ * @param len 	Number of bytes (at most SPI_MAX_BATCH).
+ * @return Returns true if bytes are written, false otherwise.
+ */
+bool spi_write_fifo_burst (struct SPI_transport_t *spi, const uint8_t *data, uint8_t len);
+
+#endif
@@ -1,519 +1,310 @@
-#include "glib.h"
-#include <stdlib.h>
-#include <iostream>
-#include <fstream>
-#include <fcntl.h>
 #include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/time.h>
+#include <iostream>
 #include <string>
-#include <linux/spi/spidev.h>
-#include <linux/types.h>
-#include <stdint.h>
-#include <sys/ioctl.h>
-#include <string>
-#include <thread>
-#include <condition_variable>
 #include <mutex>
-#include <chrono>
-
-#include "constants.h"
+#include <thread>
+#include "pan/debug.h"
+#include "common/phy_layer/sim_frame.h"
 #include "phy.h"
-#include "mqtt_iface.h"
-#include "simulator.h"
-#include "global.h"
+#include "backend.h"
+#include "rt.h"
+#include "x86_phy.h"
 
 using namespace std;
 
-// process synchronization during sending
-bool waiting_send = false;
-std::mutex m, mm, mmm;
-std::condition_variable cv;
+// maximum time in ms sending waits for simulator to take frame
+#define SIMULATOR_SEND_TIMEOUT 100
 
-struct PHY_storage_t {
-	uint8_t mode;
+/**
+ * Structure for network simulator backend.
+ */
+struct PHY_simulator_storage_t {
+	std::mutex mutex;
 	uint8_t channel;
 	uint8_t band;
 	uint8_t bitrate;
 	uint8_t power;
-	uint8_t received_packet[MAX_PHY_PAYLOAD_SIZE];
-	uint8_t cca_noise_threshold_max;
-	uint8_t cca_noise_threshold_min;
-	uint8_t signal_strength;
-
-	// the PAN coordinator setting
-	std::thread irq_interrupt_deamon;
-	std::thread timer_interrupt_generator;
-	bool irq1_enabled = false;
-	bool irq0_enabled = false;
-	GMainLoop *gloop;
-	bool terminate_timer = false;
-} PHY_STORAGE;
+	uint32_t next_id = 0;
+	struct PHY_callbacks_t callbacks;
+	std::string bus_path = SIM_DEFAULT_BUS_PATH;
+	std::string node_path;
+	struct sockaddr_un bus_addr;
+	int fd = -1;
+	std::thread rx_deamon;
+	struct PHY_simulator_stats_t stats;
+} SIMULATOR_STORAGE;
 
 /**
- * Extern functions.
+ * Fills address of UNIX socket.
+ * @param addr 	Address.
+ * @param path 	Socket path.
+ * @return Returns false if path is too long, true otherwise.
  */
-extern void PHY_process_packet (uint8_t * data, uint8_t len);
-extern void PHY_timer_interrupt (void);
-
-/**
- * Support functions.
- */
-void set_register (uint8_t address, uint8_t value);
-uint8_t get_register (uint8_t address);
-void write_fifo (uint8_t data);
-void set_rf_mode (uint8_t mode);
-bool set_power (uint8_t power);
-bool set_bitrate (uint8_t bitrate);
-bool set_channel_freq_rate (uint8_t channel, uint8_t band, uint8_t bitrate);
-void send_reload_radio ();
-inline uint8_t get_cca_noise ();
-
-/**
- * Implemented functions from hw layer.
- */
-void HW_irq0_occurred (void);
-void HW_irq1_occurred (void);
-
-// Constant table
-// BAND_863, BAND863_C950, BAND_902, BAND_915
-const uint16_t _start_freq[] = { 860, 950, 902, 915 };
-uint16_t _channel_spacing[] = { 384, 400, 400, 400 };
-
-uint16_t _channel_compare (uint8_t band, uint8_t channel, uint8_t bitrate)
+static bool set_address (struct sockaddr_un *addr, const std::string & path)
 {
-	uint32_t freq = (uint32_t) _start_freq[band] * 1000;
-	if ((band == BAND_863 || band == BAND_863_C950)
-			&& !(bitrate == DATA_RATE_100 || bitrate == DATA_RATE_200)) {
-		freq += channel * 300;
-	}
-	else {
-		freq += channel * _channel_spacing[band];
-	}
-	uint32_t channel_compare_tmp = (freq * 808);
-	return (uint16_t) (channel_compare_tmp / ((uint32_t) 9 * FXTAL));
+	memset (addr, 0, sizeof (*addr));
+	addr->sun_family = AF_UNIX;
+	if (path.empty () || path.size () >= sizeof (addr->sun_path))
+		return false;
+	strncpy (addr->sun_path, path.c_str (), sizeof (addr->sun_path) - 1);
+	return true;
 }
 
 /**
- * Finds out the number of the channels.
- * @params band 		The band.
- * @params bitrate 	The bitrate.
- * @return Returns the number of channels for the band and the bitrate.
+ * Receives frames from network simulator until the socket is shut down.
  */
-uint8_t channel_amount (uint8_t band, uint8_t bitrate)
+static void rx_deamon_f ()
 {
-	if ((band == BAND_863 || band == BAND_863_C950)
-			&& (bitrate == DATA_RATE_100 || bitrate == DATA_RATE_200)) {
-		return 25;
-	}
-	else {
-		return 32;
+	uint8_t buffer[SIM_FRAME_HEADER_SIZE + MAX_PHY_PAYLOAD_SIZE + 1];
+	struct PHY_rx_info_t info;
+
+	rt_thread_setup (PHY_THREAD_RX);
+	while (true) {
+		ssize_t size = recv (SIMULATOR_STORAGE.fd, buffer, sizeof (buffer), 0);
+		if (size < 0 && errno == EINTR)
+			continue;
+		// socket was shut down by simulator_stop()
+		if (size <= 0)
+			return;
+		info.timestamp = PHY_monotonic_ns ();
+		bool accepted;
+		{
+			std::lock_guard < std::mutex > lock (SIMULATOR_STORAGE.mutex);
+			accepted = sim_frame_valid (buffer, size)
+				&& buffer[3] <= MAX_PHY_PAYLOAD_SIZE
+				&& buffer[1] == SIMULATOR_STORAGE.channel;
+			if (accepted)
+				SIMULATOR_STORAGE.stats.received++;
+			else
+				SIMULATOR_STORAGE.stats.ignored++;
+			info.channel = SIMULATOR_STORAGE.channel;
+			info.bitrate = SIMULATOR_STORAGE.bitrate;
+		}
+		info.rssi = 0;
+		info.radio = 0;
+		if (accepted)
+			SIMULATOR_STORAGE.callbacks.received (buffer + SIM_FRAME_HEADER_SIZE, buffer[3], &info);
 	}
 }
 
-/**
- * Defines rvalue.
- * @return Returns the rvalue.
- */
-uint8_t r_value ()
+void PHY_simulator_set_bus (const char *bus_path, const char *node_path)
 {
-	return 100;
+	std::lock_guard < std::mutex > lock (SIMULATOR_STORAGE.mutex);
+	SIMULATOR_STORAGE.bus_path = bus_path ? bus_path : SIM_DEFAULT_BUS_PATH;
+	SIMULATOR_STORAGE.node_path = node_path ? node_path : "";
 }
 
-/**
- * Computes pvalue based on the band, the channel and the bitrate.
- * @param band 		The band.
- * @param channel The channel number.
- * @param bitrate The bitrate.
- * @return Returns the pvalue.
- */
-uint8_t p_value (uint8_t band, uint8_t channel, uint8_t bitrate)
+void PHY_simulator_get_stats (struct PHY_simulator_stats_t *stats)
 {
+	std::lock_guard < std::mutex > lock (SIMULATOR_STORAGE.mutex);
+	*stats = SIMULATOR_STORAGE.stats;
 }
 
 /**
- * Accesses the control register of MRF89XA.
- * @param address The address of the register.
- * @param value   The register setting.
+ * Initializes simulator backend, binds socket of the device.
+ * The network simulator does not have to run yet.
+ * @param params 			Parameters of physical layer.
+ * @param callbacks 	Functions of upper layer.
+ * @return Returns false if socket cannot be created, true otherwise.
  */
-void set_register (const uint8_t address, const uint8_t value)
+static bool simulator_init (struct PHY_init_t *params,
+														const struct PHY_callbacks_t *callbacks)
 {
-}
-
-/**
- * Reads back the register value.
- * @param 	address The address of the register.
- * @return  Return the register value.
- */
-uint8_t get_register (uint8_t address)
-{
-}
-
-/**
- * Reads the FIFO.
- * @return Returns the read char.
- */
-uint8_t read_fifo (void)
-{
-}
-
-/**
- * Fills the FIFO.
- * @param Data The data to be sent to FIFO.
- */
-void write_fifo (const uint8_t data)
-{
-}
-
-/**
- * Sets the MRF89XA transceiver operating mode to sleep, transmit, receive or standby.
- * @param mode The mode.
- */
-void set_rf_mode (uint8_t mode)
-{
-}
-
-/**
- * set the operating channel, band, bitrate and R, P, S registers for the RF transceiver.
- * @param channel		The channel number (0-31, not all channels
- *                	are available under all conditions).
- * @param band 			The band.
- * @param bitrate		The bitrate.
- * @return Returns true, if the channel setting is successful, false otherwise.
- */
-bool set_channel_freq_rate (uint8_t channel, uint8_t band, uint8_t bitrate)
-{
-}
-
-/**
- * Sets the bitrate for the RF transceiver.
- * @param bitrate The bitrate.
- * @return Returns true, if the bitrate setting is successful, false otherwise.
- */
-bool set_bitrate (uint8_t bitrate)
-{
-	uint8_t datarate;
-	uint8_t bandwidth;
-	uint8_t freq_dev;
-	uint8_t filcon_set;
-	if (bitrate > DATA_RATE_200) {
+	struct sockaddr_un node_addr;
+
+	std::lock_guard < std::mutex > lock (SIMULATOR_STORAGE.mutex);
+	SIMULATOR_STORAGE.callbacks = *callbacks;
+	SIMULATOR_STORAGE.channel = params->channel;
+	SIMULATOR_STORAGE.band = params->band;
+	SIMULATOR_STORAGE.bitrate = params->bitrate;
+	SIMULATOR_STORAGE.power = params->power;
+	SIMULATOR_STORAGE.stats = PHY_simulator_stats_t ();
+
+	// simulator replies to the address frames come from
+	if (SIMULATOR_STORAGE.node_path.empty ())
+		SIMULATOR_STORAGE.node_path =
+			SIMULATOR_STORAGE.bus_path + "." + to_string (getpid ());
+	if (!set_address (&SIMULATOR_STORAGE.bus_addr, SIMULATOR_STORAGE.bus_path)
+			|| !set_address (&node_addr, SIMULATOR_STORAGE.node_path)) {
+		cerr << "simulator_init(): invalid socket path!" << endl;
 		return false;
 	}
-
-	switch (bitrate) {
-	case DATA_RATE_5:
-		datarate = BITRATE_5;
-		bandwidth = BW_50;
-		freq_dev = FREQ_DEV_33;
-		filcon_set = FILCON_SET_157;
-		break;
-	case DATA_RATE_10:
-		datarate = BITRATE_10;
-		bandwidth = BW_50;
-		freq_dev = FREQ_DEV_33;
-		filcon_set = FILCON_SET_157;
-		break;
-	case DATA_RATE_20:
-		datarate = BITRATE_20;
-		bandwidth = BW_75;
-		freq_dev = FREQ_DEV_40;
-		filcon_set = FILCON_SET_234;
-		break;
-	case DATA_RATE_40:
-		datarate = BITRATE_40;
-		bandwidth = BW_150;
-		freq_dev = FREQ_DEV_80;
-		filcon_set = FILCON_SET_414;
-		break;
-	case DATA_RATE_50:
-		datarate = BITRATE_50;
-		bandwidth = BW_175;
-		freq_dev = FREQ_DEV_100;
-		filcon_set = FILCON_SET_514;
-		break;
-	case DATA_RATE_66:
-		datarate = BITRATE_66;
-		bandwidth = BW_250;
-		freq_dev = FREQ_DEV_133;
-		filcon_set = FILCON_SET_676;
-		break;
-	case DATA_RATE_100:
-		datarate = BITRATE_100;
-		bandwidth = BW_400;
-		freq_dev = FREQ_DEV_200;
-		filcon_set = FILCON_SET_987;
-		break;
-	case DATA_RATE_200:
-		datarate = BITRATE_200;
-		bandwidth = BW_400;
-		freq_dev = FREQ_DEV_200;
-		filcon_set = FILCON_SET_987;
-		break;
+	SIMULATOR_STORAGE.fd = socket (AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+	if (SIMULATOR_STORAGE.fd < 0) {
+		cerr << "simulator_init(): can't create socket!" << endl;
+		return false;
 	}
-	set_register (BRREG, datarate);
-	set_register (FILCONREG, filcon_set | bandwidth);
-	set_register (FDEVREG, freq_dev);
+	// socket left behind by previous run
+	unlink (SIMULATOR_STORAGE.node_path.c_str ());
+	if (bind (SIMULATOR_STORAGE.fd, (struct sockaddr *) &node_addr, sizeof (node_addr)) < 0) {
+		cerr << "simulator_init(): can't bind " << SIMULATOR_STORAGE.node_path << "!" << endl;
+		close (SIMULATOR_STORAGE.fd);
+		SIMULATOR_STORAGE.fd = -1;
+		return false;
+	}
+	struct timeval timeout = { 0, SIMULATOR_SEND_TIMEOUT * 1000 };
+	setsockopt (SIMULATOR_STORAGE.fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof (timeout));
+	SIMULATOR_STORAGE.rx_deamon = std::thread (rx_deamon_f);
+	D_PHY printf ("simulator_init(): %s -> %s\n", SIMULATOR_STORAGE.node_path.c_str (),
+								SIMULATOR_STORAGE.bus_path.c_str ());
 	return true;
 }
 
 /**
- * Sets the output power for the RF transceiver.
- * @param power RF transceiver output power.
- * @return Returns true, if the output power setting is successful, false otherwise.
+ * Stops receiving and removes socket of the device.
  */
-bool set_power (uint8_t power)
+static void simulator_stop ()
 {
-
+	if (SIMULATOR_STORAGE.fd < 0)
+		return;
+	// wakes up blocked recv()
+	shutdown (SIMULATOR_STORAGE.fd, SHUT_RDWR);
+	SIMULATOR_STORAGE.rx_deamon.join ();
+	close (SIMULATOR_STORAGE.fd);
+	SIMULATOR_STORAGE.fd = -1;
+	unlink (SIMULATOR_STORAGE.node_path.c_str ());
 }
 
 /**
- * Synthetise the RF.
+ * Sends frame to network simulator as one datagram.
+ * @param radio Radio index, simulated device has only radio 0.
+ * @param data 	Frame.
+ * @param len 	Frame length.
+ * @param bitrate Bitrate of frame, simulator decides if receivers hear it.
+ * @return Returns frame identifier, 0 if frame is refused.
  */
-void send_reload_radio ()
+static uint32_t simulator_send (uint8_t radio, const uint8_t * data, uint8_t len, bool,
+															  uint8_t bitrate)
 {
-	set_rf_mode (RF_STANDBY);
-	set_rf_mode (RF_SYNTHESIZER);
-	set_register (FTPRIREG, (FTPRIREG_SET & 0xFD) | 0x02);
-	set_rf_mode (RF_STANDBY);
-	set_rf_mode (RF_RECEIVER);
-}
-
-/**
- * Reads the RSSI value.
- * @return Returns the RSSI value.
- */
-uint8_t get_cca_noise ()
-{
-	return get_register (RSTSREG) >> 1;
-}
-
-/*
- * The HW layer initialization.
- */
-void HW_init (void)
-{
-}
-
-/**
- * The interrupt request 0 (IRQ0) occured.
- */
-void HW_irq0_occurred (void)
-{
-}
-
-/**
- * The interrupt request 1 (IRQ1) occured.
- */
-void HW_irq1_occurred (void)
-{
-	printf("Preruseni\n");
-	if (PHY_STORAGE.mode == RF_RECEIVER) {
-		printf ("HW_irq1occurred() RF_RECEIVER\n");
-		uint8_t received_len = 0;
-		//std::lock_guard<std::mutex> lock(mm);
-		{
-			std::lock_guard < std::mutex > lock (mm);
-
-			PHY_STORAGE.irq1_enabled = false;
-			PHY_STORAGE.irq0_enabled = false;
-
-			uint8_t fifo_stat = get_register (FTXRXIREG);
-
-			while (fifo_stat & 0x02) {
-				//HW_enableData();
-				uint8_t readed_byte = read_fifo ();
-				//HW_disableData();
-				PHY_STORAGE.received_packet[received_len++] = readed_byte;
-				fifo_stat = get_register (FTXRXIREG);
-			}
-			PHY_STORAGE.irq1_enabled = true;
-			PHY_STORAGE.irq0_enabled = true;
-		}
-		printf ("HW_irq1occurred() received_len: %d\n", received_len);
-		if (received_len == 0)
-			return;
-		//add zero termination needed for string operations
-		if (received_len < 63) {
-			PHY_STORAGE.received_packet[received_len] = 0;
+	uint8_t buffer[SIM_FRAME_HEADER_SIZE + MAX_PHY_PAYLOAD_SIZE];
+	uint32_t id;
+
+	if (radio != 0 || len == 0 || len > MAX_PHY_PAYLOAD_SIZE || SIMULATOR_STORAGE.fd < 0)
+		return 0;
+	{
+		std::lock_guard < std::mutex > lock (SIMULATOR_STORAGE.mutex);
+		if (bitrate == PHY_BITRATE_BASE)
+			bitrate = SIMULATOR_STORAGE.bitrate;
+		uint16_t size = sim_frame_encode (buffer, SIMULATOR_STORAGE.channel,
+																			bitrate, data, len);
+		// full queue of simulator blocks sender for at most SIMULATOR_SEND_TIMEOUT
+		if (sendto (SIMULATOR_STORAGE.fd, buffer, size, 0,
+								(struct sockaddr *) &SIMULATOR_STORAGE.bus_addr,
+								sizeof (SIMULATOR_STORAGE.bus_addr)) != size) {
+			D_PHY printf ("simulator_send(): %s\n", strerror (errno));
+			SIMULATOR_STORAGE.stats.send_failed++;
+			return 0;
 		}
-		PHY_process_packet (PHY_STORAGE.received_packet + 1, received_len - 1);
+		SIMULATOR_STORAGE.stats.sent++;
+		if (++SIMULATOR_STORAGE.next_id == 0)
+			SIMULATOR_STORAGE.next_id = 1;
+		id = SIMULATOR_STORAGE.next_id;
 	}
-	else {
-		printf ("HW_irq1occurred(): not in RECEIVER mode!\n");
-		//PHY_STORAGE.send_done = 1;
-	}
-}
-
-
-void irq_interrupt_deamon_f ()
-{
+	SIMULATOR_STORAGE.callbacks.send_done (id, PHY_TX_OK);
+	return id;
 }
 
-void timer_interrupt_generator_f ()
+void PHY_simulator_receive (const uint8_t * data, uint8_t len)
 {
-	while (!PHY_STORAGE.terminate_timer) {
-		std::this_thread::sleep_for (std::chrono::milliseconds (300));
-		PHY_timer_interrupt ();
+	uint8_t frame[MAX_PHY_PAYLOAD_SIZE];
+	struct PHY_rx_info_t info;
+
+	if (len > MAX_PHY_PAYLOAD_SIZE)
+		return;
+	for (uint8_t i = 0; i < len; i++)
+		frame[i] = data[i];
+	info.timestamp = PHY_monotonic_ns ();
+	info.rssi = 0;
+	{
+		std::lock_guard < std::mutex > lock (SIMULATOR_STORAGE.mutex);
+		info.channel = SIMULATOR_STORAGE.channel;
+		info.bitrate = SIMULATOR_STORAGE.bitrate;
 	}
+	info.radio = 0;
+	SIMULATOR_STORAGE.callbacks.received (frame, len, &info);
 }
 
 /**
- * Initializes the physical layer.
- * @param params The parameters for the initialization.
+ * Simulated channel is always clear.
+ * @return Returns RSSI value.
  */
-void PHY_init (struct PHY_init_t* phy_params)
+static uint8_t simulator_get_noise (uint8_t)
 {
-	HW_init ();
-	PHY_STORAGE.irq_interrupt_deamon = std::thread (irq_interrupt_deamon_f);
-	PHY_STORAGE.timer_interrupt_generator = std::thread (timer_interrupt_generator_f);
-
-	PHY_STORAGE.cca_noise_threshold_max = phy_params->cca_noise_threshold_max;
-	PHY_STORAGE.cca_noise_threshold_min = phy_params->cca_noise_threshold_min;
-
-	for (uint8_t i = 0; i <= 31; i++) {
-		if ((i << 1) == R1CNTREG) {
-			set_channel_freq_rate (phy_params->channel, phy_params->band, phy_params->bitrate);
-			// jump over R1CNTREG, P1CNTREG, S1CNTREG
-			i += 3;
-		}
-		if ((i << 1) == TXPARAMREG) {
-			set_power (phy_params->power);
-			// jump over TXPARAMREG
-			i += 1;
-		}
-		if ((i << 1) == FDEVREG) {
-			set_bitrate (phy_params->bitrate);
-			// jump over FDEVREG, BRREG
-			i += 2;
-		}
-		if ((i << 1) == FILCONREG) {
-			// already done in previous call of set_bitrate(params.bitrate);
-			i += 1;
-		}
-		set_register (i << 1, init_config_regs[i]);
-	}
-
-	for (uint8_t i = 0; i <= 31; i++) {
-		uint8_t reg_val = get_register (i << 1);
-	}
-
-	send_reload_radio ();
-	PHY_STORAGE.irq0_enabled = true;
-	PHY_STORAGE.irq1_enabled = true;
-	// TODO: PHY initialization is set directly!
-	PHY_STORAGE.channel = 5;
-	PHY_STORAGE.band = 0;
-	PHY_STORAGE.bitrate = 5;
+	return 0;
 }
 
-void PHY_stop ()
+static uint8_t simulator_get_measured_noise ()
 {
-
-	PHY_STORAGE.terminate_timer = true;
-	// waiting for threads to end
-	PHY_STORAGE.irq_interrupt_deamon.join ();
-	PHY_STORAGE.timer_interrupt_generator.join ();
+	return 0;
 }
 
-/**
- * Sends the data.
- * @param data 	The data.
- * @param len 	The data length.
- */
-void PHY_send (const uint8_t * data, uint8_t len)
+static bool simulator_set_band (uint8_t band)
 {
-	string msg, msg_tmp;
-	msg.clear ();
-	msg = create_head ();
-
-	for (uint8_t i = 0; i < len; i++) {
-		msg += to_string (data[i]) + ',';
-	}
-	msg_tmp = "/usr/bin/mosquitto_pub -t BeeeOn/data_from -m " + msg;
-	//cout << msg_tmp << endl;
-	std::system (msg_tmp.c_str ());
-	//mq->publish(NULL, "BeeeOn/data_from", msg.length(), msg.c_str());
+	std::lock_guard < std::mutex > lock (SIMULATOR_STORAGE.mutex);
+	SIMULATOR_STORAGE.band = band;
+	return true;
 }
 
-/**
- * Sends the data if the noise on medium is acceptable.
- * @param data 	The data.
- * @param len 	The data length.
- */
-void PHY_send_with_cca (uint8_t * data, uint8_t len)
+static bool simulator_set_channel (uint8_t radio, uint8_t channel)
 {
-	uint8_t noise;
-	std::lock_guard < std::mutex > lock (mm);
-	do {
-		noise = PHY_get_noise ();
-	} while(noise > PHY_STORAGE.cca_noise_threshold_max || noise < PHY_STORAGE.cca_noise_threshold_min);
-	PHY_send (data, len);
+	if (radio != 0)
+		return false;
+	std::lock_guard < std::mutex > lock (SIMULATOR_STORAGE.mutex);
+	SIMULATOR_STORAGE.channel = channel;
+	return true;
 }
 
-/**
- * Sets the band.
- * @param band The band.
- * @return Returns true if the band setting is successful, false otherwise.
- */
-bool PHY_set_freq (uint8_t band)
+static uint8_t simulator_get_channel (uint8_t)
 {
-	if (band == PHY_STORAGE.band)
-		return true;
-	bool holder = set_channel_freq_rate (PHY_STORAGE.channel, band, PHY_STORAGE.bitrate);
-	send_reload_radio ();
-	return holder;
+	std::lock_guard < std::mutex > lock (SIMULATOR_STORAGE.mutex);
+	return SIMULATOR_STORAGE.channel;
 }
 
-/**
- * Sets the channel number.
- * @param channel The channel number.
- * @return Returns true if the channel number setting is successful, false otherwise.
- */
-bool PHY_set_channel (uint8_t channel)
+static bool simulator_set_bitrate (uint8_t bitrate)
 {
-	if (channel == PHY_STORAGE.channel)
-		return true;
-	bool holder = set_channel_freq_rate (channel, PHY_STORAGE.band, PHY_STORAGE.bitrate);
-	send_reload_radio ();
-	return holder;
+	if (bitrate > DATA_RATE_200)
+		return false;
+	std::lock_guard < std::mutex > lock (SIMULATOR_STORAGE.mutex);
+	SIMULATOR_STORAGE.bitrate = bitrate;
+	return true;
 }
 
-/**
- * Sets the bitrate.
- * @param bitrate The bitrate.
- * @return Returns true if the bitrate setting is successful, false otherwise.
- */
-bool PHY_set_bitrate (uint8_t bitrate)
+static bool simulator_set_power (uint8_t power)
 {
-	if (bitrate == PHY_STORAGE.bitrate)
-		return true;
-	if (set_bitrate (bitrate) == false)
+	if (power > TX_POWER_N_8_DB)
 		return false;
-	bool holder = set_channel_freq_rate (PHY_STORAGE.channel, PHY_STORAGE.band, bitrate);
-	send_reload_radio ();
-	return holder;
+	std::lock_guard < std::mutex > lock (SIMULATOR_STORAGE.mutex);
+	SIMULATOR_STORAGE.power = power;
+	return true;
 }
 
-/**
- * Sets the output power.
- * @param power The power.
- * @return Returns true if the power setting is successful, false otherwise.
- */
-bool PHY_set_power (uint8_t power)
+static uint8_t simulator_get_radio_count ()
 {
-	if (power == PHY_STORAGE.power)
-		return true;
-	return set_power (power);
+	return 1;
 }
 
-/**
- * Reads the RSSI value.
- * @return Returns the RSSI value.
- */
-uint8_t PHY_get_noise ()
+static uint8_t simulator_get_rx_radio ()
 {
-	return get_cca_noise ();
+	return 0;
 }
 
-uint8_t PHY_get_measured_noise()
-{
-	return PHY_STORAGE.signal_strength;
-}
+const struct PHY_backend_t PHY_SIMULATOR_BACKEND = {
+	"simulator",
+	simulator_init,
+	simulator_stop,
+	simulator_send,
+	simulator_get_noise,
+	simulator_get_measured_noise,
+	simulator_set_band,
+	simulator_set_channel,
+	simulator_get_channel,
+	simulator_set_bitrate,
+	simulator_set_power,
+	simulator_get_radio_count,
+	simulator_get_rx_radio
+};
@@ -0,0 +1,38 @@
+#ifndef MRF_X86_PHY_H
+#define MRF_X86_PHY_H
+
+#include <stdint.h>
+
+/**
+ * Counters of simulator backend.
+ */
+struct PHY_simulator_stats_t {
+	uint32_t sent;					/**< Number of frames passed to simulator. */
+	uint32_t send_failed;		/**< Number of frames refused by socket. */
+	uint32_t received;			/**< Number of frames passed to the stack. */
+	uint32_t ignored;				/**< Number of malformed or foreign channel datagrams. */
+};
+
+/**
+ * Sets sockets used to talk to network simulator, has to be called
+ * before PHY_init(). Frames are sent as datagrams to the simulator
+ * socket, the simulator sends frames for the device to its own socket.
+ * @param bus_path 		Socket of simulator, NULL for SIM_DEFAULT_BUS_PATH.
+ * @param node_path 	Socket of the device, NULL for bus_path.<pid>.
+ */
+void PHY_simulator_set_bus (const char *bus_path, const char *node_path);
+
+/**
+ * Gets counters of simulator backend.
+ * @param stats 	Structure for counters.
+ */
+void PHY_simulator_get_stats (struct PHY_simulator_stats_t *stats);
+
+/**
+ * Passes frame received from network simulator to the stack.
+ * @param data 	Frame.
+ * @param len 	Frame length.
+ */
+void PHY_simulator_receive (const uint8_t * data, uint8_t len);
+
+#endif
@@ -0,0 +1,188 @@
+#include "loopback_stack.h"
+#include <atomic>
+#include <mutex>
+#include <unistd.h>
+
+/*
+ * Tests of TX buffer sized at init on loopback bus: far more four-way
+ * handshakes than neighbours run at once without refusal, handshakes of
+ * every coordinator and end device run one after another in order of
+ * sending and TX buffer refuses packets only when all its records are used.
+ */
+
+static const uint8_t COORDS = 3;
+static const uint8_t EDS = 3;
+static const uint8_t NEIGHBOURS = COORDS + EDS;
+static const uint16_t BUFFER_SIZE = 64;
+static const uint8_t PACKETS = 10;
+// transfer type of BUSY ACK
+static const uint8_t BUSY = 0x08;
+
+/**
+ * Handshakes seen by neighbour, DATA carry their number for neighbour.
+ */
+struct neighbour_t {
+	uint8_t expected;								/**< Number of the next new DATA. */
+	uint8_t last;										/**< Number of DATA waiting for COMMIT. */
+	bool open;											/**< Flag if DATA waits for COMMIT. */
+	std::vector < uint8_t > committed;	/**< Numbers of committed DATA. */
+};
+
+static int endpoint;
+static std::mutex mutex;
+static neighbour_t neighbours[NEIGHBOURS];
+static uint8_t sent[NEIGHBOURS];
+static std::atomic < bool > silent (false);
+static std::atomic < int > completed (0);
+static std::atomic < int > busy (0);
+
+/**
+ * Gets neighbour which packet of PAN is for, coordinators 1 - COORDS
+ * come first, end devices 00000001 - EDS follow.
+ * @param data 	Packet sent by PAN.
+ * @return Returns index of neighbour.
+ */
+static uint8_t neighbour_of (const uint8_t *data)
+{
+	if (data[0] & 0x20)
+		return COORDS + data[8] - 1;
+	return LINK_cid_mask (data[5]) - 1;
+}
+
+/**
+ * Coordinators and end devices answering four-way handshake of PAN,
+ * nothing is answered while silent.
+ */
+static void coordinator (void *, uint8_t *data, uint8_t len)
+{
+	uint8_t packet_type = data[0] >> 6;
+	uint8_t transfer_type = data[0] & 0x0f;
+	uint8_t reply[LINK_HEADER_SIZE];
+
+	if (len < LINK_HEADER_SIZE)
+		return;
+	if (transfer_type == BUSY)
+		busy++;
+	if (transfer_type != LINK_DATA_HS4 || silent)
+		return;
+	uint8_t n = neighbour_of (data);
+	CHECK (n < NEIGHBOURS);
+	if (packet_type == 0 && len > LINK_HEADER_SIZE) {
+		std::lock_guard < std::mutex > lock (mutex);
+		uint8_t number = data[LINK_HEADER_SIZE];
+		// handshake of neighbour starts after the previous one, DATA can be repeated only
+		if (neighbours[n].open) {
+			CHECK (number == neighbours[n].last);
+		}
+		else {
+			CHECK (number == neighbours[n].expected);
+			neighbours[n].expected++;
+			neighbours[n].last = number;
+			neighbours[n].open = true;
+		}
+		reply_header (reply, data, 2, LINK_DATA_HS4);
+	}
+	else if (packet_type == 1) {
+		std::lock_guard < std::mutex > lock (mutex);
+		if (neighbours[n].open) {
+			neighbours[n].committed.push_back (neighbours[n].last);
+			neighbours[n].open = false;
+			completed++;
+		}
+		reply_header (reply, data, 3, LINK_DATA_HS4);
+	}
+	else {
+		return;
+	}
+	PHY_loopback_send (endpoint, reply, sizeof (reply));
+}
+
+/**
+ * Sends the next numbered DATA to neighbour by four-way handshake.
+ * @param n 	Index of neighbour.
+ * @return Returns false if TX buffer is full, true otherwise.
+ */
+static bool send_to (uint8_t n)
+{
+	uint8_t payload[10] = { sent[n] };
+	uint8_t cid = n + 1;
+	uint8_t edid[EDID_LENGTH] = { 0, 0, 0, (uint8_t) (n - COORDS + 1) };
+	bool ed = n >= COORDS;
+
+	if (!LINK_send_coord (ed, ed ? edid : &cid, payload, sizeof (payload), LINK_DATA_HS4))
+		return false;
+	sent[n]++;
+	return true;
+}
+
+/**
+ * Waits until neighbours commit DATA.
+ * @param count 	Number of committed DATA of all neighbours.
+ */
+static void wait_completed (int count)
+{
+	for (int i = 0; i < 10000 && completed < count; i++)
+		usleep (1000);
+	CHECK (completed == count);
+	// PAN frees records when COMMIT ACK comes
+	usleep (100000);
+}
+
+/**
+ * Checks that neighbours committed all sent DATA in order of sending.
+ */
+static void check_order ()
+{
+	std::lock_guard < std::mutex > lock (mutex);
+
+	for (uint8_t n = 0; n < NEIGHBOURS; n++) {
+		CHECK (neighbours[n].committed.size () == sent[n]);
+		for (uint8_t i = 0; i < sent[n]; i++)
+			CHECK (neighbours[n].committed[i] == i);
+	}
+}
+
+static void test_concurrent ()
+{
+	for (uint8_t i = 0; i < PACKETS; i++) {
+		for (uint8_t n = 0; n < NEIGHBOURS; n++)
+			CHECK (send_to (n));
+	}
+	wait_completed (PACKETS * NEIGHBOURS);
+	check_order ();
+	CHECK (busy == 0);
+}
+
+static void test_full ()
+{
+	// handshakes do not finish, every sent packet keeps its record
+	silent = true;
+	for (uint16_t i = 0; i < BUFFER_SIZE; i++)
+		CHECK (send_to (i % NEIGHBOURS));
+	CHECK (!send_to (0));
+	CHECK (!send_to (NEIGHBOURS - 1));
+	// DATA are repeated, then handshakes finish one after another
+	silent = false;
+	wait_completed (PACKETS * NEIGHBOURS + BUFFER_SIZE);
+	check_order ();
+	// records are free again
+	CHECK (send_to (0));
+	wait_completed (PACKETS * NEIGHBOURS + BUFFER_SIZE + 1);
+	check_order ();
+	CHECK (busy == 0);
+}
+
+int main ()
+{
+	struct LINK_init_t link_params = LINK_init_t ();
+
+	link_params.tx_max_retries = 5;
+	link_params.tx_buffer_size = BUFFER_SIZE;
+	endpoint = stack_start (coordinator, &link_params, COORDS);
+
+	test_concurrent ();
+	test_full ();
+
+	stack_stop (endpoint);
+	return 0;
+}
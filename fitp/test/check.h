@@ -0,0 +1,21 @@
+#ifndef FITP_TEST_CHECK_H
+#define FITP_TEST_CHECK_H
+
+#include <iostream>
+#include <cstdlib>
+
+/*
+ * Checks of unit tests, the first failed check ends test with nonzero
+ * exit status. Checks stay active in release builds (no assert), threads
+ * of running stack are not joined on failure.
+ */
+#define CHECK(condition) \
+	do { \
+		if (!(condition)) { \
+			std::cerr << __FILE__ << ":" << __LINE__ << ": check failed: " \
+				<< #condition << std::endl; \
+			std::_Exit (1); \
+		} \
+	} while (0)
+
+#endif
@@ -0,0 +1,145 @@
+#include "fitp.h"
+#include "pan/global_storage/global.h"
+#include "pan/link_layer/link.h"
+#include "pan/phy_layer/emulator.h"
+#include "check.h"
+#include <atomic>
+#include <unistd.h>
+
+/*
+ * Tests of MRF89XA backend on emulated radio: reception of injected frame,
+ * transmission completed by TXDONE and warm start.
+ */
+
+static std::atomic < int > transmitted (0);
+static uint8_t tx_frame[MAX_PHY_PAYLOAD_SIZE];
+static uint8_t tx_len;
+
+void fitp_received (const uint8_t, const uint8_t *, const uint8_t *, const uint8_t)
+{
+}
+
+void fitp_notify_send_done ()
+{
+}
+
+static void on_tx (void *, uint8_t, const uint8_t *data, uint8_t len)
+{
+	for (uint8_t i = 0; i < len; i++)
+		tx_frame[i] = data[i];
+	tx_len = len;
+	transmitted++;
+}
+
+/**
+ * Waits for message delivered to application.
+ * @param data 	Message.
+ * @param info 	Metadata of frame.
+ */
+static void receive (std::vector < uint8_t > &data, struct PHY_rx_info_t &info)
+{
+	for (int i = 0; i < 3 && data.empty (); i++)
+		fitp_received_data (data, info);
+}
+
+static void start (bool warm)
+{
+	std::vector < struct PHY_radio_config_t > radios = {
+		{ "emu:0", "emu:0", "emu:0", PHY_EMULATOR_LINE_IRQ0, PHY_EMULATOR_LINE_IRQ1,
+			PHY_EMULATOR_LINE_RESET, 0 }
+	};
+	struct PHY_init_t phy_params = { 3, BAND_863, DATA_RATE_20, TX_POWER_13_DB, 60, 0 };
+	struct LINK_init_t link_params = LINK_init_t ();
+
+	link_params.tx_max_retries = 3;
+
+	CHECK (fitp_set_radios (radios));
+	fitp_set_warm_start (warm);
+	fitp_init (&phy_params, &link_params);
+}
+
+static void test_receive ()
+{
+	// broadcast with two bytes of data from end device 01020304
+	uint8_t frame[22] = { LINK_DATA_BROADCAST };
+	for (uint8_t i = 0; i < 4; i++)
+		frame[1 + i] = GLOBAL_STORAGE.nid[i];
+	frame[6] = 1;
+	frame[7] = 2;
+	frame[8] = 3;
+	frame[9] = 4;
+	frame[11] = 1;
+	frame[16] = 1;
+	frame[17] = 2;
+	frame[18] = 3;
+	frame[19] = 4;
+	frame[20] = 0xaa;
+	frame[21] = 0xbb;
+
+	PHY_emulator_reset_stats (0);
+	CHECK (PHY_emulator_inject (0, frame, sizeof (frame)));
+	std::vector < uint8_t > data;
+	struct PHY_rx_info_t info;
+	receive (data, info);
+	CHECK (data.size () == 8);
+	CHECK (data[2] == 1 && data[5] == 4);
+	CHECK (data[6] == 0xaa && data[7] == 0xbb);
+	CHECK (info.channel == 3);
+
+	struct PHY_emulator_stats_t stats;
+	PHY_emulator_get_stats (0, &stats);
+	CHECK (stats.irq1_edges == 1);
+	CHECK (stats.fifo_reads == sizeof (frame) + 1);
+}
+
+static void test_transmit ()
+{
+	uint8_t data[4] = { 1, 2, 3, 4 };
+	struct PHY_tx_stats_t before;
+	struct PHY_tx_stats_t after;
+
+	CHECK (PHY_get_tx_stats (0, &before));
+	PHY_emulator_reset_stats (0);
+	transmitted = 0;
+	CHECK (PHY_send_on_radio (0, data, sizeof (data), false) != 0);
+	for (int i = 0; i < 3000 && transmitted == 0; i++)
+		usleep (1000);
+	CHECK (transmitted == 1);
+	CHECK (tx_len == sizeof (data));
+	for (uint8_t i = 0; i < sizeof (data); i++)
+		CHECK (tx_frame[i] == data[i]);
+
+	// TX thread counts frame after TXDONE
+	for (int i = 0; i < 1000; i++) {
+		CHECK (PHY_get_tx_stats (0, &after));
+		if (after.sent != before.sent)
+			break;
+		usleep (1000);
+	}
+	CHECK (after.sent == before.sent + 1);
+	CHECK (after.failed == before.failed);
+}
+
+int main ()
+{
+	struct PHY_init_stats_t init_stats;
+
+	PHY_emulator_set_tx_handler (on_tx, 0);
+	start (false);
+	CHECK (PHY_get_init_stats (0, &init_stats));
+	CHECK (!init_stats.warm);
+	uint32_t cold_writes = init_stats.registers_written;
+	test_receive ();
+	test_transmit ();
+	fitp_deinit ();
+
+	// registers of emulated radio are kept, reset is skipped
+	start (true);
+	CHECK (PHY_get_init_stats (0, &init_stats));
+	CHECK (init_stats.warm);
+	CHECK (init_stats.registers_written < cold_writes);
+	test_receive ();
+	test_transmit ();
+	fitp_deinit ();
+	return 0;
+}
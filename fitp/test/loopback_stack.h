@@ -0,0 +1,83 @@
+#ifndef FITP_TEST_LOOPBACK_STACK_H
+#define FITP_TEST_LOOPBACK_STACK_H
+
+#include "fitp.h"
+#include "pan/global_storage/global.h"
+#include "pan/link_layer/link.h"
+#include "pan/phy_layer/loopback.h"
+#include "check.h"
+
+/*
+ * PAN on loopback bus for tests of link layer. The test attaches one
+ * endpoint acting as coordinators which are children of PAN, application
+ * callbacks of the stack are not used.
+ */
+
+void fitp_received (const uint8_t, const uint8_t *, const uint8_t *, const uint8_t)
+{
+}
+
+void fitp_notify_send_done ()
+{
+}
+
+/**
+ * Starts PAN with loopback backend, coordinators 1 to children are its
+ * children and routing is enabled.
+ * @param coordinator 	Handler of frames sent by PAN.
+ * @param link_params 	Parameters of link layer.
+ * @param children 			Number of coordinators which are children of PAN.
+ * @param bitrate 			Bitrate of PHY_init.
+ * @return Returns endpoint of coordinators.
+ */
+inline int stack_start (PHY_loopback_rx_t coordinator, struct LINK_init_t *link_params,
+											 uint8_t children = 1, uint8_t bitrate = DATA_RATE_20)
+{
+	struct PHY_init_t phy_params = { 3, BAND_863, bitrate, TX_POWER_13_DB, 60, 0 };
+
+	CHECK (fitp_set_phy_backend ("loopback"));
+	int endpoint = PHY_loopback_attach (3, coordinator, 0);
+	CHECK (endpoint >= 0);
+	fitp_init (&phy_params, link_params);
+	for (uint8_t cid = 1; cid <= children; cid++)
+		GLOBAL_STORAGE.routing_tree[cid] = 0;
+	GLOBAL_STORAGE.routing_enabled = true;
+	return endpoint;
+}
+
+/**
+ * Stops PAN and detaches endpoint of coordinators.
+ * @param endpoint 	Endpoint of coordinators.
+ */
+inline void stack_stop (int endpoint)
+{
+	fitp_deinit ();
+	PHY_loopback_detach (endpoint);
+}
+
+/**
+ * Builds header of answer to packet sent by PAN, addressed from coordinator
+ * or end device which packet is for.
+ * @param reply 					Array for header (LINK_HEADER_SIZE).
+ * @param data 						Packet sent by PAN.
+ * @param packet_type 		Packet type of answer.
+ * @param transfer_type 	Transfer type of answer.
+ */
+inline void reply_header (uint8_t *reply, const uint8_t *data, uint8_t packet_type,
+													uint8_t transfer_type)
+{
+	bool from_ed = data[0] & 0x20;
+
+	reply[0] = packet_type << 6 | (from_ed ? 0x10 : 0) | transfer_type;
+	for (uint8_t i = 1; i < 5; i++)
+		reply[i] = data[i];
+	// PAN is coordinator 0
+	reply[5] = 0;
+	// end device is source by EDID which packet was sent to
+	for (uint8_t i = 6; i < LINK_HEADER_SIZE; i++)
+		reply[i] = from_ed ? data[i - 1] : 0;
+	if (!from_ed)
+		reply[6] = LINK_cid_mask (data[5]);
+}
+
+#endif
@@ -0,0 +1,119 @@
+#include "loopback_stack.h"
+#include <atomic>
+#include <unistd.h>
+
+/*
+ * Tests of bitrate adaptation towards coordinator 1 on loopback bus.
+ * The coordinator is switched by RATE SWITCH and returns to bitrate of
+ * PHY_init after COMMIT ACK, frames faster than DATA_RATE_40 are lost.
+ */
+
+static const uint8_t BASE_BITRATE = DATA_RATE_20;
+static const uint8_t MAX_BITRATE = DATA_RATE_40;
+
+static int endpoint;
+static std::atomic < uint8_t > listening (BASE_BITRATE);
+static std::atomic < int > switches (0);
+static std::atomic < int > delivered (0);
+
+/**
+ * Coordinator 1 answering four-way handshake of PAN.
+ */
+static void coordinator (void *, uint8_t *data, uint8_t len)
+{
+	uint8_t packet_type = data[0] >> 6;
+	uint8_t transfer_type = data[0] & 0x0f;
+
+	if (len < LINK_HEADER_SIZE || LINK_cid_mask (data[5]) != 1)
+		return;
+	if (transfer_type == LINK_RATE_SWITCH && len > LINK_HEADER_SIZE) {
+		listening = data[LINK_HEADER_SIZE];
+		switches++;
+		return;
+	}
+	if (transfer_type != LINK_DATA_HS4 || listening > MAX_BITRATE)
+		return;
+
+	// ACK of DATA, COMMIT ACK of COMMIT
+	uint8_t reply[LINK_HEADER_SIZE];
+	if (packet_type == 0) {
+		reply_header (reply, data, 2, LINK_DATA_HS4);
+	}
+	else if (packet_type == 1) {
+		reply_header (reply, data, 3, LINK_DATA_HS4);
+		listening = BASE_BITRATE;
+		delivered++;
+	}
+	else {
+		return;
+	}
+	PHY_loopback_send (endpoint, reply, sizeof (reply));
+}
+
+/**
+ * Sends DATA to coordinator 1 one after another.
+ * @param duration_ms 	Duration of sending.
+ */
+static void exchange (uint32_t duration_ms)
+{
+	uint8_t cid = 1;
+	uint8_t data[20] = { 0 };
+	uint64_t end = PHY_monotonic_ns () + duration_ms * 1000000ULL;
+
+	while (PHY_monotonic_ns () < end) {
+		int before = delivered;
+		CHECK (LINK_send_coord (false, &cid, data, sizeof (data), LINK_DATA_HS4));
+		while (delivered == before && PHY_monotonic_ns () < end)
+			usleep (1000);
+	}
+	// the last handshake is finished
+	usleep (300000);
+}
+
+static void test_disabled ()
+{
+	struct LINK_rate_stats_t stats;
+
+	fitp_set_rate_control (false);
+	exchange (300);
+	CHECK (delivered > 0);
+	CHECK (switches == 0);
+	fitp_get_rate_stats (1, &stats);
+	for (uint8_t i = 0; i < LINK_RATE_COUNT; i++)
+		CHECK (stats.attempts[i] == 0);
+}
+
+static void test_adaptation ()
+{
+	struct LINK_rate_stats_t stats;
+	uint32_t failed_faster = 0;
+
+	fitp_set_rate_control (true);
+	// statistics are evaluated every second
+	exchange (3500);
+	CHECK (switches > 0);
+	fitp_get_rate_stats (1, &stats);
+	CHECK (stats.best_throughput == MAX_BITRATE);
+	CHECK (stats.probability[MAX_BITRATE] == 1000);
+	CHECK (stats.successes[MAX_BITRATE] > 0);
+	for (uint8_t i = MAX_BITRATE + 1; i < LINK_RATE_COUNT; i++) {
+		CHECK (stats.successes[i] == 0);
+		failed_faster += stats.attempts[i];
+	}
+	// faster bitrates are sampled
+	CHECK (failed_faster > 0);
+}
+
+int main ()
+{
+	struct LINK_init_t link_params = LINK_init_t ();
+
+	link_params.tx_max_retries = 5;
+	endpoint = stack_start (coordinator, &link_params, 1, BASE_BITRATE);
+
+	test_disabled ();
+	test_adaptation ();
+
+	stack_stop (endpoint);
+	return 0;
+}
@@ -0,0 +1,134 @@
+#include "pan/phy_layer/ring.h"
+#include "check.h"
+#include <thread>
+
+/*
+ * Tests of RX ring: order of frames, full ring, counters and transfer
+ * of frames between producer and consumer threads.
+ */
+
+static struct RING_t ring;
+
+/**
+ * Stores frame with one byte payload.
+ * @param value 	Payload.
+ * @return Returns false if ring is full.
+ */
+static bool push (uint8_t value)
+{
+	struct RING_slot_t *slot = ring_reserve (&ring);
+	if (!slot)
+		return false;
+	slot->len = 1;
+	slot->data[0] = value;
+	ring_commit (&ring);
+	return true;
+}
+
+/**
+ * Takes the oldest frame.
+ * @param value 	Payload of frame.
+ * @return Returns false if ring is empty.
+ */
+static bool pop (uint8_t *value)
+{
+	struct RING_slot_t *slot = ring_peek (&ring);
+	if (!slot)
+		return false;
+	*value = slot->data[0];
+	ring_release (&ring);
+	return true;
+}
+
+static void test_order ()
+{
+	uint8_t value;
+
+	ring_init (&ring);
+	CHECK (!pop (&value));
+	CHECK (ring_occupancy (&ring) == 0);
+	for (uint8_t i = 0; i < 3; i++)
+		CHECK (push (i));
+	CHECK (ring_occupancy (&ring) == 3);
+	for (uint8_t i = 0; i < 3; i++) {
+		CHECK (pop (&value));
+		CHECK (value == i);
+	}
+	CHECK (!pop (&value));
+	CHECK (ring.stats.pushed == 3);
+	CHECK (ring.stats.high_watermark == 3);
+}
+
+static void test_full ()
+{
+	uint8_t value;
+
+	ring_init (&ring);
+	for (uint8_t i = 0; i < RING_SLOTS; i++)
+		CHECK (push (i));
+	CHECK (ring_occupancy (&ring) == RING_SLOTS);
+	// full ring refuses slot, the stored frames are kept
+	CHECK (ring_reserve (&ring) == 0);
+	CHECK (pop (&value));
+	CHECK (value == 0);
+	CHECK (push (RING_SLOTS));
+	for (uint8_t i = 1; i <= RING_SLOTS; i++) {
+		CHECK (pop (&value));
+		CHECK (value == i);
+	}
+	CHECK (ring.stats.high_watermark == RING_SLOTS);
+}
+
+static void test_wrap ()
+{
+	uint8_t value;
+
+	// indexes run over slots many times
+	ring_init (&ring);
+	for (uint32_t i = 0; i < RING_SLOTS * 100; i++) {
+		CHECK (push (i & 0xff));
+		CHECK (pop (&value));
+		CHECK (value == (i & 0xff));
+	}
+	CHECK (ring.stats.pushed == RING_SLOTS * 100);
+	CHECK (ring.stats.high_watermark == 1);
+}
+
+static void test_threads ()
+{
+	const uint32_t frames = 20000;
+	bool ordered = true;
+
+	ring_init (&ring);
+	std::thread consumer ([&ordered, frames] {
+		uint8_t value;
+		for (uint32_t i = 0; i < frames; ) {
+			if (!pop (&value)) {
+				std::this_thread::yield ();
+				continue;
+			}
+			if (value != (i & 0xff))
+				ordered = false;
+			i++;
+		}
+	});
+	for (uint32_t i = 0; i < frames; ) {
+		if (push (i & 0xff))
+			i++;
+		else
+			std::this_thread::yield ();
+	}
+	consumer.join ();
+	CHECK (ordered);
+	CHECK (ring_occupancy (&ring) == 0);
+	CHECK (ring.stats.pushed == frames);
+}
+
+int main ()
+{
+	test_order ();
+	test_full ();
+	test_wrap ();
+	test_threads ();
+	return 0;
+}
@@ -0,0 +1,162 @@
+#include "loopback_stack.h"
+#include <atomic>
+#include <unistd.h>
+
+/*
+ * Tests of round-trip time estimation (Jacobson/Karels) and retransmission
+ * timeout of link layer, and of Karn's rule on loopback bus.
+ */
+
+// internal functions of link layer
+uint64_t neighbour_key (bool ed, const uint8_t* address);
+void rtt_sample (uint64_t key, uint64_t sent_at);
+void rtt_backoff (uint64_t key);
+uint32_t rtt_timeout (uint64_t key);
+
+static int endpoint;
+static std::atomic < int > data_frames (0);
+static std::atomic < int > acked (0);
+
+/**
+ * Takes round-trip time sample of coordinator.
+ * @param cid 	Coordinator ID.
+ * @param us 		Round-trip time (us).
+ */
+static void sample (uint8_t cid, uint32_t us)
+{
+	rtt_sample (neighbour_key (false, &cid), PHY_monotonic_ns () - us * 1000ULL);
+}
+
+static struct LINK_rtt_stats_t stats_of (uint8_t cid)
+{
+	struct LINK_rtt_stats_t stats;
+
+	CHECK (LINK_get_rtt_stats (false, &cid, &stats));
+	return stats;
+}
+
+static void test_estimation ()
+{
+	uint8_t cid = 2;
+	struct LINK_rtt_stats_t stats;
+
+	// the first sample sets SRTT, RTTVAR is its half, RTO = SRTT + 4 * RTTVAR
+	sample (cid, 20000);
+	stats = stats_of (cid);
+	CHECK (stats.samples == 1);
+	CHECK (stats.srtt_us >= 20000 && stats.srtt_us < 21000);
+	CHECK (stats.rttvar_us >= 10000 && stats.rttvar_us < 10500);
+	CHECK (stats.rto_ms >= 60 && stats.rto_ms <= 63);
+
+	// equal sample decreases RTTVAR by quarter
+	sample (cid, 20000);
+	stats = stats_of (cid);
+	CHECK (stats.srtt_us >= 20000 && stats.srtt_us < 21000);
+	CHECK (stats.rttvar_us >= 7500 && stats.rttvar_us < 8500);
+	CHECK (stats.rto_ms >= 50 && stats.rto_ms <= 51);
+
+	// SRTT moves by eighth of error
+	sample (cid, 100000);
+	stats = stats_of (cid);
+	CHECK (stats.srtt_us >= 30000 && stats.srtt_us < 31000);
+	CHECK (stats.min_us >= 20000 && stats.min_us < 21000);
+	CHECK (stats.max_us >= 100000 && stats.max_us < 101000);
+	CHECK (stats.samples == 3);
+
+	// RTO is bounded from above
+	cid = 3;
+	sample (cid, 2000000);
+	CHECK (stats_of (cid).rto_ms == 1000);
+
+	// RTO is bounded from below
+	cid = 6;
+	for (int i = 0; i < 20; i++)
+		sample (cid, 1000);
+	CHECK (stats_of (cid).rto_ms == 50);
+}
+
+static void test_backoff ()
+{
+	uint8_t cid = 4;
+	uint64_t key = neighbour_key (false, &cid);
+
+	sample (cid, 20000);
+	uint32_t rto = stats_of (cid).rto_ms;
+	// timeouts double RTO up to 64 times
+	for (uint8_t i = 1; i <= 7; i++) {
+		rtt_backoff (key);
+		uint8_t backoff = i < 6 ? i : 6;
+		CHECK (stats_of (cid).backoff == backoff);
+		CHECK (rtt_timeout (key) == (rto << backoff));
+	}
+	CHECK (stats_of (cid).timeouts == 7);
+	// backoff ends with the next sample
+	sample (cid, 20000);
+	CHECK (stats_of (cid).backoff == 0);
+	CHECK (rtt_timeout (key) < rto * 2);
+
+	// backoff extends RTO past its upper bound up to its own one
+	cid = 5;
+	key = neighbour_key (false, &cid);
+	sample (cid, 2000000);
+	rtt_backoff (key);
+	rtt_backoff (key);
+	CHECK (rtt_timeout (key) == 4000);
+	for (int i = 0; i < 4; i++)
+		rtt_backoff (key);
+	CHECK (rtt_timeout (key) == 60000);
+}
+
+/**
+ * Coordinator 1, every odd DATA frame is lost, so every DATA is
+ * acknowledged only after its retransmission.
+ */
+static void coordinator (void *, uint8_t *data, uint8_t len)
+{
+	if (len <= LINK_HEADER_SIZE || LINK_cid_mask (data[5]) != 1
+			|| data[0] != LINK_DATA_HS2)
+		return;
+	if (++data_frames % 2 == 1)
+		return;
+	uint8_t ack[LINK_HEADER_SIZE + 1];
+	reply_header (ack, data, 2, LINK_DATA_HS2);
+	ack[LINK_HEADER_SIZE] = data[LINK_HEADER_SIZE];
+	PHY_loopback_send (endpoint, ack, sizeof (ack));
+	acked++;
+}
+
+static void test_karn ()
+{
+	uint8_t cid = 1;
+	uint8_t payload[10] = { 0 };
+	struct LINK_rtt_stats_t stats;
+
+	fitp_set_two_way_transfer (true);
+	for (int i = 0; i < 3; i++) {
+		CHECK (LINK_send_coord (false, &cid, payload, sizeof (payload), LINK_DATA_HS2));
+		for (int j = 0; j < 3000 && acked == i; j++)
+			usleep (1000);
+		CHECK (acked == i + 1);
+	}
+	// ACK of retransmitted DATA can belong to the first transmission
+	stats = stats_of (cid);
+	CHECK (stats.samples == 0);
+	CHECK (stats.timeouts == 3);
+	// initial RTO is doubled by every timeout without sample
+	CHECK (stats.backoff == 3);
+}
+
+int main ()
+{
+	struct LINK_init_t link_params = LINK_init_t ();
+
+	link_params.tx_max_retries = 3;
+	endpoint = stack_start (coordinator, &link_params);
+
+	test_estimation ();
+	test_backoff ();
+	test_karn ();
+
+	stack_stop (endpoint);
+	return 0;
+}
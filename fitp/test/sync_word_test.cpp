@@ -0,0 +1,65 @@
+#include "common/phy_layer/sync_word.h"
+#include "check.h"
+
+/*
+ * Tests of sync word derived from network ID.
+ */
+
+static bool equal (const uint8_t *sync, uint8_t b0, uint8_t b1, uint8_t b2, uint8_t b3)
+{
+	return sync[0] == b0 && sync[1] == b1 && sync[2] == b2 && sync[3] == b3;
+}
+
+static void test_default ()
+{
+	uint8_t nid[4] = { 0, 0, 0, 0 };
+	uint8_t sync[SYNC_WORD_LENGTH];
+
+	sync_word_from_nid (nid, sync);
+	CHECK (equal (sync, SYNCV31REG_SET, SYNCV23REG_SET, SYNCV15REG_SET, SYNCV07REG_SET));
+}
+
+static void test_derived ()
+{
+	// nid[3] is the most significant byte, it changes SYNCV31REG
+	uint8_t nid[4] = { 0x01, 0x02, 0x03, 0x04 };
+	uint8_t sync[SYNC_WORD_LENGTH];
+
+	sync_word_from_nid (nid, sync);
+	CHECK (equal (sync, SYNCV31REG_SET ^ 0x04, SYNCV23REG_SET ^ 0x03,
+								SYNCV15REG_SET ^ 0x02, SYNCV07REG_SET ^ 0x01));
+}
+
+static void test_transitions ()
+{
+	// bytes without bit transitions are replaced by default ones
+	uint8_t nid[4] = { 0x00, SYNCV15REG_SET ^ 0xff, 0x00, SYNCV31REG_SET };
+	uint8_t sync[SYNC_WORD_LENGTH];
+
+	sync_word_from_nid (nid, sync);
+	CHECK (equal (sync, SYNCV31REG_SET, SYNCV23REG_SET, SYNCV15REG_SET, SYNCV07REG_SET));
+}
+
+static void test_networks ()
+{
+	uint8_t nid_a[4] = { 0xa1, 0x00, 0x00, 0x03 };
+	uint8_t nid_b[4] = { 0xa2, 0x00, 0x00, 0x03 };
+	uint8_t sync_a[SYNC_WORD_LENGTH];
+	uint8_t sync_b[SYNC_WORD_LENGTH];
+	uint8_t again[SYNC_WORD_LENGTH];
+
+	sync_word_from_nid (nid_a, sync_a);
+	sync_word_from_nid (nid_b, sync_b);
+	sync_word_from_nid (nid_a, again);
+	CHECK (equal (again, sync_a[0], sync_a[1], sync_a[2], sync_a[3]));
+	CHECK (!equal (sync_b, sync_a[0], sync_a[1], sync_a[2], sync_a[3]));
+}
+
+int main ()
+{
+	test_default ();
+	test_derived ();
+	test_transitions ();
+	test_networks ();
+	return 0;
+}
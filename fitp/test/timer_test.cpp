@@ -0,0 +1,129 @@
+#include "loopback_stack.h"
+#include <mutex>
+#include <unistd.h>
+
+/*
+ * Tests of retransmission deadlines on loopback bus: coordinators 1 and 2
+ * never acknowledge DATA, PAN resends it after timeout doubled by every
+ * retransmission and gives up after tx_max_retries retransmissions, then
+ * idle PAN is not woken up by timers.
+ */
+
+static const uint8_t MAX_RETRIES = 4;
+static const uint32_t INITIAL_RTO_MS = 100;
+static const uint32_t MAX_BACKOFF = 3;
+
+static int endpoint;
+static std::mutex mutex;
+static std::vector < uint64_t > sent[3];	// times of DATA sent to coordinator (ns)
+
+/**
+ * Coordinators 1 and 2 which do not answer.
+ */
+static void coordinator (void *, uint8_t *data, uint8_t len)
+{
+	uint8_t cid = LINK_cid_mask (data[5]);
+
+	if (len < LINK_HEADER_SIZE || (data[0] >> 6) != 0
+			|| (data[0] & 0x0f) != LINK_DATA_HS4 || cid < 1 || cid > 2)
+		return;
+	std::lock_guard < std::mutex > lock (mutex);
+	sent[cid].push_back (PHY_monotonic_ns ());
+}
+
+/**
+ * Waits until DATA is sent to coordinator.
+ * @param cid 		Coordinator ID.
+ * @param count 	Number of transmissions of DATA.
+ */
+static void wait_sent (uint8_t cid, size_t count)
+{
+	for (int i = 0; i < 5000; i++) {
+		{
+			std::lock_guard < std::mutex > lock (mutex);
+			if (sent[cid].size () >= count)
+				return;
+		}
+		usleep (1000);
+	}
+}
+
+/**
+ * Checks retransmissions of DATA to coordinator.
+ * @param cid 	Coordinator ID.
+ */
+static void check_schedule (uint8_t cid)
+{
+	std::lock_guard < std::mutex > lock (mutex);
+	std::vector < uint64_t > &times = sent[cid];
+
+	// the first transmission and all retransmissions
+	CHECK (times.size () == MAX_RETRIES + 1u);
+	for (uint8_t i = 1; i < times.size (); i++) {
+		uint32_t backoff = i - 1u < MAX_BACKOFF ? i - 1u : MAX_BACKOFF;
+		uint32_t timeout = INITIAL_RTO_MS << backoff;
+		uint32_t interval = (times[i] - times[i - 1]) / 1000000;
+		// deadlines have millisecond resolution, wakeups can be late
+		CHECK (interval + 1 >= timeout);
+		CHECK (interval < timeout + timeout / 2);
+	}
+}
+
+static void test_retransmissions ()
+{
+	uint8_t payload[10] = { 0 };
+	uint8_t cid;
+	struct LINK_rtt_stats_t stats;
+
+	cid = 1;
+	CHECK (LINK_send_coord (false, &cid, payload, sizeof (payload), LINK_DATA_HS4));
+	// deadlines of coordinators interleave
+	usleep (150000);
+	cid = 2;
+	CHECK (LINK_send_coord (false, &cid, payload, sizeof (payload), LINK_DATA_HS4));
+	// 100 + 200 + 400 + 800 ms
+	wait_sent (1, MAX_RETRIES + 1);
+	wait_sent (2, MAX_RETRIES + 1);
+	// the last timeout gives up, nothing is sent then, it is not longer
+	// than the next doubling whatever limit of backoff is
+	usleep ((INITIAL_RTO_MS << MAX_RETRIES) * 3 / 2 * 1000);
+
+	check_schedule (1);
+	check_schedule (2);
+	{
+		std::lock_guard < std::mutex > lock (mutex);
+		// coordinator 2 starts later
+		CHECK (sent[2][0] > sent[1][0] + 100000000ULL);
+	}
+	for (cid = 1; cid <= 2; cid++) {
+		CHECK (LINK_get_rtt_stats (false, &cid, &stats));
+		CHECK (stats.samples == 0);
+		CHECK (stats.timeouts == MAX_RETRIES);
+	}
+}
+
+static void test_idle ()
+{
+	struct PHY_latency_stats_t before;
+	struct PHY_latency_stats_t after;
+
+	// no handshake runs and bitrate adaptation is disabled
+	CHECK (PHY_get_latency_stats (PHY_THREAD_TIMER, &before));
+	usleep (500000);
+	CHECK (PHY_get_latency_stats (PHY_THREAD_TIMER, &after));
+	CHECK (after.samples == before.samples);
+}
+
+int main ()
+{
+	struct LINK_init_t link_params = LINK_init_t ();
+
+	link_params.tx_max_retries = MAX_RETRIES;
+	endpoint = stack_start (coordinator, &link_params, 2);
+
+	test_retransmissions ();
+	test_idle ();
+
+	stack_stop (endpoint);
+	return 0;
+}
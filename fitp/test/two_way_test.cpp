@@ -0,0 +1,166 @@
+#include "loopback_stack.h"
+#include <atomic>
+#include <mutex>
+#include <unistd.h>
+
+/*
+ * Tests of two-way DATA/ACK transfer with coordinator 1 on loopback bus:
+ * repeated DATA is acknowledged but delivered once, also when newer DATA
+ * were accepted meanwhile, lost ACK makes PAN resend DATA with the same
+ * sequence number.
+ */
+
+static int endpoint;
+static std::mutex mutex;
+static std::vector < uint8_t > acks;				// sequence numbers acknowledged by PAN
+static std::vector < uint8_t > data_seqs;		// sequence numbers of DATA sent by PAN
+static std::atomic < int > finished (0);
+
+/**
+ * Coordinator 1, the first DATA of every sequence number is lost.
+ */
+static void coordinator (void *, uint8_t *data, uint8_t len)
+{
+	uint8_t packet_type = data[0] >> 6;
+	uint8_t transfer_type = data[0] & 0x0f;
+
+	if (len <= LINK_HEADER_SIZE || LINK_cid_mask (data[5]) != 1
+			|| transfer_type != LINK_DATA_HS2)
+		return;
+	uint8_t seq = data[LINK_HEADER_SIZE];
+	std::lock_guard < std::mutex > lock (mutex);
+	if (packet_type == 2) {
+		acks.push_back (seq);
+		return;
+	}
+	if (packet_type != 0)
+		return;
+	data_seqs.push_back (seq);
+	if (data_seqs.size () % 2 == 1)
+		return;
+	uint8_t ack[LINK_HEADER_SIZE + 1];
+	reply_header (ack, data, 2, LINK_DATA_HS2);
+	ack[LINK_HEADER_SIZE] = seq;
+	PHY_loopback_send (endpoint, ack, sizeof (ack));
+	finished++;
+}
+
+/**
+ * Sends DATA of two-way transfer from coordinator 1 to PAN.
+ * @param seq 	Sequence number.
+ */
+static void send_to_pan (uint8_t seq)
+{
+	// end device 01020304 sends data 0xaa seq to PAN through coordinator 1
+	uint8_t frame[23] = { LINK_DATA_HS2 };
+	for (uint8_t i = 0; i < 4; i++)
+		frame[1 + i] = GLOBAL_STORAGE.nid[i];
+	frame[6] = 1;
+	frame[LINK_HEADER_SIZE] = seq;
+	frame[12] = 1;
+	frame[17] = 1;
+	frame[18] = 2;
+	frame[19] = 3;
+	frame[20] = 4;
+	frame[21] = 0xaa;
+	frame[22] = seq;
+	CHECK (PHY_loopback_send (endpoint, frame, sizeof (frame)) != 0);
+	usleep (100000);
+}
+
+static void test_duplicates ()
+{
+	std::vector < uint8_t > data;
+	struct PHY_rx_info_t info;
+
+	send_to_pan (5);
+	// ACK of DATA 5 was lost, coordinator repeats it
+	send_to_pan (5);
+	send_to_pan (6);
+	{
+		std::lock_guard < std::mutex > lock (mutex);
+		CHECK (acks.size () == 3);
+		CHECK (acks[0] == 5 && acks[1] == 5 && acks[2] == 6);
+	}
+	fitp_received_data (data, info);
+	if (data.empty ())
+		fitp_received_data (data, info);
+	CHECK (data.size () == 8);
+	CHECK (data[6] == 0xaa && data[7] == 5);
+	// repeated DATA is not delivered
+	data.clear ();
+	fitp_received_data (data, info);
+	CHECK (data.size () == 8);
+	CHECK (data[7] == 6);
+}
+
+/**
+ * Receives the next data delivered by PAN.
+ * @return Returns sequence number carried in data.
+ */
+static uint8_t received_seq ()
+{
+	std::vector < uint8_t > data;
+	struct PHY_rx_info_t info;
+
+	fitp_received_data (data, info);
+	if (data.empty ())
+		fitp_received_data (data, info);
+	CHECK (data.size () == 8);
+	return data[7];
+}
+
+static void test_pipelined ()
+{
+	send_to_pan (7);
+	send_to_pan (8);
+	// ACK of DATA 7 was lost after DATA 8 had been sent
+	send_to_pan (7);
+	send_to_pan (9);
+	{
+		std::lock_guard < std::mutex > lock (mutex);
+		CHECK (acks.size () == 7);
+		CHECK (acks[3] == 7 && acks[4] == 8 && acks[5] == 7 && acks[6] == 9);
+	}
+	// DATA 7 is not delivered twice
+	CHECK (received_seq () == 7);
+	CHECK (received_seq () == 8);
+	CHECK (received_seq () == 9);
+}
+
+static void test_retransmission ()
+{
+	uint8_t cid = 1;
+	uint8_t payload[10] = { 0 };
+
+	for (int i = 0; i < 3; i++)
+		CHECK (LINK_send_coord (false, &cid, payload, sizeof (payload), LINK_DATA_HS2));
+	for (int i = 0; i < 5000 && finished < 3; i++)
+		usleep (1000);
+	CHECK (finished == 3);
+
+	std::lock_guard < std::mutex > lock (mutex);
+	CHECK (data_seqs.size () == 6);
+	for (uint8_t i = 0; i < 6; i += 2) {
+		// retransmission keeps sequence number, the next DATA takes new one
+		CHECK (data_seqs[i] == data_seqs[i + 1]);
+		if (i > 0)
+			CHECK (data_seqs[i] == (uint8_t) (data_seqs[i - 1] + 1));
+	}
+}
+
+int main ()
+{
+	struct LINK_init_t link_params = LINK_init_t ();
+
+	link_params.tx_max_retries = 3;
+	endpoint = stack_start (coordinator, &link_params);
+	fitp_set_two_way_transfer (true);
+
+	test_duplicates ();
+	test_pipelined ();
+	test_retransmission ();
+
+	stack_stop (endpoint);
+	return 0;
+}
@@ -0,0 +1,336 @@
+#include "loopback_stack.h"
+#include <map>
+#include <mutex>
+#include <unistd.h>
+
+/*
+ * Tests of four-way handshake in windows with coordinators 1 - 3 on
+ * loopback bus. Coordinators keep DATA of window until COMMIT and answer
+ * by the next expected sequence number, losses and BUSY ACK are injected
+ * per coordinator.
+ */
+
+static const uint8_t COORDS = 3;
+static const uint8_t MAX_RETRIES = 3;
+static const uint32_t WINDOW_DELAY_MS = 50;
+// transfer type of BUSY ACK
+static const uint8_t BUSY = 0x08;
+
+/**
+ * Packet of window sent by PAN.
+ */
+struct frame_t {
+	uint8_t type;				/**< Packet type. */
+	uint8_t seq;				/**< Sequence number of DATA, the oldest one of COMMIT. */
+	uint64_t at;				/**< Time of delivery (ns). */
+};
+
+/**
+ * Coordinator receiving windows.
+ */
+struct coordinator_t {
+	bool active;												/**< Flag if expected is known. */
+	uint8_t expected;										/**< Sequence number expected next. */
+	std::map < uint8_t, uint8_t > stored;	/**< Numbers of stored DATA by sequence number. */
+	std::vector < frame_t > frames;			/**< Packets of window sent by PAN. */
+	std::vector < uint8_t > delivered;		/**< Numbers of delivered DATA. */
+	std::vector < uint8_t > acks;				/**< Sequence numbers of sent COMMIT ACK. */
+	int lose_data;											/**< DATA lost as n-th one, 0 if none. */
+	bool lose_ack;											/**< Flag if the next COMMIT ACK is lost. */
+	bool busy;													/**< Flag if the next DATA gets BUSY ACK. */
+	bool silent;												/**< Flag if coordinator does not answer. */
+};
+
+static int endpoint;
+static std::mutex mutex;
+static coordinator_t coords[COORDS + 1];
+static uint8_t numbers[COORDS + 1];
+
+/**
+ * Learns sequence numbers of window from the first packet.
+ * @param coord 	Coordinator.
+ * @param base 		The oldest unacknowledged sequence number.
+ */
+static void sync (coordinator_t *coord, uint8_t base)
+{
+	if (coord->active)
+		return;
+	coord->active = true;
+	coord->expected = base;
+}
+
+/**
+ * Coordinators 1 - COORDS answering windows of PAN.
+ */
+static void coordinator (void *, uint8_t *data, uint8_t len)
+{
+	uint8_t packet_type = data[0] >> 6;
+	uint8_t cid = LINK_cid_mask (data[5]);
+	uint8_t reply[LINK_HEADER_SIZE + 1];
+
+	if (len <= LINK_HEADER_SIZE || (data[0] & 0x0f) != LINK_DATA_WINDOW
+			|| cid < 1 || cid > COORDS)
+		return;
+	std::lock_guard < std::mutex > lock (mutex);
+	coordinator_t *coord = &coords[cid];
+	uint8_t seq = data[LINK_HEADER_SIZE];
+	coord->frames.push_back ({ packet_type, seq, PHY_monotonic_ns () });
+	if (coord->silent)
+		return;
+	if (packet_type == 0 && len > LINK_HEADER_SIZE + LINK_WINDOW_HEADER_SIZE) {
+		if (coord->busy) {
+			coord->busy = false;
+			reply_header (reply, data, 2, BUSY);
+			PHY_loopback_send (endpoint, reply, LINK_HEADER_SIZE);
+			return;
+		}
+		if (coord->lose_data > 0 && --coord->lose_data == 0)
+			return;
+		sync (coord, data[LINK_HEADER_SIZE + 1]);
+		// DATA already delivered are repeated by go-back-N
+		if ((uint8_t) (seq - coord->expected) < LINK_WINDOW_SIZE)
+			coord->stored[seq] = data[LINK_HEADER_SIZE + LINK_WINDOW_HEADER_SIZE];
+		return;
+	}
+	if (packet_type != 1)
+		return;
+	sync (coord, seq);
+	while (coord->stored.count (coord->expected)) {
+		coord->delivered.push_back (coord->stored[coord->expected]);
+		coord->stored.erase (coord->expected++);
+	}
+	if (coord->lose_ack) {
+		coord->lose_ack = false;
+		return;
+	}
+	coord->acks.push_back (coord->expected);
+	reply_header (reply, data, 3, LINK_DATA_WINDOW);
+	reply[LINK_HEADER_SIZE] = coord->expected;
+	PHY_loopback_send (endpoint, reply, sizeof (reply));
+}
+
+/**
+ * Sends the next numbered DATA to coordinator in window.
+ * @param cid 	Coordinator ID.
+ */
+static void send_window (uint8_t cid)
+{
+	uint8_t payload[10] = { numbers[cid]++ };
+
+	CHECK (LINK_send_coord (false, &cid, payload, sizeof (payload), LINK_DATA_WINDOW));
+}
+
+/**
+ * Waits until coordinator delivers DATA, then until PAN gets COMMIT ACK.
+ * @param cid 		Coordinator ID.
+ * @param count 	Number of DATA delivered by coordinator.
+ */
+static void wait_delivered (uint8_t cid, size_t count)
+{
+	for (int i = 0; i < 3000; i++) {
+		{
+			std::lock_guard < std::mutex > lock (mutex);
+			if (coords[cid].delivered.size () >= count)
+				break;
+		}
+		usleep (1000);
+	}
+	usleep (100000);
+	std::lock_guard < std::mutex > lock (mutex);
+	CHECK (coords[cid].delivered.size () == count);
+	// DATA are delivered once in order of sending
+	for (uint8_t i = 0; i < count; i++)
+		CHECK (coords[cid].delivered[i] == i);
+}
+
+/**
+ * Gets packets of window sent to coordinator since mark.
+ * @param cid 		Coordinator ID.
+ * @param type 		Packet type.
+ * @param from 		Number of packets sent before mark.
+ * @return Returns packets of type.
+ */
+static std::vector < frame_t > frames_of (uint8_t cid, uint8_t type, size_t from)
+{
+	std::lock_guard < std::mutex > lock (mutex);
+	std::vector < frame_t > result;
+
+	for (size_t i = from; i < coords[cid].frames.size (); i++) {
+		if (coords[cid].frames[i].type == type)
+			result.push_back (coords[cid].frames[i]);
+	}
+	return result;
+}
+
+/**
+ * Waits for packets of window sent to coordinator since mark.
+ * @param cid 		Coordinator ID.
+ * @param type 		Packet type.
+ * @param from 		Number of packets sent before mark.
+ * @param count 	Number of packets of type.
+ */
+static void wait_frames (uint8_t cid, uint8_t type, size_t from, size_t count)
+{
+	for (int i = 0; i < 3000 && frames_of (cid, type, from).size () < count; i++)
+		usleep (1000);
+	// COMMIT ACK of the last packet reaches PAN
+	usleep (100000);
+}
+
+/**
+ * Marks packets sent to coordinator so far.
+ * @param cid 	Coordinator ID.
+ * @return Returns number of packets sent to coordinator.
+ */
+static size_t mark (uint8_t cid)
+{
+	std::lock_guard < std::mutex > lock (mutex);
+	return coords[cid].frames.size ();
+}
+
+static void test_full_window ()
+{
+	size_t from = mark (1);
+
+	for (uint8_t i = 0; i < LINK_WINDOW_SIZE; i++)
+		send_window (1);
+	wait_delivered (1, LINK_WINDOW_SIZE);
+	std::vector < frame_t > data = frames_of (1, 0, from);
+	std::vector < frame_t > commits = frames_of (1, 1, from);
+	CHECK (data.size () == LINK_WINDOW_SIZE);
+	// one COMMIT covers full window at once
+	CHECK (commits.size () == 1);
+	CHECK (commits[0].seq == data[0].seq);
+	CHECK (commits[0].at > data[LINK_WINDOW_SIZE - 1].at);
+	CHECK ((commits[0].at - data[0].at) / 1000000 < WINDOW_DELAY_MS);
+}
+
+static void test_partial_window ()
+{
+	size_t from = mark (1);
+	uint64_t sent_at = PHY_monotonic_ns ();
+
+	send_window (1);
+	send_window (1);
+	wait_delivered (1, LINK_WINDOW_SIZE + 2);
+	std::vector < frame_t > data = frames_of (1, 0, from);
+	std::vector < frame_t > commits = frames_of (1, 1, from);
+	CHECK (data.size () == 2);
+	CHECK (commits.size () == 1);
+	// DATA sent meanwhile share COMMIT, deadlines have millisecond resolution
+	CHECK ((commits[0].at - sent_at) / 1000000 + 1 >= WINDOW_DELAY_MS);
+}
+
+static void test_lost_data ()
+{
+	size_t from = mark (1);
+	size_t acked;
+
+	{
+		std::lock_guard < std::mutex > lock (mutex);
+		coords[1].lose_data = 2;
+		acked = coords[1].acks.size ();
+	}
+	for (uint8_t i = 0; i < LINK_WINDOW_SIZE; i++)
+		send_window (1);
+	wait_delivered (1, 2 * LINK_WINDOW_SIZE + 2);
+	std::vector < frame_t > data = frames_of (1, 0, from);
+	uint8_t first = data[0].seq;
+	// DATA following the lost one are resent go-back-N
+	CHECK (data.size () == 2 * LINK_WINDOW_SIZE - 1);
+	for (uint8_t i = 0; i < LINK_WINDOW_SIZE; i++)
+		CHECK (data[i].seq == (uint8_t) (first + i));
+	for (uint8_t i = 1; i < LINK_WINDOW_SIZE; i++)
+		CHECK (data[LINK_WINDOW_SIZE + i - 1].seq == (uint8_t) (first + i));
+
+	std::lock_guard < std::mutex > lock (mutex);
+	std::vector < uint8_t > &acks = coords[1].acks;
+	// cumulative COMMIT ACK stops at the lost DATA
+	CHECK (acks.size () > acked + 1);
+	CHECK (acks[acked] == (uint8_t) (first + 1));
+	CHECK (acks.back () == (uint8_t) (first + LINK_WINDOW_SIZE));
+}
+
+static void test_lost_commit_ack ()
+{
+	size_t from = mark (1);
+
+	{
+		std::lock_guard < std::mutex > lock (mutex);
+		coords[1].lose_ack = true;
+	}
+	for (uint8_t i = 0; i < LINK_WINDOW_SIZE; i++)
+		send_window (1);
+	// window is resent after timeout, it is not delivered again
+	wait_frames (1, 1, from, 2);
+	wait_delivered (1, 3 * LINK_WINDOW_SIZE + 2);
+	std::vector < frame_t > data = frames_of (1, 0, from);
+	std::vector < frame_t > commits = frames_of (1, 1, from);
+	CHECK (data.size () == 2 * LINK_WINDOW_SIZE);
+	CHECK (commits.size () == 2);
+	CHECK (commits[1].seq == commits[0].seq);
+}
+
+static void test_busy ()
+{
+	{
+		std::lock_guard < std::mutex > lock (mutex);
+		coords[2].busy = true;
+	}
+	send_window (2);
+	wait_delivered (2, 1);
+	std::vector < frame_t > data = frames_of (2, 0, 0);
+	std::vector < frame_t > commits = frames_of (2, 1, 0);
+	CHECK (data.size () == 2);
+	CHECK (commits.size () == 2);
+	// BUSY ACK postpones COMMIT beyond delay of window
+	CHECK ((commits[0].at - data[0].at) / 1000000 >= 2 * WINDOW_DELAY_MS);
+}
+
+static void test_drop ()
+{
+	struct LINK_rtt_stats_t stats;
+	uint8_t cid = 3;
+
+	{
+		std::lock_guard < std::mutex > lock (mutex);
+		coords[3].silent = true;
+	}
+	send_window (3);
+	wait_frames (3, 1, 0, MAX_RETRIES + 1);
+	// the last timeout ends window, nothing is sent then
+	usleep (1100000);
+	CHECK (frames_of (3, 0, 0).size () == MAX_RETRIES + 1u);
+	CHECK (frames_of (3, 1, 0).size () == MAX_RETRIES + 1u);
+	CHECK (LINK_get_rtt_stats (false, &cid, &stats));
+	CHECK (stats.timeouts == MAX_RETRIES);
+
+	// window was dropped, the next DATA starts new one
+	{
+		std::lock_guard < std::mutex > lock (mutex);
+		coords[3].silent = false;
+	}
+	numbers[3] = 0;
+	size_t from = mark (3);
+	send_window (3);
+	wait_delivered (3, 1);
+	CHECK (frames_of (3, 0, from).size () == 1);
+}
+
+int main ()
+{
+	struct LINK_init_t link_params = LINK_init_t ();
+
+	link_params.tx_max_retries = MAX_RETRIES;
+	endpoint = stack_start (coordinator, &link_params, COORDS);
+
+	test_full_window ();
+	test_partial_window ();
+	test_lost_data ();
+	test_lost_commit_ack ();
+	test_busy ();
+	test_drop ();
+
+	stack_stop (endpoint);
+	return 0;
+}